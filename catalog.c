@@ -0,0 +1,329 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+
+/*
+ * The catalog is a cache written and read by the same program on the
+ * same machine, so numbers and strings are stored in native form. The
+ * header records the size of wchar_t and the config extension. Trees are
+ * stored depth first:
+ *   path, mtime, depth, number of files, files, number of subdirectories
+ * followed by the subdirectories.
+ */
+#define CATALOG_MAGIC       "OVGCAT\r\n"
+#define CATALOG_VERSION     1
+#define CATALOG_MAX_LEVELS  64        /* deeper trees are not loaded */
+#define CATALOG_MAX_STRING  32768     /* in characters */
+#define CATALOG_MAX_ENTRIES (1 << 20) /* files or subdirectories per directory */
+
+#ifdef _WIN32
+#define PATH_SEP L'\\'
+#else
+#define PATH_SEP L'/'
+#endif
+
+static FILE *
+open_file(const wchar_t *path, const wchar_t *mode)
+{
+#ifdef _WIN32
+    return _wfopen(path, mode);
+#else
+    char name[4096];
+    char m[8];
+
+    if (wcstombs(name, path, sizeof(name)) >= sizeof(name)
+        || wcstombs(m, mode, sizeof(m)) >= sizeof(m))
+    {
+        return NULL;
+    }
+    return fopen(name, m);
+#endif
+}
+
+/* Move the file from over the file to */
+static int
+replace_file(const wchar_t *from, const wchar_t *to)
+{
+#ifdef _WIN32
+    return MoveFileExW(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    char src[4096];
+    char dst[4096];
+
+    if (wcstombs(src, from, sizeof(src)) >= sizeof(src)
+        || wcstombs(dst, to, sizeof(dst)) >= sizeof(dst))
+    {
+        return 0;
+    }
+    return rename(src, dst) == 0;
+#endif
+}
+
+static void
+put_u32(FILE *f, uint32_t v)
+{
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void
+put_u64(FILE *f, uint64_t v)
+{
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void
+put_str(FILE *f, const wchar_t *s)
+{
+    size_t len = wcslen(s);
+
+    put_u32(f, (uint32_t)len);
+    fwrite(s, sizeof(*s), len, f);
+}
+
+static void
+save_dir(FILE *f, const dirscan_dir_t *d)
+{
+    put_str(f, d->path);
+    put_u64(f, d->mtime);
+    put_u32(f, (uint32_t)d->depth);
+
+    put_u32(f, (uint32_t)d->nfiles);
+    for (size_t i = 0; i < d->nfiles; i++)
+    {
+        const dirscan_file_t *file = &d->files[i];
+
+        put_str(f, file->name);
+        put_u64(f, file->size);
+        put_u64(f, file->mtime);
+        put_u32(f, file->readable);
+        put_u32(f, file->meta);
+        put_u64(f, file->meta_stamp);
+    }
+
+    put_u32(f, (uint32_t)d->nsubdirs);
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        save_dir(f, d->subdirs[i]);
+    }
+}
+
+int
+catalog_save(const wchar_t *path, const wchar_t *ext, dirscan_dir_t *const *dirs, size_t n)
+{
+    size_t len = wcslen(path);
+    wchar_t *tmp = malloc((len + 5) * sizeof(*tmp));
+    FILE *f = NULL;
+    int ok;
+
+    if (tmp)
+    {
+        wmemcpy(tmp, path, len);
+        wmemcpy(tmp + len, L".tmp", 5);
+        f = open_file(tmp, L"wb");
+    }
+    if (!f)
+    {
+        free(tmp);
+        return 0;
+    }
+
+    fwrite(CATALOG_MAGIC, 1, strlen(CATALOG_MAGIC), f);
+    put_u32(f, CATALOG_VERSION);
+    put_u32(f, sizeof(wchar_t));
+    put_str(f, ext);
+    put_u32(f, (uint32_t)n);
+    for (size_t i = 0; i < n; i++)
+    {
+        save_dir(f, dirs[i]);
+    }
+
+    ok = !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    /* write a new file and move it over the old one, so that a failed
+     * write leaves the old catalog in place */
+    ok = ok && replace_file(tmp, path);
+    free(tmp);
+    return ok;
+}
+
+static int
+get_u32(FILE *f, uint32_t *v)
+{
+    return fread(v, sizeof(*v), 1, f) == 1;
+}
+
+static int
+get_u64(FILE *f, uint64_t *v)
+{
+    return fread(v, sizeof(*v), 1, f) == 1;
+}
+
+static wchar_t *
+get_str(FILE *f)
+{
+    uint32_t len;
+    wchar_t *s;
+
+    if (!get_u32(f, &len) || len > CATALOG_MAX_STRING)
+    {
+        return NULL;
+    }
+    s = malloc((len + 1) * sizeof(*s));
+    if (s && fread(s, sizeof(*s), len, f) != len)
+    {
+        free(s);
+        return NULL;
+    }
+    if (s)
+    {
+        s[len] = L'\0';
+    }
+    return s;
+}
+
+static dirscan_dir_t *
+load_dir(FILE *f, int level)
+{
+    dirscan_dir_t *d;
+    wchar_t *path = get_str(f);
+    const wchar_t *sep;
+    uint32_t depth, count;
+
+    if (!path)
+    {
+        return NULL;
+    }
+    d = calloc(1, sizeof(*d));
+    if (!d)
+    {
+        free(path);
+        return NULL;
+    }
+    d->path = path;
+    sep = wcsrchr(path, PATH_SEP);
+    d->name = sep ? sep + 1 : path;
+
+    if (!get_u64(f, &d->mtime) || !get_u32(f, &depth) || !get_u32(f, &count)
+        || count > CATALOG_MAX_ENTRIES)
+    {
+        goto error;
+    }
+    d->depth = (int)depth;
+    d->files = calloc(count ? count : 1, sizeof(*d->files));
+    if (!d->files)
+    {
+        goto error;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        dirscan_file_t *file = &d->files[i];
+        uint32_t readable, meta;
+
+        file->name = get_str(f);
+        if (!file->name)
+        {
+            goto error;
+        }
+        d->nfiles++;
+        if (!get_u64(f, &file->size) || !get_u64(f, &file->mtime) || !get_u32(f, &readable)
+            || !get_u32(f, &meta) || !get_u64(f, &file->meta_stamp))
+        {
+            goto error;
+        }
+        file->readable = readable != 0;
+        file->meta = meta;
+    }
+
+    if (!get_u32(f, &count) || count > CATALOG_MAX_ENTRIES
+        || (count > 0 && level >= CATALOG_MAX_LEVELS))
+    {
+        goto error;
+    }
+    d->subdirs = calloc(count ? count : 1, sizeof(*d->subdirs));
+    if (!d->subdirs)
+    {
+        goto error;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        d->subdirs[i] = load_dir(f, level + 1);
+        if (!d->subdirs[i])
+        {
+            goto error;
+        }
+        d->nsubdirs++;
+    }
+    return d;
+
+error:
+    dirscan_free(d);
+    return NULL;
+}
+
+size_t
+catalog_load(const wchar_t *path, const wchar_t *ext, dirscan_dir_t **dirs, size_t max)
+{
+    FILE *f = open_file(path, L"rb");
+    char magic[sizeof(CATALOG_MAGIC) - 1];
+    uint32_t version, char_size, count;
+    wchar_t *saved_ext = NULL;
+    size_t n = 0;
+
+    if (!f)
+    {
+        return 0;
+    }
+    if (fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, CATALOG_MAGIC, sizeof(magic))
+        || !get_u32(f, &version) || version != CATALOG_VERSION || !get_u32(f, &char_size)
+        || char_size != sizeof(wchar_t) || !(saved_ext = get_str(f)) || wcscmp(saved_ext, ext)
+        || !get_u32(f, &count))
+    {
+        goto out;
+    }
+
+    for (n = 0; n < count && n < max; n++)
+    {
+        dirs[n] = load_dir(f, 0);
+        if (!dirs[n])
+        {
+            /* do not use a damaged catalog */
+            while (n > 0)
+            {
+                dirscan_free(dirs[--n]);
+            }
+            break;
+        }
+    }
+
+out:
+    free(saved_ext);
+    fclose(f);
+    return n;
+}
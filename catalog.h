@@ -0,0 +1,43 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "dirscan.h"
+
+/*
+ * A catalog keeps the results of scanning config directories in a
+ * file, so that the next run can pass them as cached to dirscan_run().
+ */
+
+/*
+ * Save the trees dirs[0..n-1] scanned for files with extension ext to the
+ * catalog at path, replacing it. Returns 0 on error.
+ */
+int catalog_save(const wchar_t *path, const wchar_t *ext, dirscan_dir_t *const *dirs, size_t n);
+
+/*
+ * Load up to max trees from the catalog at path into dirs. Returns the
+ * number of trees loaded, which is 0 if the catalog does not exist, is
+ * damaged, or was saved for another extension.
+ */
+size_t catalog_load(const wchar_t *path, const wchar_t *ext, dirscan_dir_t **dirs, size_t max);
+
+#endif /* ifndef CATALOG_H */
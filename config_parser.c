@@ -19,15 +19,118 @@
  *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <wchar.h>
+#ifdef _WIN32
 #include "main.h"
 #include "misc.h"
+#endif
 #include "config_parser.h"
 
+#define CONFIG_READ_SIZE (64 * 1024) /* bytes read at a time */
+
+/*
+ * Errors are reported to the event log. Elsewhere, i.e., when the parser
+ * is built for tests, they are not reported.
+ */
+#ifdef _WIN32
+#define config_error(...) MsgToEventLog(EVENTLOG_ERROR_TYPE, __VA_ARGS__)
+#else
+#define config_error(...) ((void)0)
+#endif
+
+/* A parsed line, before the final location of its tokens is known */
+typedef struct
+{
+    size_t first; /* index of its first token */
+    int ntokens;
+    config_slice_t comment;
+} line_t;
+
+/*
+ * The config is read in blocks and parsed a line at a time. Tokens are
+ * appended to a single text buffer and referred to by offset, so that
+ * the buffer can grow. Once the whole file is parsed, the lines, tokens
+ * and text are moved into one allocation.
+ */
+typedef struct
+{
+    wchar_t *text; /* tokens and comments, each nul terminated */
+    size_t text_len;
+    size_t text_size;
+    config_slice_t *tokens;
+    size_t ntokens;
+    size_t tokens_size;
+    line_t *lines;
+    size_t nlines;
+    size_t lines_size;
+    wchar_t *wline; /* the line being parsed */
+    size_t wline_size;
+} parser_t;
+
+/*
+ * Make room for need elements of size elem in buf, which has room for
+ * *size. Returns the buffer, or NULL if out of memory, leaving buf as it
+ * was.
+ */
+static void *
+reserve(void *buf, size_t *size, size_t need, size_t elem)
+{
+    size_t n = *size ? *size : 64;
+
+    if (need <= *size)
+    {
+        return buf;
+    }
+    while (n < need)
+    {
+        n *= 2;
+    }
+    if (n > SIZE_MAX / elem)
+    {
+        return NULL;
+    }
+    buf = realloc(buf, n * elem);
+    if (buf)
+    {
+        *size = n;
+    }
+    return buf;
+}
+
+static int
+append_text(parser_t *ps, const wchar_t *s, size_t len)
+{
+    wchar_t *text = reserve(ps->text, &ps->text_size, ps->text_len + len + 1, sizeof(*text));
+
+    if (!text)
+    {
+        return -1;
+    }
+    ps->text = text;
+    wmemcpy(text + ps->text_len, s, len);
+    ps->text_len += len;
+    return 0;
+}
+
+/* End the string being appended to text */
+static int
+end_text(parser_t *ps)
+{
+    return append_text(ps, L"", 1);
+}
+
 static int
 legal_escape(wchar_t c)
 {
@@ -36,178 +139,423 @@ legal_escape(wchar_t c)
 }
 
 static int
-is_comment(wchar_t *s)
+is_comment(const wchar_t *s)
 {
     wchar_t *comment_chars = L";#";
     return (s && (wcschr(comment_chars, s[0]) != NULL));
 }
 
 static int
-copy_token(wchar_t **dest, wchar_t **src, wchar_t *delim)
+copy_token(parser_t *ps, const wchar_t **src, wchar_t *delim)
 {
-    wchar_t *p = *src;
-    wchar_t *s = *dest;
+    const wchar_t *p = *src;
+    const wchar_t *start = p;
 
-    /* copy src to dest until delim character with escaped chars converted */
-    for (; *p != L'\0' && wcschr(delim, *p) == NULL; p++, s++)
+    /* copy src to text until delim character with escaped chars converted */
+    for (; *p != L'\0' && wcschr(delim, *p) == NULL; p++)
     {
         if (*p == L'\\' && legal_escape(*(p + 1)))
         {
-            *s = *(++p);
+            /* copy up to the backslash and continue with the escaped char */
+            if (append_text(ps, start, p - start) != 0)
+            {
+                return -1;
+            }
+            start = ++p;
+            if (*p == L'\0')
+            {
+                break; /* a backslash at the end of the line is dropped */
+            }
         }
         else if (*p == L'\\')
         {
-            MsgToEventLog(EVENTLOG_ERROR_TYPE, L"Parse error in copy_token: illegal backslash");
+            config_error(L"Parse error in copy_token: illegal backslash");
             return -1; /* parse error -- illegal backslash in input */
         }
-        else
-        {
-            *s = *p;
-        }
     }
     /* at this point p is one of the delimiters or null */
-    *s = L'\0';
     *src = p;
-    *dest = s;
-    return 0;
+    return append_text(ps, start, p - start);
 }
 
 static int
-tokenize(config_entry_t *ce)
+add_token(parser_t *ps, size_t offset)
 {
-    wchar_t *p, *s;
-    p = ce->line;
-    s = ce->sline;
-    unsigned int i = 0;
+    config_slice_t *tokens =
+        reserve(ps->tokens, &ps->tokens_size, ps->ntokens + 1, sizeof(*tokens));
+
+    if (!tokens)
+    {
+        return -1;
+    }
+    ps->tokens = tokens;
+    tokens[ps->ntokens].offset = offset;
+    tokens[ps->ntokens].len = ps->text_len - offset;
+    ps->ntokens++;
+    return end_text(ps);
+}
+
+static int
+tokenize(parser_t *ps, line_t *line)
+{
+    const wchar_t *p = ps->wline;
     int status = 0;
 
-    for (; *p != L'\0'; p++, s++)
+    for (; *p != L'\0'; p++)
     {
+        size_t offset = ps->text_len;
+
         if (*p == L' ' || *p == L'\t')
         {
             continue;
         }
 
-        if (_countof(ce->tokens) <= i)
-        {
-            return -1;
-        }
-        ce->tokens[i++] = s;
-
         if (*p == L'\'')
         {
-            int len = wcscspn(++p, L"\'");
-            wcsncpy(s, p, len);
-            s += len;
+            size_t len = wcscspn(++p, L"\'");
+            status = append_text(ps, p, len);
             p += len;
         }
         else if (*p == L'\"')
         {
             p++;
-            status = copy_token(&s, &p, L"\"");
+            status = copy_token(ps, &p, L"\"");
         }
         else if (is_comment(p))
         {
-            /* store rest of the line as comment -- remove from tokens */
-            ce->comment = s;
-            wcsncpy(s, p, wcslen(p));
-            ce->tokens[--i] = NULL;
-            break;
+            /* store rest of the line as comment -- not a token */
+            line->comment.offset = offset;
+            line->comment.len = wcslen(p);
+            status = append_text(ps, p, line->comment.len);
+            return (status != 0) ? status : end_text(ps);
         }
         else
         {
-            status = copy_token(&s, &p, L" \t");
+            status = copy_token(ps, &p, L" \t");
         }
 
-        if (status != 0)
+        if (status != 0 || (status = add_token(ps, offset)) != 0)
         {
             return status;
         }
+        line->ntokens++;
 
         if (*p == L'\0')
         {
             break;
         }
     }
-    ce->ntokens = i;
     return 0;
 }
 
-config_entry_t *
-config_readline(FILE *fd, int first)
+/*
+ * Convert len bytes of UTF-8 to wide characters in out, which must have
+ * room for len of them, the most they can take. Invalid bytes are
+ * replaced by U+FFFD. Returns the number of wide characters.
+ */
+static size_t
+utf8_to_wide(const char *data, size_t len, wchar_t *out)
 {
-    int len;
-    char tmp[MAX_LINE_LENGTH];
-    int offset = 0;
+#ifdef _WIN32
+    /* len <= INT_MAX, checked by the caller */
+    return (size_t)MultiByteToWideChar(CP_UTF8, 0, data, (int)len, out, (int)len);
+#else
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    size_t n = 0;
 
-    if (fgets(tmp, _countof(tmp) - 1, fd) == NULL)
+    while (p < end)
     {
-        return NULL;
+        unsigned long cp = *p;
+        int extra = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : 1;
+        int i;
+
+        if (cp < 0x80)
+        {
+            out[n++] = (wchar_t)cp;
+            p++;
+            continue;
+        }
+
+        /* decode a sequence, or replace each byte of an invalid one */
+        for (i = 1; i <= extra && p + i < end && (p[i] & 0xC0) == 0x80; i++)
+        {
+        }
+        if (cp < 0xC2 || cp > 0xF4 || i <= extra)
+        {
+            cp = 0xFFFD;
+            p++;
+        }
+        else
+        {
+            cp &= 0x3F >> extra;
+            for (i = 1; i <= extra; i++)
+            {
+                cp = (cp << 6) | (p[i] & 0x3F);
+            }
+            if ((extra == 2 && (cp < 0x800 || (cp >= 0xD800 && cp < 0xE000)))
+                || (extra == 3 && (cp < 0x10000 || cp > 0x10FFFF)))
+            {
+                cp = 0xFFFD;
+                extra = 0;
+            }
+            p += extra + 1;
+        }
+        out[n++] = (wchar_t)cp;
     }
-    /* remove UTF-8 BOM */
-    if (first && strncmp(tmp, "\xEF\xBB\xBF", 3) == 0)
+    return n;
+#endif
+}
+
+/*
+ * Parse a line of len bytes, not including the newline. Like a line
+ * read in text mode, it ends at the first carriage return or nul.
+ */
+static int
+parse_line(parser_t *ps, const char *data, size_t len)
+{
+    line_t *lines = reserve(ps->lines, &ps->lines_size, ps->nlines + 1, sizeof(*lines));
+    line_t *line;
+    wchar_t *wline;
+    size_t wlen = 0;
+
+    if (!lines)
     {
-        offset = 3;
+        return -1;
     }
+    ps->lines = lines;
+    line = memset(&lines[ps->nlines], 0, sizeof(*line));
+    line->first = ps->ntokens;
 
-    config_entry_t *ce = calloc(sizeof(*ce), 1);
-    if (!ce)
+    for (size_t i = 0; i < len; i++)
     {
-        MsgToEventLog(EVENTLOG_ERROR_TYPE, L"Out of memory in config_readline");
-        return NULL;
+        if (data[i] == '\r' || data[i] == '\0')
+        {
+            len = i;
+            break;
+        }
+    }
+    if (len > INT_MAX)
+    {
+        return -1;
+    }
+    wline = reserve(ps->wline, &ps->wline_size, len + 1, sizeof(*wline));
+    if (!wline)
+    {
+        return -1;
+    }
+    ps->wline = wline;
+    if (len > 0)
+    {
+        wlen = utf8_to_wide(data, len, wline);
+    }
+    wline[wlen] = L'\0';
+
+    if (tokenize(ps, line) != 0)
+    {
+        return -1;
+    }
+
+    /* skip leading "--" in first token if any */
+    if (line->ntokens > 0)
+    {
+        config_slice_t *t = &ps->tokens[line->first];
+        size_t skip = wcsspn(ps->text + t->offset, L"--");
+
+        t->offset += skip;
+        t->len -= skip;
+    }
+    ps->nlines++;
+    return 0;
+}
+
+/* Parse the lines in fd until the end of the file or a parse error */
+static void
+parse_file(parser_t *ps, FILE *fd)
+{
+    char *block = malloc(CONFIG_READ_SIZE);
+    char *partial = NULL; /* start of a line continued in the next block */
+    size_t partial_len = 0;
+    size_t partial_size = 0;
+    int first = 1;
+    int in_line = 0; /* bytes were read after the last newline */
+    size_t n;
+
+    if (!block)
+    {
+        config_error(L"Out of memory in config_parse");
+        return;
+    }
+
+    while ((n = fread(block, 1, CONFIG_READ_SIZE, fd)) > 0)
+    {
+        const char *p = block;
+        const char *end = block + n;
+        const char *nl;
+
+        /* remove UTF-8 BOM */
+        if (first && n >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+        {
+            p += 3;
+        }
+        first = 0;
+        in_line = 1;
+
+        while ((nl = memchr(p, '\n', end - p)) != NULL)
+        {
+            int status;
+
+            if (partial_len)
+            {
+                char *buf = reserve(partial, &partial_size, partial_len + (nl - p), 1);
+
+                if (!buf)
+                {
+                    goto out;
+                }
+                partial = buf;
+                memcpy(partial + partial_len, p, nl - p);
+                status = parse_line(ps, partial, partial_len + (nl - p));
+                partial_len = 0;
+            }
+            else
+            {
+                /* the whole line is in the block: parse it in place */
+                status = parse_line(ps, p, nl - p);
+            }
+            if (status != 0)
+            {
+                goto out;
+            }
+            p = nl + 1;
+            in_line = (p < end);
+        }
+
+        /* keep the rest for the next block */
+        if (p < end)
+        {
+            char *buf = reserve(partial, &partial_size, partial_len + (end - p), 1);
+
+            if (!buf)
+            {
+                goto out;
+            }
+            partial = buf;
+            memcpy(partial + partial_len, p, end - p);
+            partial_len += end - p;
+        }
     }
 
-    mbstowcs(ce->line, &tmp[offset], _countof(ce->line) - 1);
+    /* a last line without newline */
+    if (in_line)
+    {
+        parse_line(ps, partial, partial_len);
+    }
 
-    len = wcscspn(ce->line, L"\n\r");
-    ce->line[len] = L'\0';
+out:
+    free(partial);
+    free(block);
+}
 
-    if (tokenize(ce) != 0)
+/* Move the parsed lines into a single allocation linked as a list */
+static config_entry_t *
+make_list(parser_t *ps)
+{
+    size_t entries_size = ps->nlines * sizeof(config_entry_t);
+    size_t tokens_size = ps->ntokens * sizeof(config_slice_t);
+    config_entry_t *head;
+    config_slice_t *tokens;
+    wchar_t *text;
+
+    if (ps->nlines == 0)
+    {
+        return NULL;
+    }
+    head = malloc(entries_size + tokens_size + ps->text_len * sizeof(wchar_t));
+    if (!head)
     {
-        free(ce);
+        config_error(L"Out of memory in config_parse");
         return NULL;
     }
+    tokens = (config_slice_t *)((char *)head + entries_size);
+    text = (wchar_t *)((char *)tokens + tokens_size);
+    if (ps->ntokens > 0)
+    {
+        memcpy(tokens, ps->tokens, tokens_size);
+    }
+    if (ps->text_len > 0)
+    {
+        wmemcpy(text, ps->text, ps->text_len);
+    }
 
-    /* skip leading "--" in first token if any */
-    if (ce->ntokens > 0)
+    for (size_t i = 0; i < ps->nlines; i++)
     {
-        ce->tokens[0] += wcsspn(ce->tokens[0], L"--");
+        head[i].text = text;
+        head[i].tokens = tokens + ps->lines[i].first;
+        head[i].ntokens = ps->lines[i].ntokens;
+        head[i].comment = ps->lines[i].comment;
+        head[i].next = (i + 1 < ps->nlines) ? &head[i + 1] : NULL;
     }
+    return head;
+}
 
-    return ce;
+static FILE *
+open_config(const wchar_t *fname)
+{
+#ifdef _WIN32
+    FILE *fd = NULL;
+
+    return _wfopen_s(&fd, fname, L"rb") == 0 ? fd : NULL;
+#else
+    char name[4096];
+
+    if (wcstombs(name, fname, sizeof(name)) >= sizeof(name))
+    {
+        return NULL;
+    }
+    return fopen(name, "rb");
+#endif
 }
 
 config_entry_t *
 config_parse(wchar_t *fname)
 {
     FILE *fd = NULL;
-    config_entry_t *head, *tail;
+    parser_t ps;
+    config_entry_t *head;
 
-    if (!fname || _wfopen_s(&fd, fname, L"r"))
+    if (!fname || (fd = open_config(fname)) == NULL)
     {
-        MsgToEventLog(EVENTLOG_ERROR_TYPE, L"Error opening <%ls> in config_parse", fname);
+        config_error(L"Error opening <%ls> in config_parse", fname);
         return NULL;
     }
-    head = tail = config_readline(fd, 1);
 
-    while (tail)
-    {
-        tail->next = config_readline(fd, 0);
-        tail = tail->next;
-    }
+    memset(&ps, 0, sizeof(ps));
+    parse_file(&ps, fd);
     fclose(fd);
+
+    head = make_list(&ps);
+
+    free(ps.text);
+    free(ps.tokens);
+    free(ps.lines);
+    free(ps.wline);
     return head;
 }
 
 void
 config_list_free(config_entry_t *head)
 {
-    config_entry_t *next;
-    while (head)
+    /* all entries are in the allocation of the first */
+    free(head);
+}
+
+const wchar_t *
+config_token(const config_entry_t *ce, int i)
+{
+    if (i < 0 || i >= ce->ntokens)
     {
-        next = head->next;
-        free(head);
-        head = next;
+        return NULL;
     }
-    return;
+    return ce->text + ce->tokens[i].offset;
 }
@@ -22,23 +22,35 @@
 #ifndef CONFIG_PARSER_H
 #define CONFIG_PARSER_H
 
-#define MAX_LINE_LENGTH 256
+#include <stddef.h>
+#include <wchar.h>
 
 typedef struct config_entry config_entry_t;
 
+/* A part of the text of a parsed config */
+typedef struct
+{
+    size_t offset; /* in characters from the start of the text */
+    size_t len;
+} config_slice_t;
+
+/*
+ * A line of a config. The tokens and comments of all lines are stored
+ * one after another in text, each followed by a nul character.
+ */
 struct config_entry
 {
-    wchar_t line[MAX_LINE_LENGTH];
-    wchar_t sline[MAX_LINE_LENGTH];
-    wchar_t *tokens[16];
-    wchar_t *comment;
+    const wchar_t *text;
+    const config_slice_t *tokens; /* with quotes removed and escapes converted */
     int ntokens;
+    config_slice_t comment;       /* rest of the line from ; or #, len is 0 if none */
     config_entry_t *next;
 };
 
 /**
  * Parse an ovpn file into a list of tokenized
- * structs.
+ * structs. Lines can be of any length. Parsing stops
+ * at the first line with an illegal backslash.
  * @param fname : filename of the config to parse
  * @returns the pointer to the head of a list of
  *          config_entry_t structs.
@@ -53,4 +65,13 @@ config_entry_t *config_parse(wchar_t *fname);
  */
 void config_list_free(config_entry_t *head);
 
+/**
+ * Get a token of a config line
+ * @param ce : a config line
+ * @param i : index of the token
+ * @returns the nul terminated token or NULL if the line has
+ *          no more than i tokens.
+ */
+const wchar_t *config_token(const config_entry_t *ce, int i);
+
 #endif /* ifndef CONFIG_PARSER_H */
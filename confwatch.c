@@ -0,0 +1,664 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+#include "confwatch.h"
+
+#ifdef _WIN32
+#define PATH_SEP L'\\'
+#else
+#define PATH_SEP L'/'
+#endif
+
+#define CONFWATCH_PATH_MAX 4096
+
+/* Changes as reported by the system */
+enum
+{
+    raw_added,
+    raw_removed,
+    raw_modified,
+};
+
+struct confwatch
+{
+    wchar_t *root;
+    wchar_t *ext;
+    int max_depth;
+#ifdef _WIN32
+    HANDLE dir;
+    OVERLAPPED ov;
+    BOOL pending; /* a read is outstanding */
+    DWORD buf[16 * 1024];
+#else
+    int fd;
+    int root_wd;  /* watch descriptor of the root, -1 if it is not watched */
+    char **dirs;  /* dirs[wd] is the path of the directory watched by wd, relative to root */
+    size_t ndirs; /* number of entries in dirs */
+    char *mbroot; /* root as a multibyte string */
+#endif
+};
+
+static int
+same_ext(const wchar_t *name, const wchar_t *ext)
+{
+    size_t len = wcslen(name);
+    size_t ext_len = wcslen(ext);
+    const wchar_t *p;
+
+    if (ext_len == 0)
+    {
+        return 1;
+    }
+    if (len < ext_len + 2 || name[len - ext_len - 1] != L'.')
+    {
+        return 0;
+    }
+    for (p = name + len - ext_len; *p; p++, ext++)
+    {
+        if (towlower(*p) != towlower(*ext))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Number of directories between the root and the file at rel */
+static int
+levels(const wchar_t *rel)
+{
+    int n = 0;
+
+    for (; *rel; rel++)
+    {
+        n += (*rel == PATH_SEP);
+    }
+    return n;
+}
+
+int
+confwatch_group(const wchar_t *root,
+                const wchar_t *dir,
+                int group,
+                confwatch_group_fn child,
+                void *arg)
+{
+    size_t root_len = wcslen(root);
+    const wchar_t *name;
+
+    while (root_len > 1 && root[root_len - 1] == PATH_SEP)
+    {
+        root_len--;
+    }
+    if (wcsncmp(dir, root, root_len) != 0 || dir[root_len] != PATH_SEP)
+    {
+        return group;
+    }
+
+    for (name = dir + root_len + 1; *name;)
+    {
+        const wchar_t *end = wcschr(name, PATH_SEP);
+        size_t len = end ? (size_t)(end - name) : wcslen(name);
+
+        if (len > 0)
+        {
+            group = child(arg, group, name, len);
+        }
+        name += len + (end != NULL);
+    }
+    return group;
+}
+
+/*
+ * Report a change of the file or directory at rel, relative to the root,
+ * if it may affect config files. is_dir is -1 if it is not known whether
+ * rel is a directory. Returns the number of changes reported.
+ */
+static int
+report(confwatch_t *w, int action, const wchar_t *rel, int is_dir, confwatch_fn fn, void *arg)
+{
+    const wchar_t *name = wcsrchr(rel, PATH_SEP);
+    int depth = levels(rel);
+    size_t root_len = wcslen(w->root);
+    size_t rel_len = wcslen(rel);
+    int config;
+    wchar_t path[CONFWATCH_PATH_MAX];
+
+    name = name ? name + 1 : rel;
+    config = is_dir != 1 && same_ext(name, w->ext);
+
+    if (depth > w->max_depth || (is_dir == 1 && depth + 1 > w->max_depth && action != raw_removed))
+    {
+        return 0;
+    }
+    if (root_len + 1 + rel_len >= CONFWATCH_PATH_MAX)
+    {
+        return 0;
+    }
+    wmemcpy(path, w->root, root_len);
+    path[root_len] = PATH_SEP;
+    wmemcpy(path + root_len + 1, rel, rel_len + 1);
+
+    switch (action)
+    {
+        case raw_added:
+            if (is_dir == 1)
+            {
+                fn(arg, confwatch_add_dir, path, w->max_depth - depth - 1);
+                return 1;
+            }
+        /* fall through */
+        case raw_modified:
+            if (config)
+            {
+                fn(arg, confwatch_config, path, 0);
+                return 1;
+            }
+            return 0;
+
+        case raw_removed:
+            if (config || is_dir != 0)
+            {
+                fn(arg, confwatch_remove, path, 0);
+                return 1;
+            }
+            return 0;
+    }
+    return 0;
+}
+
+static confwatch_t *
+alloc_watch(const wchar_t *root, const wchar_t *ext, int max_depth)
+{
+    confwatch_t *w = calloc(1, sizeof(*w));
+
+    if (!w)
+    {
+        return NULL;
+    }
+    w->root = wcsdup(root);
+    w->ext = wcsdup(ext);
+    w->max_depth = max_depth;
+    if (!w->root || !w->ext)
+    {
+        free(w->root);
+        free(w->ext);
+        free(w);
+        return NULL;
+    }
+    /* changes are reported with paths joined to the root */
+    while (wcslen(w->root) > 1 && w->root[wcslen(w->root) - 1] == PATH_SEP)
+    {
+        w->root[wcslen(w->root) - 1] = L'\0';
+    }
+    return w;
+}
+
+static void
+free_watch(confwatch_t *w)
+{
+    free(w->root);
+    free(w->ext);
+    free(w);
+}
+
+#ifdef _WIN32
+
+/* Start recording changes until the next call of confwatch_read() */
+static BOOL
+start_read(confwatch_t *w)
+{
+    w->pending = ReadDirectoryChangesW(w->dir,
+                                       w->buf,
+                                       sizeof(w->buf),
+                                       TRUE,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+                                           | FILE_NOTIFY_CHANGE_LAST_WRITE
+                                           | FILE_NOTIFY_CHANGE_SECURITY,
+                                       NULL,
+                                       &w->ov,
+                                       NULL);
+    return w->pending;
+}
+
+confwatch_t *
+confwatch_open(const wchar_t *root, const wchar_t *ext, int max_depth)
+{
+    confwatch_t *w = alloc_watch(root, ext, max_depth);
+
+    if (!w)
+    {
+        return NULL;
+    }
+    w->dir = CreateFileW(w->root,
+                         FILE_LIST_DIRECTORY,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         NULL,
+                         OPEN_EXISTING,
+                         FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                         NULL);
+    w->ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (w->dir == INVALID_HANDLE_VALUE || !w->ov.hEvent)
+    {
+        w->dir = (w->dir == INVALID_HANDLE_VALUE) ? NULL : w->dir;
+        confwatch_close(w);
+        return NULL;
+    }
+
+    if (!start_read(w))
+    {
+        confwatch_close(w);
+        return NULL;
+    }
+    return w;
+}
+
+int
+confwatch_read(confwatch_t *w, unsigned int timeout, confwatch_fn fn, void *arg)
+{
+    const FILE_NOTIFY_INFORMATION *fni;
+    wchar_t rel[MAX_PATH];
+    DWORD len;
+    int n = 0;
+
+    if (!w->pending && !start_read(w))
+    {
+        return -1;
+    }
+    if (WaitForSingleObject(w->ov.hEvent, timeout) != WAIT_OBJECT_0)
+    {
+        return 0;
+    }
+    w->pending = FALSE;
+
+    if (!GetOverlappedResult(w->dir, &w->ov, &len, FALSE))
+    {
+        if (GetLastError() != ERROR_NOTIFY_ENUM_DIR)
+        {
+            return -1;
+        }
+        len = 0;
+    }
+    if (len == 0)
+    {
+        /* more changes than fit in the buffer */
+        fn(arg, confwatch_rescan, w->root, w->max_depth);
+        return 1;
+    }
+
+    for (fni = (const FILE_NOTIFY_INFORMATION *)w->buf;;
+         fni = (const FILE_NOTIFY_INFORMATION *)((const BYTE *)fni + fni->NextEntryOffset))
+    {
+        size_t rel_len = fni->FileNameLength / sizeof(WCHAR);
+        WCHAR path[MAX_PATH];
+        DWORD attr;
+
+        if (rel_len < _countof(rel))
+        {
+            memcpy(rel, fni->FileName, rel_len * sizeof(WCHAR));
+            rel[rel_len] = L'\0';
+
+            switch (fni->Action)
+            {
+                case FILE_ACTION_ADDED:
+                case FILE_ACTION_RENAMED_NEW_NAME:
+                    /* a name that is already gone is reported as removed later */
+                    _snwprintf(path, _countof(path), L"%ls\\%ls", w->root, rel);
+                    path[_countof(path) - 1] = L'\0';
+                    attr = GetFileAttributesW(path);
+                    if (attr != INVALID_FILE_ATTRIBUTES)
+                    {
+                        int is_dir = !!(attr & FILE_ATTRIBUTE_DIRECTORY);
+
+                        n += report(w, raw_added, rel, is_dir, fn, arg);
+                    }
+                    break;
+
+                case FILE_ACTION_REMOVED:
+                case FILE_ACTION_RENAMED_OLD_NAME:
+                    n += report(w, raw_removed, rel, -1, fn, arg);
+                    break;
+
+                case FILE_ACTION_MODIFIED:
+                    n += report(w, raw_modified, rel, -1, fn, arg);
+                    break;
+            }
+        }
+        if (fni->NextEntryOffset == 0)
+        {
+            break;
+        }
+    }
+    return n;
+}
+
+void
+confwatch_close(confwatch_t *w)
+{
+    DWORD len;
+
+    if (w->pending)
+    {
+        CancelIoEx(w->dir, &w->ov);
+        GetOverlappedResult(w->dir, &w->ov, &len, TRUE);
+    }
+    if (w->dir)
+    {
+        CloseHandle(w->dir);
+    }
+    if (w->ov.hEvent)
+    {
+        CloseHandle(w->ov.hEvent);
+    }
+    free_watch(w);
+}
+
+#else /* ifdef _WIN32 */
+
+#define WATCH_MASK                                                                     \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB \
+     | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+static void
+forget_dir(confwatch_t *w, int wd)
+{
+    if (wd >= 0 && (size_t)wd < w->ndirs)
+    {
+        free(w->dirs[wd]);
+        w->dirs[wd] = NULL;
+    }
+    if (wd == w->root_wd)
+    {
+        w->root_wd = -1;
+    }
+}
+
+/*
+ * Watch the directory at rel and its subdirectories, which is depth
+ * levels below the root. Returns 0 if out of memory.
+ */
+static int
+watch_tree(confwatch_t *w, const char *rel, int depth)
+{
+    char path[CONFWATCH_PATH_MAX];
+    struct dirent *de;
+    DIR *d;
+    int wd;
+
+    if ((size_t)snprintf(path, sizeof(path), "%s%s%s", w->mbroot, *rel ? "/" : "", rel)
+        >= sizeof(path))
+    {
+        return 1;
+    }
+    wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+    if (wd < 0)
+    {
+        return 1; /* gone again or not a directory */
+    }
+    if ((size_t)wd >= w->ndirs)
+    {
+        size_t n = (size_t)wd + 64;
+        char **dirs = realloc(w->dirs, n * sizeof(*dirs));
+
+        if (!dirs)
+        {
+            return 0;
+        }
+        memset(dirs + w->ndirs, 0, (n - w->ndirs) * sizeof(*dirs));
+        w->dirs = dirs;
+        w->ndirs = n;
+    }
+    free(w->dirs[wd]);
+    w->dirs[wd] = strdup(rel);
+    if (!w->dirs[wd])
+    {
+        return 0;
+    }
+    if (*rel == '\0')
+    {
+        w->root_wd = wd;
+    }
+
+    if (depth >= w->max_depth || !(d = opendir(path)))
+    {
+        return 1;
+    }
+    while ((de = readdir(d)))
+    {
+        char sub[CONFWATCH_PATH_MAX];
+        struct stat st;
+
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        {
+            continue;
+        }
+        if ((size_t)snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name) >= sizeof(sub)
+            || lstat(sub, &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            continue;
+        }
+        snprintf(sub, sizeof(sub), "%s%s%s", rel, *rel ? "/" : "", de->d_name);
+        if (!watch_tree(w, sub, depth + 1))
+        {
+            closedir(d);
+            return 0;
+        }
+    }
+    closedir(d);
+    return 1;
+}
+
+/* Stop watching the directory at rel and its subdirectories */
+static void
+unwatch_tree(confwatch_t *w, const char *rel)
+{
+    size_t len = strlen(rel);
+
+    for (size_t wd = 0; wd < w->ndirs; wd++)
+    {
+        const char *dir = w->dirs[wd];
+
+        if (dir && strncmp(dir, rel, len) == 0 && (dir[len] == '\0' || dir[len] == '/'))
+        {
+            inotify_rm_watch(w->fd, (int)wd);
+            forget_dir(w, (int)wd);
+        }
+    }
+}
+
+/* Number of directories from the root down to the directory at rel */
+static int
+dir_levels(const char *rel)
+{
+    int n = 1;
+
+    for (; *rel; rel++)
+    {
+        n += (*rel == '/');
+    }
+    return n;
+}
+
+static int
+report_mb(confwatch_t *w, int action, const char *rel, int is_dir, confwatch_fn fn, void *arg)
+{
+    wchar_t wrel[CONFWATCH_PATH_MAX];
+
+    if (mbstowcs(wrel, rel, CONFWATCH_PATH_MAX) >= CONFWATCH_PATH_MAX)
+    {
+        return 0;
+    }
+    return report(w, action, wrel, is_dir, fn, arg);
+}
+
+confwatch_t *
+confwatch_open(const wchar_t *root, const wchar_t *ext, int max_depth)
+{
+    confwatch_t *w = alloc_watch(root, ext, max_depth);
+    size_t len;
+
+    if (!w)
+    {
+        return NULL;
+    }
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    w->root_wd = -1;
+    len = wcstombs(NULL, w->root, 0);
+    if (w->fd < 0 || len == (size_t)-1 || !(w->mbroot = malloc(len + 1)))
+    {
+        confwatch_close(w);
+        return NULL;
+    }
+    wcstombs(w->mbroot, w->root, len + 1);
+
+    if (!watch_tree(w, "", 0) || w->root_wd < 0)
+    {
+        confwatch_close(w);
+        return NULL;
+    }
+    return w;
+}
+
+int
+confwatch_read(confwatch_t *w, unsigned int timeout, confwatch_fn fn, void *arg)
+{
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+    int n = 0;
+    ssize_t len;
+
+    if (poll(&pfd, 1, (int)(timeout > 0x7fffffff ? 0x7fffffff : timeout)) <= 0)
+    {
+        return 0;
+    }
+    len = read(w->fd, buf, sizeof(buf));
+    if (len <= 0)
+    {
+        return 0;
+    }
+
+    for (char *p = buf; p < buf + len;)
+    {
+        const struct inotify_event *ev = (const struct inotify_event *)p;
+        int is_dir = !!(ev->mask & IN_ISDIR);
+        const char *dir = NULL;
+        char rel[CONFWATCH_PATH_MAX];
+
+        p += sizeof(*ev) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW)
+        {
+            /* watch the tree as it is now and have it scanned again */
+            unwatch_tree(w, "");
+            if (!watch_tree(w, "", 0))
+            {
+                return -1;
+            }
+            fn(arg, confwatch_rescan, w->root, w->max_depth);
+            n++;
+            continue;
+        }
+        if (ev->wd >= 0 && (size_t)ev->wd < w->ndirs)
+        {
+            dir = w->dirs[ev->wd];
+        }
+        if (!dir)
+        {
+            continue;
+        }
+        if (ev->mask & IN_IGNORED)
+        {
+            forget_dir(w, ev->wd);
+            continue;
+        }
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+        {
+            if (ev->wd == w->root_wd)
+            {
+                return -1; /* the root itself is gone */
+            }
+            continue; /* reported as removed by its parent */
+        }
+        if (ev->len == 0
+            || (size_t)snprintf(rel, sizeof(rel), "%s%s%s", dir, *dir ? "/" : "", ev->name)
+                   >= sizeof(rel))
+        {
+            continue;
+        }
+
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            /* watch a new directory before it is scanned, so that no
+             * file added to it is missed */
+            if (is_dir && !watch_tree(w, rel, dir_levels(rel)))
+            {
+                return -1;
+            }
+            n += report_mb(w, raw_added, rel, is_dir, fn, arg);
+        }
+        else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            if (is_dir)
+            {
+                unwatch_tree(w, rel);
+            }
+            n += report_mb(w, raw_removed, rel, is_dir, fn, arg);
+        }
+        else if (!is_dir && (ev->mask & (IN_CLOSE_WRITE | IN_ATTRIB)))
+        {
+            n += report_mb(w, raw_modified, rel, 0, fn, arg);
+        }
+    }
+    return n;
+}
+
+void
+confwatch_close(confwatch_t *w)
+{
+    for (size_t wd = 0; wd < w->ndirs; wd++)
+    {
+        free(w->dirs[wd]);
+    }
+    free(w->dirs);
+    free(w->mbroot);
+    if (w->fd >= 0)
+    {
+        close(w->fd);
+    }
+    free_watch(w);
+}
+
+#endif /* ifdef _WIN32 */
@@ -0,0 +1,73 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CONFWATCH_H
+#define CONFWATCH_H
+
+#include <stddef.h>
+#include <wchar.h>
+
+/* Changes to a tree of config files, as reported by confwatch_read() */
+typedef enum
+{
+    confwatch_config,  /* the config file at path was added or changed */
+    confwatch_add_dir, /* the directory at path was added: scan it depth levels down */
+    confwatch_remove,  /* path was removed or renamed away -- a config or a directory */
+    confwatch_rescan,  /* changes were lost: scan the whole tree again */
+} confwatch_change_t;
+
+/* path is the full path of the changed file or directory */
+typedef void (*confwatch_fn)(void *arg, confwatch_change_t change, const wchar_t *path, int depth);
+
+typedef struct confwatch confwatch_t;
+
+/*
+ * Watch the directory root and its subdirectories up to max_depth levels
+ * down for changes to config files, which are files with extension ext,
+ * or any file if ext is empty. Returns NULL on error, e.g. if the file
+ * system does not support change notifications.
+ */
+confwatch_t *confwatch_open(const wchar_t *root, const wchar_t *ext, int max_depth);
+
+/*
+ * Wait up to timeout milliseconds for changes and report them to fn. A
+ * renamed file is reported as removed under its old name and added
+ * under its new one. Returns the number of changes reported, or -1 if
+ * the tree can no longer be watched.
+ */
+int confwatch_read(confwatch_t *w, unsigned int timeout, confwatch_fn fn, void *arg);
+
+void confwatch_close(confwatch_t *w);
+
+/* Return the group of the directory name[0..len) below the group parent */
+typedef int (*confwatch_group_fn)(void *arg, int parent, const wchar_t *name, size_t len);
+
+/*
+ * Return the group of the directory dir, given that root is in group:
+ * walking down from root, child is called for each directory on the way
+ * to dir with the group of its parent. Returns group if dir is not below
+ * root. Used to place configs in the groups a scan would put them in.
+ */
+int confwatch_group(const wchar_t *root,
+                    const wchar_t *dir,
+                    int group,
+                    confwatch_group_fn child,
+                    void *arg);
+
+#endif /* ifndef CONFWATCH_H */
@@ -0,0 +1,277 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+#include "connmap.h"
+
+/* Both indexes use linear probing and are kept at most half full */
+#define CONNMAP_MIN_SLOTS 64
+
+static inline wchar_t
+fold(wchar_t ch)
+{
+    if (ch < 0x80)
+    {
+        return (ch >= L'A' && ch <= L'Z') ? ch - L'A' + L'a' : ch;
+    }
+    return (wchar_t)towlower(ch);
+}
+
+/* FNV-1a of the case folded name */
+static uint32_t
+hash_name(const wchar_t *name)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *name; name++)
+    {
+        h = (h ^ (uint32_t)fold(*name)) * 16777619u;
+    }
+    return h;
+}
+
+static int
+same_name(const wchar_t *a, const wchar_t *b)
+{
+    for (; *a && fold(*a) == fold(*b); a++, b++)
+    {
+    }
+    return fold(*a) == fold(*b);
+}
+
+static size_t
+hash_key(uintptr_t key)
+{
+    uint64_t h = (uint64_t)key;
+
+    /* handles are multiples of 4: mix all bits into the low ones */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static int
+names_grow(connmap_names_t *m)
+{
+    size_t n = m->slots ? 2 * (m->mask + 1) : CONNMAP_MIN_SLOTS;
+    connmap_name_t *slots = calloc(n, sizeof(*slots));
+
+    if (!slots)
+    {
+        return 0;
+    }
+    for (size_t i = 0; m->slots && i <= m->mask; i++)
+    {
+        size_t j = m->slots[i].hash & (n - 1);
+
+        if (!m->slots[i].value)
+        {
+            continue;
+        }
+        while (slots[j].value)
+        {
+            j = (j + 1) & (n - 1);
+        }
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->mask = n - 1;
+
+    return 1;
+}
+
+int
+connmap_names_add(connmap_names_t *m, const wchar_t *name, void *value)
+{
+    uint32_t hash = hash_name(name);
+    size_t i;
+
+    if ((m->count + 1) * 2 > (m->slots ? m->mask + 1 : 0) && !names_grow(m))
+    {
+        return 0;
+    }
+
+    for (i = hash & m->mask; m->slots[i].value; i = (i + 1) & m->mask)
+    {
+        if (m->slots[i].hash == hash && same_name(m->slots[i].key, name))
+        {
+            return 1;
+        }
+    }
+    m->slots[i].key = name;
+    m->slots[i].value = value;
+    m->slots[i].hash = hash;
+    m->count++;
+
+    return 1;
+}
+
+void *
+connmap_names_find(const connmap_names_t *m, const wchar_t *name)
+{
+    uint32_t hash;
+
+    if (!m->slots)
+    {
+        return NULL;
+    }
+    hash = hash_name(name);
+    for (size_t i = hash & m->mask; m->slots[i].value; i = (i + 1) & m->mask)
+    {
+        if (m->slots[i].hash == hash && same_name(m->slots[i].key, name))
+        {
+            return m->slots[i].value;
+        }
+    }
+    return NULL;
+}
+
+void
+connmap_names_free(connmap_names_t *m)
+{
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
+
+static int
+keys_grow(connmap_keys_t *m)
+{
+    size_t n = m->slots ? 2 * (m->mask + 1) : CONNMAP_MIN_SLOTS;
+    connmap_key_t *slots = calloc(n, sizeof(*slots));
+
+    if (!slots)
+    {
+        return 0;
+    }
+    for (size_t i = 0; m->slots && i <= m->mask; i++)
+    {
+        size_t j = hash_key(m->slots[i].key) & (n - 1);
+
+        if (!m->slots[i].value)
+        {
+            continue;
+        }
+        while (slots[j].value)
+        {
+            j = (j + 1) & (n - 1);
+        }
+        slots[j] = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->mask = n - 1;
+
+    return 1;
+}
+
+int
+connmap_keys_set(connmap_keys_t *m, uintptr_t key, void *value)
+{
+    size_t i;
+
+    if ((m->count + 1) * 2 > (m->slots ? m->mask + 1 : 0) && !keys_grow(m))
+    {
+        return 0;
+    }
+
+    for (i = hash_key(key) & m->mask; m->slots[i].value; i = (i + 1) & m->mask)
+    {
+        if (m->slots[i].key == key)
+        {
+            m->slots[i].value = value;
+            return 1;
+        }
+    }
+    m->slots[i].key = key;
+    m->slots[i].value = value;
+    m->count++;
+
+    return 1;
+}
+
+void
+connmap_keys_remove(connmap_keys_t *m, uintptr_t key, const void *value)
+{
+    size_t i, j;
+
+    if (!m->slots)
+    {
+        return;
+    }
+    for (i = hash_key(key) & m->mask; m->slots[i].key != key; i = (i + 1) & m->mask)
+    {
+        if (!m->slots[i].value)
+        {
+            return;
+        }
+    }
+    if (!m->slots[i].value || m->slots[i].value != value)
+    {
+        return;
+    }
+
+    /* move later entries of the probe sequence into the hole, so that
+     * lookups do not stop early */
+    for (j = (i + 1) & m->mask; m->slots[j].value; j = (j + 1) & m->mask)
+    {
+        size_t home = hash_key(m->slots[j].key) & m->mask;
+
+        /* the entry may move to i unless its home is cyclically in (i, j] */
+        if (((j - home) & m->mask) >= ((j - i) & m->mask))
+        {
+            m->slots[i] = m->slots[j];
+            i = j;
+        }
+    }
+    m->slots[i].key = 0;
+    m->slots[i].value = NULL;
+    m->count--;
+}
+
+void *
+connmap_keys_find(const connmap_keys_t *m, uintptr_t key)
+{
+    if (!m->slots)
+    {
+        return NULL;
+    }
+    for (size_t i = hash_key(key) & m->mask; m->slots[i].value; i = (i + 1) & m->mask)
+    {
+        if (m->slots[i].key == key)
+        {
+            return m->slots[i].value;
+        }
+    }
+    return NULL;
+}
+
+void
+connmap_keys_free(connmap_keys_t *m)
+{
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
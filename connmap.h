@@ -0,0 +1,86 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CONNMAP_H
+#define CONNMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+typedef struct
+{
+    const wchar_t *key; /* owned by the caller */
+    void *value;        /* NULL if the slot is free */
+    uint32_t hash;
+} connmap_name_t;
+
+/*
+ * A hash index of values by a name compared ignoring case. Names are
+ * not copied and have to stay valid while they are in the index. Names
+ * can only be removed all at once.
+ */
+typedef struct
+{
+    connmap_name_t *slots;
+    size_t mask;  /* number of slots - 1 */
+    size_t count; /* number of names */
+} connmap_names_t;
+
+typedef struct
+{
+    uintptr_t key;
+    void *value; /* NULL if the slot is free */
+} connmap_key_t;
+
+/* A hash index of values by an integer key such as a handle */
+typedef struct
+{
+    connmap_key_t *slots;
+    size_t mask;  /* number of slots - 1 */
+    size_t count; /* number of keys */
+} connmap_keys_t;
+
+/*
+ * Add value under name unless the name is already in the index, in
+ * which case the value added first is kept. value must not be NULL.
+ * Returns 0 if out of memory.
+ */
+int connmap_names_add(connmap_names_t *m, const wchar_t *name, void *value);
+
+/* Return the value added under name or NULL if there is none */
+void *connmap_names_find(const connmap_names_t *m, const wchar_t *name);
+
+void connmap_names_free(connmap_names_t *m);
+
+/*
+ * Set the value of key, replacing any value it had. value must not be
+ * NULL. Returns 0 if out of memory.
+ */
+int connmap_keys_set(connmap_keys_t *m, uintptr_t key, void *value);
+
+/* Remove key if its value is value */
+void connmap_keys_remove(connmap_keys_t *m, uintptr_t key, const void *value);
+
+/* Return the value of key or NULL if it is not in the index */
+void *connmap_keys_find(const connmap_keys_t *m, uintptr_t key);
+
+void connmap_keys_free(connmap_keys_t *m);
+
+#endif /* ifndef CONNMAP_H */
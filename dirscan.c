@@ -0,0 +1,813 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+#include "dirscan.h"
+
+#define DIRSCAN_MAX_THREADS 32
+
+#ifdef _WIN32
+#define PATH_SEP       L'\\'
+#define DIRSCAN_SETTLE (5 * 10000000ULL) /* 5 s in 100 ns units */
+typedef SRWLOCK scan_lock_t;
+typedef CONDITION_VARIABLE scan_cond_t;
+typedef HANDLE scan_thread_t;
+#else
+#define PATH_SEP       L'/'
+#define DIRSCAN_SETTLE (5 * 1000000000ULL) /* 5 s in ns */
+typedef pthread_mutex_t scan_lock_t;
+typedef pthread_cond_t scan_cond_t;
+typedef pthread_t scan_thread_t;
+#endif
+
+/*
+ * Directories waiting to be listed are queued in the order they are
+ * found. Each directory keeps its subdirectories in the order they
+ * were listed, so that the tree built is the same whichever thread
+ * lists which directory.
+ */
+struct scan
+{
+    const wchar_t *ext;
+    uint64_t now;          /* time the scan started */
+    scan_lock_t lock;
+    scan_cond_t cond;      /* signalled when directories are queued or all are done */
+    dirscan_dir_t **queue; /* directories found, queue[head] is the next one to list */
+    size_t head;
+    size_t count;          /* number of directories in queue */
+    size_t alloc;
+    size_t pending;        /* number of directories queued or being listed */
+    int failed;            /* out of memory */
+};
+
+#ifdef _WIN32
+
+static void
+scan_lock(struct scan *s)
+{
+    AcquireSRWLockExclusive(&s->lock);
+}
+
+static void
+scan_unlock(struct scan *s)
+{
+    ReleaseSRWLockExclusive(&s->lock);
+}
+
+static void
+scan_wait(struct scan *s)
+{
+    SleepConditionVariableSRW(&s->cond, &s->lock, INFINITE, 0);
+}
+
+static void
+scan_wake(struct scan *s)
+{
+    WakeAllConditionVariable(&s->cond);
+}
+
+#else /* ifdef _WIN32 */
+
+static void
+scan_lock(struct scan *s)
+{
+    pthread_mutex_lock(&s->lock);
+}
+
+static void
+scan_unlock(struct scan *s)
+{
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void
+scan_wait(struct scan *s)
+{
+    pthread_cond_wait(&s->cond, &s->lock);
+}
+
+static void
+scan_wake(struct scan *s)
+{
+    pthread_cond_broadcast(&s->cond);
+}
+
+#endif /* ifdef _WIN32 */
+
+static int
+same_ext(const wchar_t *name, const wchar_t *ext)
+{
+    size_t len = wcslen(name);
+    size_t ext_len = wcslen(ext);
+    const wchar_t *p;
+
+    if (ext_len == 0)
+    {
+        return 1;
+    }
+    if (len < ext_len + 2 || name[len - ext_len - 1] != L'.')
+    {
+        return 0;
+    }
+    for (p = name + len - ext_len; *p; p++, ext++)
+    {
+        if (towlower(*p) != towlower(*ext))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Return a newly allocated dir\name */
+static wchar_t *
+join_path(const wchar_t *dir, const wchar_t *name)
+{
+    size_t dir_len = wcslen(dir);
+    size_t name_len = wcslen(name);
+    wchar_t *path = malloc((dir_len + name_len + 2) * sizeof(*path));
+
+    if (path)
+    {
+        wmemcpy(path, dir, dir_len);
+        path[dir_len] = PATH_SEP;
+        wmemcpy(path + dir_len + 1, name, name_len + 1);
+    }
+    return path;
+}
+
+static dirscan_dir_t *
+new_dir(wchar_t *path, size_t name_offset, int depth)
+{
+    dirscan_dir_t *d = calloc(1, sizeof(*d));
+
+    if (!d)
+    {
+        free(path);
+        return NULL;
+    }
+    d->path = path;
+    d->name = path + name_offset;
+    d->depth = depth;
+    return d;
+}
+
+/* Add a config file to d. Returns NULL if out of memory. */
+static dirscan_file_t *
+add_file(dirscan_dir_t *d, const wchar_t *name, uint64_t size, uint64_t mtime)
+{
+    dirscan_file_t *f;
+
+    if ((d->nfiles & (d->nfiles - 1)) == 0)
+    {
+        /* grow at powers of two */
+        size_t n = d->nfiles ? 2 * d->nfiles : 1;
+        dirscan_file_t *files = realloc(d->files, n * sizeof(*files));
+
+        if (!files)
+        {
+            return NULL;
+        }
+        d->files = files;
+    }
+    f = &d->files[d->nfiles];
+    memset(f, 0, sizeof(*f));
+    f->name = wcsdup(name);
+    if (!f->name)
+    {
+        return NULL;
+    }
+    f->size = size;
+    f->mtime = mtime;
+    d->nfiles++;
+    return f;
+}
+
+/* Add a subdirectory to d. Returns NULL if out of memory. */
+static dirscan_dir_t *
+add_subdir(dirscan_dir_t *d, const wchar_t *name)
+{
+    wchar_t *path;
+
+    if ((d->nsubdirs & (d->nsubdirs - 1)) == 0)
+    {
+        size_t n = d->nsubdirs ? 2 * d->nsubdirs : 1;
+        dirscan_dir_t **subdirs = realloc(d->subdirs, n * sizeof(*subdirs));
+
+        if (!subdirs)
+        {
+            return NULL;
+        }
+        d->subdirs = subdirs;
+    }
+    path = join_path(d->path, name);
+    if (!path)
+    {
+        return NULL;
+    }
+    d->subdirs[d->nsubdirs] = new_dir(path, wcslen(d->path) + 1, d->depth - 1);
+    return d->subdirs[d->nsubdirs++];
+}
+
+/*
+ * Find name among the files of the cached directory c. Entries are
+ * usually listed in the same order as before, so the search starts at
+ * *next, which is then moved past the entry found.
+ */
+static const dirscan_file_t *
+find_file(const dirscan_dir_t *c, const wchar_t *name, size_t *next)
+{
+    for (size_t n = 0; c && n < c->nfiles; n++)
+    {
+        size_t i = (*next + n) % c->nfiles;
+
+        if (wcscmp(c->files[i].name, name) == 0)
+        {
+            *next = i + 1;
+            return &c->files[i];
+        }
+    }
+    return NULL;
+}
+
+static const dirscan_dir_t *
+find_subdir(const dirscan_dir_t *c, const wchar_t *name, size_t *next)
+{
+    for (size_t n = 0; c && n < c->nsubdirs; n++)
+    {
+        size_t i = (*next + n) % c->nsubdirs;
+
+        if (wcscmp(c->subdirs[i]->name, name) == 0)
+        {
+            *next = i + 1;
+            return c->subdirs[i];
+        }
+    }
+    return NULL;
+}
+
+#ifdef _WIN32
+
+static uint64_t
+filetime(const FILETIME *ft)
+{
+    return ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+}
+
+static uint64_t
+now(void)
+{
+    FILETIME ft;
+
+    GetSystemTimeAsFileTime(&ft);
+    return filetime(&ft);
+}
+
+static uint64_t
+dir_mtime(const wchar_t *path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+
+    /* the time of a junction or link does not change with its target */
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attr)
+        || (attr.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    {
+        return 0;
+    }
+    return filetime(&attr.ftLastWriteTime);
+}
+
+static int
+readable(const wchar_t *dir, const wchar_t *name)
+{
+    wchar_t *path = join_path(dir, name);
+    HANDLE h = INVALID_HANDLE_VALUE;
+
+    if (path)
+    {
+        h = CreateFileW(
+            path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        free(path);
+    }
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    CloseHandle(h);
+    return 1;
+}
+
+#else /* ifdef _WIN32 */
+
+static uint64_t
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t
+stat_mtime(const struct stat *st)
+{
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static int
+to_mb(const wchar_t *path, char *buf, size_t size)
+{
+    size_t len = wcstombs(buf, path, size);
+
+    return len != (size_t)-1 && len < size;
+}
+
+static uint64_t
+dir_mtime(const wchar_t *path)
+{
+    char name[4096];
+    struct stat st;
+
+    if (!to_mb(path, name, sizeof(name)) || stat(name, &st) != 0)
+    {
+        return 0;
+    }
+    return stat_mtime(&st);
+}
+
+static int
+readable(const wchar_t *dir, const wchar_t *name)
+{
+    wchar_t *path = join_path(dir, name);
+    char buf[4096];
+    int fd = -1;
+
+    if (path && to_mb(path, buf, sizeof(buf)))
+    {
+        fd = open(buf, O_RDONLY);
+    }
+    free(path);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+#endif /* ifdef _WIN32 */
+
+/*
+ * Add the config file name to d. What is known about the file is taken
+ * from its cached copy cf if the file is unchanged, except that a file
+ * that was not readable is checked again. Returns 0 if out of memory.
+ */
+static int
+add_config(dirscan_dir_t *d,
+           const wchar_t *name,
+           uint64_t size,
+           uint64_t mtime,
+           const dirscan_file_t *cf)
+{
+    dirscan_file_t *f = add_file(d, name, size, mtime);
+
+    if (!f)
+    {
+        return 0;
+    }
+    if (cf && cf->size == size && cf->mtime == mtime)
+    {
+        f->readable = cf->readable;
+        f->meta = cf->meta;
+        f->meta_stamp = cf->meta_stamp;
+    }
+    if (!f->readable)
+    {
+        f->readable = (unsigned char)readable(d->path, name);
+        d->changed |= f->readable;
+    }
+    return 1;
+}
+
+/* Take the entries of d from its unchanged cached copy c */
+static int
+copy_cached(dirscan_dir_t *d, const dirscan_dir_t *c)
+{
+    d->mtime = c->mtime;
+    for (size_t i = 0; i < c->nfiles; i++)
+    {
+        const dirscan_file_t *cf = &c->files[i];
+
+        if (!add_config(d, cf->name, cf->size, cf->mtime, cf))
+        {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < c->nsubdirs; i++)
+    {
+        dirscan_dir_t *sub = add_subdir(d, c->subdirs[i]->name);
+
+        if (!sub)
+        {
+            return 0;
+        }
+        sub->cached = c->subdirs[i];
+    }
+    return 1;
+}
+
+#ifdef _WIN32
+
+static int
+read_dir(struct scan *s, dirscan_dir_t *d, const dirscan_dir_t *c)
+{
+    WIN32_FIND_DATAW find;
+    wchar_t *pattern = join_path(d->path, L"*");
+    size_t next_file = 0, next_dir = 0;
+    HANDLE h;
+    int ok = 1;
+
+    if (!pattern)
+    {
+        return 0;
+    }
+    h = FindFirstFileExW(
+        pattern, FindExInfoBasic, &find, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    free(pattern);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return 1;
+    }
+
+    do
+    {
+        if (find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (d->depth > 0 && wcscmp(find.cFileName, L".") && wcscmp(find.cFileName, L".."))
+            {
+                dirscan_dir_t *sub = add_subdir(d, find.cFileName);
+
+                ok = sub != NULL;
+                if (sub)
+                {
+                    sub->cached = find_subdir(c, find.cFileName, &next_dir);
+                }
+            }
+        }
+        else if (same_ext(find.cFileName, s->ext))
+        {
+            uint64_t size = ((uint64_t)find.nFileSizeHigh << 32) | find.nFileSizeLow;
+
+            ok = add_config(d,
+                            find.cFileName,
+                            size,
+                            filetime(&find.ftLastWriteTime),
+                            find_file(c, find.cFileName, &next_file));
+        }
+    } while (ok && FindNextFileW(h, &find));
+
+    FindClose(h);
+    return ok;
+}
+
+#else /* ifdef _WIN32 */
+
+static int
+read_dir(struct scan *s, dirscan_dir_t *d, const dirscan_dir_t *c)
+{
+    char path[4096];
+    size_t next_file = 0, next_dir = 0;
+    size_t len;
+    struct dirent *de;
+    DIR *dir;
+    int ok = 1;
+
+    if (!to_mb(d->path, path, sizeof(path) - 1) || !(dir = opendir(path)))
+    {
+        return 1;
+    }
+    len = strlen(path);
+    path[len++] = '/';
+
+    while (ok && (de = readdir(dir)))
+    {
+        wchar_t name[1024];
+        struct stat st;
+
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0
+            || strlen(de->d_name) >= sizeof(path) - len
+            || mbstowcs(name, de->d_name, 1024) >= 1024)
+        {
+            continue;
+        }
+        strcpy(path + len, de->d_name);
+        if (stat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            if (d->depth > 0)
+            {
+                dirscan_dir_t *sub = add_subdir(d, name);
+
+                ok = sub != NULL;
+                if (sub)
+                {
+                    sub->cached = find_subdir(c, name, &next_dir);
+                }
+            }
+        }
+        else if (same_ext(name, s->ext))
+        {
+            ok = add_config(
+                d, name, (uint64_t)st.st_size, stat_mtime(&st), find_file(c, name, &next_file));
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+#endif /* ifdef _WIN32 */
+
+/*
+ * List the config files and, unless d is at the maximum depth, the
+ * subdirectories of d, or copy them from the cached copy of d if the
+ * directory did not change since. The time of a directory changed in the
+ * last few seconds is not kept, as it could change again without the
+ * time moving on.
+ */
+static int
+list_dir(struct scan *s, dirscan_dir_t *d)
+{
+    const dirscan_dir_t *c = d->cached;
+    uint64_t mtime = dir_mtime(d->path);
+
+    d->cached = NULL;
+    if (c && c->depth != d->depth)
+    {
+        c = NULL;
+    }
+    if (c && mtime && mtime == c->mtime)
+    {
+        return copy_cached(d, c);
+    }
+    d->mtime = (mtime + DIRSCAN_SETTLE > s->now) ? 0 : mtime;
+    d->changed = 1;
+
+    return read_dir(s, d, c);
+}
+
+/* List directories from the queue until all are done */
+static void
+scan_work(struct scan *s)
+{
+    scan_lock(s);
+    for (;;)
+    {
+        dirscan_dir_t *d;
+        int ok;
+
+        while (s->head == s->count && s->pending > 0)
+        {
+            scan_wait(s);
+        }
+        if (s->head == s->count)
+        {
+            break;
+        }
+        d = s->queue[s->head++];
+        scan_unlock(s);
+
+        ok = list_dir(s, d);
+
+        scan_lock(s);
+        if (!ok)
+        {
+            s->failed = 1;
+        }
+        if (!s->failed && s->count + d->nsubdirs > s->alloc)
+        {
+            size_t n = 2 * (s->count + d->nsubdirs);
+            dirscan_dir_t **queue = realloc(s->queue, n * sizeof(*queue));
+
+            if (queue)
+            {
+                s->queue = queue;
+                s->alloc = n;
+            }
+            else
+            {
+                s->failed = 1;
+            }
+        }
+        if (!s->failed && d->nsubdirs > 0)
+        {
+            memcpy(s->queue + s->count, d->subdirs, d->nsubdirs * sizeof(*d->subdirs));
+            s->count += d->nsubdirs;
+            s->pending += d->nsubdirs;
+        }
+        s->pending--;
+        if ((!s->failed && d->nsubdirs > 0) || s->pending == 0)
+        {
+            scan_wake(s);
+        }
+    }
+    scan_unlock(s);
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI
+scan_thread(LPVOID arg)
+{
+    scan_work(arg);
+    return 0;
+}
+
+#else
+
+static void *
+scan_thread(void *arg)
+{
+    scan_work(arg);
+    return NULL;
+}
+
+#endif
+
+dirscan_dir_t *
+dirscan_run(const wchar_t *root,
+            const wchar_t *ext,
+            int max_depth,
+            int threads,
+            const dirscan_dir_t *cached)
+{
+    scan_thread_t workers[DIRSCAN_MAX_THREADS];
+    struct scan s;
+    dirscan_dir_t *d;
+    wchar_t *path = wcsdup(root);
+    const wchar_t *sep;
+    int started = 0;
+
+    if (!path)
+    {
+        return NULL;
+    }
+    sep = wcsrchr(path, PATH_SEP);
+    d = new_dir(path, sep ? (size_t)(sep - path) + 1 : 0, max_depth);
+    if (!d)
+    {
+        return NULL;
+    }
+    d->cached = cached;
+
+    memset(&s, 0, sizeof(s));
+    s.ext = ext;
+    s.now = now();
+    s.alloc = 64;
+    s.queue = malloc(s.alloc * sizeof(*s.queue));
+    if (!s.queue)
+    {
+        dirscan_free(d);
+        return NULL;
+    }
+    s.queue[s.count++] = d;
+    s.pending = 1;
+
+#ifdef _WIN32
+    InitializeSRWLock(&s.lock);
+    InitializeConditionVariable(&s.cond);
+#else
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+#endif
+
+    /* the calling thread is one of the workers */
+    if (threads > DIRSCAN_MAX_THREADS)
+    {
+        threads = DIRSCAN_MAX_THREADS;
+    }
+    for (; started < threads - 1; started++)
+    {
+#ifdef _WIN32
+        workers[started] = CreateThread(NULL, 0, scan_thread, &s, 0, NULL);
+        if (!workers[started])
+        {
+            break;
+        }
+#else
+        if (pthread_create(&workers[started], NULL, scan_thread, &s) != 0)
+        {
+            break;
+        }
+#endif
+    }
+    scan_work(&s);
+
+    for (int i = 0; i < started; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(workers[i], INFINITE);
+        CloseHandle(workers[i]);
+#else
+        pthread_join(workers[i], NULL);
+#endif
+    }
+#ifndef _WIN32
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+#endif
+    free(s.queue);
+
+    if (s.failed)
+    {
+        dirscan_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+/* Return true if path is below the directory dir */
+static int
+is_below(const wchar_t *dir, const wchar_t *path)
+{
+    size_t len = wcslen(dir);
+
+    return wcsncmp(path, dir, len) == 0 && path[len] == PATH_SEP;
+}
+
+int
+dirscan_invalidate(dirscan_dir_t *d, const wchar_t *path)
+{
+    size_t i;
+
+    if (!is_below(d->path, path))
+    {
+        return 0;
+    }
+    /* the subdirectory holding path, if it is known */
+    for (i = 0; i < d->nsubdirs && !is_below(d->subdirs[i]->path, path); i++)
+    {
+    }
+    if (i == d->nsubdirs)
+    {
+        d->mtime = 0;
+        return 1;
+    }
+    return dirscan_invalidate(d->subdirs[i], path);
+}
+
+void
+dirscan_free(dirscan_dir_t *d)
+{
+    if (!d)
+    {
+        return;
+    }
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        dirscan_free(d->subdirs[i]);
+    }
+    for (size_t i = 0; i < d->nfiles; i++)
+    {
+        free(d->files[i].name);
+    }
+    free(d->subdirs);
+    free(d->files);
+    free(d->path);
+    free(d);
+}
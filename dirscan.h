@@ -0,0 +1,84 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* A config file found by dirscan_run() */
+typedef struct
+{
+    wchar_t *name;
+    uint64_t size;
+    uint64_t mtime;         /* last write time */
+    unsigned char readable; /* 1 if the file can be opened for reading */
+    unsigned int meta;      /* caller data, kept while the file is unchanged */
+    uint64_t meta_stamp;    /* caller data, e.g. when meta was derived */
+} dirscan_file_t;
+
+/* A directory found by dirscan_run() */
+typedef struct dirscan_dir
+{
+    wchar_t *path;                /* full path */
+    const wchar_t *name;          /* last component of path */
+    uint64_t mtime;               /* last write time, 0 if it cannot be relied on */
+    dirscan_file_t *files;        /* config files in the order they were listed */
+    size_t nfiles;
+    struct dirscan_dir **subdirs; /* subdirectories in the order they were listed */
+    size_t nsubdirs;
+    int depth;                    /* number of levels below this one to scan */
+    int changed;                  /* 1 unless the entries are the same as in the cache */
+    /* the same directory in an earlier scan, used while scanning */
+    const struct dirscan_dir *cached;
+} dirscan_dir_t;
+
+/*
+ * Scan the directory root and its subdirectories up to max_depth levels
+ * down for config files, which are files with extension ext, or any file
+ * if ext is empty. Every directory is listed once; up to threads
+ * directories are listed in parallel. The result does not depend on the
+ * order in which the directories are scanned. A directory that cannot
+ * be listed is returned without entries. Returns NULL if out of memory.
+ *
+ * cached is the result of an earlier scan of root or NULL. A directory
+ * whose last write time is the same as in cached is not listed again:
+ * its entries, including their size and time, are copied from cached,
+ * and only files not readable before are checked again. In a directory
+ * that is listed, files with the same size and time as before keep their
+ * readable and meta values.
+ */
+dirscan_dir_t *dirscan_run(const wchar_t *root,
+                           const wchar_t *ext,
+                           int max_depth,
+                           int threads,
+                           const dirscan_dir_t *cached);
+
+/*
+ * Mark the directory of d that holds path as changed, so that a scan
+ * with d as the cache lists it again. Used to keep a cached scan in step
+ * with changes applied without scanning. Returns 0 if path is not below d.
+ */
+int dirscan_invalidate(dirscan_dir_t *d, const wchar_t *path);
+
+void dirscan_free(dirscan_dir_t *d);
+
+#endif /* ifndef DIRSCAN_H */
@@ -0,0 +1,324 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "eventlog.h"
+
+/* Longest encoding of a character: a \u escape */
+#define EVENTLOG_CHAR_MAX 6
+
+void
+eventlog_init(eventlog_t *e, eventlog_write_fn write, void *arg)
+{
+    e->len = 0;
+    e->event = 0;
+    e->in_event = 0;
+    e->write = write;
+    e->arg = arg;
+}
+
+void
+eventlog_flush(eventlog_t *e)
+{
+    if (e->len > 0)
+    {
+        e->write(e->arg, e->data, e->len, e->in_event);
+        e->len = 0;
+    }
+    e->event = 0;
+}
+
+/*
+ * Write out the whole events before the one being formatted and move it
+ * to the start of the buffer. If there are none, the event does not fit
+ * in the buffer and the part formatted so far is written.
+ */
+static void
+make_room(eventlog_t *e)
+{
+    if (e->in_event && e->event > 0)
+    {
+        e->write(e->arg, e->data, e->event, 0);
+        memmove(e->data, e->data + e->event, e->len - e->event);
+        e->len -= e->event;
+        e->event = 0;
+    }
+    else
+    {
+        eventlog_flush(e);
+    }
+}
+
+/* Make room for n bytes, n <= EVENTLOG_BUF_SIZE */
+static inline char *
+reserve(eventlog_t *e, size_t n)
+{
+    while (EVENTLOG_BUF_SIZE - e->len < n)
+    {
+        make_room(e);
+    }
+    return e->data + e->len;
+}
+
+static void
+put_split(eventlog_t *e, const char *s, size_t n)
+{
+    while (n > 0)
+    {
+        size_t room;
+
+        reserve(e, 1);
+        room = EVENTLOG_BUF_SIZE - e->len;
+        if (room > n)
+        {
+            room = n;
+        }
+        memcpy(e->data + e->len, s, room);
+        e->len += room;
+        s += room;
+        n -= room;
+    }
+}
+
+static inline void
+put(eventlog_t *e, const char *s, size_t n)
+{
+    if (EVENTLOG_BUF_SIZE - e->len >= n)
+    {
+        memcpy(e->data + e->len, s, n);
+        e->len += n;
+    }
+    else
+    {
+        put_split(e, s, n);
+    }
+}
+
+static void
+put_key(eventlog_t *e, const char *key)
+{
+    put(e, ",\"", 2);
+    put(e, key, strlen(key));
+    put(e, "\":", 2);
+}
+
+/* Write the escaped form of a character that may not appear in JSON strings */
+static void
+put_escape(eventlog_t *e, unsigned char ch)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *p = reserve(e, EVENTLOG_CHAR_MAX);
+
+    p[0] = '\\';
+    switch (ch)
+    {
+        case '"':
+        case '\\':
+            p[1] = (char)ch;
+            e->len += 2;
+            return;
+
+        case '\n':
+            p[1] = 'n';
+            e->len += 2;
+            return;
+
+        case '\r':
+            p[1] = 'r';
+            e->len += 2;
+            return;
+
+        case '\t':
+            p[1] = 't';
+            e->len += 2;
+            return;
+    }
+    p[1] = 'u';
+    p[2] = '0';
+    p[3] = '0';
+    p[4] = hex[ch >> 4];
+    p[5] = hex[ch & 15];
+    e->len += 6;
+}
+
+static inline int
+needs_escape(unsigned char ch)
+{
+    return ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+/*
+ * Return true if any of the 8 bytes of w needs escaping: a byte is below
+ * 0x20 or is zero after xor-ing with '"' or '\\'.
+ */
+static inline int
+word_needs_escape(uint64_t w)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t q = w ^ (ones * '"');
+    uint64_t b = w ^ (ones * '\\');
+
+    uint64_t below = (w - ones * 0x20) & ~w;
+
+    return ((below | ((q - ones) & ~q) | ((b - ones) & ~b)) & highs) != 0;
+}
+
+static void
+put_num(eventlog_t *e, unsigned long long value)
+{
+    char digits[20];
+    size_t n = 0;
+
+    do
+    {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    put(e, digits + sizeof(digits) - n, n);
+}
+
+void
+eventlog_begin(eventlog_t *e, unsigned long long timestamp, const char *type)
+{
+    e->event = e->len;
+    e->in_event = 1;
+    put(e, "{\"time\":", 8);
+    put_num(e, timestamp);
+    eventlog_str(e, "type", type, strlen(type));
+}
+
+void
+eventlog_str(eventlog_t *e, const char *key, const char *value, size_t len)
+{
+    size_t run = 0;
+
+    put_key(e, key);
+    put(e, "\"", 1);
+
+    /* copy runs of characters that need no escaping in one go, looking
+     * at 8 characters at a time */
+    for (size_t i = 0; i < len;)
+    {
+        size_t end = len - i < 8 ? len : i + 8;
+        uint64_t w;
+
+        if (end == i + 8)
+        {
+            memcpy(&w, value + i, 8);
+            if (!word_needs_escape(w))
+            {
+                i = end;
+                continue;
+            }
+        }
+        for (; i < end; i++)
+        {
+            if (needs_escape((unsigned char)value[i]))
+            {
+                put(e, value + run, i - run);
+                put_escape(e, (unsigned char)value[i]);
+                run = i + 1;
+            }
+        }
+    }
+    put(e, value + run, len - run);
+    put(e, "\"", 1);
+}
+
+void
+eventlog_wstr(eventlog_t *e, const char *key, const wchar_t *value)
+{
+    put_key(e, key);
+    put(e, "\"", 1);
+
+    for (; *value; value++)
+    {
+        unsigned long cp = (unsigned long)*value;
+        char *p;
+
+        if (cp < 0x80)
+        {
+            if (needs_escape((unsigned char)cp))
+            {
+                put_escape(e, (unsigned char)cp);
+            }
+            else
+            {
+                p = reserve(e, 1);
+                *p = (char)cp;
+                e->len++;
+            }
+            continue;
+        }
+
+        /* UTF-16 surrogate pairs, unpaired surrogates are replaced */
+        if (cp >= 0xD800 && cp <= 0xDBFF && value[1] >= 0xDC00 && value[1] <= 0xDFFF)
+        {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + ((unsigned long)*++value - 0xDC00);
+        }
+        else if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+        {
+            cp = 0xFFFD;
+        }
+
+        p = reserve(e, 4);
+        if (cp < 0x800)
+        {
+            p[0] = (char)(0xC0 | (cp >> 6));
+            p[1] = (char)(0x80 | (cp & 0x3F));
+            e->len += 2;
+        }
+        else if (cp < 0x10000)
+        {
+            p[0] = (char)(0xE0 | (cp >> 12));
+            p[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            p[2] = (char)(0x80 | (cp & 0x3F));
+            e->len += 3;
+        }
+        else
+        {
+            p[0] = (char)(0xF0 | (cp >> 18));
+            p[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            p[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            p[3] = (char)(0x80 | (cp & 0x3F));
+            e->len += 4;
+        }
+    }
+    put(e, "\"", 1);
+}
+
+void
+eventlog_num(eventlog_t *e, const char *key, unsigned long long value)
+{
+    put_key(e, key);
+    put_num(e, value);
+}
+
+void
+eventlog_end(eventlog_t *e)
+{
+    put(e, "}\n", 2);
+    e->in_event = 0;
+}
@@ -0,0 +1,74 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stddef.h>
+#include <wchar.h>
+
+/* Size of the buffer events are formatted into */
+#define EVENTLOG_BUF_SIZE 8192
+
+/*
+ * Called to write out len bytes of formatted events. partial is nonzero
+ * if the data ends inside an event, which is then continued by the next
+ * write.
+ */
+typedef void (*eventlog_write_fn)(void *arg, const char *data, size_t len, int partial);
+
+/*
+ * A stream of events written as one JSON object per line. Events are
+ * formatted directly into a fixed buffer that is passed to the write
+ * function when it fills up or is flushed, so no memory is allocated.
+ * When the buffer fills up, the whole events in it are written and the
+ * event being formatted is moved to its start. Only an event that does
+ * not fit in the buffer by itself is split across writes.
+ */
+typedef struct
+{
+    char data[EVENTLOG_BUF_SIZE];
+    size_t len;   /* number of bytes not yet written */
+    size_t event; /* offset of the event being formatted */
+    int in_event; /* nonzero between eventlog_begin() and eventlog_end() */
+    eventlog_write_fn write;
+    void *arg;
+} eventlog_t;
+
+void eventlog_init(eventlog_t *e, eventlog_write_fn write, void *arg);
+
+/* Start an event with its "time" and "type" fields */
+void eventlog_begin(eventlog_t *e, unsigned long long timestamp, const char *type);
+
+/* Add a field with the len bytes of the UTF-8 string value */
+void eventlog_str(eventlog_t *e, const char *key, const char *value, size_t len);
+
+/* Add a field with the NUL terminated wide string value */
+void eventlog_wstr(eventlog_t *e, const char *key, const wchar_t *value);
+
+/* Add a field with the number value */
+void eventlog_num(eventlog_t *e, const char *key, unsigned long long value);
+
+/* End the event */
+void eventlog_end(eventlog_t *e);
+
+/* Write out all events formatted so far, including an unfinished one */
+void eventlog_flush(eventlog_t *e);
+
+#endif /* ifndef EVENTLOG_H */
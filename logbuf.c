@@ -0,0 +1,229 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logbuf.h"
+
+/* Number of entries allocated for the first lines added */
+#define LOGBUF_INITIAL_ALLOC 256
+
+void
+logbuf_init(logbuf_t *lb, size_t capacity)
+{
+    memset(lb, 0, sizeof(*lb));
+    lb->capacity = capacity;
+}
+
+void
+logbuf_free(logbuf_t *lb)
+{
+    for (size_t i = 0; i < lb->count; i++)
+    {
+        free(lb->lines[(lb->head + i) % lb->alloc].text);
+    }
+    free(lb->lines);
+    lb->lines = NULL;
+    lb->dropped += lb->count;
+    lb->alloc = lb->head = lb->count = 0;
+}
+
+/*
+ * Grow the array of entries while the buffer is not full. The lines
+ * only wrap around once capacity entries are allocated, so growing
+ * never has to move lines.
+ */
+static int
+logbuf_grow(logbuf_t *lb)
+{
+    size_t alloc = lb->alloc ? lb->alloc * 2 : LOGBUF_INITIAL_ALLOC;
+    log_line_t *lines;
+
+    if (alloc > lb->capacity)
+    {
+        alloc = lb->capacity;
+    }
+    lines = realloc(lb->lines, alloc * sizeof(*lines));
+    if (lines == NULL)
+    {
+        return 0;
+    }
+    lb->lines = lines;
+    lb->alloc = alloc;
+
+    return 1;
+}
+
+const log_line_t *
+logbuf_append(logbuf_t *lb, time_t timestamp, unsigned int flags, const char *text, size_t len)
+{
+    log_line_t *line;
+    char *copy;
+
+    if (lb->capacity == 0)
+    {
+        return NULL;
+    }
+    if (lb->count == lb->alloc && lb->alloc < lb->capacity && !logbuf_grow(lb))
+    {
+        return NULL;
+    }
+
+    copy = malloc(len + 1);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+
+    if (lb->count == lb->capacity)
+    {
+        /* full: reuse the entry of the oldest line */
+        line = &lb->lines[lb->head];
+        free(line->text);
+        lb->head = (lb->head + 1) % lb->alloc;
+        lb->dropped++;
+    }
+    else
+    {
+        line = &lb->lines[(lb->head + lb->count) % lb->alloc];
+        lb->count++;
+    }
+
+    line->timestamp = timestamp;
+    line->flags = flags;
+    line->text = copy;
+
+    return line;
+}
+
+unsigned int
+logbuf_parse_flags(const char *flags, size_t len)
+{
+    unsigned int result = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        switch (flags[i])
+        {
+            case 'W':
+                result |= LOG_LINE_WARNING;
+                break;
+
+            case 'N':
+                result |= LOG_LINE_ERROR;
+                break;
+
+            case 'F':
+                result |= LOG_LINE_ERROR | LOG_LINE_FATAL;
+                break;
+
+            case 'I':
+                result |= LOG_LINE_INFO;
+                break;
+
+            case 'D':
+                result |= LOG_LINE_DEBUG;
+                break;
+        }
+    }
+    return result;
+}
+
+const log_line_t *
+logbuf_get(const logbuf_t *lb, size_t i)
+{
+    if (i >= lb->count)
+    {
+        return NULL;
+    }
+    return &lb->lines[(lb->head + i) % lb->alloc];
+}
+
+/* Write the two digits of n to buf */
+static void
+put_2digits(wchar_t *buf, int n)
+{
+    buf[0] = L'0' + n / 10;
+    buf[1] = L'0' + n % 10;
+}
+
+void
+logbuf_format_date(log_date_t *date, time_t timestamp, wchar_t *buf)
+{
+    static const wchar_t days[] = L"SunMonTueWedThuFriSat";
+    static const wchar_t months[] = L"JanFebMarAprMayJunJulAugSepOctNovDec";
+    time_t delta = timestamp - date->time;
+    struct tm tm;
+
+    /* Time zone offsets and DST changes are whole minutes: within the
+     * same minute only the seconds differ from the cached date.
+     */
+    if (date->time != 0 && delta > -60 && delta < 60 && date->sec + delta >= 0
+        && date->sec + delta < 60)
+    {
+        date->sec += (int)delta;
+        date->time = timestamp;
+        put_2digits(date->text + 17, date->sec);
+    }
+#ifdef _WIN32
+    else if (localtime_s(&tm, &timestamp) == 0)
+#else
+    else if (localtime_r(&timestamp, &tm) != NULL)
+#endif
+    {
+        /* "Www Mmm dd hh:mm:ss yyyy" */
+        wmemcpy(date->text, days + 3 * tm.tm_wday, 3);
+        date->text[3] = L' ';
+        wmemcpy(date->text + 4, months + 3 * tm.tm_mon, 3);
+        date->text[7] = L' ';
+        put_2digits(date->text + 8, tm.tm_mday);
+        if (tm.tm_mday < 10)
+        {
+            date->text[8] = L' ';
+        }
+        date->text[10] = L' ';
+        put_2digits(date->text + 11, tm.tm_hour);
+        date->text[13] = L':';
+        put_2digits(date->text + 14, tm.tm_min);
+        date->text[16] = L':';
+        put_2digits(date->text + 17, tm.tm_sec);
+        date->text[19] = L' ';
+        put_2digits(date->text + 20, (tm.tm_year + 1900) / 100 % 100);
+        put_2digits(date->text + 22, (tm.tm_year + 1900) % 100);
+        date->text[LOG_DATE_LEN] = L'\0';
+        date->sec = tm.tm_sec;
+        date->time = timestamp;
+    }
+    else
+    {
+        /* not representable as local time */
+        wmemset(buf, L'?', LOG_DATE_LEN);
+        buf[LOG_DATE_LEN] = L'\0';
+        return;
+    }
+
+    wmemcpy(buf, date->text, LOG_DATE_LEN + 1);
+}
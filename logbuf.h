@@ -0,0 +1,108 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGBUF_H
+#define LOGBUF_H
+
+#include <stddef.h>
+#include <time.h>
+#include <wchar.h>
+
+/* log line flags */
+#define LOG_LINE_WARNING 0x01 /* W */
+#define LOG_LINE_ERROR   0x02 /* N or F */
+#define LOG_LINE_INFO    0x04 /* I */
+#define LOG_LINE_DEBUG   0x08 /* D */
+#define LOG_LINE_FATAL   0x10 /* F */
+
+/* Length of a date formatted like ctime() without the newline */
+#define LOG_DATE_LEN 24
+
+/* The last date formatted by logbuf_format_date() */
+typedef struct
+{
+    time_t time;                    /* timestamp of the cached date, 0 if none */
+    int sec;                        /* seconds of the cached date */
+    wchar_t text[LOG_DATE_LEN + 1]; /* "Www Mmm dd hh:mm:ss yyyy" */
+} log_date_t;
+
+typedef struct
+{
+    time_t timestamp;
+    unsigned int flags; /* LOG_LINE_* */
+    char *text;         /* UTF-8, NUL terminated */
+} log_line_t;
+
+/*
+ * A ring of log lines holding up to capacity lines. Once it is full,
+ * appending a line drops the oldest one. Lines are addressed by their
+ * index from the oldest line held. The sequence number of a line,
+ * dropped + index, stays the same while it is held.
+ */
+typedef struct
+{
+    log_line_t *lines;
+    size_t capacity;            /* maximum number of lines */
+    size_t alloc;               /* number of entries allocated in lines */
+    size_t head;                /* index of the oldest line in lines */
+    size_t count;               /* number of lines held */
+    unsigned long long dropped; /* number of lines dropped so far */
+    log_date_t date;            /* date cache of the thread using the buffer */
+} logbuf_t;
+
+/* Initialize an empty log buffer -- no memory is allocated until lines are added */
+void logbuf_init(logbuf_t *lb, size_t capacity);
+
+/*
+ * Free all lines and reset the buffer to hold no lines. The lines freed
+ * count as dropped, so that sequence numbers are not reused.
+ */
+void logbuf_free(logbuf_t *lb);
+
+/*
+ * Append a copy of the len bytes of text as a new line, dropping the
+ * oldest line if the buffer is full. Returns the line added or NULL
+ * on error.
+ */
+const log_line_t *logbuf_append(logbuf_t *lb,
+                                time_t timestamp,
+                                unsigned int flags,
+                                const char *text,
+                                size_t len);
+
+/*
+ * Return the LOG_LINE_* flags for the len characters of the flags field
+ * of a management log line, e.g. "W" or "I".
+ */
+unsigned int logbuf_parse_flags(const char *flags, size_t len);
+
+/* Return the i'th oldest line or NULL if there is no such line */
+const log_line_t *logbuf_get(const logbuf_t *lb, size_t i);
+
+/*
+ * Format timestamp as local time like ctime() without the trailing
+ * newline into buf, which must have room for LOG_DATE_LEN + 1 chars.
+ * The date is formatted with the fields of the last timestamp cached
+ * in date, so that lines logged in the same minute only have their
+ * seconds updated. Reentrant as long as date is not shared between
+ * threads.
+ */
+void logbuf_format_date(log_date_t *date, time_t timestamp, wchar_t *buf);
+
+#endif /* ifndef LOGBUF_H */
@@ -0,0 +1,160 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "logfilter.h"
+
+static inline int
+passes(const logfilter_t *f, unsigned int flags)
+{
+    return (f->show == 0 || (flags & f->show)) && !(flags & f->hide);
+}
+
+void
+logfilter_free(logfilter_t *f)
+{
+    free(f->seqs);
+    f->seqs = NULL;
+    f->first = f->count = f->alloc = 0;
+}
+
+/* Make room for n more entries */
+static int
+reserve(logfilter_t *f, size_t n)
+{
+    size_t alloc = f->alloc ? f->alloc : 256;
+    unsigned long long *seqs;
+
+    if (f->first + f->count + n <= f->alloc)
+    {
+        return 1;
+    }
+
+    /* reclaim the entries of dropped lines before growing */
+    if (f->first > 0)
+    {
+        memmove(f->seqs, f->seqs + f->first, f->count * sizeof(*f->seqs));
+        f->first = 0;
+        if (f->count + n <= f->alloc)
+        {
+            return 1;
+        }
+    }
+
+    while (alloc < f->count + n)
+    {
+        alloc *= 2;
+    }
+    seqs = realloc(f->seqs, alloc * sizeof(*seqs));
+    if (!seqs)
+    {
+        return 0;
+    }
+    f->seqs = seqs;
+    f->alloc = alloc;
+
+    return 1;
+}
+
+/* Add the lines of lb from index from on to the index */
+static int
+add_lines(logfilter_t *f, const logbuf_t *lb, size_t from)
+{
+    unsigned long long *out;
+
+    if (from >= lb->count)
+    {
+        return 1;
+    }
+    if (!reserve(f, lb->count - from))
+    {
+        return 0;
+    }
+    out = f->seqs + f->first + f->count;
+
+    /* the held lines are at most two runs of the ring */
+    for (size_t i = from; i < lb->count;)
+    {
+        size_t pos = (lb->head + i) % lb->alloc;
+        size_t end = pos + (lb->count - i);
+        unsigned long long seq = lb->dropped + i;
+
+        if (end > lb->alloc)
+        {
+            end = lb->alloc;
+        }
+        for (size_t j = pos; j < end; j++, seq++)
+        {
+            *out = seq;
+            out += passes(f, lb->lines[j].flags);
+        }
+        i += end - pos;
+    }
+
+    f->count = (size_t)(out - (f->seqs + f->first));
+    f->next = lb->dropped + lb->count;
+
+    return 1;
+}
+
+int
+logfilter_set(logfilter_t *f, const logbuf_t *lb, unsigned int show, unsigned int hide)
+{
+    f->show = show;
+    f->hide = hide;
+    f->first = f->count = 0;
+    f->next = lb->dropped;
+
+    return add_lines(f, lb, 0);
+}
+
+int
+logfilter_update(logfilter_t *f, const logbuf_t *lb, size_t *removed)
+{
+    size_t n = 0;
+
+    while (n < f->count && f->seqs[f->first + n] < lb->dropped)
+    {
+        n++;
+    }
+    f->first += n;
+    f->count -= n;
+    *removed = n;
+
+    if (f->next < lb->dropped)
+    {
+        f->next = lb->dropped;
+    }
+    return add_lines(f, lb, (size_t)(f->next - lb->dropped));
+}
+
+const log_line_t *
+logfilter_get(const logfilter_t *f, const logbuf_t *lb, size_t i)
+{
+    if (i >= f->count || f->seqs[f->first + i] < lb->dropped)
+    {
+        return NULL;
+    }
+    return logbuf_get(lb, (size_t)(f->seqs[f->first + i] - lb->dropped));
+}
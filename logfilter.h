@@ -0,0 +1,58 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGFILTER_H
+#define LOGFILTER_H
+
+#include "logbuf.h"
+
+/*
+ * The lines of a log buffer passing a filter, as an index of their
+ * sequence numbers. A line passes if it has any of the flags in show
+ * -- or show is 0 -- and none of the flags in hide. The index is built
+ * from the flags stored with the lines, so the text is not looked at.
+ */
+typedef struct
+{
+    unsigned int show;
+    unsigned int hide;
+    unsigned long long *seqs; /* sequence numbers of the lines passing */
+    size_t first;             /* index of the first entry in use in seqs */
+    size_t count;             /* number of entries in use */
+    size_t alloc;             /* number of entries allocated */
+    unsigned long long next;  /* sequence number of the next line to filter */
+} logfilter_t;
+
+/* Free the index. The filter passes no lines until it is set again. */
+void logfilter_free(logfilter_t *f);
+
+/* Change the filter and rebuild the index for the lines of lb. Returns 0 on error. */
+int logfilter_set(logfilter_t *f, const logbuf_t *lb, unsigned int show, unsigned int hide);
+
+/*
+ * Bring the index up to date with lb after lines were added or dropped.
+ * The number of entries removed from the start of the index, for lines
+ * dropped, is returned in *removed. Returns 0 on error.
+ */
+int logfilter_update(logfilter_t *f, const logbuf_t *lb, size_t *removed);
+
+/* Return the i'th line passing the filter or NULL if there is no such line */
+const log_line_t *logfilter_get(const logfilter_t *f, const logbuf_t *lb, size_t i);
+
+#endif /* ifndef LOGFILTER_H */
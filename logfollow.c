@@ -0,0 +1,288 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logfollow.h"
+
+#define LOGFOLLOW_BUF_SIZE (64 * 1024)
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+static FILE *
+open_file(const wchar_t *path)
+{
+#ifdef _WIN32
+    /* allows the writer to keep the log open */
+    return _wfopen(path, L"rb");
+#else
+    char name[4096];
+
+    if (wcstombs(name, path, sizeof(name)) >= sizeof(name))
+    {
+        return NULL;
+    }
+    return fopen(name, "rb");
+#endif
+}
+
+/* FNV-1a */
+static uint64_t
+hash_head(const char *data, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * Check whether the log starts with the head recorded in pos, which any
+ * log does if no head is recorded yet. If it does and the recorded head
+ * is shorter than LOGFOLLOW_HEAD_SIZE, it is extended to the bytes now
+ * in the log.
+ */
+static int
+same_log(FILE *log, logfollow_pos_t *pos)
+{
+    char head[LOGFOLLOW_HEAD_SIZE];
+    size_t n;
+
+    if (fseek64(log, 0, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+    n = fread(head, 1, sizeof(head), log);
+    if (pos->head_len > 0
+        && (n < pos->head_len || hash_head(head, pos->head_len) != pos->head_hash))
+    {
+        return 0;
+    }
+    pos->head_len = (uint32_t)n;
+    pos->head_hash = hash_head(head, n);
+
+    return 1;
+}
+
+/* Read the complete lines of log from pos->offset to its end */
+static long
+read_lines(FILE *log, logfollow_pos_t *pos, uint64_t max_backlog, logfollow_fn fn, void *arg)
+{
+    char *buf = malloc(LOGFOLLOW_BUF_SIZE);
+    uint64_t size, offset = pos->offset;
+    size_t have = 0;
+    int skip = 0;
+    long lines = 0;
+
+    if (!buf || fseek64(log, 0, SEEK_END) != 0)
+    {
+        free(buf);
+        return -1;
+    }
+    size = (uint64_t)ftell64(log);
+    if (offset > size)
+    {
+        offset = size;
+    }
+
+    /* skip to the first complete line of the backlog */
+    if (size - offset > max_backlog)
+    {
+        offset = size - max_backlog;
+        skip = 1;
+    }
+    if (fseek64(log, (int64_t)offset, SEEK_SET) != 0)
+    {
+        free(buf);
+        return -1;
+    }
+
+    for (;;)
+    {
+        size_t n = fread(buf + have, 1, LOGFOLLOW_BUF_SIZE - have, log);
+        size_t start = 0;
+
+        if (n == 0)
+        {
+            break;
+        }
+        have += n;
+
+        for (;;)
+        {
+            char *lf = memchr(buf + start, '\n', have - start);
+            size_t len;
+
+            if (!lf)
+            {
+                break;
+            }
+            len = (size_t)(lf - (buf + start));
+            if (skip)
+            {
+                skip = 0;
+            }
+            else
+            {
+                if (fn)
+                {
+                    fn(arg, buf + start, len - (len > 0 && lf[-1] == '\r'));
+                }
+                lines++;
+            }
+            start += len + 1;
+        }
+
+        if (start == 0 && have == LOGFOLLOW_BUF_SIZE)
+        {
+            /* an overlong line: pass it on in pieces */
+            if (fn && !skip)
+            {
+                fn(arg, buf, have);
+            }
+            start = have;
+        }
+
+        /* keep the incomplete last line for the next read */
+        offset += start;
+        memmove(buf, buf + start, have - start);
+        have -= start;
+    }
+
+    free(buf);
+    pos->offset = offset;
+    return lines;
+}
+
+long
+logfollow_read(logfollow_pos_t *pos,
+               const wchar_t *path,
+               const wchar_t *rotated_path,
+               uint64_t max_backlog,
+               logfollow_fn fn,
+               void *arg)
+{
+    FILE *log = open_file(path);
+    long lines = 0;
+    long n;
+
+    if (!log)
+    {
+        return -1;
+    }
+
+    if (pos->head_len > 0 && !same_log(log, pos))
+    {
+        FILE *old = rotated_path ? open_file(rotated_path) : NULL;
+
+        /* finish reading the log before it was rotated */
+        if (old && same_log(old, pos))
+        {
+            n = read_lines(old, pos, max_backlog, fn, arg);
+            lines += n > 0 ? n : 0;
+        }
+        if (old)
+        {
+            fclose(old);
+        }
+        memset(pos, 0, sizeof(*pos));
+    }
+    if (fseek64(log, 0, SEEK_END) != 0 || (uint64_t)ftell64(log) < pos->offset)
+    {
+        memset(pos, 0, sizeof(*pos)); /* truncated */
+    }
+    if (pos->head_len == 0)
+    {
+        same_log(log, pos); /* record the head of the log */
+    }
+
+    n = read_lines(log, pos, max_backlog, fn, arg);
+    fclose(log);
+
+    return n < 0 ? -1 : lines + n;
+}
+
+/* Parse n digits at s, returning -1 if they are not all digits */
+static int
+digits(const char *s, int n)
+{
+    int value = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (s[i] < '0' || s[i] > '9')
+        {
+            return -1;
+        }
+        value = value * 10 + (s[i] - '0');
+    }
+    return value;
+}
+
+time_t
+logfollow_line_time(logfollow_time_t *cache, const char *line, size_t len, size_t *prefix_len)
+{
+    struct tm tm = { 0 };
+    int sec;
+
+    /* "YYYY-MM-DD hh:mm:ss " */
+    if (len < 20 || line[4] != '-' || line[7] != '-' || line[10] != ' ' || line[13] != ':'
+        || line[16] != ':' || line[19] != ' ' || (sec = digits(line + 17, 2)) < 0 || sec > 60)
+    {
+        return 0;
+    }
+
+    if (cache->time == 0 || memcmp(cache->minute, line, sizeof(cache->minute)) != 0)
+    {
+        tm.tm_year = digits(line, 4) - 1900;
+        tm.tm_mon = digits(line + 5, 2) - 1;
+        tm.tm_mday = digits(line + 8, 2);
+        tm.tm_hour = digits(line + 11, 2);
+        tm.tm_min = digits(line + 14, 2);
+        tm.tm_isdst = -1;
+        if (tm.tm_year < 0 || tm.tm_mon < 0 || tm.tm_mday < 0 || tm.tm_hour < 0 || tm.tm_min < 0)
+        {
+            return 0;
+        }
+        cache->time = mktime(&tm);
+        if (cache->time == (time_t)-1)
+        {
+            cache->time = 0;
+            return 0;
+        }
+        memcpy(cache->minute, line, sizeof(cache->minute));
+    }
+
+    *prefix_len = 20;
+    return cache->time + sec;
+}
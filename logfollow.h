@@ -0,0 +1,85 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGFOLLOW_H
+#define LOGFOLLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <wchar.h>
+
+/* Number of bytes at the start of a log identifying it */
+#define LOGFOLLOW_HEAD_SIZE 256
+
+/*
+ * Position of a reader in a log file that is appended to by another
+ * process. It is a plain struct so that it can be saved and restored.
+ */
+typedef struct
+{
+    uint64_t offset;    /* offset after the last complete line read */
+    uint64_t head_hash; /* hash of the first head_len bytes of the log */
+    uint32_t head_len;  /* 0 if nothing was read yet */
+    uint32_t reserved;
+} logfollow_pos_t;
+
+/* Called for every line read with the line without its terminator */
+typedef void (*logfollow_fn)(void *arg, const char *line, size_t len);
+
+/*
+ * Read the complete lines added to the log at path since pos, calling
+ * fn for each of them unless fn is NULL, and advance pos past them.
+ *
+ * If the log no longer starts with the bytes it started with when pos
+ * was recorded, it was rotated or replaced: if rotated_path is not NULL
+ * and names the previous log, the rest of that is read first; then the
+ * log is read from its start. A log shorter than pos was truncated and
+ * is also read from its start. At most max_backlog bytes are read: the
+ * lines before those are skipped.
+ *
+ * Returns the number of lines read or -1 if the log cannot be read.
+ */
+long logfollow_read(logfollow_pos_t *pos,
+                    const wchar_t *path,
+                    const wchar_t *rotated_path,
+                    uint64_t max_backlog,
+                    logfollow_fn fn,
+                    void *arg);
+
+/* The minute of the last time parsed by logfollow_line_time() */
+typedef struct
+{
+    char minute[16]; /* "YYYY-MM-DD hh:mm" */
+    time_t time;     /* time of the minute, 0 if none */
+} logfollow_time_t;
+
+/*
+ * Return the local time of a line starting with "YYYY-MM-DD hh:mm:ss "
+ * as written by openvpn to log files, and the length of that prefix in
+ * *prefix_len. Returns 0 if the line does not start with a time. The
+ * minute is cached in cache, so that lines logged in the same minute
+ * are not converted again.
+ */
+time_t logfollow_line_time(logfollow_time_t *cache,
+                           const char *line,
+                           size_t len,
+                           size_t *prefix_len);
+
+#endif /* ifndef LOGFOLLOW_H */
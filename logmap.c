@@ -0,0 +1,503 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "logmap.h"
+
+/* Views start at a multiple of the allocation granularity of Windows */
+#define LOGMAP_VIEW_ALIGN (64 * 1024)
+
+/* Number of bytes searched at a time: a chunk always fits in one view */
+#define LOGMAP_CHUNK (LOGMAP_VIEW_SIZE - LOGMAP_VIEW_ALIGN)
+
+#ifdef _WIN32
+
+static void
+unmap_view(logmap_t *m)
+{
+    if (m->view)
+    {
+        UnmapViewOfFile(m->view);
+    }
+    m->view = NULL;
+    m->offset = 0;
+    m->len = 0;
+}
+
+static void
+logmap_unmap(logmap_t *m)
+{
+    unmap_view(m);
+    if (m->mapping)
+    {
+        CloseHandle(m->mapping);
+    }
+    m->mapping = NULL;
+    m->size = 0;
+}
+
+/* Replace the view by one of len bytes at offset */
+static int
+map_view(logmap_t *m, uint64_t offset, size_t len)
+{
+    unmap_view(m);
+    if (!m->mapping)
+    {
+        m->mapping = CreateFileMappingW(
+            m->file, NULL, PAGE_READONLY, (DWORD)(m->size >> 32), (DWORD)m->size, NULL);
+        if (!m->mapping)
+        {
+            return 0;
+        }
+    }
+    m->view = MapViewOfFile(m->mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, len);
+    if (!m->view)
+    {
+        return 0;
+    }
+    m->offset = offset;
+    m->len = len;
+
+    return 1;
+}
+
+int
+logmap_open(logmap_t *m, const wchar_t *path)
+{
+    memset(m, 0, sizeof(*m));
+    m->file = CreateFileW(path,
+                          GENERIC_READ,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          NULL,
+                          OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL,
+                          NULL);
+    if (m->file == INVALID_HANDLE_VALUE)
+    {
+        m->file = NULL;
+        return 0;
+    }
+    if (logmap_remap(m) < 0)
+    {
+        logmap_close(m);
+        return 0;
+    }
+    return 1;
+}
+
+int
+logmap_remap(logmap_t *m)
+{
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m->file, &size) || (uint64_t)size.QuadPart < m->size)
+    {
+        logmap_unmap(m);
+        return -1;
+    }
+    if ((uint64_t)size.QuadPart == m->size)
+    {
+        return 0;
+    }
+
+    /* The file only grows, so the current view stays valid. A mapping
+     * of the new size is created when the next view is mapped. */
+    if (m->mapping)
+    {
+        CloseHandle(m->mapping);
+        m->mapping = NULL;
+    }
+    m->size = (uint64_t)size.QuadPart;
+
+    return 1;
+}
+
+void
+logmap_close(logmap_t *m)
+{
+    logmap_unmap(m);
+    if (m->file)
+    {
+        CloseHandle(m->file);
+    }
+    m->file = NULL;
+}
+
+#else /* ifdef _WIN32 */
+
+static void
+unmap_view(logmap_t *m)
+{
+    if (m->view)
+    {
+        munmap((void *)m->view, m->len);
+    }
+    m->view = NULL;
+    m->offset = 0;
+    m->len = 0;
+}
+
+static void
+logmap_unmap(logmap_t *m)
+{
+    unmap_view(m);
+    m->size = 0;
+}
+
+/* Replace the view by one of len bytes at offset */
+static int
+map_view(logmap_t *m, uint64_t offset, size_t len)
+{
+    void *data;
+
+    unmap_view(m);
+    data = mmap(NULL, len, PROT_READ, MAP_SHARED, m->fd, (off_t)offset);
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    m->view = data;
+    m->offset = offset;
+    m->len = len;
+
+    return 1;
+}
+
+int
+logmap_open(logmap_t *m, const wchar_t *path)
+{
+    char name[4096];
+
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+    if (wcstombs(name, path, sizeof(name)) >= sizeof(name))
+    {
+        return 0;
+    }
+    m->fd = open(name, O_RDONLY);
+    if (m->fd < 0 || logmap_remap(m) < 0)
+    {
+        logmap_close(m);
+        return 0;
+    }
+    return 1;
+}
+
+int
+logmap_remap(logmap_t *m)
+{
+    struct stat st;
+
+    if (fstat(m->fd, &st) != 0 || (uint64_t)st.st_size < m->size)
+    {
+        logmap_unmap(m);
+        return -1;
+    }
+    if ((uint64_t)st.st_size == m->size)
+    {
+        return 0;
+    }
+
+    /* the file only grows, so the current view stays valid */
+    m->size = (uint64_t)st.st_size;
+
+    return 1;
+}
+
+void
+logmap_close(logmap_t *m)
+{
+    logmap_unmap(m);
+    if (m->fd >= 0)
+    {
+        close(m->fd);
+    }
+    m->fd = -1;
+}
+
+#endif /* ifdef _WIN32 */
+
+/*
+ * Return a pointer to the len bytes of the log at offset, moving the
+ * view there unless they are in it already. len must be between 1 and
+ * LOGMAP_CHUNK. Returns NULL on error.
+ */
+static const char *
+logmap_at(logmap_t *m, uint64_t offset, size_t len)
+{
+    uint64_t start;
+
+    if (offset + len > m->size)
+    {
+        return NULL;
+    }
+    if (!m->view || offset < m->offset || offset + len > m->offset + m->len)
+    {
+        start = offset - offset % LOGMAP_VIEW_ALIGN;
+        if (!map_view(m,
+                      start,
+                      (size_t)(m->size - start < LOGMAP_VIEW_SIZE ? m->size - start
+                                                                  : LOGMAP_VIEW_SIZE)))
+        {
+            return NULL;
+        }
+    }
+    return m->view + (offset - m->offset);
+}
+
+/*
+ * Find the first line feed between the offsets from and to. Returns 1
+ * and its offset in *pos if found, 0 if not, and -1 on error.
+ */
+static int
+find_lf(logmap_t *m, uint64_t from, uint64_t to, uint64_t *pos)
+{
+    while (from < to)
+    {
+        size_t len = (size_t)(to - from < LOGMAP_CHUNK ? to - from : LOGMAP_CHUNK);
+        const char *data = logmap_at(m, from, len);
+        const char *lf;
+
+        if (!data)
+        {
+            return -1;
+        }
+        lf = memchr(data, '\n', len);
+        if (lf)
+        {
+            *pos = from + (uint64_t)(lf - data);
+            return 1;
+        }
+        from += len;
+    }
+    return 0;
+}
+
+/* Like find_lf(), but find the last line feed between from and to */
+static int
+find_lf_back(logmap_t *m, uint64_t from, uint64_t to, uint64_t *pos)
+{
+    while (from < to)
+    {
+        size_t len = (size_t)(to - from < LOGMAP_CHUNK ? to - from : LOGMAP_CHUNK);
+        const char *data = logmap_at(m, to - len, len);
+
+        if (!data)
+        {
+            return -1;
+        }
+        for (size_t i = len; i > 0; i--)
+        {
+            if (data[i - 1] == '\n')
+            {
+                *pos = to - len + i - 1;
+                return 1;
+            }
+        }
+        to -= len;
+    }
+    return 0;
+}
+
+uint64_t
+logmap_tail(logmap_t *m, uint64_t n)
+{
+    uint64_t lf;
+
+    /* skip an incomplete last line */
+    if (find_lf_back(m, 0, m->size, &lf) <= 0)
+    {
+        return 0;
+    }
+
+    /* go back from the line feed ending a line to the one before it */
+    for (; n > 0; n--)
+    {
+        if (find_lf_back(m, 0, lf, &lf) <= 0)
+        {
+            return 0;
+        }
+    }
+    return lf + 1;
+}
+
+int
+logmap_lines_init(logmap_lines_t *l, uint64_t base)
+{
+    memset(l, 0, sizeof(*l));
+    l->base = l->end = l->scanned = base;
+    l->alloc = 64;
+    l->marks = malloc(l->alloc * sizeof(*l->marks));
+    if (!l->marks)
+    {
+        return 0;
+    }
+    l->marks[l->nmarks++] = base;
+
+    return 1;
+}
+
+void
+logmap_lines_free(logmap_lines_t *l)
+{
+    free(l->marks);
+    memset(l, 0, sizeof(*l));
+}
+
+int
+logmap_lines_scan(logmap_lines_t *l, logmap_t *m, uint64_t max)
+{
+    uint64_t stop = m->size;
+    uint64_t lf;
+
+    if (l->scanned > m->size)
+    {
+        return -1; /* index of a different mapping */
+    }
+    if (stop - l->scanned > max)
+    {
+        stop = l->scanned + max;
+    }
+
+    while (l->scanned < stop)
+    {
+        int found = find_lf(m, l->scanned, stop, &lf);
+
+        if (found < 0)
+        {
+            return -1;
+        }
+        if (!found)
+        {
+            l->scanned = stop;
+            break;
+        }
+        l->scanned = l->end = lf + 1;
+        l->count++;
+
+        if (l->count % LOGMAP_STRIDE == 0)
+        {
+            if (l->nmarks == l->alloc)
+            {
+                uint64_t *marks = realloc(l->marks, 2 * l->alloc * sizeof(*marks));
+                if (!marks)
+                {
+                    return -1;
+                }
+                l->marks = marks;
+                l->alloc *= 2;
+            }
+            l->marks[l->nmarks++] = l->end;
+        }
+    }
+
+    return l->scanned == m->size;
+}
+
+const char *
+logmap_line(logmap_t *m, const logmap_lines_t *l, uint64_t n, size_t *len)
+{
+    uint64_t pos, lf;
+    const char *line;
+
+    if (n >= l->count || l->end > m->size)
+    {
+        return NULL;
+    }
+
+    /* lines between the marks are found by scanning for their ends */
+    pos = l->marks[n / LOGMAP_STRIDE];
+    for (n %= LOGMAP_STRIDE; n > 0; n--)
+    {
+        if (find_lf(m, pos, l->end, &lf) <= 0)
+        {
+            return NULL; /* the file changed under the index */
+        }
+        pos = lf + 1;
+    }
+    if (find_lf(m, pos, l->end, &lf) <= 0)
+    {
+        return NULL;
+    }
+
+    if (lf - pos > LOGMAP_MAX_LINE)
+    {
+        *len = LOGMAP_MAX_LINE;
+        return logmap_at(m, pos, *len);
+    }
+
+    /* map the line with its line feed, so that an empty line is mapped too */
+    *len = (size_t)(lf - pos);
+    line = logmap_at(m, pos, *len + 1);
+    if (line && *len > 0 && line[*len - 1] == '\r')
+    {
+        (*len)--;
+    }
+    return line;
+}
+
+uint64_t
+logmap_line_number(logmap_t *m, const logmap_lines_t *l, uint64_t offset)
+{
+    size_t lo = 0, hi = l->nmarks;
+    uint64_t pos, lf, n;
+
+    if (offset > l->end)
+    {
+        offset = l->end;
+    }
+
+    /* the last mark at or before offset */
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (l->marks[mid] <= offset)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    n = (uint64_t)lo * LOGMAP_STRIDE;
+    for (pos = l->marks[lo]; pos < offset; n++)
+    {
+        if (find_lf(m, pos, offset, &lf) <= 0)
+        {
+            break;
+        }
+        pos = lf + 1;
+    }
+    return n;
+}
@@ -0,0 +1,114 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGMAP_H
+#define LOGMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* Number of lines between two offsets kept in a line index */
+#define LOGMAP_STRIDE 256
+
+/*
+ * Size of the part of the log mapped at a time. Only one view of this
+ * size is mapped, so that logs larger than the address space of a
+ * 32-bit process can be shown.
+ */
+#define LOGMAP_VIEW_SIZE (32 * 1024 * 1024)
+
+/* Lines longer than this are cut by logmap_line() */
+#define LOGMAP_MAX_LINE (64 * 1024)
+
+/* A read-only memory mapping of a growing log file, one view at a time */
+typedef struct
+{
+#ifdef _WIN32
+    void *file;    /* HANDLE of the file */
+    void *mapping; /* HANDLE of the file mapping, created on demand */
+#else
+    int fd;
+#endif
+    uint64_t size;    /* size of the file when last checked */
+    const char *view; /* mapped part of the file, NULL if none */
+    uint64_t offset;  /* offset of the view in the file */
+    size_t len;       /* length of the view */
+} logmap_t;
+
+/*
+ * A sparse index of the lines of a mapped log starting at offset base.
+ * Only complete lines -- ending with a line feed -- are counted.
+ */
+typedef struct
+{
+    uint64_t base;    /* offset of line 0 */
+    uint64_t end;     /* offset after the last line counted */
+    uint64_t scanned; /* offset up to which the log was scanned */
+    uint64_t count;   /* number of lines */
+    uint64_t *marks;  /* marks[k] is the offset of line k * LOGMAP_STRIDE */
+    size_t nmarks;
+    size_t alloc;
+} logmap_lines_t;
+
+/*
+ * Map the file at path. The file is opened allowing others to write,
+ * rename and delete it. Returns 0 on error.
+ */
+int logmap_open(logmap_t *m, const wchar_t *path);
+
+/*
+ * Extend the mapping to the current size of the file. Returns 1 if the
+ * file grew, 0 if it did not change, and -1 on error or if the file
+ * was truncated, in which case the mapping is empty.
+ *
+ * The functions below map the view they need as they go, so pointers
+ * into the log they return are only valid until the next call with the
+ * same mapping.
+ */
+int logmap_remap(logmap_t *m);
+
+void logmap_close(logmap_t *m);
+
+/* Return the offset of the first of the last n complete lines */
+uint64_t logmap_tail(logmap_t *m, uint64_t n);
+
+/* Initialize an empty index of the lines starting at base. Returns 0 on error. */
+int logmap_lines_init(logmap_lines_t *l, uint64_t base);
+
+void logmap_lines_free(logmap_lines_t *l);
+
+/*
+ * Index the lines of the mapping not indexed yet, scanning at most max
+ * bytes. Returns 1 once all of the mapping is scanned, 0 if there is
+ * more to scan, and -1 on error.
+ */
+int logmap_lines_scan(logmap_lines_t *l, logmap_t *m, uint64_t max);
+
+/*
+ * Return the n'th line indexed in l and its length without the line
+ * terminator in *len, or NULL if there is no such line. At most
+ * LOGMAP_MAX_LINE bytes of a line are returned.
+ */
+const char *logmap_line(logmap_t *m, const logmap_lines_t *l, uint64_t n, size_t *len);
+
+/* Return the number of the line indexed in l starting at offset */
+uint64_t logmap_line_number(logmap_t *m, const logmap_lines_t *l, uint64_t offset);
+
+#endif /* ifndef LOGMAP_H */
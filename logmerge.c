@@ -0,0 +1,230 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "logmerge.h"
+
+/* Return the next line of source i */
+static inline const log_line_t *
+source_line(const logmerge_t *m, size_t i)
+{
+    const logmerge_source_t *s = &m->sources[i];
+    return logbuf_get(s->lb, (size_t)(s->next - s->lb->dropped));
+}
+
+/* Return true if node a goes before node b */
+static inline int
+node_before(const struct logmerge_node *a, const struct logmerge_node *b)
+{
+    return a->timestamp < b->timestamp || (a->timestamp == b->timestamp && a->source < b->source);
+}
+
+static void
+sift_down(logmerge_t *m, size_t i)
+{
+    struct logmerge_node node = m->heap[i];
+
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+
+        if (child >= m->len)
+        {
+            break;
+        }
+        if (child + 1 < m->len && node_before(&m->heap[child + 1], &m->heap[child]))
+        {
+            child++;
+        }
+        if (!node_before(&m->heap[child], &node))
+        {
+            break;
+        }
+        m->heap[i] = m->heap[child];
+        i = child;
+    }
+    m->heap[i] = node;
+}
+
+int
+logmerge_init(logmerge_t *m, logmerge_source_t *sources, size_t count)
+{
+    m->sources = sources;
+    m->len = 0;
+    m->heap = malloc((count ? count : 1) * sizeof(*m->heap));
+    if (!m->heap)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        logmerge_source_t *s = &sources[i];
+
+        /* lines dropped from the buffer can no longer be merged */
+        if (s->next < s->lb->dropped)
+        {
+            s->next = s->lb->dropped;
+        }
+        if (s->end > s->lb->dropped + s->lb->count)
+        {
+            s->end = s->lb->dropped + s->lb->count;
+        }
+        if (s->next < s->end)
+        {
+            m->heap[m->len].source = i;
+            m->heap[m->len].timestamp = source_line(m, i)->timestamp;
+            m->len++;
+        }
+    }
+    for (size_t i = m->len / 2; i-- > 0;)
+    {
+        sift_down(m, i);
+    }
+
+    return 1;
+}
+
+void
+logmerge_free(logmerge_t *m)
+{
+    free(m->heap);
+    m->heap = NULL;
+    m->len = 0;
+}
+
+const log_line_t *
+logmerge_next(logmerge_t *m, size_t *source, unsigned long long *seq)
+{
+    const log_line_t *line;
+    logmerge_source_t *s;
+
+    if (m->len == 0)
+    {
+        return NULL;
+    }
+
+    *source = m->heap[0].source;
+    s = &m->sources[*source];
+    line = source_line(m, *source);
+    *seq = s->next++;
+
+    /* advance the source or remove it once it has no lines left */
+    if (s->next < s->end)
+    {
+        m->heap[0].timestamp = source_line(m, *source)->timestamp;
+    }
+    else
+    {
+        m->heap[0] = m->heap[--m->len];
+    }
+    if (m->len > 0)
+    {
+        sift_down(m, 0);
+    }
+
+    return line;
+}
+
+int
+logmerge_row_before(const logmerge_row_t *a, const logmerge_row_t *b)
+{
+    if (a->timestamp != b->timestamp)
+    {
+        return a->timestamp < b->timestamp;
+    }
+    if (a->source != b->source)
+    {
+        return a->source < b->source;
+    }
+    return a->seq < b->seq;
+}
+
+static int
+compare_rows(const void *a, const void *b)
+{
+    return logmerge_row_before(a, b) ? -1 : logmerge_row_before(b, a);
+}
+
+size_t
+logmerge_insert(logmerge_row_t *rows, size_t first, size_t count, size_t top)
+{
+    size_t lo = 0, hi = first;
+    size_t moved = 0;
+    size_t i, j, k;
+    logmerge_row_t *tmp;
+
+    for (i = first + 1; i < count; i++)
+    {
+        if (logmerge_row_before(&rows[i], &rows[i - 1]))
+        {
+            qsort(rows + first, count - first, sizeof(*rows), compare_rows);
+            break;
+        }
+    }
+    if (first == 0 || first == count || !logmerge_row_before(&rows[first], &rows[first - 1]))
+    {
+        return 0;
+    }
+
+    /* the rows after the position of the first new row */
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (logmerge_row_before(&rows[first], &rows[mid]))
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    tmp = malloc((count - lo) * sizeof(*tmp));
+    if (!tmp)
+    {
+        return 0;
+    }
+    for (i = lo, j = first, k = 0; i < first || j < count; k++)
+    {
+        if (i < first && (j == count || !logmerge_row_before(&rows[j], &rows[i])))
+        {
+            tmp[k] = rows[i++];
+        }
+        else
+        {
+            /* before row top unless that was taken already */
+            if (i <= top)
+            {
+                moved++;
+            }
+            tmp[k] = rows[j++];
+        }
+    }
+    memcpy(rows + lo, tmp, (count - lo) * sizeof(*tmp));
+    free(tmp);
+
+    return moved;
+}
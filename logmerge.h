@@ -0,0 +1,91 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGMERGE_H
+#define LOGMERGE_H
+
+#include "logbuf.h"
+
+/* A range of lines of a log buffer to merge, by sequence number */
+typedef struct
+{
+    const logbuf_t *lb;
+    unsigned long long next; /* sequence number of the next line to merge */
+    unsigned long long end;  /* sequence number after the last line to merge */
+} logmerge_source_t;
+
+/*
+ * Merge of log buffers ordered by timestamp. The lines of each buffer
+ * are expected in timestamp order; lines with equal timestamps are
+ * taken in the order of the sources. Lines are not copied: the buffers
+ * must not change while the merge is in use.
+ */
+typedef struct
+{
+    logmerge_source_t *sources;
+    struct logmerge_node
+    {
+        time_t timestamp; /* timestamp of the next line of the source */
+        size_t source;
+    } *heap;    /* sources with lines left, the next line to merge on top */
+    size_t len; /* number of sources in heap */
+} logmerge_t;
+
+/*
+ * Start merging the lines of count sources. The sources are advanced
+ * as lines are merged. Returns 0 on error.
+ */
+int logmerge_init(logmerge_t *m, logmerge_source_t *sources, size_t count);
+
+void logmerge_free(logmerge_t *m);
+
+/*
+ * Return the next line in timestamp order, or NULL when all lines are
+ * merged. The index of its source and its sequence number are returned
+ * in *source and *seq.
+ */
+const log_line_t *logmerge_next(logmerge_t *m, size_t *source, unsigned long long *seq);
+
+/*
+ * A merged line kept as a row of a merged view. Rows are ordered by
+ * timestamp, then by source, then by sequence number.
+ */
+typedef struct
+{
+    time_t timestamp;
+    size_t source;          /* index of the source, SIZE_MAX if it is gone */
+    unsigned long long seq; /* sequence number of the line in its buffer */
+    void *owner;            /* what the buffer belongs to, e.g., a connection */
+} logmerge_row_t;
+
+/* Return true if row a goes before row b */
+int logmerge_row_before(const logmerge_row_t *a, const logmerge_row_t *b);
+
+/*
+ * Insert rows first..count-1, a batch of newly merged lines, into the
+ * ordered rows before them. Lines may be older than lines merged
+ * before, e.g., history sent late, and a buffer may not be in timestamp
+ * order, so the batch is sorted first if needed. Only the rows after
+ * the position of the earliest new row are moved. Returns the number of
+ * new rows placed before row top. On error the rows are left out of
+ * order.
+ */
+size_t logmerge_insert(logmerge_row_t *rows, size_t first, size_t count, size_t top);
+
+#endif /* ifndef LOGMERGE_H */
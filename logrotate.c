@@ -0,0 +1,304 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <wchar.h>
+#include <wctype.h>
+#include "logrotate.h"
+
+#ifdef _WIN32
+#include "main.h"
+#include "options.h"
+
+extern options_t o;
+#endif
+
+#ifndef MAX_PATH
+#define MAX_PATH 4096
+#endif
+
+/* Whether path ends in ext, ignoring case */
+static int
+has_ext(const wchar_t *path, const wchar_t *ext)
+{
+    size_t len = wcslen(path), ext_len = wcslen(ext);
+
+    if (len < ext_len)
+    {
+        return 0;
+    }
+    path += len - ext_len;
+    for (; *ext; path++, ext++)
+    {
+        if (towlower(*path) != (wint_t)*ext)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+logrotate_path(wchar_t *buf, size_t len, const wchar_t *path, unsigned long n)
+{
+    const wchar_t *ext = has_ext(path, L".log") ? L".log" : has_ext(path, L".jsonl") ? L".jsonl"
+                                                                                      : NULL;
+    int res;
+
+    if (n == 0)
+    {
+        res = swprintf(buf, len, L"%ls", path);
+    }
+    else if (ext)
+    {
+        /* keep the extension so that the file opens like the log */
+        int base = (int)(wcslen(path) - wcslen(ext));
+
+        res = swprintf(buf, len, L"%.*ls.%lu%ls", base, path, n, path + base);
+    }
+    else
+    {
+        res = swprintf(buf, len, L"%ls.%lu", path, n);
+    }
+    return res >= 0 && (size_t)res < len;
+}
+
+#ifdef _WIN32
+
+static int
+file_size(const wchar_t *path, uint64_t *size)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &fa))
+    {
+        return 0;
+    }
+    *size = ((uint64_t)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+    return 1;
+}
+
+static int
+move_file(const wchar_t *from, const wchar_t *to)
+{
+    return MoveFileExW(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static int
+delete_file(const wchar_t *path)
+{
+    return DeleteFileW(path) != 0;
+}
+
+#else /* ifdef _WIN32 */
+
+static int
+to_mb(char *buf, const wchar_t *path)
+{
+    return wcstombs(buf, path, MAX_PATH) < MAX_PATH;
+}
+
+static int
+file_size(const wchar_t *path, uint64_t *size)
+{
+    char name[MAX_PATH];
+    struct stat st;
+
+    if (!to_mb(name, path) || stat(name, &st) != 0)
+    {
+        return 0;
+    }
+    *size = (uint64_t)st.st_size;
+    return 1;
+}
+
+static int
+move_file(const wchar_t *from, const wchar_t *to)
+{
+    char from_name[MAX_PATH], to_name[MAX_PATH];
+
+    return to_mb(from_name, from) && to_mb(to_name, to) && rename(from_name, to_name) == 0;
+}
+
+static int
+delete_file(const wchar_t *path)
+{
+    char name[MAX_PATH];
+
+    return to_mb(name, path) && unlink(name) == 0;
+}
+
+#endif /* ifdef _WIN32 */
+
+/* Move the search index of a log along with it, or delete it if to is NULL */
+static void
+move_index(const wchar_t *from, const wchar_t *to)
+{
+    wchar_t from_idx[MAX_PATH + 4];
+    wchar_t to_idx[MAX_PATH + 4];
+
+    swprintf(from_idx, MAX_PATH + 4, L"%ls.idx", from);
+    if (!to)
+    {
+        delete_file(from_idx);
+        return;
+    }
+    swprintf(to_idx, MAX_PATH + 4, L"%ls.idx", to);
+    if (!move_file(from_idx, to_idx))
+    {
+        delete_file(to_idx);
+    }
+}
+
+int
+logrotate(const wchar_t *path, uint64_t max_size, unsigned long count)
+{
+    wchar_t from[MAX_PATH];
+    wchar_t to[MAX_PATH];
+    wchar_t pending[MAX_PATH];
+    uint64_t size;
+
+    if (max_size == 0 || count == 0 || !file_size(path, &size) || size < max_size)
+    {
+        return LOGROTATE_NOT_DUE;
+    }
+    count = count < LOGROTATE_MAX_COUNT ? count : LOGROTATE_MAX_COUNT;
+
+    /* Move the log out of the way first, so that the generations are
+     * left alone while it is still open */
+    if (swprintf(pending, MAX_PATH, L"%ls.rotate", path) < 0 || !move_file(path, pending))
+    {
+        return LOGROTATE_FAILED;
+    }
+
+    /* Shift the older generations up by one, replacing the oldest one */
+    for (unsigned long n = count; n > 1; n--)
+    {
+        if (logrotate_path(from, MAX_PATH, path, n - 1) && logrotate_path(to, MAX_PATH, path, n)
+            && move_file(from, to))
+        {
+            move_index(from, to);
+        }
+    }
+    if (!logrotate_path(to, MAX_PATH, path, 1) || !move_file(pending, to))
+    {
+        move_file(pending, path);
+        return LOGROTATE_FAILED;
+    }
+    move_index(path, to);
+
+    /* Drop the generations kept under a higher count */
+    for (unsigned long n = count + 1; n <= LOGROTATE_MAX_COUNT; n++)
+    {
+        if (logrotate_path(to, MAX_PATH, path, n) && delete_file(to))
+        {
+            move_index(to, NULL);
+        }
+    }
+
+    return LOGROTATE_DONE;
+}
+
+#ifdef _WIN32
+
+/*
+ * Compress a rotated log in place using NTFS compression. The file stays
+ * readable as is, so it can still be viewed and searched. Runs in the
+ * background mode of the scheduler which also lowers its I/O priority.
+ */
+static DWORD WINAPI
+CompressLogThread(LPVOID arg)
+{
+    WCHAR *path = arg;
+    USHORT format = COMPRESSION_FORMAT_DEFAULT;
+    DWORD bytes;
+    HANDLE fd;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    /* share delete so that the next rotation can proceed */
+    fd = CreateFileW(path,
+                     GENERIC_READ | GENERIC_WRITE,
+                     FILE_SHARE_READ | FILE_SHARE_DELETE,
+                     NULL,
+                     OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL,
+                     NULL);
+    if (fd != INVALID_HANDLE_VALUE)
+    {
+        if (!DeviceIoControl(
+                fd, FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &bytes, NULL))
+        {
+            PrintDebug(L"Compressing rotated log '%ls' failed (error = %lu)", path, GetLastError());
+        }
+        CloseHandle(fd);
+    }
+
+    free(path);
+    return 0;
+}
+
+BOOL
+RotateLog(const WCHAR *path)
+{
+    WCHAR gen1[MAX_PATH];
+    HANDLE thread;
+    WCHAR *arg;
+    int res;
+
+    res = logrotate(path, (uint64_t)o.log_rotate_size * 1024 * 1024, o.log_rotate_count);
+    /* held open by the daemon: retried when it lets go of the log */
+    if (res == LOGROTATE_FAILED && GetLastError() != ERROR_SHARING_VIOLATION)
+    {
+        PrintDebug(L"Rotating log '%ls' failed (error = %lu)", path, GetLastError());
+    }
+    if (res != LOGROTATE_DONE || !logrotate_path(gen1, _countof(gen1), path, 1))
+    {
+        return res != LOGROTATE_FAILED;
+    }
+
+    arg = _wcsdup(gen1);
+    if (arg)
+    {
+        thread = CreateThread(NULL, 0, CompressLogThread, arg, 0, NULL);
+        if (thread)
+        {
+            CloseHandle(thread);
+        }
+        else
+        {
+            free(arg);
+        }
+    }
+    return TRUE;
+}
+
+#endif /* ifdef _WIN32 */
@@ -0,0 +1,70 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Size based rotation of log files. The rotated generations of
+ * "name.log" are "name.1.log", "name.2.log", ... with generation 1 the
+ * most recent one. The search index "<file>.idx" of a generation moves
+ * along with it.
+ */
+
+#ifndef LOGROTATE_H
+#define LOGROTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* Highest number of generations that may be kept */
+#define LOGROTATE_MAX_COUNT 99
+
+/* Results of logrotate() */
+#define LOGROTATE_NOT_DUE 0  /* the log is missing or below the size limit */
+#define LOGROTATE_DONE    1  /* the log is now generation 1 */
+#define LOGROTATE_FAILED  -1 /* the log could not be moved, e.g. as it is open */
+
+/*
+ * Get the path of the n'th rotated generation of a log -- "name.n.log"
+ * for "name.log", the log itself for n = 0. Returns 0 if the path does
+ * not fit in len characters.
+ */
+int logrotate_path(wchar_t *buf, size_t len, const wchar_t *path, unsigned long n);
+
+/*
+ * Rotate the log at path if it is at least max_size bytes: older
+ * generations are shifted up, the log becomes generation 1, and
+ * generations beyond count are deleted, also those left over from a
+ * higher count. Windows does not let a log be moved while it is open
+ * without delete sharing, as openvpn and the service hold it; the
+ * rotation then fails and leaves all generations as they were.
+ * Returns a LOGROTATE_* result.
+ */
+int logrotate(const wchar_t *path, uint64_t max_size, unsigned long count);
+
+#ifdef _WIN32
+/*
+ * Rotate the log at path with the configured size and number of
+ * generations, and compress the new generation 1 in the background.
+ * Returns false if the log is due but could not be moved, as the daemon
+ * or the service still has it open.
+ */
+BOOL RotateLog(const WCHAR *path);
+#endif
+
+#endif /* ifndef LOGROTATE_H */
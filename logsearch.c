@@ -0,0 +1,418 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logsearch.h"
+
+#define LOGIDX_MAGIC       "OVPNLIDX"
+#define LOGIDX_VERSION     1
+#define LOGIDX_BLOCK_SIZE  (64 * 1024)
+#define LOGIDX_BLOOM_ORDER 14
+#define LOGIDX_BLOOM_BITS  (1 << LOGIDX_BLOOM_ORDER)
+#define LOGIDX_HEAD_SIZE   256 /* bytes of the log identifying it */
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;     /* number of blocks indexed */
+    uint64_t indexed;   /* number of bytes of the log covered by the blocks */
+    uint64_t head_hash; /* hash of the first head_len bytes of the log */
+    uint32_t head_len;
+    uint32_t reserved;
+} logidx_header_t;
+
+/* Blocks follow the header in the order of their offsets */
+typedef struct
+{
+    uint64_t offset;
+    uint32_t len;
+    uint32_t reserved;
+    unsigned char bloom[LOGIDX_BLOOM_BITS / 8]; /* trigrams in the block */
+} logidx_block_t;
+
+struct search
+{
+    char *query; /* ASCII lower case */
+    size_t len;
+    uint32_t *bits; /* bloom filter bits of the trigrams in query */
+    logsearch_fn fn;
+    void *arg;
+    long matches;
+    int stopped;
+};
+
+static FILE *
+open_file(const wchar_t *path, const wchar_t *mode)
+{
+#ifdef _WIN32
+    return _wfopen(path, mode);
+#else
+    char name[4096];
+    char m[8];
+
+    if (wcstombs(name, path, sizeof(name)) >= sizeof(name)
+        || wcstombs(m, mode, sizeof(m)) >= sizeof(m))
+    {
+        return NULL;
+    }
+    return fopen(name, m);
+#endif
+}
+
+static inline unsigned char
+fold(unsigned char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : ch;
+}
+
+static inline uint32_t
+trigram_bit(unsigned char a, unsigned char b, unsigned char c)
+{
+    uint32_t t = ((uint32_t)fold(a) << 16) | ((uint32_t)fold(b) << 8) | fold(c);
+
+    /* multiplicative hashing */
+    return (t * 2654435761u) >> (32 - LOGIDX_BLOOM_ORDER);
+}
+
+static void
+bloom_add(unsigned char *bloom, const char *data, size_t len)
+{
+    for (size_t i = 2; i < len; i++)
+    {
+        uint32_t bit = trigram_bit(data[i - 2], data[i - 1], data[i]);
+        bloom[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+static int
+bloom_test(const unsigned char *bloom, const struct search *s)
+{
+    for (size_t i = 0; i + 2 < s->len; i++)
+    {
+        if (!(bloom[s->bits[i] >> 3] & (1 << (s->bits[i] & 7))))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* FNV-1a */
+static uint64_t
+hash_head(const char *data, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * Open the index of log and read its header. An index not matching the
+ * log -- the log was truncated or replaced since it was indexed -- is
+ * discarded and a new one is created. Returns NULL if the index can
+ * neither be read nor created.
+ */
+static FILE *
+open_index(const wchar_t *index_path, FILE *log, logidx_header_t *hdr)
+{
+    FILE *idx = open_file(index_path, L"r+b");
+
+    if (idx)
+    {
+        char head[LOGIDX_HEAD_SIZE];
+        int64_t size = -1;
+
+        if (fseek64(log, 0, SEEK_END) == 0)
+        {
+            size = ftell64(log);
+        }
+
+        if (fread(hdr, sizeof(*hdr), 1, idx) == 1 && memcmp(hdr->magic, LOGIDX_MAGIC, 8) == 0
+            && hdr->version == LOGIDX_VERSION && (int64_t)hdr->indexed <= size
+            && hdr->head_len <= sizeof(head) && fseek64(log, 0, SEEK_SET) == 0
+            && fread(head, 1, hdr->head_len, log) == hdr->head_len
+            && hash_head(head, hdr->head_len) == hdr->head_hash)
+        {
+            return idx;
+        }
+        fclose(idx);
+    }
+
+    idx = open_file(index_path, L"w+b");
+    if (idx)
+    {
+        memset(hdr, 0, sizeof(*hdr));
+        memcpy(hdr->magic, LOGIDX_MAGIC, 8);
+        hdr->version = LOGIDX_VERSION;
+        hdr->head_hash = hash_head(NULL, 0);
+    }
+    return idx;
+}
+
+/* Report the lines in data containing the query */
+static void
+scan_block(struct search *s, const char *data, size_t len, uint64_t offset)
+{
+    size_t line = 0;
+
+    for (size_t i = 0; i + s->len <= len; i++)
+    {
+        size_t j, end;
+
+        if (data[i] == '\n')
+        {
+            line = i + 1;
+            continue;
+        }
+        if (fold(data[i]) != (unsigned char)s->query[0])
+        {
+            continue;
+        }
+        j = 1;
+        while (j < s->len && fold(data[i + j]) == (unsigned char)s->query[j])
+        {
+            j++;
+        }
+        if (j < s->len)
+        {
+            continue;
+        }
+
+        /* report the line once and continue with the next one */
+        end = i + s->len;
+        while (end < len && data[end] != '\n')
+        {
+            end++;
+        }
+        s->matches++;
+        if (!s->fn(s->arg,
+                   data + line,
+                   end - line - (end > line && data[end - 1] == '\r'),
+                   offset + line))
+        {
+            s->stopped = 1;
+            return;
+        }
+        line = end + 1;
+        i = end;
+    }
+}
+
+/* Give the caller a chance to stop the search after a block is read */
+static void
+end_block(struct search *s, uint64_t offset)
+{
+    if (!s->stopped && !s->fn(s->arg, NULL, 0, offset))
+    {
+        s->stopped = 1;
+    }
+}
+
+long
+logsearch_find(const wchar_t *log_path,
+               const wchar_t *index_path,
+               const char *query,
+               logsearch_fn fn,
+               void *arg,
+               logsearch_stats_t *stats)
+{
+    struct search s = { .fn = fn, .arg = arg };
+    logsearch_stats_t st = { 0 };
+    logidx_header_t hdr = { 0 };
+    logidx_block_t blk;
+    FILE *log = NULL;
+    FILE *idx = NULL;
+    char *buf = NULL;
+    uint64_t pos = 0;
+    int indexing, dirty = 0;
+    long ret = -1;
+
+    s.len = strlen(query);
+    if (s.len == 0)
+    {
+        ret = 0;
+        goto out;
+    }
+
+    s.query = malloc(s.len);
+    s.bits = malloc((s.len > 2 ? s.len - 2 : 1) * sizeof(*s.bits));
+    buf = malloc(LOGIDX_BLOCK_SIZE);
+    log = open_file(log_path, L"rb");
+    if (!s.query || !s.bits || !buf || !log)
+    {
+        goto out;
+    }
+    for (size_t i = 0; i < s.len; i++)
+    {
+        s.query[i] = fold(query[i]);
+    }
+    for (size_t i = 0; i + 2 < s.len; i++)
+    {
+        s.bits[i] = trigram_bit(query[i], query[i + 1], query[i + 2]);
+    }
+
+    idx = open_index(index_path, log, &hdr);
+    indexing = idx != NULL;
+
+    /* Read the blocks whose filter has all trigrams of the query */
+    for (uint32_t i = 0; i < hdr.count && !s.stopped; i++)
+    {
+        if (fread(&blk, sizeof(blk), 1, idx) != 1 || blk.offset != pos
+            || blk.len > LOGIDX_BLOCK_SIZE)
+        {
+            /* index cut short: continue from the last good block */
+            hdr.count = i;
+            dirty = 1;
+            break;
+        }
+        pos += blk.len;
+
+        if (!bloom_test(blk.bloom, &s))
+        {
+            continue;
+        }
+        if (fseek64(log, (int64_t)blk.offset, SEEK_SET) != 0
+            || fread(buf, 1, blk.len, log) != blk.len)
+        {
+            goto out;
+        }
+        st.blocks_read++;
+        st.bytes_read += blk.len;
+        scan_block(&s, buf, blk.len, blk.offset);
+        end_block(&s, blk.offset + blk.len);
+    }
+    if (!s.stopped && hdr.indexed != pos)
+    {
+        hdr.indexed = pos;
+        dirty = 1;
+    }
+
+    /* Read the rest of the log, adding complete blocks to the index */
+    if (indexing
+        && fseek64(idx, (int64_t)(sizeof(hdr) + (uint64_t)hdr.count * sizeof(blk)), SEEK_SET)
+               != 0)
+    {
+        indexing = 0;
+    }
+    while (!s.stopped)
+    {
+        size_t n, len;
+
+        if (fseek64(log, (int64_t)pos, SEEK_SET) != 0)
+        {
+            goto out;
+        }
+        len = n = fread(buf, 1, LOGIDX_BLOCK_SIZE, log);
+        if (n == 0)
+        {
+            break;
+        }
+        if (n == LOGIDX_BLOCK_SIZE)
+        {
+            /* end the block after the last line break -- overlong lines
+             * are split */
+            while (len > 0 && buf[len - 1] != '\n')
+            {
+                len--;
+            }
+            if (len == 0)
+            {
+                len = n;
+            }
+        }
+        st.blocks_read++;
+        st.bytes_read += len;
+
+        /* the last block is indexed once it is complete */
+        if (n == LOGIDX_BLOCK_SIZE && indexing)
+        {
+            memset(&blk, 0, sizeof(blk));
+            blk.offset = pos;
+            blk.len = (uint32_t)len;
+            bloom_add(blk.bloom, buf, len);
+            if (fwrite(&blk, sizeof(blk), 1, idx) == 1)
+            {
+                if (hdr.count == 0)
+                {
+                    hdr.head_len = len < LOGIDX_HEAD_SIZE ? (uint32_t)len : LOGIDX_HEAD_SIZE;
+                    hdr.head_hash = hash_head(buf, hdr.head_len);
+                }
+                hdr.count++;
+                hdr.indexed = pos + len;
+                dirty = 1;
+            }
+            else
+            {
+                indexing = 0;
+            }
+        }
+
+        scan_block(&s, buf, len, pos);
+        pos += len;
+        end_block(&s, pos);
+    }
+
+    ret = s.matches;
+
+out:
+    if (idx)
+    {
+        /* the header is written last so that an interrupted update
+         * leaves a consistent index */
+        if (dirty && fseek64(idx, 0, SEEK_SET) == 0)
+        {
+            fwrite(&hdr, sizeof(hdr), 1, idx);
+        }
+        fclose(idx);
+    }
+    if (log)
+    {
+        fclose(log);
+    }
+    free(buf);
+    free(s.bits);
+    free(s.query);
+
+    if (stats)
+    {
+        st.blocks = hdr.count;
+        *stats = st;
+    }
+    return ret;
+}
@@ -0,0 +1,61 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef LOGSEARCH_H
+#define LOGSEARCH_H
+
+#include <stddef.h>
+#include <wchar.h>
+
+/*
+ * Called for every line of the log matching a query with the line
+ * (without the line terminator) and its offset in the log file. It is
+ * also called with line set to NULL after every block read, so that a
+ * search not finding anything can be stopped as well. Return 0 to stop
+ * the search.
+ */
+typedef int (*logsearch_fn)(void *arg, const char *line, size_t len, unsigned long long offset);
+
+typedef struct
+{
+    unsigned long blocks;          /* number of indexed blocks of the log */
+    unsigned long blocks_read;     /* number of blocks read from the log */
+    unsigned long long bytes_read; /* number of bytes read from the log */
+} logsearch_stats_t;
+
+/*
+ * Search the log file at log_path for lines containing query, ignoring
+ * ASCII case. The log is split into blocks of about 64 kB ending at a
+ * line break and the trigrams of each block are recorded in a bloom
+ * filter kept in the file at index_path, so that only blocks that may
+ * contain the query are read. The index is brought up to date with the
+ * log as part of the search: blocks appended to the log since the last
+ * search are added, and the index is rebuilt if the log was truncated
+ * or replaced. If the index cannot be written, the whole log is read.
+ * Returns the number of matching lines or -1 on error. If stats is not
+ * NULL it is filled in with the work done.
+ */
+long logsearch_find(const wchar_t *log_path,
+                    const wchar_t *index_path,
+                    const char *query,
+                    logsearch_fn fn,
+                    void *arg,
+                    logsearch_stats_t *stats);
+
+#endif /* ifndef LOGSEARCH_H */
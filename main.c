@@ -38,6 +38,8 @@
 #include "openvpn.h"
 #include "openvpn_config.h"
 #include "viewlog.h"
+#include "logrotate.h"
+#include "timeline.h"
 #include "service.h"
 #include "main.h"
 #include "options.h"
@@ -548,6 +550,15 @@ static void CALLBACK
 ManagePersistent(HWND hwnd, UINT UNUSED msg, UINT_PTR id, DWORD UNUSED now)
 {
     CheckServiceStatus();
+    for (connection_t *c = o.chead; c; c = c->next)
+    {
+        /* the service holds the log open while the daemon runs: this
+         * only succeeds once it has stopped or restarts the daemon */
+        if (c->flags & FLAG_DAEMON_PERSISTENT && (c->state == disconnected || c->state == detached))
+        {
+            RotateLog(c->log_path);
+        }
+    }
     if (o.service_state == service_connected)
     {
         for (connection_t *c = o.chead; c; c = c->next)
@@ -560,8 +571,9 @@ ManagePersistent(HWND hwnd, UINT UNUSED msg, UINT_PTR id, DWORD UNUSED now)
                  * connect.
                  */
                 c->auto_connect = false;
-                c->state = detached; /* this is required to retain management-hold on re-attach */
-                StartOpenVPN(c);     /* attach to the management i/f */
+                /* this is required to retain management-hold on re-attach */
+                SetConnState(c, detached);
+                StartOpenVPN(c); /* attach to the management i/f */
             }
         }
     }
@@ -686,6 +698,14 @@ WindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
             {
                 ImportConfigFromURL();
             }
+            else if (LOWORD(wParam) == IDM_SEARCHLOGS)
+            {
+                SearchLogs();
+            }
+            else if (LOWORD(wParam) == IDM_TIMELINE)
+            {
+                ShowLogTimeline();
+            }
             else if (LOWORD(wParam) == IDM_SETTINGS)
             {
                 ShowSettingsDialog();
@@ -36,8 +36,6 @@
 #define GUI_REGKEY_HKCU    _T("Software\\OpenVPN-GUI")
 
 #define MAX_LOG_LENGTH     1024 /* Max number of characters per log line */
-#define MAX_LOG_LINES      500  /* Max number of lines in LogWindow */
-#define DEL_LOG_LINES      10   /* Number of lines to delete from LogWindow */
 #define USAGE_BUF_SIZE     3000 /* Size of buffer used to display usage message */
 
 /* Authorized group who can use any options and config locations */
@@ -62,6 +60,8 @@
 #define WM_OVPN_ECHOMSG    (WM_APP + 22)
 #define WM_OVPN_STATE      (WM_APP + 23)
 #define WM_OVPN_DETACH     (WM_APP + 24)
+#define WM_OVPN_LOGINDEX   (WM_APP + 25)
+#define WM_OVPN_LOGSEARCH  (WM_APP + 26)
 
 #define MSGF_OVPN_WAIT     (MSGF_USER + 1)
 
@@ -31,6 +31,7 @@
 #include "manage.h"
 #include "main.h"
 #include "misc.h"
+#include "openvpn-gui-res.h"
 
 extern options_t o;
 
@@ -42,21 +43,501 @@ static mgmt_msg_func rtmsg_handler[mgmt_rtmsg_type_max];
 static const time_t max_connect_time = 15;
 
 /*
- * Initialize the real-time notification handlers
+ * Bounds in milliseconds of the delay between attempts to connect
+ * to the management interface
+ */
+#define MGMT_RETRY_MIN 50
+#define MGMT_RETRY_MAX 2000
+
+/*
+ * Number of times the ready probe is sent before the management
+ * interface is taken to be ready without a proper response
+ */
+#define MGMT_PROBE_MAX 5
+
+/*
+ * Stop receiving from a socket while this many bytes of lines are
+ * waiting to be handled by the status thread. This keeps a busy
+ * daemon from queueing unbounded output while the status thread is
+ * blocked, e.g., in a modal dialog.
+ */
+#define MGMT_INBOX_MAX (1024 * 1024)
+
+/*
+ * Maximum number of commands written to the management interface
+ * before the response to the oldest one arrives. OpenVPN handles
+ * commands strictly in order, so responses are matched to commands
+ * in FIFO order. Set to 1 to send one command per round-trip.
+ */
+#define MGMT_MAX_INFLIGHT 8
+
+/*
+ * Maximum number of bytes of commands queued per connection. Queries
+ * are refused while the queue is full, e.g., when OpenVPN is not
+ * reading from the management interface. Control and state commands
+ * and replies to prompts are queued regardless, as the GUI sends only
+ * a few of them on each event and OpenVPN waits for the replies.
+ */
+#define MGMT_CMD_QUEUE_MAX (64 * 1024)
+
+/*
+ * Sockets of all management connections are served by reactor threads,
+ * each waiting on up to REACTOR_MAX_SOCKETS sockets. A reactor receives
+ * management output and splits it into lines, so that the status threads
+ * are only notified of decoded events. Commands are still sent and
+ * responses handled by the thread owning the connection's status window.
+ */
+#define REACTOR_MAX_SOCKETS (MAXIMUM_WAIT_OBJECTS - 1)
+
+struct mgmt_reactor
+{
+    struct mgmt_reactor *next;
+    HANDLE thread;
+    HANDLE wake;                             /* signalled when the set of sockets changes */
+    BOOL stop;                               /* set to terminate the reactor thread */
+    int count;                               /* number of connections served */
+    connection_t *conn[REACTOR_MAX_SOCKETS]; /* NULL for unused slots */
+    HANDLE event[REACTOR_MAX_SOCKETS];       /* socket event of each slot */
+};
+
+/*
+ * Protects the reactor list and the slots of the reactors. The receive
+ * state of a connection is protected by its own rx_lock, which is taken
+ * after reactor_lock, so that a socket being drained holds up neither
+ * the other reactors nor the status threads of other connections.
+ */
+static CRITICAL_SECTION reactor_lock;
+static struct mgmt_reactor *reactors;
+
+/*
+ * Initialize the real-time notification handlers and the reactor lock
  */
 void
 InitManagement(const mgmt_rtmsg_handler *handler)
 {
+    static BOOL initialized;
     int i;
+
     for (i = 0; handler[i].handler; ++i)
     {
         rtmsg_handler[handler[i].type] = handler[i].handler;
     }
+
+    if (!initialized)
+    {
+        InitializeCriticalSection(&reactor_lock);
+        initialized = TRUE;
+    }
+}
+
+
+#ifdef DEBUG
+/*
+ * Start recording the management session of a connection if a
+ * recording directory was specified on the command line
+ */
+static void
+OpenRecord(connection_t *c)
+{
+    WCHAR path[MAX_PATH];
+    DWORD written;
+
+    c->manage.record = NULL;
+    if (o.mgmt_record_dir[0] == L'\0')
+    {
+        return;
+    }
+
+    _sntprintf_0(path, L"%ls\\%ls-%lld.mgmt", o.mgmt_record_dir, c->config_name,
+                 (long long)time(NULL));
+    c->manage.record = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+    if (c->manage.record == INVALID_HANDLE_VALUE)
+    {
+        PrintDebug(L"Failed to create management recording %ls (error = %lu)", path,
+                   GetLastError());
+        c->manage.record = NULL;
+        return;
+    }
+    WriteFile(c->manage.record, MGMT_RECORD_MAGIC, sizeof(MGMT_RECORD_MAGIC) - 1, &written, NULL);
 }
 
+
 /*
- * Connect to the OpenVPN management interface and register
- * asynchronous socket event notification for it
+ * Append the data of one recv() to the recording of a connection
+ */
+static void
+RecordData(connection_t *c, const char *data, int len)
+{
+    mgmt_record_t rec = { GetTickCount64() - c->manage.connect_start, (uint32_t)len, 0 };
+    DWORD written;
+
+    if (c->manage.record == NULL)
+    {
+        return;
+    }
+    if (!WriteFile(c->manage.record, &rec, sizeof(rec), &written, NULL)
+        || !WriteFile(c->manage.record, data, len, &written, NULL))
+    {
+        CloseHandle(c->manage.record);
+        c->manage.record = NULL;
+    }
+}
+
+
+static void
+CloseRecord(connection_t *c)
+{
+    if (c->manage.record)
+    {
+        CloseHandle(c->manage.record);
+        c->manage.record = NULL;
+    }
+}
+#endif /* ifdef DEBUG */
+
+
+/*
+ * Receive pending management output into the connection's inbox. If
+ * drain is false, stop once the inbox is full. Returns true if lines
+ * were added. Called with the receive lock of the connection held.
+ */
+static BOOL
+ReceiveLines(connection_t *c, BOOL drain)
+{
+    mgmt_buf_t *rbuf = &c->manage.rbuf;
+    size_t len = c->manage.inbox.len;
+    int res;
+
+    while (drain || c->manage.inbox.len < MGMT_INBOX_MAX)
+    {
+        if (!mgmt_buf_reserve(rbuf, 1))
+        {
+            break;
+        }
+
+        res = recv(c->manage.sk, rbuf->data + rbuf->len, (int)(rbuf->size - rbuf->len), 0);
+        if (res <= 0)
+        {
+            break;
+        }
+#ifdef DEBUG
+        RecordData(c, rbuf->data + rbuf->len, res);
+#endif
+        rbuf->len += res;
+
+        if (!mgmt_split_lines(rbuf, &c->manage.inbox))
+        {
+            break;
+        }
+    }
+    c->manage.rx_paused = (c->manage.inbox.len >= MGMT_INBOX_MAX);
+
+    return c->manage.inbox.len > len;
+}
+
+
+/*
+ * Notify the status window of a management socket event
+ */
+static BOOL
+PostManagementEvent(connection_t *c, int event, int error)
+{
+    return PostMessage(
+        c->hwndStatus, WM_MANAGEMENT, (WPARAM)c->manage.sk, WSAMAKESELECTREPLY(event, error));
+}
+
+
+/*
+ * Handle the network events of the socket of connection c in a reactor
+ * slot. Called with the receive lock of c held, or with c NULL if the
+ * slot is unused.
+ */
+static void
+HandleSocketEvents(struct mgmt_reactor *r, int slot, connection_t *c)
+{
+    WSANETWORKEVENTS ne;
+
+    if (c == NULL)
+    {
+        /* unregistered after we started waiting */
+        ResetEvent(r->event[slot]);
+        return;
+    }
+
+    if (WSAEnumNetworkEvents(c->manage.sk, r->event[slot], &ne) != 0)
+    {
+        ResetEvent(r->event[slot]);
+        return;
+    }
+
+    if (ne.lNetworkEvents & FD_CONNECT)
+    {
+        PostManagementEvent(c, FD_CONNECT, ne.iErrorCode[FD_CONNECT_BIT]);
+    }
+
+    /* The event is also signalled to resume receiving into a full inbox */
+    if ((ne.lNetworkEvents & (FD_READ | FD_CLOSE)) || c->manage.rx_paused)
+    {
+        if (ReceiveLines(c, (ne.lNetworkEvents & FD_CLOSE) != 0) && !c->manage.rx_notified)
+        {
+            c->manage.rx_notified = PostManagementEvent(c, FD_READ, 0);
+        }
+    }
+
+    if (ne.lNetworkEvents & FD_WRITE)
+    {
+        PostManagementEvent(c, FD_WRITE, ne.iErrorCode[FD_WRITE_BIT]);
+    }
+
+    if (ne.lNetworkEvents & FD_CLOSE)
+    {
+        PostManagementEvent(c, FD_CLOSE, ne.iErrorCode[FD_CLOSE_BIT]);
+    }
+}
+
+
+/*
+ * ThreadProc of a reactor
+ */
+static DWORD WINAPI
+ReactorThread(void *p)
+{
+    struct mgmt_reactor *r = p;
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    int slots[MAXIMUM_WAIT_OBJECTS];
+
+    while (TRUE)
+    {
+        DWORD n = 1, res;
+
+        handles[0] = r->wake;
+        EnterCriticalSection(&reactor_lock);
+        if (r->stop)
+        {
+            LeaveCriticalSection(&reactor_lock);
+            break;
+        }
+        for (int i = 0; i < REACTOR_MAX_SOCKETS; i++)
+        {
+            if (r->conn[i])
+            {
+                handles[n] = r->event[i];
+                slots[n++] = i;
+            }
+        }
+        LeaveCriticalSection(&reactor_lock);
+
+        res = WaitForMultipleObjects(n, handles, FALSE, INFINITE);
+        if (res == WAIT_FAILED)
+        {
+            MsgToEventLog(EVENTLOG_ERROR_TYPE,
+                          L"%hs:%d WaitForMultipleObjects failed (error = %lu)",
+                          __func__,
+                          __LINE__,
+                          GetLastError());
+            Sleep(100);
+            continue;
+        }
+        if (res < WAIT_OBJECT_0 + 1 || res >= WAIT_OBJECT_0 + n)
+        {
+            continue; /* woken up to update the set of sockets */
+        }
+
+        /* Serve all signalled sockets so that a busy one cannot starve the others */
+        for (DWORD i = res - WAIT_OBJECT_0; i < n; i++)
+        {
+            connection_t *c;
+
+            if (WaitForSingleObject(handles[i], 0) != WAIT_OBJECT_0)
+            {
+                continue;
+            }
+
+            /* Only the connection is locked while its socket is drained */
+            EnterCriticalSection(&reactor_lock);
+            c = r->conn[slots[i]];
+            if (c)
+            {
+                AcquireSRWLockExclusive(&c->manage.rx_lock);
+            }
+            LeaveCriticalSection(&reactor_lock);
+
+            HandleSocketEvents(r, slots[i], c);
+            if (c)
+            {
+                ReleaseSRWLockExclusive(&c->manage.rx_lock);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Start a new reactor thread. Called with the reactor lock held.
+ */
+static struct mgmt_reactor *
+NewReactor(void)
+{
+    struct mgmt_reactor *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+
+    r->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (r->wake)
+    {
+        r->thread = CreateThread(NULL, 0, ReactorThread, r, 0, NULL);
+    }
+    if (r->thread == NULL)
+    {
+        MsgToEventLog(EVENTLOG_ERROR_TYPE,
+                      L"%hs:%d Failed to start management reactor (error = %lu)",
+                      __func__,
+                      __LINE__,
+                      GetLastError());
+        if (r->wake)
+        {
+            CloseHandle(r->wake);
+        }
+        free(r);
+        return NULL;
+    }
+
+    r->next = reactors;
+    reactors = r;
+
+    return r;
+}
+
+
+/*
+ * Hand the management socket of a connection to a reactor
+ */
+static BOOL
+RegisterManagement(connection_t *c)
+{
+    struct mgmt_reactor *r;
+    BOOL ret = FALSE;
+    int i;
+
+    EnterCriticalSection(&reactor_lock);
+
+    for (r = reactors; r; r = r->next)
+    {
+        if (r->count < REACTOR_MAX_SOCKETS)
+        {
+            break;
+        }
+    }
+    if (r == NULL && (r = NewReactor()) == NULL)
+    {
+        goto out;
+    }
+
+    for (i = 0; r->conn[i]; i++)
+    {
+    }
+
+    /* slot events are kept for reuse and may still be signalled */
+    if (r->event[i] == NULL)
+    {
+        r->event[i] = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    else
+    {
+        ResetEvent(r->event[i]);
+    }
+    if (r->event[i] == NULL
+        || WSAEventSelect(c->manage.sk, r->event[i], FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE)
+               != 0)
+    {
+        goto out;
+    }
+
+    r->conn[i] = c;
+    r->count++;
+    c->manage.reactor = r;
+    c->manage.slot = i;
+    c->manage.rx_paused = FALSE;
+    c->manage.rx_notified = FALSE;
+    SetEvent(r->wake);
+    ret = TRUE;
+
+out:
+    LeaveCriticalSection(&reactor_lock);
+    return ret;
+}
+
+
+/*
+ * Remove the management socket of a connection from its reactor. The
+ * reactor does not touch the connection once this returns.
+ */
+static void
+UnregisterManagement(connection_t *c)
+{
+    struct mgmt_reactor *r = c->manage.reactor;
+    if (r == NULL)
+    {
+        return;
+    }
+
+    EnterCriticalSection(&reactor_lock);
+    r->conn[c->manage.slot] = NULL;
+    r->count--;
+    c->manage.reactor = NULL;
+    SetEvent(r->wake);
+    LeaveCriticalSection(&reactor_lock);
+
+    /* wait for the reactor to be done with the socket if it is serving it */
+    AcquireSRWLockExclusive(&c->manage.rx_lock);
+    ReleaseSRWLockExclusive(&c->manage.rx_lock);
+}
+
+
+/*
+ * Stop all reactor threads. Only to be called once all management
+ * connections are closed.
+ */
+void
+StopManagementReactor(void)
+{
+    struct mgmt_reactor *r, *next;
+
+    EnterCriticalSection(&reactor_lock);
+    r = reactors;
+    reactors = NULL;
+    for (next = r; next; next = next->next)
+    {
+        next->stop = TRUE;
+        SetEvent(next->wake);
+    }
+    LeaveCriticalSection(&reactor_lock);
+
+    for (; r; r = next)
+    {
+        next = r->next;
+        WaitForSingleObject(r->thread, INFINITE);
+        CloseHandle(r->thread);
+        CloseHandle(r->wake);
+        for (int i = 0; i < REACTOR_MAX_SOCKETS; i++)
+        {
+            if (r->event[i])
+            {
+                CloseHandle(r->event[i]);
+            }
+        }
+        free(r);
+    }
+}
+
+/*
+ * Connect to the OpenVPN management interface and hand the
+ * socket to a reactor for asynchronous event notification
  */
 BOOL
 OpenManagement(connection_t *c)
@@ -68,19 +549,32 @@ OpenManagement(connection_t *c)
     }
 
     c->manage.connected = 0;
-    c->manage.sk = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    c->manage.probe_errors = 0;
+    SetConnManagement(c, socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
     if (c->manage.sk == INVALID_SOCKET)
     {
         WSACleanup();
         return FALSE;
     }
-    if (WSAAsyncSelect(
-            c->manage.sk, c->hwndStatus, WM_MANAGEMENT, FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE)
-        != 0)
+    c->manage.connect_attempts = 1;
+    c->manage.connect_start = GetTickCount64();
+    c->manage.retry_seed = (uint32_t)((uintptr_t)c * 2654435761u)
+                           ^ (uint32_t)c->manage.connect_start ^ GetCurrentThreadId();
+#ifdef DEBUG
+    OpenRecord(c);
+#endif
+    if (!RegisterManagement(c))
     {
+#ifdef DEBUG
+        CloseRecord(c);
+#endif
+        closesocket(c->manage.sk);
+        SetConnManagement(c, INVALID_SOCKET);
+        WSACleanup();
         return FALSE;
     }
 
+    c->manage.connect_time = 0;
     connect(c->manage.sk, (SOCKADDR *)&c->manage.skaddr, sizeof(c->manage.skaddr));
     c->manage.timeout = time(NULL) + max_connect_time;
 
@@ -89,116 +583,359 @@ OpenManagement(connection_t *c)
 
 
 /*
- * Try to send a queued management command to OpenVPN
+ * Schedule the next attempt to connect to the management interface
+ * after a failed one. The delay doubles with every attempt up to
+ * MGMT_RETRY_MAX and is randomized by +/-25%, from the random state of
+ * the connection, so that several connections waiting for the same
+ * daemon do not retry in lock-step.
  */
 static void
-SendCommand(connection_t *c)
+ScheduleConnect(connection_t *c)
 {
-    int res;
-    mgmt_cmd_t *cmd = c->manage.cmd_queue;
-    if (cmd == NULL || cmd->size == 0)
+    UINT delay = mgmt_retry_delay(
+        &c->manage.retry_seed, c->manage.connect_attempts, MGMT_RETRY_MIN, MGMT_RETRY_MAX);
+
+    SetTimer(c->hwndStatus, IDT_MGMT_RETRY, delay, NULL);
+}
+
+
+/*
+ * Mark the management interface ready for input and tell the GUI
+ */
+static void
+SignalReady(connection_t *c)
+{
+    c->manage.connected = 2;
+    if (rtmsg_handler[ready_])
     {
-        return;
+        rtmsg_handler[ready_](c, "");
     }
+}
+
 
-    res = send(c->manage.sk, cmd->command, cmd->size, 0);
-    if (res < 1)
+/*
+ * Handle the response to the ready probe. Only the pid shows that the
+ * interface handles commands: after any other response the probe is
+ * sent again from the retry timer. After MGMT_PROBE_MAX failed probes
+ * the interface is taken to be ready, as it does answer.
+ */
+static void
+OnReadyProbe(connection_t *c, char *msg)
+{
+    if (msg && strncmp(msg, "pid=", 4) == 0)
     {
+        SignalReady(c);
         return;
     }
 
-    if (res != cmd->size)
+    PrintDebug(L"%ls: ready probe failed (%hs)", c->config_name, msg ? msg : "ERROR");
+    if (++c->manage.probe_errors >= MGMT_PROBE_MAX)
     {
-        memmove(cmd->command, cmd->command + res, cmd->size - res);
+        SignalReady(c);
+        return;
     }
+    SetTimer(c->hwndStatus, IDT_MGMT_RETRY, MGMT_RETRY_MIN << c->manage.probe_errors, NULL);
+}
+
 
-    cmd->size -= res;
+/*
+ * Send the ready probe, a cheap command answered with the pid of the
+ * daemon once the interface accepts input
+ */
+static void
+SendReadyProbe(connection_t *c)
+{
+    if (!ManagementCommand(c, "pid", OnReadyProbe, regular))
+    {
+        SignalReady(c);
+    }
 }
 
 
 /*
- * Send a command to the OpenVPN management interface
+ * Retry connecting to the management interface, or sending the ready
+ * probe once connected -- called when the retry timer set by
+ * ScheduleConnect() or OnReadyProbe() expires
  */
-BOOL
-ManagementCommand(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type)
+void
+RetryManagement(connection_t *c)
 {
-    mgmt_cmd_t *cmd = calloc(1, sizeof(*cmd));
-    if (cmd == NULL)
+    KillTimer(c->hwndStatus, IDT_MGMT_RETRY);
+    if (c->manage.sk == INVALID_SOCKET || c->manage.connected == 2)
     {
-        return FALSE;
+        return;
+    }
+    if (c->manage.connected == 1)
+    {
+        SendReadyProbe(c);
+        return;
     }
 
-    cmd->size = strlen(command) + 1;
-    cmd->command = malloc(cmd->size);
-    if (cmd->command == NULL)
+    c->manage.connect_attempts++;
+    connect(c->manage.sk, (SOCKADDR *)&c->manage.skaddr, sizeof(c->manage.skaddr));
+}
+
+
+/*
+ * Try to send queued management commands to OpenVPN. Commands are
+ * written back to back up to MGMT_MAX_INFLIGHT commands ahead of the
+ * oldest one still waiting for its response. The unsent parts of all
+ * commands in that window are gathered into a single WSASend() call.
+ */
+static void
+SendCommand(connection_t *c)
+{
+    WSABUF bufs[MGMT_MAX_INFLIGHT];
+    char *data[MGMT_MAX_INFLIGHT];
+    size_t len[MGMT_MAX_INFLIGHT];
+    DWORD sent;
+    int count;
+
+    c->manage.send_posted = FALSE;
+    while (TRUE)
     {
-        free(cmd);
-        return FALSE;
+        count = mgmt_cmdq_unsent(&c->manage.cmds, MGMT_MAX_INFLIGHT, data, len);
+        for (int i = 0; i < count; i++)
+        {
+            bufs[i].buf = data[i];
+            bufs[i].len = (ULONG)len[i];
+        }
+
+        /* Stop when all is sent or the socket would block: FD_WRITE resumes */
+        if (count == 0 || WSASend(c->manage.sk, bufs, count, &sent, 0, NULL, NULL) != 0)
+        {
+            return;
+        }
+        mgmt_cmdq_sent(&c->manage.cmds, sent);
     }
-    memcpy(cmd->command, command, cmd->size);
-    *(cmd->command + cmd->size - 1) = '\n';
+}
 
-    cmd->handler = handler;
-    cmd->type = type;
 
-    if (c->manage.cmd_queue)
+/*
+ * Have the queued commands sent once the status thread is back in its
+ * message loop. The commands queued meanwhile, by the handlers of a
+ * batch of lines or in a burst of replies, go out in one write.
+ */
+static void
+PostSendCommand(connection_t *c)
+{
+    if (!c->manage.send_posted)
     {
-        cmd->next = c->manage.cmd_queue;
-        cmd->prev = c->manage.cmd_queue->prev;
-        cmd->next->prev = cmd->prev->next = cmd;
+        c->manage.send_posted = PostManagementEvent(c, FD_WRITE, 0);
+        if (!c->manage.send_posted)
+        {
+            SendCommand(c);
+        }
     }
-    else
+}
+
+
+/*
+ * Free the commands of a connection and its pool of command nodes
+ */
+static void
+FreeCommands(connection_t *c)
+{
+    PrintDebug(L"%ls: %lu management commands in %lu sends, %lu node allocations, "
+               L"%lu string allocations",
+               c->config_name,
+               c->manage.cmds.stats.commands,
+               c->manage.cmds.stats.sends,
+               c->manage.cmds.stats.node_allocs,
+               c->manage.cmds.stats.str_allocs);
+
+    mgmt_cmdq_clear(&c->manage.cmds);
+}
+
+
+/*
+ * Queue a command for the OpenVPN management interface. A query is
+ * refused while the queue is full.
+ */
+static BOOL
+QueueCommand(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type, BOOL query)
+{
+    /* Refuse to queue more while OpenVPN is not taking commands in */
+    if (query && c->manage.cmds.bytes + strlen(command) + 1 > MGMT_CMD_QUEUE_MAX)
     {
-        cmd->next = cmd->prev = cmd;
-        c->manage.cmd_queue = cmd;
+        PrintDebug(L"%ls: management command queue full", c->config_name);
+        return FALSE;
     }
 
-    if (c->manage.cmd_queue == cmd)
+    if (!mgmt_cmdq_add(&c->manage.cmds, command, handler, type))
     {
-        SendCommand(c);
+        return FALSE;
     }
+    PostSendCommand(c);
 
     return TRUE;
 }
 
 
 /*
- * Remove a command from a connection's command queue
+ * Send a control or state command to the OpenVPN management interface.
+ * It is queued even while the command queue is full: the GUI sends a
+ * few of these on each event and counts on them being sent.
  */
-static BOOL
-UnqueueCommand(connection_t *c)
+BOOL
+ManagementCommand(connection_t *c, char *command, mgmt_msg_func handler, mgmt_cmd_type type)
 {
-    mgmt_cmd_t *cmd = c->manage.cmd_queue;
-    if (!cmd)
+    return QueueCommand(c, command, handler, type, FALSE);
+}
+
+
+/*
+ * Send the reply to a prompt (password, needok, needstr, ...) to the
+ * OpenVPN management interface. OpenVPN does not go on until it gets
+ * the reply, so it is queued even while the command queue is full.
+ */
+BOOL
+ManagementReply(connection_t *c, char *command)
+{
+    return QueueCommand(c, command, NULL, regular, FALSE);
+}
+
+
+/*
+ * Send a query, one of a number that depends on the daemon, to the
+ * OpenVPN management interface. Returns FALSE if the command queue is
+ * full, which the caller has to handle.
+ */
+BOOL
+ManagementQuery(connection_t *c, char *command, mgmt_msg_func handler)
+{
+    return QueueCommand(c, command, handler, regular, TRUE);
+}
+
+
+/*
+ * Handle a complete line of management interface output
+ */
+static void
+DispatchLine(connection_t *c, char *line)
+{
+    int res = mgmt_dispatch(&c->manage.cmds, rtmsg_handler, c, line);
+
+    if (res & MGMT_DISPATCH_BANNER)
     {
-        return FALSE;
+        /* The banner may arrive before the interface accepts input: send a
+         * cheap command and signal readiness once its response arrives.
+         */
+        SendReadyProbe(c);
+    }
+    else if (res & MGMT_DISPATCH_ANSWERED)
+    {
+        /* the window of commands in flight has moved on */
+        PostSendCommand(c);
     }
+}
 
-    /* Wipe command as it may contain passwords */
-    memset(cmd->command, 'x', cmd->size);
 
-    if (cmd->type == combined)
+/*
+ * Take the lines received by the reactor for handling. The emptied
+ * buffer of the previous batch becomes the new inbox.
+ */
+static void
+TakeLines(connection_t *c)
+{
+    mgmt_buf_t lines = c->manage.lines;
+
+    /* The reactor and slot are only changed by this thread */
+    AcquireSRWLockExclusive(&c->manage.rx_lock);
+    c->manage.lines = c->manage.inbox;
+    c->manage.inbox = lines;
+    c->manage.rx_notified = FALSE;
+    if (c->manage.rx_paused && c->manage.reactor)
     {
-        cmd->type = regular;
-        return TRUE;
+        /* the inbox has room again: let the reactor resume receiving */
+        SetEvent(c->manage.reactor->event[c->manage.slot]);
     }
+    ReleaseSRWLockExclusive(&c->manage.rx_lock);
+}
 
-    if (cmd->next == cmd)
+
+/*
+ * Handle all lines of management interface output received so far
+ */
+static void
+ReadManagement(connection_t *c)
+{
+    SOCKET sk = c->manage.sk;
+
+    /* Handlers may run a modal loop which dispatches another FD_READ:
+     * let the outer call pick up those lines once it is done.
+     */
+    if (c->manage.reading)
     {
-        c->manage.cmd_queue = NULL;
+        c->manage.read_pending = TRUE;
+        return;
     }
-    else
+    c->manage.reading = TRUE;
+
+    do
     {
-        cmd->prev->next = cmd->next;
-        cmd->next->prev = cmd->prev;
-        c->manage.cmd_queue = cmd->next;
-        SendCommand(c);
-    }
+        char *line, *next;
+        char *end;
+        unsigned long count;
 
-    free(cmd->command);
-    free(cmd);
+        c->manage.read_pending = FALSE;
+        TakeLines(c);
+        end = c->manage.lines.data + c->manage.lines.len;
 
-    return TRUE;
+        for (line = c->manage.lines.data; line < end; line = next)
+        {
+            /* handlers may modify the line */
+            next = line + strlen(line) + 1;
+
+            if (strncmp(line, ">LOG:", 5) == 0)
+            {
+                next = mgmt_join_log_lines(line, end, &count);
+            }
+
+            if (strcmp(line, "ENTER PASSWORD:") != 0)
+            {
+                /* Handle regular management interface output */
+                DispatchLine(c, line);
+            }
+            else if (*c->manage.password)
+            {
+                /* Reply to a management password request */
+                ManagementReply(c, c->manage.password);
+                SecureZeroMemory(c->manage.password, sizeof(c->manage.password));
+            }
+            else
+            {
+                /* either we don't have a password or we used it and didn't match */
+                MsgToEventLog(EVENTLOG_WARNING_TYPE,
+                              L"%ls: management password mismatch",
+                              c->config_name);
+                SetConnState(c, disconnecting);
+                CloseManagement(c);
+                rtmsg_handler[stop_](c, "");
+            }
+
+            /* stop if a handler has closed the management connection */
+            if (c->manage.sk != sk)
+            {
+                c->manage.reading = FALSE;
+                c->manage.lines.len = 0;
+                if (c->manage.sk == INVALID_SOCKET)
+                {
+                    mgmt_buf_free(&c->manage.lines);
+                }
+                else if (c->manage.read_pending)
+                {
+                    /* reopened meanwhile and lines arrived on the new socket */
+                    ReadManagement(c);
+                }
+                return;
+            }
+        }
+
+        c->manage.lines.len = 0;
+    } while (c->manage.read_pending);
+
+    c->manage.reading = FALSE;
 }
 
 
@@ -208,10 +945,6 @@ UnqueueCommand(connection_t *c)
 void
 OnManagement(SOCKET sk, LPARAM lParam)
 {
-    int res;
-    char *data;
-    ULONG data_size, offset;
-
     connection_t *c = GetConnByManagement(sk);
     if (c == NULL)
     {
@@ -226,8 +959,9 @@ OnManagement(SOCKET sk, LPARAM lParam)
                 /* keep trying for connections with persistent daemons */
                 if (c->flags & FLAG_DAEMON_PERSISTENT || time(NULL) < c->manage.timeout)
                 {
-                    /* show a message on status window */
-                    if (rtmsg_handler[log_] && (c->flags & FLAG_DAEMON_PERSISTENT))
+                    /* show a message on status window once */
+                    if (rtmsg_handler[log_] && (c->flags & FLAG_DAEMON_PERSISTENT)
+                        && c->manage.connect_attempts == 1)
                     {
                         char buf[256];
                         _snprintf_0(buf,
@@ -236,7 +970,7 @@ OnManagement(SOCKET sk, LPARAM lParam)
                         rtmsg_handler[log_](c, buf);
                     }
 
-                    connect(c->manage.sk, (SOCKADDR *)&c->manage.skaddr, sizeof(c->manage.skaddr));
+                    ScheduleConnect(c);
                 }
                 else
                 {
@@ -251,6 +985,22 @@ OnManagement(SOCKET sk, LPARAM lParam)
             else
             {
                 c->manage.connected = 1;
+                c->manage.connect_time = GetTickCount64() - c->manage.connect_start;
+                PrintDebug(L"%ls: management connected after %d attempt(s) in %llu ms",
+                           c->config_name,
+                           c->manage.connect_attempts,
+                           c->manage.connect_time);
+                if (rtmsg_handler[log_] && c->manage.connect_attempts > 1)
+                {
+                    char buf[256];
+                    _snprintf_0(buf,
+                                "%lld,I,Management interface connected after %d attempts in "
+                                "%llu ms",
+                                (long long)time(NULL),
+                                c->manage.connect_attempts,
+                                c->manage.connect_time);
+                    rtmsg_handler[log_](c, buf);
+                }
                 if (rtmsg_handler[validate_])
                 {
                     rtmsg_handler[validate_](c, "");
@@ -259,230 +1009,7 @@ OnManagement(SOCKET sk, LPARAM lParam)
             break;
 
         case FD_READ:
-            if (ioctlsocket(c->manage.sk, FIONREAD, &data_size) != 0 || data_size == 0)
-            {
-                return;
-            }
-
-            data = malloc(c->manage.saved_size + data_size);
-            if (data == NULL)
-            {
-                return;
-            }
-
-            res = recv(c->manage.sk, data + c->manage.saved_size, data_size, 0);
-            if (res != (int)data_size)
-            {
-                free(data);
-                return;
-            }
-
-            /* Copy previously saved management data */
-            if (c->manage.saved_size)
-            {
-                memcpy(data, c->manage.saved_data, c->manage.saved_size);
-                data_size += c->manage.saved_size;
-                free(c->manage.saved_data);
-                c->manage.saved_data = NULL;
-                c->manage.saved_size = 0;
-            }
-
-            offset = 0;
-            while (offset < data_size)
-            {
-                char *pos;
-                char *line = data + offset;
-                size_t line_size = data_size - offset;
-                BOOL passwd_request = false;
-                const char *passwd_prompt = "ENTER PASSWORD:";
-
-                if (line_size >= strlen(passwd_prompt)
-                    && memcmp(line, passwd_prompt, strlen(passwd_prompt)) == 0)
-                {
-                    pos = memchr(line, ':', line_size);
-                    passwd_request = true;
-                }
-                else
-                {
-                    pos = memchr(line, '\n', line_size);
-                }
-
-                if (pos == NULL)
-                {
-                    c->manage.saved_data = malloc(line_size);
-                    if (c->manage.saved_data)
-                    {
-                        c->manage.saved_size = line_size;
-                        memcpy(c->manage.saved_data, line, c->manage.saved_size);
-                    }
-                    break;
-                }
-
-                offset += (pos - line) + 1;
-
-                /* Reply to a management password request */
-                if (*c->manage.password && passwd_request)
-                {
-                    ManagementCommand(c, c->manage.password, NULL, regular);
-                    SecureZeroMemory(c->manage.password, sizeof(c->manage.password));
-
-                    continue;
-                }
-
-                if (!*c->manage.password && passwd_request)
-                {
-                    /* either we don't have a password or we used it and didn't match */
-                    MsgToEventLog(EVENTLOG_WARNING_TYPE,
-                                  L"%ls: management password mismatch",
-                                  c->config_name);
-                    c->state = disconnecting;
-                    CloseManagement(c);
-                    rtmsg_handler[stop_](c, "");
-
-                    continue;
-                }
-
-                /* Handle regular management interface output */
-                line[pos - line - 1] = '\0';
-                if (line[0] == '>')
-                {
-                    /* Real time notifications */
-                    pos = line + 1;
-                    if (strncmp(pos, "LOG:", 4) == 0)
-                    {
-                        if (rtmsg_handler[log_])
-                        {
-                            rtmsg_handler[log_](c, pos + 4);
-                        }
-                    }
-                    else if (strncmp(pos, "STATE:", 6) == 0)
-                    {
-                        if (rtmsg_handler[state_])
-                        {
-                            rtmsg_handler[state_](c, pos + 6);
-                        }
-                    }
-                    else if (strncmp(pos, "HOLD:", 5) == 0)
-                    {
-                        if (rtmsg_handler[hold_])
-                        {
-                            rtmsg_handler[hold_](c, pos + 5);
-                        }
-                    }
-                    else if (strncmp(pos, "PASSWORD:", 9) == 0)
-                    {
-                        if (rtmsg_handler[password_])
-                        {
-                            rtmsg_handler[password_](c, pos + 9);
-                        }
-                    }
-                    else if (strncmp(pos, "PROXY:", 6) == 0)
-                    {
-                        if (rtmsg_handler[proxy_])
-                        {
-                            rtmsg_handler[proxy_](c, pos + 6);
-                        }
-                    }
-                    else if (strncmp(pos, "INFO:", 5) == 0)
-                    {
-                        /* delay until management interface accepts input */
-                        /* use real sleep here, since WM_MANAGEMENT might arrive before management
-                         * is ready */
-                        Sleep(100);
-                        c->manage.connected = 2;
-                        if (rtmsg_handler[ready_])
-                        {
-                            rtmsg_handler[ready_](c, pos + 5);
-                        }
-                    }
-                    else if (strncmp(pos, "NEED-OK:", 8) == 0)
-                    {
-                        if (rtmsg_handler[needok_])
-                        {
-                            rtmsg_handler[needok_](c, pos + 8);
-                        }
-                    }
-                    else if (strncmp(pos, "NEED-STR:", 9) == 0)
-                    {
-                        if (rtmsg_handler[needstr_])
-                        {
-                            rtmsg_handler[needstr_](c, pos + 9);
-                        }
-                    }
-                    else if (strncmp(pos, "ECHO:", 5) == 0)
-                    {
-                        if (rtmsg_handler[echo_])
-                        {
-                            rtmsg_handler[echo_](c, pos + 5);
-                        }
-                    }
-                    else if (strncmp(pos, "BYTECOUNT:", 10) == 0)
-                    {
-                        if (rtmsg_handler[bytecount_])
-                        {
-                            rtmsg_handler[bytecount_](c, pos + 10);
-                        }
-                    }
-                    else if (strncmp(pos, "INFOMSG:", 8) == 0)
-                    {
-                        if (rtmsg_handler[infomsg_])
-                        {
-                            rtmsg_handler[infomsg_](c, pos + 8);
-                        }
-                    }
-                    else if (strncmp(pos, "PKCS11ID", 8) == 0 && c->manage.cmd_queue)
-                    {
-                        /* This is not a real-time message, but unfortunately implemented
-                         * in the core as one. Work around by handling the response here.
-                         */
-                        mgmt_cmd_t *cmd = c->manage.cmd_queue;
-                        if (cmd->handler)
-                        {
-                            cmd->handler(c, line);
-                        }
-                        UnqueueCommand(c);
-                    }
-                }
-                else if (c->manage.cmd_queue)
-                {
-                    /* Response to commands */
-                    mgmt_cmd_t *cmd = c->manage.cmd_queue;
-                    if (strncmp(line, "SUCCESS:", 8) == 0)
-                    {
-                        if (cmd->handler)
-                        {
-                            cmd->handler(c, line + 9);
-                        }
-                        UnqueueCommand(c);
-                    }
-                    else if (strncmp(line, "ERROR:", 6) == 0)
-                    {
-                        /* Response sent to management is not processed. Log an error in status
-                         * window  */
-                        char buf[256];
-                        _snprintf_0(buf,
-                                    "%lld,N,Previous command sent to management failed: %s",
-                                    (long long)time(NULL),
-                                    line);
-                        rtmsg_handler[log_](c, buf);
-
-                        if (cmd->handler)
-                        {
-                            cmd->handler(c, NULL);
-                        }
-                        UnqueueCommand(c);
-                    }
-                    else if (strcmp(line, "END") == 0)
-                    {
-                        UnqueueCommand(c);
-                    }
-                    else if (cmd->handler)
-                    {
-                        cmd->handler(c, line);
-                    }
-                }
-            }
-            free(data);
+            ReadManagement(c);
             break;
 
         case FD_WRITE:
@@ -504,18 +1031,24 @@ CloseManagement(connection_t *c)
 {
     if (c->manage.sk != INVALID_SOCKET)
     {
-        if (c->manage.saved_size)
+        KillTimer(c->hwndStatus, IDT_MGMT_RETRY);
+        UnregisterManagement(c);
+#ifdef DEBUG
+        CloseRecord(c);
+#endif
+        mgmt_buf_free(&c->manage.rbuf);
+        mgmt_buf_free(&c->manage.inbox);
+        /* The lines may still be in use by a handler */
+        if (!c->manage.reading)
         {
-            free(c->manage.saved_data);
-            c->manage.saved_data = NULL;
-            c->manage.saved_size = 0;
+            mgmt_buf_free(&c->manage.lines);
         }
         closesocket(c->manage.sk);
-        c->manage.sk = INVALID_SOCKET;
+        SetConnManagement(c, INVALID_SOCKET);
         c->manage.connected = 0;
-        while (UnqueueCommand(c))
-        {
-        }
+        c->manage.send_posted = FALSE;
+        FreeCommands(c);
         WSACleanup();
     }
 }
+
@@ -23,50 +23,9 @@
 #define MANAGE_H
 
 #include <winsock2.h>
+#include "mgmtproto.h"
 
-typedef enum
-{
-    ready_,
-    stop_,
-    bytecount_,
-    echo_,
-    hold_,
-    log_,
-    password_,
-    proxy_,
-    state_,
-    needok_,
-    needstr_,
-    pkcs11_id_count_,
-    infomsg_,
-    timeout_,
-    validate_,
-    mgmt_rtmsg_type_max
-} mgmt_rtmsg_type;
-
-typedef enum
-{
-    regular,
-    combined
-} mgmt_cmd_type;
-
-typedef void (*mgmt_msg_func)(connection_t *, char *);
-
-typedef struct
-{
-    mgmt_rtmsg_type type;
-    mgmt_msg_func handler;
-} mgmt_rtmsg_handler;
-
-typedef struct mgmt_cmd
-{
-    struct mgmt_cmd *prev, *next;
-    char *command;
-    int size;
-    mgmt_msg_func handler;
-    mgmt_cmd_type type;
-} mgmt_cmd_t;
-
+struct mgmt_reactor;
 
 void InitManagement(const mgmt_rtmsg_handler *handler);
 
@@ -74,8 +33,16 @@ BOOL OpenManagement(connection_t *);
 
 BOOL ManagementCommand(connection_t *, char *, mgmt_msg_func, mgmt_cmd_type);
 
+BOOL ManagementReply(connection_t *, char *);
+
+BOOL ManagementQuery(connection_t *, char *, mgmt_msg_func);
+
 void OnManagement(SOCKET, LPARAM);
 
+void RetryManagement(connection_t *);
+
 void CloseManagement(connection_t *);
 
+void StopManagementReactor(void);
+
 #endif /* ifndef MANAGE_H */
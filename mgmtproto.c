@@ -0,0 +1,546 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mgmtproto.h"
+
+/*
+ * Initial capacity of the per-connection receive buffers. A buffer
+ * is grown only when the data it has to hold does not fit.
+ */
+#define MGMT_RBUF_SIZE 4096
+
+/*
+ * Maximum number of unused command nodes kept per connection
+ */
+#define MGMT_CMD_POOL_MAX 16
+
+/* Wipe memory that may have held a password */
+static void
+wipe(void *p, size_t n)
+{
+#ifdef _WIN32
+    SecureZeroMemory(p, n);
+#else
+    volatile char *v = p;
+
+    while (n--)
+    {
+        *v++ = 0;
+    }
+#endif
+}
+
+int
+mgmt_buf_reserve(mgmt_buf_t *buf, size_t n)
+{
+    size_t size = buf->size ? buf->size : MGMT_RBUF_SIZE;
+    char *data;
+
+    if (buf->len + n <= buf->size)
+    {
+        return 1;
+    }
+
+    while (size < buf->len + n)
+    {
+        size *= 2;
+    }
+    data = realloc(buf->data, size);
+    if (data == NULL)
+    {
+        return 0;
+    }
+    buf->data = data;
+    buf->size = size;
+
+    return 1;
+}
+
+void
+mgmt_buf_free(mgmt_buf_t *buf)
+{
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+unsigned int
+mgmt_retry_delay(uint32_t *seed, int attempts, unsigned int min, unsigned int max)
+{
+    int shift = attempts > 1 ? (attempts - 1 < 16 ? attempts - 1 : 16) : 0;
+    unsigned int delay = (min << shift) < max ? min << shift : max;
+    uint32_t x = *seed ? *seed : 0x9e3779b9;
+
+    /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+
+    return delay - delay / 4 + x % (delay / 2 + 1);
+}
+
+int
+mgmt_split_lines(mgmt_buf_t *rbuf, mgmt_buf_t *inbox)
+{
+    static const char passwd_prompt[] = "ENTER PASSWORD:";
+    const size_t prompt_len = sizeof(passwd_prompt) - 1;
+    size_t offset = 0;
+    int ret = 1;
+
+    while (offset < rbuf->len)
+    {
+        char *line = rbuf->data + offset;
+        size_t line_size = rbuf->len - offset;
+        size_t len, next;
+
+        if (line_size >= prompt_len && memcmp(line, passwd_prompt, prompt_len) == 0)
+        {
+            len = next = prompt_len;
+        }
+        else
+        {
+            char *pos = memchr(line, '\n', line_size);
+            if (pos == NULL)
+            {
+                break;
+            }
+            next = pos - line + 1;
+            len = pos - line;
+            if (len > 0 && line[len - 1] == '\r')
+            {
+                len--;
+            }
+        }
+
+        if (!mgmt_buf_reserve(inbox, len + 1))
+        {
+            ret = 0;
+            break;
+        }
+        memcpy(inbox->data + inbox->len, line, len);
+        inbox->data[inbox->len + len] = '\0';
+        inbox->len += len + 1;
+
+        offset += next;
+    }
+
+    rbuf->len -= offset;
+    memmove(rbuf->data, rbuf->data + offset, rbuf->len);
+
+    return ret;
+}
+
+/*
+ * Check whether msg starts with prefix and return its length in *len
+ */
+static inline int
+match_prefix(const char *msg, const char *prefix, size_t *len)
+{
+    *len = strlen(prefix);
+    return strncmp(msg, prefix, *len) == 0;
+}
+
+/* Map a notification to its type in one step by switching on the first character */
+mgmt_rtmsg_type
+mgmt_rtmsg_type_of(const char *msg, size_t *len)
+{
+    switch (msg[0])
+    {
+        case 'B':
+            if (match_prefix(msg, "BYTECOUNT:", len))
+            {
+                return bytecount_;
+            }
+            break;
+
+        case 'E':
+            if (match_prefix(msg, "ECHO:", len))
+            {
+                return echo_;
+            }
+            break;
+
+        case 'H':
+            if (match_prefix(msg, "HOLD:", len))
+            {
+                return hold_;
+            }
+            break;
+
+        case 'I':
+            if (match_prefix(msg, "INFOMSG:", len))
+            {
+                return infomsg_;
+            }
+            if (match_prefix(msg, "INFO:", len))
+            {
+                return ready_;
+            }
+            break;
+
+        case 'L':
+            if (match_prefix(msg, "LOG:", len))
+            {
+                return log_;
+            }
+            break;
+
+        case 'N':
+            if (match_prefix(msg, "NEED-OK:", len))
+            {
+                return needok_;
+            }
+            if (match_prefix(msg, "NEED-STR:", len))
+            {
+                return needstr_;
+            }
+            break;
+
+        case 'P':
+            if (match_prefix(msg, "PASSWORD:", len))
+            {
+                return password_;
+            }
+            if (match_prefix(msg, "PROXY:", len))
+            {
+                return proxy_;
+            }
+            break;
+
+        case 'S':
+            if (match_prefix(msg, "STATE:", len))
+            {
+                return state_;
+            }
+            break;
+    }
+
+    return mgmt_rtmsg_type_max;
+}
+
+char *
+mgmt_join_log_lines(char *line, const char *end, unsigned long *count)
+{
+    char *tail = line + strlen(line);
+    char *next = tail + 1;
+
+    *count = 1;
+    while (next < end && strncmp(next, ">LOG:", 5) == 0)
+    {
+        size_t len = strlen(next + 5);
+
+        *tail++ = '\n';
+        memmove(tail, next + 5, len + 1);
+        tail += len;
+        next += 5 + len + 1;
+        (*count)++;
+    }
+
+    return next;
+}
+
+/*
+ * Get a command node from the pool or allocate a new one
+ */
+static mgmt_cmd_t *
+alloc_cmd(mgmt_cmdq_t *q)
+{
+    mgmt_cmd_t *cmd = q->pool;
+    if (cmd)
+    {
+        q->pool = cmd->next;
+        q->pool_size--;
+        cmd->prev = cmd->next = NULL;
+    }
+    else
+    {
+        cmd = calloc(1, sizeof(*cmd));
+        if (cmd == NULL)
+        {
+            return NULL;
+        }
+        q->stats.node_allocs++;
+    }
+    return cmd;
+}
+
+/*
+ * Wipe a command and return its node to the pool
+ */
+static void
+free_cmd(mgmt_cmdq_t *q, mgmt_cmd_t *cmd)
+{
+    if (cmd->command)
+    {
+        wipe(cmd->command, cmd->len);
+        if (cmd->command != cmd->buf)
+        {
+            free(cmd->command);
+        }
+    }
+    cmd->command = NULL;
+    cmd->sent = cmd->len = 0;
+
+    if (q->pool_size < MGMT_CMD_POOL_MAX)
+    {
+        cmd->next = q->pool;
+        q->pool = cmd;
+        q->pool_size++;
+    }
+    else
+    {
+        free(cmd);
+    }
+}
+
+mgmt_cmd_t *
+mgmt_cmdq_add(mgmt_cmdq_t *q, const char *command, mgmt_msg_func handler, mgmt_cmd_type type)
+{
+    size_t len = strlen(command) + 1;
+    mgmt_cmd_t *cmd = alloc_cmd(q);
+
+    if (cmd == NULL)
+    {
+        return NULL;
+    }
+
+    cmd->len = (int)len;
+    cmd->sent = 0;
+    if (len <= sizeof(cmd->buf))
+    {
+        cmd->command = cmd->buf;
+    }
+    else
+    {
+        cmd->command = malloc(len);
+        if (cmd->command == NULL)
+        {
+            free_cmd(q, cmd);
+            return NULL;
+        }
+        q->stats.str_allocs++;
+    }
+    memcpy(cmd->command, command, len - 1);
+    cmd->command[len - 1] = '\n';
+    q->stats.commands++;
+    q->bytes += len;
+
+    cmd->handler = handler;
+    cmd->type = type;
+
+    if (q->queue)
+    {
+        cmd->next = q->queue;
+        cmd->prev = q->queue->prev;
+        cmd->next->prev = cmd->prev->next = cmd;
+    }
+    else
+    {
+        cmd->next = cmd->prev = cmd;
+        q->queue = cmd;
+    }
+
+    return cmd;
+}
+
+int
+mgmt_cmdq_remove(mgmt_cmdq_t *q)
+{
+    mgmt_cmd_t *cmd = q->queue;
+    if (!cmd)
+    {
+        return 0;
+    }
+
+    /* Wipe command as it may contain passwords */
+    wipe(cmd->command, cmd->len);
+
+    if (cmd->type == combined)
+    {
+        cmd->type = regular;
+        return 1;
+    }
+
+    if (cmd->next == cmd)
+    {
+        q->queue = NULL;
+    }
+    else
+    {
+        cmd->prev->next = cmd->next;
+        cmd->next->prev = cmd->prev;
+        q->queue = cmd->next;
+    }
+
+    q->bytes -= cmd->len;
+    free_cmd(q, cmd);
+
+    return 1;
+}
+
+int
+mgmt_cmdq_unsent(mgmt_cmdq_t *q, int max, char **buf, size_t *len)
+{
+    mgmt_cmd_t *cmd = q->queue;
+    int count = 0;
+
+    for (int i = 0; cmd && i < max; i++)
+    {
+        if (cmd->sent < cmd->len)
+        {
+            buf[count] = cmd->command + cmd->sent;
+            len[count] = cmd->len - cmd->sent;
+            count++;
+        }
+        cmd = cmd->next;
+        if (cmd == q->queue)
+        {
+            break;
+        }
+    }
+
+    return count;
+}
+
+void
+mgmt_cmdq_sent(mgmt_cmdq_t *q, size_t n)
+{
+    /* Partial writes are kept track of by advancing the offsets in order */
+    for (mgmt_cmd_t *cmd = q->queue; n > 0; cmd = cmd->next)
+    {
+        size_t part = n < (size_t)(cmd->len - cmd->sent) ? n : (size_t)(cmd->len - cmd->sent);
+
+        cmd->sent += (int)part;
+        n -= part;
+    }
+    q->stats.sends++;
+}
+
+void
+mgmt_cmdq_clear(mgmt_cmdq_t *q)
+{
+    while (q->queue)
+    {
+        q->queue->type = regular;
+        mgmt_cmdq_remove(q);
+    }
+    while (q->pool)
+    {
+        mgmt_cmd_t *cmd = q->pool;
+        q->pool = cmd->next;
+        free(cmd);
+    }
+    q->pool_size = 0;
+}
+
+int
+mgmt_dispatch(mgmt_cmdq_t *q, const mgmt_msg_func *handler, struct connection *c, char *line)
+{
+    mgmt_cmd_t *cmd = q->queue;
+
+    if (line[0] == '>')
+    {
+        /* Real time notifications */
+        size_t len;
+        mgmt_rtmsg_type type = mgmt_rtmsg_type_of(line + 1, &len);
+
+        if (type == ready_)
+        {
+            return MGMT_DISPATCH_BANNER;
+        }
+        else if (type != mgmt_rtmsg_type_max)
+        {
+            if (handler[type])
+            {
+                handler[type](c, line + 1 + len);
+            }
+        }
+        else if (strncmp(line + 1, "PKCS11ID", 8) == 0 && cmd)
+        {
+            /* This is not a real-time message, but unfortunately implemented
+             * in the core as one. Work around by handling the response here.
+             */
+            if (cmd->handler)
+            {
+                cmd->handler(c, line);
+            }
+            mgmt_cmdq_remove(q);
+            return MGMT_DISPATCH_ANSWERED;
+        }
+    }
+    else if (cmd)
+    {
+        /* Response to commands */
+        if (strncmp(line, "SUCCESS:", 8) == 0)
+        {
+            if (cmd->handler)
+            {
+                cmd->handler(c, line + 9);
+            }
+            mgmt_cmdq_remove(q);
+            return MGMT_DISPATCH_ANSWERED;
+        }
+        else if (strncmp(line, "ERROR:", 6) == 0)
+        {
+            /* Response sent to management is not processed. Log an error in status
+             * window  */
+            if (handler[log_])
+            {
+                char buf[256];
+                snprintf(buf,
+                         sizeof(buf),
+                         "%lld,N,Previous command sent to management failed: %s",
+                         (long long)time(NULL),
+                         line);
+                handler[log_](c, buf);
+            }
+
+            if (cmd->handler)
+            {
+                cmd->handler(c, NULL);
+            }
+            /* the error answers one part of a combined command: the
+             * other part is still to come */
+            mgmt_cmdq_remove(q);
+            return MGMT_DISPATCH_ANSWERED;
+        }
+        else if (strcmp(line, "END") == 0)
+        {
+            mgmt_cmdq_remove(q);
+            return MGMT_DISPATCH_ANSWERED;
+        }
+        else if (cmd->handler)
+        {
+            cmd->handler(c, line);
+        }
+    }
+
+    return 0;
+}
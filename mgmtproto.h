@@ -0,0 +1,204 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The OpenVPN management interface protocol without the sockets: output
+ * split into lines, real-time notifications told apart, and commands
+ * queued with their responses matched to them in order.
+ */
+
+#ifndef MGMTPROTO_H
+#define MGMTPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    ready_,
+    stop_,
+    bytecount_,
+    echo_,
+    hold_,
+    log_,
+    password_,
+    proxy_,
+    state_,
+    needok_,
+    needstr_,
+    pkcs11_id_count_,
+    infomsg_,
+    timeout_,
+    validate_,
+    mgmt_rtmsg_type_max
+} mgmt_rtmsg_type;
+
+typedef enum
+{
+    regular,
+    combined
+} mgmt_cmd_type;
+
+struct connection;
+
+typedef void (*mgmt_msg_func)(struct connection *, char *);
+
+typedef struct
+{
+    mgmt_rtmsg_type type;
+    mgmt_msg_func handler;
+} mgmt_rtmsg_handler;
+
+/* Commands up to this length (including the newline) are stored inline */
+#define MGMT_CMD_INLINE_SIZE 128
+
+typedef struct mgmt_cmd
+{
+    struct mgmt_cmd *prev, *next;
+    char *command; /* points to buf unless the command is too long */
+    int sent;      /* number of bytes already sent */
+    int len;       /* length of the command including the newline */
+    mgmt_msg_func handler;
+    mgmt_cmd_type type;
+    char buf[MGMT_CMD_INLINE_SIZE];
+} mgmt_cmd_t;
+
+/* A growable buffer of management interface output */
+typedef struct
+{
+    char *data;
+    size_t size; /* capacity of data */
+    size_t len;  /* number of bytes used */
+} mgmt_buf_t;
+
+/* Allocation counters of the per-connection command pool */
+typedef struct
+{
+    unsigned long commands;    /* number of commands queued */
+    unsigned long sends;       /* number of writes to the socket */
+    unsigned long node_allocs; /* command nodes allocated from the heap */
+    unsigned long str_allocs;  /* commands too long to be stored inline */
+} mgmt_cmd_stats_t;
+
+/* The commands of a connection waiting for their responses */
+typedef struct
+{
+    mgmt_cmd_t *queue;      /* circular list, oldest first, NULL if empty */
+    size_t bytes;           /* length of the commands in queue */
+    mgmt_cmd_t *pool;       /* unused command nodes kept for reuse */
+    int pool_size;          /* number of nodes in pool */
+    mgmt_cmd_stats_t stats; /* command allocation counters */
+} mgmt_cmdq_t;
+
+/*
+ * Management sessions are recorded in debug builds with the
+ * mgmt_record_dir option. A recording starts with MGMT_RECORD_MAGIC
+ * and holds the data of every recv() preceded by a mgmt_record_t
+ * header, little-endian as written on Windows, so that the boundaries of
+ * the reads are preserved. tests/test_mgmtproto replays such recordings.
+ */
+#define MGMT_RECORD_MAGIC "OVPNMGMT"
+
+typedef struct
+{
+    uint64_t time;     /* milliseconds since the session was opened */
+    uint32_t len;      /* number of bytes that follow */
+    uint32_t reserved; /* zero */
+} mgmt_record_t;
+
+/*
+ * Return the delay in milliseconds after the given number of failed
+ * attempts to connect: doubling from min up to max and randomized by
+ * +/-25% with the random state *seed of the connection, so that
+ * connections waiting for the same daemon do not retry in lock-step.
+ */
+unsigned int mgmt_retry_delay(uint32_t *seed, int attempts, unsigned int min, unsigned int max);
+
+/* Make sure buf has room for n more bytes. Returns 0 if out of memory. */
+int mgmt_buf_reserve(mgmt_buf_t *buf, size_t n);
+
+void mgmt_buf_free(mgmt_buf_t *buf);
+
+/*
+ * Move the complete lines received into rbuf to inbox, each NUL
+ * terminated and without its line end. A password prompt is not
+ * terminated by a newline and is passed on as a line of its own. A
+ * partial line is left at the start of rbuf. Returns 0 if out of memory.
+ */
+int mgmt_split_lines(mgmt_buf_t *rbuf, mgmt_buf_t *inbox);
+
+/*
+ * Return the type of a real-time notification (without the leading '>')
+ * and the length of its prefix in *len, or mgmt_rtmsg_type_max if the
+ * notification is not known. The >INFO: banner is of type ready_.
+ */
+mgmt_rtmsg_type mgmt_rtmsg_type_of(const char *msg, size_t *len);
+
+/*
+ * Join the >LOG: line at line and the >LOG: lines directly following
+ * it, up to end, into one notification with the records separated by
+ * newlines, so that the log handler can append them in one operation.
+ * The number of lines joined is returned in *count. Returns the start
+ * of the first line not included.
+ */
+char *mgmt_join_log_lines(char *line, const char *end, unsigned long *count);
+
+/*
+ * Queue a command, which is copied and terminated by a newline. Returns
+ * the command, or NULL if out of memory.
+ */
+mgmt_cmd_t *mgmt_cmdq_add(mgmt_cmdq_t *q,
+                          const char *command,
+                          mgmt_msg_func handler,
+                          mgmt_cmd_type type);
+
+/*
+ * Remove the oldest command after one of its responses. A combined
+ * command gets two responses and is only removed after the second one.
+ * The command is wiped, as it may contain a password. Returns 0 if the
+ * queue is empty.
+ */
+int mgmt_cmdq_remove(mgmt_cmdq_t *q);
+
+/*
+ * Gather the unsent parts of the oldest max commands, the window of
+ * commands that may be in flight, into buf[] and len[], which have room
+ * for max entries. Returns the number of entries, 0 if all is sent.
+ */
+int mgmt_cmdq_unsent(mgmt_cmdq_t *q, int max, char **buf, size_t *len);
+
+/* Record that n bytes of the gathered commands were written */
+void mgmt_cmdq_sent(mgmt_cmdq_t *q, size_t n);
+
+/* Remove all commands, ending their responses, and free the pool */
+void mgmt_cmdq_clear(mgmt_cmdq_t *q);
+
+/* Flags returned by mgmt_dispatch() */
+#define MGMT_DISPATCH_BANNER   0x1 /* the line is the >INFO: banner, left to the caller */
+#define MGMT_DISPATCH_ANSWERED 0x2 /* the oldest command was answered */
+
+/*
+ * Handle a line of management interface output: a real-time
+ * notification is passed to its handler in handler[], indexed by type,
+ * and a response to the handler of the oldest command in q. Returns
+ * MGMT_DISPATCH_* flags.
+ */
+int mgmt_dispatch(mgmt_cmdq_t *q, const mgmt_msg_func *handler, struct connection *c, char *line);
+
+#endif /* ifndef MGMTPROTO_H */
@@ -246,7 +246,7 @@ ManagementCommandFromInput(connection_t *c, LPCSTR fmt, HWND hDlg, int id)
     if (cmd)
     {
         snprintf(cmd, cmd_len, fmt, input);
-        retval = ManagementCommand(c, cmd, NULL, regular);
+        retval = ManagementReply(c, cmd);
         free(cmd);
     }
 
@@ -293,7 +293,7 @@ ManagementCommandFromTwoInputsBase64(connection_t *c, LPCSTR fmt, HWND hDlg, int
     if (cmd)
     {
         snprintf(cmd, cmd_len, fmt, input_b64, input2_b64);
-        retval = ManagementCommand(c, cmd, NULL, regular);
+        retval = ManagementReply(c, cmd);
         free(cmd);
     }
 
@@ -350,7 +350,7 @@ ManagementCommandFromInputBase64(connection_t *c, LPCSTR fmt, HWND hDlg, int id)
     if (cmd)
     {
         snprintf(cmd, cmd_len, fmt, input_b64);
-        retval = ManagementCommand(c, cmd, NULL, regular);
+        retval = ManagementReply(c, cmd);
         free(cmd);
     }
 
@@ -903,8 +903,8 @@ BOOL
 ParseManagementAddress(connection_t *c)
 {
     BOOL ret = true;
-    wchar_t *pw_file = NULL;
-    wchar_t *workdir = c->config_dir;
+    const wchar_t *pw_file = NULL;
+    const wchar_t *workdir = c->config_dir;
     wchar_t config_path[MAX_PATH];
     wchar_t pw_path[MAX_PATH] = L"";
 
@@ -923,21 +923,21 @@ ParseManagementAddress(connection_t *c)
 
     while (l)
     {
-        if (l->ntokens >= 3 && !wcscmp(l->tokens[0], L"management"))
+        if (l->ntokens >= 3 && !wcscmp(config_token(l, 0), L"management"))
         {
             /* we require the address to be a numerical ipv4 address -- e.g., 127.0.0.1*/
-            if (InetPtonW(AF_INET, l->tokens[1], &addr->sin_addr) != 1)
+            if (InetPtonW(AF_INET, config_token(l, 1), &addr->sin_addr) != 1)
             {
                 config_list_free(head);
                 return false;
             }
 
-            addr->sin_port = htons(_wtoi(l->tokens[2]));
-            pw_file = l->tokens[3]; /* may be null */
+            addr->sin_port = htons(_wtoi(config_token(l, 2)));
+            pw_file = config_token(l, 3); /* may be null */
         }
-        else if (l->ntokens >= 2 && !wcscmp(l->tokens[0], L"cd"))
+        else if (l->ntokens >= 2 && !wcscmp(config_token(l, 0), L"cd"))
         {
-            workdir = l->tokens[1];
+            workdir = config_token(l, 1);
         }
         l = l->next;
     }
@@ -54,6 +54,7 @@
 #define ID_DETACH                       167
 #define ID_TXT_BYTECOUNT                168
 #define ID_TXT_IP                       169
+#define ID_CMB_LOGFILTER                159
 
 /* Change Passphrase Dialog */
 #define ID_DLG_CHGPASS                  170
@@ -170,6 +171,20 @@
 #define ID_STATIC_QR                    501
 #define ID_TXT_QR                       502
 
+/* Log search dialog */
+#define ID_DLG_LOGSEARCH                510
+#define ID_EDT_LOGSEARCH                511
+#define ID_LVW_LOGSEARCH                512
+#define ID_TXT_LOGSEARCH                513
+
+/* Log viewer dialog */
+#define ID_DLG_LOGVIEW                  520
+#define ID_LST_LOGVIEW                  521
+
+/* Log timeline dialog */
+#define ID_DLG_TIMELINE                 530
+#define ID_LST_TIMELINE                 531
+
 /* General settings contd.. */
 
 #define ID_CHK_CONCAT_OTP               470
@@ -198,6 +213,8 @@
 #define IDS_MENU_IMPORT_AS              1026
 #define IDS_MENU_IMPORT_FILE            1027
 #define IDS_MENU_IMPORT_URL             1028
+#define IDS_MENU_SEARCHLOGS             1029
+#define IDS_MENU_TIMELINE               1030
 
 /* LogViewer Dialog */
 #define IDS_ERR_START_LOG_VIEWER        1101
@@ -332,6 +349,19 @@
 #define IDS_CERT_ISSUER                 2163
 #define IDS_CERT_NOTAFTER               2164
 
+/* log search related */
+#define IDS_LOGSEARCH_CONNECTION        2170
+#define IDS_LOGSEARCH_LINE              2171
+#define IDS_NFO_LOGSEARCH_RESULT        2172
+#define IDS_NFO_LOGSEARCH_LIMIT         2173
+#define IDS_NFO_LOGSEARCH_RUNNING       2174
+
+/* log filter related */
+#define IDS_LOGFILTER_ALL               2180
+#define IDS_LOGFILTER_NODEBUG           2181
+#define IDS_LOGFILTER_WARNINGS          2182
+#define IDS_LOGFILTER_ERRORS            2183
+
 /* openvpn daemon state descriptions */
 /* Needs to be kept in sync with daemon_states[] in openvpn.c */
 #define IDS_NFO_OVPN_STATE_INITIAL      2200
@@ -351,5 +381,10 @@
 
 /* Timer IDs */
 #define IDT_STOP_TIMER                  2500 /* Timer used to trigger force termination */
+#define IDT_MGMT_RETRY                  2501 /* Timer used to retry connecting to management */
+#define IDT_LOG_FOLLOW                  2503 /* Timer used to check the viewed log for new lines */
+#define IDT_TIMELINE_REFRESH            2504 /* Timer used to merge new log lines into the timeline */
+#define IDT_EVENT_FLUSH                 2505 /* Timer used to flush buffered connection events */
+#define IDT_DAEMON_LOG                  2506 /* Timer used to advance the position in the daemon log */
 
 #endif                                       /* ifndef OPENVPN_GUI_RES_H */
@@ -63,6 +63,12 @@
 #include "pkcs11.h"
 #include "service.h"
 #include "qr.h"
+#include "logbuf.h"
+#include "logfilter.h"
+#include "logrotate.h"
+#include "eventlog.h"
+#include "logfollow.h"
+#include "registry.h"
 
 #define OPENVPN_SERVICE_PIPE_NAME_OVPN2 L"\\\\.\\pipe\\openvpn\\service"
 #define OPENVPN_SERVICE_PIPE_NAME_OVPN3 L"\\\\.\\pipe\\ovpnagent"
@@ -73,6 +79,10 @@ static BOOL TerminateOpenVPN(connection_t *c);
 
 static BOOL LaunchOpenVPN(connection_t *c);
 
+static BOOL ShowDaemonLog(connection_t *c);
+
+static void CatchUpDaemonLog(connection_t *c, time_t timestamp, const char *line, size_t len);
+
 const TCHAR *cfgProp = _T("conn");
 
 /* Replace excluded characters by specified one */
@@ -130,8 +140,7 @@ show_error_tip(HWND editbox, const WCHAR *msg)
 }
 
 /*
- * Receive banner on connection to management interface
- * Format: <BANNER>
+ * Handle the management interface becoming ready for input
  */
 void
 OnReady(connection_t *c, UNUSED char *msg)
@@ -143,7 +152,15 @@ OnReady(connection_t *c, UNUSED char *msg)
         ManagementCommand(c, "version 4", NULL, regular);
     }
     ManagementCommand(c, "state on", NULL, regular);
-    ManagementCommand(c, "log on all", OnLogLine, combined);
+    /* lines a persistent connection logged before we attached are read from its log file */
+    if ((c->flags & FLAG_DAEMON_PERSISTENT) && ShowDaemonLog(c))
+    {
+        ManagementCommand(c, "log on", NULL, regular);
+    }
+    else
+    {
+        ManagementCommand(c, "log on all", OnLogLine, combined);
+    }
     ManagementCommand(c, "echo on all", OnEcho, combined);
     ManagementCommand(c, "bytecount 5", NULL, regular);
 
@@ -167,7 +184,7 @@ OnHold(connection_t *c, UNUSED char *msg)
     if ((c->flags & FLAG_DAEMON_PERSISTENT) && (c->state == disconnecting || c->state == resuming))
     {
         /* retain the hold state if we are here while disconnecting  */
-        c->state = onhold;
+        SetConnState(c, onhold);
         SetMenuStatus(c, onhold);
         SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_ONHOLD));
         SetStatusWinIcon(c->hwndStatus, ID_ICO_DISCONNECTED);
@@ -181,77 +198,683 @@ OnHold(connection_t *c, UNUSED char *msg)
 }
 
 /*
- * Handle a log line from the OpenVPN management interface
- * Format <TIMESTAMP>,<FLAGS>,<MESSAGE>
+ * Format a line of the log window as "<date> <text>". Returns a newly
+ * allocated string or NULL on error. The caller must free it.
  */
-void
-OnLogLine(connection_t *c, char *line)
+static WCHAR *
+FormatLogLine(connection_t *c, const log_line_t *line)
+{
+    const size_t date_len = LOG_DATE_LEN + 1;
+    WCHAR *text;
+    int len;
+
+    len = MultiByteToWideChar(CP_UTF8, 0, line->text, -1, NULL, 0);
+    text = malloc((date_len + max(len, 1)) * sizeof(WCHAR));
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    logbuf_format_date(&c->log_lines.date, line->timestamp, text);
+    text[LOG_DATE_LEN] = L' ';
+    if (len <= 0 || MultiByteToWideChar(CP_UTF8, 0, line->text, -1, text + date_len, len) == 0)
+    {
+        text[date_len] = L'\0';
+    }
+
+    return text;
+}
+
+/*
+ * Draw a row of the log window. Only rows in view are drawn, so the
+ * cost of updating the window does not depend on the number of lines.
+ * The rows are measured as they are drawn, for the horizontal scroll
+ * range set by UpdateLogView().
+ */
+static void
+DrawLogLine(connection_t *c, const DRAWITEMSTRUCT *dis)
+{
+    const log_line_t *line = NULL;
+    BOOL selected = (dis->itemState & ODS_SELECTED) != 0;
+    COLORREF text_clr = GetSysColor(selected ? COLOR_HIGHLIGHTTEXT : COLOR_WINDOWTEXT);
+    WCHAR *text = NULL;
+    SIZE size;
+
+    if (dis->itemID != (UINT)-1)
+    {
+        line = logfilter_get(&c->log_filter, &c->log_lines, dis->itemID);
+    }
+    if (line)
+    {
+        text = FormatLogLine(c, line);
+
+        /* change text color if Warning or Error */
+        if (!selected && (line->flags & LOG_LINE_ERROR) && o.clr_error)
+        {
+            text_clr = o.clr_error;
+        }
+        else if (!selected && (line->flags & LOG_LINE_WARNING) && o.clr_warning)
+        {
+            text_clr = o.clr_warning;
+        }
+    }
+
+    SetBkColor(dis->hDC, GetSysColor(selected ? COLOR_HIGHLIGHT : COLOR_WINDOW));
+    SetTextColor(dis->hDC, text_clr);
+    ExtTextOutW(dis->hDC,
+                dis->rcItem.left + DPI_SCALE(2),
+                dis->rcItem.top,
+                ETO_OPAQUE | ETO_CLIPPED,
+                &dis->rcItem,
+                text ? text : L"",
+                text ? (UINT)wcslen(text) : 0,
+                NULL);
+
+    if (text && GetTextExtentPoint32W(dis->hDC, text, (int)wcslen(text), &size))
+    {
+        c->log_width = max(c->log_width, size.cx + DPI_SCALE(4));
+    }
+    free(text);
+
+    if (dis->itemState & ODS_FOCUS)
+    {
+        DrawFocusRect(dis->hDC, &dis->rcItem);
+    }
+}
+
+/*
+ * Copy the selected rows of the log window to the clipboard
+ */
+static void
+CopyLogLines(connection_t *c, HWND logWnd)
+{
+    int count = SendMessage(logWnd, LB_GETSELCOUNT, 0, 0);
+    int *items;
+    WCHAR *buf = NULL;
+    size_t len = 0;
+    HGLOBAL mem;
+
+    if (count <= 0)
+    {
+        return;
+    }
+    items = malloc(count * sizeof(*items));
+    if (items == NULL)
+    {
+        return;
+    }
+    count = SendMessage(logWnd, LB_GETSELITEMS, count, (LPARAM)items);
+
+    for (int i = 0; i < count; i++)
+    {
+        const log_line_t *line = logfilter_get(&c->log_filter, &c->log_lines, items[i]);
+        WCHAR *text = line ? FormatLogLine(c, line) : NULL;
+        if (text)
+        {
+            size_t text_len = wcslen(text);
+            WCHAR *tmp = realloc(buf, (len + text_len + 3) * sizeof(WCHAR));
+            if (tmp)
+            {
+                buf = tmp;
+                wcscpy(buf + len, text);
+                wcscpy(buf + len + text_len, L"\r\n");
+                len += text_len + 2;
+            }
+            free(text);
+        }
+    }
+    free(items);
+
+    if (buf == NULL)
+    {
+        return;
+    }
+    mem = GlobalAlloc(GMEM_MOVEABLE, (len + 1) * sizeof(WCHAR));
+    if (mem)
+    {
+        memcpy(GlobalLock(mem), buf, (len + 1) * sizeof(WCHAR));
+        GlobalUnlock(mem);
+        if (!OpenClipboard(logWnd))
+        {
+            GlobalFree(mem);
+        }
+        else
+        {
+            EmptyClipboard();
+            if (!SetClipboardData(CF_UNICODETEXT, mem))
+            {
+                GlobalFree(mem);
+            }
+            CloseClipboard();
+        }
+    }
+    free(buf);
+}
+
+/*
+ * Update the log window after lines were added to the connection's log
+ * buffer: the rows of lines passing the filter are added and those of
+ * dropped lines removed. The view keeps following the end of the log
+ * unless it was scrolled back.
+ */
+static void
+UpdateLogView(connection_t *c)
 {
     HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
-    time_t timestamp;
-    TCHAR *datetime;
-    const SETTEXTEX ste = { .flags = ST_SELECTION, .codepage = CP_UTF8 };
+    const logbuf_t *lb = &c->log_lines;
+    logfilter_t *f = &c->log_filter;
+    size_t old_rows = f->count;
+    size_t shift = 0;
+    size_t added;
+    int top, page, height;
+    BOOL follow;
+    RECT rect;
+
+    logfilter_update(f, lb, &shift);
+    added = f->count - (old_rows - shift);
+    if (!logWnd || (added == 0 && shift == 0))
+    {
+        return;
+    }
+
+    /* widen the horizontal scroll range to the rows drawn */
+    if (c->log_width > SendMessage(logWnd, LB_GETHORIZONTALEXTENT, 0, 0))
+    {
+        SendMessage(logWnd, LB_SETHORIZONTALEXTENT, c->log_width, 0);
+    }
 
-    char *flags = strchr(line, ',');
-    if (flags == NULL)
+    top = SendMessage(logWnd, LB_GETTOPINDEX, 0, 0);
+    height = SendMessage(logWnd, LB_GETITEMHEIGHT, 0, 0);
+    GetClientRect(logWnd, &rect);
+    page = (height > 0) ? rect.bottom / height : 1;
+    follow = (top + page >= (int)old_rows);
+
+    SendMessage(logWnd, WM_SETREDRAW, FALSE, 0);
+    SendMessage(logWnd, LB_SETCOUNT, f->count, 0);
+    if (follow)
+    {
+        SendMessage(logWnd, LB_SETTOPINDEX, f->count - 1, 0);
+    }
+    else
+    {
+        /* keep the same lines in view although older lines were dropped */
+        SendMessage(logWnd, LB_SETTOPINDEX, (size_t)top > shift ? top - shift : 0, 0);
+    }
+    SendMessage(logWnd, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(logWnd, NULL, TRUE);
+}
+
+/* Filters of the log window in the order of the filter combo box */
+static const struct
+{
+    UINT name;         /* string resource id */
+    unsigned int show; /* see logfilter_t */
+    unsigned int hide;
+} log_filters[] = {
+    { IDS_LOGFILTER_ALL, 0, 0 },
+    { IDS_LOGFILTER_NODEBUG, 0, LOG_LINE_DEBUG },
+    { IDS_LOGFILTER_WARNINGS, LOG_LINE_WARNING | LOG_LINE_ERROR, 0 },
+    { IDS_LOGFILTER_ERRORS, LOG_LINE_ERROR, 0 },
+};
+
+/*
+ * Show the lines passing the i'th filter in the log window. The rows
+ * are taken from an index of the line flags, so switching filters does
+ * not look at the text of the lines.
+ */
+static void
+SetLogFilter(connection_t *c, size_t i)
+{
+    HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
+
+    if (i >= _countof(log_filters))
     {
         return;
     }
-    flags++;
+    logfilter_set(&c->log_filter, &c->log_lines, log_filters[i].show, log_filters[i].hide);
+
+    SendMessage(logWnd, WM_SETREDRAW, FALSE, 0);
+    SendMessage(logWnd, LB_SETCOUNT, c->log_filter.count, 0);
+    SendMessage(logWnd, LB_SETTOPINDEX, c->log_filter.count - 1, 0);
+    SendMessage(logWnd, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(logWnd, NULL, TRUE);
+}
 
-    char *message = strchr(flags, ',');
-    if (message == NULL)
+/*
+ * If event_log is enabled, log lines, state changes, byte counts and
+ * echo directives of a connection are also written as JSON objects, one
+ * per line, to <config>.jsonl next to its log file. The events are
+ * collected in a fixed buffer that is written out when it is full, when
+ * the flush timer expires, or when the connection is cleaned up. The
+ * file is kept open while the connection runs and is rotated like
+ * appended logs.
+ */
+#define EVENT_FLUSH_INTERVAL 1000 /* milliseconds */
+
+/*
+ * Move to the end of a newly opened event file and return its size. A
+ * file not ending with a line feed, e.g., after a crash, is ended with
+ * one, so that the next event starts on a line of its own.
+ */
+static ULONGLONG
+OpenEventFileEnd(HANDLE file)
+{
+    LARGE_INTEGER zero = { .QuadPart = 0 };
+    LARGE_INTEGER back = { .QuadPart = -1 };
+    LARGE_INTEGER size = { .QuadPart = 0 };
+    char last = '\n';
+    DWORD n;
+
+    if (SetFilePointerEx(file, zero, &size, FILE_END) && size.QuadPart > 0
+        && SetFilePointerEx(file, back, NULL, FILE_END))
+    {
+        if (!ReadFile(file, &last, 1, &n, NULL) || n != 1)
+        {
+            last = '\n';
+        }
+        SetFilePointerEx(file, zero, NULL, FILE_END);
+    }
+    if (last != '\n' && WriteFile(file, "\n", 1, &n, NULL) && n == 1)
     {
+        size.QuadPart++;
+    }
+    return (ULONGLONG)size.QuadPart;
+}
+
+/*
+ * Write formatted events to the event file, opening it if necessary.
+ * The file is only rotated between events. If events cannot be written,
+ * the file is cut back to the last whole event and the rest of the
+ * event is dropped, so that every line of the file is a whole event.
+ */
+static void
+WriteEvents(void *arg, const char *data, size_t len, int partial)
+{
+    connection_t *c = arg;
+    const WCHAR *ext = wcsrchr(c->log_path, L'.');
+    WCHAR path[MAX_PATH];
+    LARGE_INTEGER size;
+    DWORD written;
+
+    /* the rest of an event that could not be written */
+    if (c->events.discard)
+    {
+        const char *lf = memchr(data, '\n', len);
+        if (!lf)
+        {
+            return;
+        }
+        len -= lf + 1 - data;
+        data = lf + 1;
+        c->events.discard = FALSE;
+        if (len == 0)
+        {
+            return;
+        }
+    }
+
+    /* close a full file so that it is rotated when it is next opened */
+    if (c->events.file && c->events.size == c->events.whole && o.log_rotate_size
+        && c->events.size >= (ULONGLONG)o.log_rotate_size * 1024 * 1024)
+    {
+        CloseHandle(c->events.file);
+        c->events.file = NULL;
+    }
+
+    if (!c->events.file)
+    {
+        /* <config>.log -> <config>.jsonl */
+        _sntprintf_0(path,
+                     L"%.*ls.jsonl",
+                     ext ? (int)(ext - c->log_path) : (int)wcslen(c->log_path),
+                     c->log_path);
+        RotateLog(path);
+
+        /* opened for writing, not appending, so that it can be cut back */
+        c->events.file = CreateFileW(path,
+                                     GENERIC_READ | GENERIC_WRITE,
+                                     FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                     NULL,
+                                     OPEN_ALWAYS,
+                                     FILE_ATTRIBUTE_NORMAL,
+                                     NULL);
+        if (c->events.file == INVALID_HANDLE_VALUE)
+        {
+            PrintDebug(L"Opening event file '%ls' failed (error = %lu)", path, GetLastError());
+            c->events.file = NULL;
+            c->events.discard = partial;
+            return;
+        }
+        c->events.size = c->events.whole = OpenEventFileEnd(c->events.file);
+    }
+
+    if (WriteFile(c->events.file, data, (DWORD)len, &written, NULL) && written == len)
+    {
+        c->events.size += written;
+        if (!partial)
+        {
+            c->events.whole = c->events.size;
+        }
         return;
     }
-    message++;
-    size_t flag_size = message - flags - 1; /* message is always > flags */
 
-    /* Remove lines from log window if it is getting full */
-    if (SendMessage(logWnd, EM_GETLINECOUNT, 0, 0) > MAX_LOG_LINES)
+    /* drop what was written of the events and the rest of the last one */
+    PrintDebug(L"Writing events of '%ls' failed (error = %lu)", c->config_name, GetLastError());
+    size.QuadPart = (LONGLONG)c->events.whole;
+    if (SetFilePointerEx(c->events.file, size, NULL, FILE_BEGIN) && SetEndOfFile(c->events.file))
     {
-        int pos = SendMessage(logWnd, EM_LINEINDEX, DEL_LOG_LINES, 0);
-        SendMessage(logWnd, EM_SETSEL, 0, pos);
-        SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T(""));
+        c->events.size = c->events.whole;
     }
+    else
+    {
+        /* the file ends with part of an event, which is ended with a
+         * line feed when the file is reopened */
+        CloseHandle(c->events.file);
+        c->events.file = NULL;
+    }
+    c->events.discard = partial;
+}
 
-    timestamp = strtol(line, NULL, 10);
-    datetime = _tctime(&timestamp);
-    datetime[24] = _T(' ');
+static void
+FlushEvents(connection_t *c)
+{
+    if (c->hwndStatus)
+    {
+        KillTimer(c->hwndStatus, IDT_EVENT_FLUSH);
+    }
+    if (c->events.log.write)
+    {
+        eventlog_flush(&c->events.log);
+    }
+}
 
-    /* deselect current selection, if any */
-    SendMessage(logWnd, EM_SETSEL, (WPARAM)-1, (LPARAM)-1);
+/*
+ * Start an event of the connection. Returns false if events are not
+ * logged, otherwise the event has to be ended by EndEvent().
+ */
+static BOOL
+BeginEvent(connection_t *c, time_t timestamp, const char *type)
+{
+    if (!o.event_log)
+    {
+        return FALSE;
+    }
+    if (!c->events.log.write)
+    {
+        eventlog_init(&c->events.log, WriteEvents, c);
+    }
 
-    /* change text color if Warning or Error */
-    COLORREF text_clr = 0;
+    /* first event of a batch: make sure it gets written soon */
+    if (c->events.log.len == 0 && c->hwndStatus)
+    {
+        SetTimer(c->hwndStatus, IDT_EVENT_FLUSH, EVENT_FLUSH_INTERVAL, NULL);
+    }
+
+    eventlog_begin(&c->events.log, (unsigned long long)timestamp, type);
+    eventlog_wstr(&c->events.log, "config", c->config_name);
 
-    if (memchr(flags, 'N', flag_size) || memchr(flags, 'F', flag_size))
+    return TRUE;
+}
+
+static void
+EndEvent(connection_t *c)
+{
+    eventlog_end(&c->events.log);
+    if (!c->hwndStatus)
     {
-        text_clr = o.clr_error;
+        FlushEvents(c);
     }
-    else if (memchr(flags, 'W', flag_size))
+}
+
+static const char *
+EventLevel(unsigned int flags)
+{
+    if (flags & LOG_LINE_ERROR)
     {
-        text_clr = o.clr_warning;
+        return "error";
     }
+    return (flags & LOG_LINE_WARNING) ? "warning" : "info";
+}
 
-    if (text_clr != 0)
+/*
+ * Handle one or more log lines from the OpenVPN management interface
+ * Format <TIMESTAMP>,<FLAGS>,<MESSAGE>[\n<TIMESTAMP>,<FLAGS>,<MESSAGE>...]
+ *
+ * The lines are added to the connection's log buffer and the log window
+ * is updated once for all of them.
+ */
+void
+OnLogLine(connection_t *c, char *line)
+{
+    for (char *next; line; line = next)
     {
-        CHARFORMAT cfm = {
-            .cbSize = sizeof(CHARFORMAT),
-            .dwMask = CFM_COLOR | CFM_BOLD,
-            .dwEffects = 0,
-            .crTextColor = text_clr,
-        };
-        SendMessage(logWnd, EM_SETCHARFORMAT, SCF_SELECTION, (LPARAM)&cfm);
+        next = strchr(line, '\n');
+        if (next)
+        {
+            *next++ = '\0';
+        }
+
+        char *log_flags = strchr(line, ',');
+        if (log_flags == NULL)
+        {
+            continue;
+        }
+        log_flags++;
+
+        char *message = strchr(log_flags, ',');
+        if (message == NULL)
+        {
+            continue;
+        }
+        message++;
+        size_t flag_size = message - log_flags - 1; /* message is always > flags */
+        unsigned int flags = logbuf_parse_flags(log_flags, flag_size);
+        time_t timestamp = strtol(line, NULL, 10);
+        size_t len = strlen(message);
+
+        if (c->daemon_log.catch_up && !c->daemon_log.first_seen)
+        {
+            CatchUpDaemonLog(c, timestamp, message, len);
+        }
+
+        AcquireSRWLockExclusive(&c->log_lock);
+        logbuf_append(&c->log_lines, timestamp, flags, message, len);
+        ReleaseSRWLockExclusive(&c->log_lock);
+
+        if (BeginEvent(c, timestamp, "log"))
+        {
+            const char *level = EventLevel(flags);
+            eventlog_str(&c->events.log, "source", "openvpn", 7);
+            eventlog_str(&c->events.log, "level", level, strlen(level));
+            eventlog_str(&c->events.log, "flags", log_flags, flag_size);
+            eventlog_str(&c->events.log, "text", message, len);
+            EndEvent(c);
+        }
     }
 
-    /* Append line to log window */
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM)datetime);
-    SendMessage(logWnd, EM_SETTEXTEX, (WPARAM)&ste, (LPARAM)message);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T("\n"));
+    UpdateLogView(c);
+}
+
+/*
+ * Persistent connections are run by the service, which writes their log
+ * to a file in the global log directory. When we attach to one, the
+ * lines it logged since we last saw it are read from that file instead
+ * of asking the management interface for its whole log history. The
+ * position up to which the file was read is saved per config in the
+ * registry, so this also works across restarts of the GUI. While we are
+ * attached, lines arrive through the management interface and the
+ * position is only advanced past them.
+ *
+ * Lines logged between reading the file and "log on" taking effect only
+ * appear in the file. So when the first line arrives through the
+ * management interface, the file is read again and the lines before
+ * that one are shown first. If it is not in the file yet, the lines up
+ * to it are shown when it is next polled.
+ */
+#define DAEMON_LOG_BACKLOG       (256 * 1024) /* maximum number of bytes read at once */
+#define DAEMON_LOG_POLL_INTERVAL 2000         /* milliseconds */
+#define DAEMON_LOG_SAVE_INTERVAL 30000        /* milliseconds */
+
+static void
+SaveDaemonLogPos(connection_t *c)
+{
+    SetConfigRegistryValueBinary(c->config_name,
+                                 L"daemon_log_pos",
+                                 (const BYTE *)&c->daemon_log.pos,
+                                 sizeof(c->daemon_log.pos));
+    c->daemon_log.saved = GetTickCount64();
+}
+
+/* Read the daemon log from the saved position, passing new lines to fn */
+static long
+ReadDaemonLog(connection_t *c, logfollow_fn fn)
+{
+    WCHAR rotated[MAX_PATH];
+    const WCHAR *rotated_path = NULL;
+
+    /* a rotated log is renamed to generation 1, see RotateLog() */
+    if (logrotate_path(rotated, _countof(rotated), c->log_path, 1))
+    {
+        rotated_path = rotated;
+    }
+    return logfollow_read(&c->daemon_log.pos, c->log_path, rotated_path, DAEMON_LOG_BACKLOG, fn, c);
+}
+
+/* Add a line of the daemon log to the log window */
+static void
+AddDaemonLogLine(void *arg, const char *line, size_t len)
+{
+    connection_t *c = arg;
+    size_t prefix = 0;
+    time_t timestamp = logfollow_line_time(&c->daemon_log.time, line, len, &prefix);
+    unsigned int flags = 0;
+
+    line += prefix;
+    len -= prefix;
+
+    /* the file has no flags: look for the prefixes openvpn adds */
+    if (len >= 6 && strncmp(line, "ERROR:", 6) == 0)
+    {
+        flags = LOG_LINE_ERROR;
+    }
+    else if (len >= 8 && strncmp(line, "WARNING:", 8) == 0)
+    {
+        flags = LOG_LINE_WARNING;
+    }
+
+    AcquireSRWLockExclusive(&c->log_lock);
+    logbuf_append(&c->log_lines, timestamp ? timestamp : time(NULL), flags, line, len);
+    ReleaseSRWLockExclusive(&c->log_lock);
+}
+
+/*
+ * Whether a line of the daemon log is at or after the first line received
+ * through the management interface. A line without a time is compared by
+ * its text only.
+ */
+static BOOL
+IsAfterFirstLine(connection_t *c, time_t timestamp, const char *line, size_t len)
+{
+    if (timestamp && timestamp != c->daemon_log.first_time)
+    {
+        return timestamp > c->daemon_log.first_time;
+    }
+    return len == c->daemon_log.first_len
+           && memcmp(line, c->daemon_log.first, min(len, sizeof(c->daemon_log.first))) == 0;
+}
+
+/* Add a line of the daemon log if it was logged before the first line received */
+static void
+CatchUpDaemonLogLine(void *arg, const char *line, size_t len)
+{
+    connection_t *c = arg;
+    size_t prefix = 0;
+    time_t timestamp;
+
+    if (!c->daemon_log.catch_up)
+    {
+        return;
+    }
+    timestamp = logfollow_line_time(&c->daemon_log.time, line, len, &prefix);
+    if (IsAfterFirstLine(c, timestamp, line + prefix, len - prefix))
+    {
+        c->daemon_log.catch_up = FALSE;
+        return;
+    }
+    AddDaemonLogLine(c, line, len);
+}
 
-    /* scroll to the caret */
-    SendMessage(logWnd, EM_SCROLLCARET, 0, 0);
+/*
+ * Called with the first line received through the management interface
+ * after "log on": show the lines logged to the file before it.
+ */
+static void
+CatchUpDaemonLog(connection_t *c, time_t timestamp, const char *line, size_t len)
+{
+    c->daemon_log.first_seen = TRUE;
+    c->daemon_log.first_time = timestamp;
+    c->daemon_log.first_len = len;
+    memcpy(c->daemon_log.first, line, min(len, sizeof(c->daemon_log.first)));
+
+    ReadDaemonLog(c, CatchUpDaemonLogLine);
+}
+
+/*
+ * Show the lines added to the daemon log since it was last read and
+ * start following it. Returns false if the log cannot be read.
+ */
+static BOOL
+ShowDaemonLog(connection_t *c)
+{
+    if (!c->daemon_log.active
+        && GetConfigRegistryValue(c->config_name,
+                                  L"daemon_log_pos",
+                                  (BYTE *)&c->daemon_log.pos,
+                                  sizeof(c->daemon_log.pos))
+               != sizeof(c->daemon_log.pos))
+    {
+        CLEAR(c->daemon_log.pos);
+    }
+
+    if (ReadDaemonLog(c, AddDaemonLogLine) < 0)
+    {
+        PrintDebug(L"Reading daemon log '%ls' failed", c->log_path);
+        c->daemon_log.active = FALSE;
+        c->daemon_log.catch_up = FALSE;
+        return FALSE;
+    }
+    UpdateLogView(c);
+    SaveDaemonLogPos(c);
+
+    c->daemon_log.active = TRUE;
+    c->daemon_log.catch_up = TRUE;
+    c->daemon_log.first_seen = FALSE;
+    SetTimer(c->hwndStatus, IDT_DAEMON_LOG, DAEMON_LOG_POLL_INTERVAL, NULL);
+
+    return TRUE;
+}
+
+/* Advance the position in the daemon log past the lines shown by now */
+static void
+FollowDaemonLog(connection_t *c)
+{
+    /* where the lines received through the management interface start is not known yet */
+    if (!c->daemon_log.active || (c->daemon_log.catch_up && !c->daemon_log.first_seen))
+    {
+        return;
+    }
+    if (!c->daemon_log.catch_up)
+    {
+        ReadDaemonLog(c, NULL);
+    }
+    else if (ReadDaemonLog(c, CatchUpDaemonLogLine) > 0)
+    {
+        UpdateLogView(c);
+    }
+
+    if (GetTickCount64() - c->daemon_log.saved >= DAEMON_LOG_SAVE_INTERVAL)
+    {
+        SaveDaemonLogPos(c);
+    }
 }
 
 /* expect ipv4,remote,port,,,ipv6 */
@@ -318,6 +941,42 @@ NotifyStateChange(HWND hwnd, LPARAM lParam)
     return TRUE;
 }
 
+/*
+ * Write a state change to the event log. addresses is the rest of the
+ * notification: local IP, remote IP and port, local address and port,
+ * and local IPv6 address, any of which may be empty.
+ */
+static void
+LogStateEvent(connection_t *c,
+              time_t timestamp,
+              const char *state,
+              const char *message,
+              const char *addresses)
+{
+    static const char *keys[] = {
+        "local_ip", "remote_ip", "remote_port", "local_addr", "local_port", "local_ipv6"
+    };
+
+    if (!BeginEvent(c, timestamp, "state"))
+    {
+        return;
+    }
+    eventlog_str(&c->events.log, "state", state, strlen(state));
+    eventlog_str(&c->events.log, "message", message, strlen(message));
+    for (size_t i = 0; i < _countof(keys) && addresses; i++)
+    {
+        const char *sep = strchr(addresses, ',');
+        size_t len = sep ? (size_t)(sep - addresses) : strlen(addresses);
+
+        if (len > 0)
+        {
+            eventlog_str(&c->events.log, keys[i], addresses, len);
+        }
+        addresses = sep ? sep + 1 : NULL;
+    }
+    EndEvent(c);
+}
+
 /*
  * Handle a state change notification from the OpenVPN management interface
  * Format <TIMESTAMP>,<STATE>,[<MESSAGE>],[<LOCAL_IP>][,<REMOTE_IP>]
@@ -355,6 +1014,8 @@ OnStateChange(connection_t *c, char *data)
     }
     *pos = '\0';
 
+    LogStateEvent(c, strtol(data, NULL, 10), state, message, pos + 1);
+
     /* notify the all windows in the thread of state change */
     EnumThreadWindows(GetCurrentThreadId(), NotifyStateChange, (LPARAM)state);
 
@@ -419,7 +1080,7 @@ OnStateChange(connection_t *c, char *data)
         c->connected_since = atoi(data);
         c->failed_psw_attempts = 0;
         c->failed_auth_attempts = 0;
-        c->state = connected;
+        SetConnState(c, connected);
 
         SetMenuStatus(c, connected);
         SetTrayIcon(connected);
@@ -457,7 +1118,7 @@ OnStateChange(connection_t *c, char *data)
         /* We change the state to reconnecting only if there was a prior successful connection. */
         if (c->state == connected)
         {
-            c->state = reconnecting;
+            SetConnState(c, reconnecting);
 
             /* Update the tray icon */
             CheckAndSetTrayIcon();
@@ -1001,7 +1662,7 @@ GenericPassDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                         if (fmt && username)
                         {
                             sprintf(fmt, template, username);
-                            ManagementCommand(param->c, fmt, NULL, regular);
+                            ManagementReply(param->c, fmt);
                         }
                         else /* no memory? send an emty username and let it error out */
                         {
@@ -1010,8 +1671,7 @@ GenericPassDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                                 L"GUI> ",
                                 L"Out of memory: sending a generic username for dynamic CR",
                                 false);
-                            ManagementCommand(
-                                param->c, "username \"Auth\" \"user\"", NULL, regular);
+                            ManagementReply(param->c, "username \"Auth\" \"user\"");
                         }
                         free(fmt);
                         free(username);
@@ -1432,7 +2092,13 @@ out:
 void
 OnEcho(connection_t *c, char *msg)
 {
-    time_t timestamp = strtoul(msg, NULL, 10); /* openvpn prints these as %u */
+    time_t timestamp;
+
+    if (msg == NULL) /* "echo on" failed */
+    {
+        return;
+    }
+    timestamp = strtoul(msg, NULL, 10); /* openvpn prints these as %u */
 
     PrintDebug(L"OnEcho with msg = %hs", msg);
     if (!(msg = strchr(msg, ',')))
@@ -1441,6 +2107,13 @@ OnEcho(connection_t *c, char *msg)
         return;
     }
     msg++;
+
+    if (BeginEvent(c, timestamp, "echo"))
+    {
+        eventlog_str(&c->events.log, "text", msg, strlen(msg));
+        EndEvent(c);
+    }
+
     if (strcmp(msg, "forget-passwords") == 0)
     {
         DeleteSavedPasswords(c->config_name);
@@ -1609,7 +2282,7 @@ OnTimeout(connection_t *c, UNUSED char *msg)
     }
     WriteStatusLog(c, L"GUI> ", LoadLocalizedString(IDS_NFO_CONN_TIMEOUT, c->log_path), false);
     WriteStatusLog(c, L"GUI> ", L"Retrying. Press disconnect to abort", false);
-    c->state = connecting;
+    SetConnState(c, connecting);
     if (!OpenManagement(c))
     {
         MessageBoxExW(c->hwndStatus,
@@ -1646,13 +2319,16 @@ OnStop(connection_t *c, UNUSED char *msg)
     UINT txt_id, msg_id;
     SetMenuStatus(c, disconnected);
 
+    /* the log is no longer held open, rotate a long session's log now */
+    RotateLog(c->log_path);
+
     switch (c->state)
     {
         case connected:
             /* OpenVPN process ended unexpectedly */
             c->failed_psw_attempts = 0;
             c->failed_auth_attempts = 0;
-            c->state = disconnected;
+            SetConnState(c, disconnected);
             CheckAndSetTrayIcon();
             SetDlgItemText(
                 c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_DISCONNECTED));
@@ -1679,9 +2355,9 @@ OnStop(connection_t *c, UNUSED char *msg)
             txt_id = c->state == reconnecting ? IDS_NFO_STATE_FAILED_RECONN : IDS_NFO_STATE_FAILED;
             msg_id = c->state == reconnecting ? IDS_NFO_RECONN_FAILED : IDS_NFO_CONN_FAILED;
 
-            c->state = disconnecting;
+            SetConnState(c, disconnecting);
             CheckAndSetTrayIcon();
-            c->state = disconnected;
+            SetConnState(c, disconnected);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
             SetStatusWinIcon(c->hwndStatus, ID_ICO_DISCONNECTED);
@@ -1703,7 +2379,7 @@ OnStop(connection_t *c, UNUSED char *msg)
             /* Shutdown was initiated by us */
             c->failed_psw_attempts = 0;
             c->failed_auth_attempts = 0;
-            c->state = disconnected;
+            SetConnState(c, disconnected);
             if (c->flags & FLAG_DAEMON_PERSISTENT)
             {
                 /* user initiated disconnection -- stay detached and do not auto-reconnect */
@@ -1718,13 +2394,13 @@ OnStop(connection_t *c, UNUSED char *msg)
         case onhold:
         /* stop triggered while on hold -- possibly the daemon exited. Treat same as detaching */
         case detaching:
-            c->state = disconnected;
+            SetConnState(c, disconnected);
             CheckAndSetTrayIcon();
             SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
             break;
 
         case suspending:
-            c->state = suspended;
+            SetConnState(c, suspended);
             CheckAndSetTrayIcon();
             SetDlgItemText(
                 c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_SUSPENDED));
@@ -1776,6 +2452,14 @@ OnByteCount(connection_t *c, char *msg)
     {
         return;
     }
+
+    if (BeginEvent(c, time(NULL), "bytecount"))
+    {
+        eventlog_num(&c->events.log, "in", c->bytes_in);
+        eventlog_num(&c->events.log, "out", c->bytes_out);
+        EndEvent(c);
+    }
+
     wchar_t in[32], out[32];
     format_bytecount(in, _countof(in), c->bytes_in);
     format_bytecount(out, _countof(out), c->bytes_out);
@@ -1891,6 +2575,60 @@ WrapLine(WCHAR *line)
     return next;
 }
 
+/*
+ * Append a line to the log file in one write. GUI lines go to the file
+ * rarely, from the one call site reporting a failed start, so the file
+ * is opened for each line rather than kept open: openvpn.exe writes to
+ * the same file, and a handle held by the GUI could conflict with its
+ * share mode on the next start.
+ */
+static void
+AppendStatusLog(connection_t *c, const WCHAR *datetime, const WCHAR *prefix, const WCHAR *line)
+{
+    WCHAR *wtext;
+    char *text;
+    size_t wlen = wcslen(datetime) + wcslen(prefix) + wcslen(line) + 3;
+    int len;
+    HANDLE fd;
+    LARGE_INTEGER size;
+    DWORD written;
+
+    wtext = malloc(wlen * sizeof(WCHAR));
+    if (!wtext)
+    {
+        return;
+    }
+    _snwprintf_s(wtext, wlen, _TRUNCATE, L"%ls%ls%ls\r\n", datetime, prefix, line);
+    len = WideCharToMultiByte(CP_UTF8, 0, wtext, -1, NULL, 0, NULL, NULL);
+    text = len > 0 ? malloc(len) : NULL;
+    if (!text || !WideCharToMultiByte(CP_UTF8, 0, wtext, -1, text, len, NULL, NULL))
+    {
+        free(text);
+        free(wtext);
+        return;
+    }
+    free(wtext);
+
+    fd = CreateFile(c->log_path,
+                    FILE_APPEND_DATA,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    NULL,
+                    OPEN_ALWAYS,
+                    FILE_ATTRIBUTE_NORMAL,
+                    NULL);
+    if (fd != INVALID_HANDLE_VALUE)
+    {
+        /* start a new file with a BOM like the C runtime does for ccs=UTF-8 */
+        if (GetFileSizeEx(fd, &size) && size.QuadPart == 0)
+        {
+            WriteFile(fd, "\xEF\xBB\xBF", 3, &written, NULL);
+        }
+        WriteFile(fd, text, (DWORD)(len - 1), &written, NULL);
+        CloseHandle(fd);
+    }
+    free(text);
+}
+
 /*
  * Write a line to the status log window and optionally to the log file
  */
@@ -1903,65 +2641,54 @@ WriteStatusLog(connection_t *c, const WCHAR *prefix, const WCHAR *line, BOOL fil
         return;
     }
 
-    HWND logWnd = GetDlgItem(c->hwndStatus, ID_EDT_LOG);
-    FILE *log_fd;
+    unsigned int flags = 0;
     time_t now;
-    WCHAR datetime[26];
+    WCHAR datetime[LOG_DATE_LEN + 2];
 
     time(&now);
-    /* TODO: change this to use _wctime_s when mingw supports it */
-    wcsncpy(datetime, _wctime(&now), _countof(datetime));
-    datetime[24] = L' ';
+    logbuf_format_date(&c->log_lines.date, now, datetime);
+    datetime[LOG_DATE_LEN] = L' ';
+    datetime[LOG_DATE_LEN + 1] = L'\0';
 
     /* change text color if Warning or Error */
-    COLORREF text_clr = 0;
-
     if (wcsstr(prefix, L"ERROR"))
     {
-        text_clr = o.clr_error;
+        flags = LOG_LINE_ERROR;
     }
     else if (wcsstr(prefix, L"WARNING"))
     {
-        text_clr = o.clr_warning;
+        flags = LOG_LINE_WARNING;
     }
 
-    if (text_clr != 0)
-    {
-        CHARFORMAT cfm = {
-            .cbSize = sizeof(CHARFORMAT),
-            .dwMask = CFM_COLOR | CFM_BOLD,
-            .dwEffects = 0,
-            .crTextColor = text_clr,
-        };
-        SendMessage(logWnd, EM_SETCHARFORMAT, SCF_SELECTION, (LPARAM)&cfm);
-    }
-
-
-    /* Remove lines from log window if it is getting full */
-    if (SendMessage(logWnd, EM_GETLINECOUNT, 0, 0) > MAX_LOG_LINES)
-    {
-        int pos = SendMessage(logWnd, EM_LINEINDEX, DEL_LOG_LINES, 0);
-        SendMessage(logWnd, EM_SETSEL, 0, pos);
-        SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM) _T(""));
-    }
     /* Append line to log window */
-    SendMessage(logWnd, EM_SETSEL, (WPARAM)-1, (LPARAM)-1);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM)datetime);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM)prefix);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM)line);
-    SendMessage(logWnd, EM_REPLACESEL, FALSE, (LPARAM)L"\n");
+    int prefix_len = WideCharToMultiByte(CP_UTF8, 0, prefix, -1, NULL, 0, NULL, NULL);
+    int line_len = WideCharToMultiByte(CP_UTF8, 0, line, -1, NULL, 0, NULL, NULL);
+    char *text = (prefix_len > 0 && line_len > 0) ? malloc(prefix_len + line_len) : NULL;
+    if (text)
+    {
+        WideCharToMultiByte(CP_UTF8, 0, prefix, -1, text, prefix_len, NULL, NULL);
+        WideCharToMultiByte(CP_UTF8, 0, line, -1, text + prefix_len - 1, line_len, NULL, NULL);
+        AcquireSRWLockExclusive(&c->log_lock);
+        logbuf_append(&c->log_lines, now, flags, text, prefix_len + line_len - 2);
+        ReleaseSRWLockExclusive(&c->log_lock);
+        if (BeginEvent(c, now, "log"))
+        {
+            const char *level = EventLevel(flags);
+            eventlog_str(&c->events.log, "source", "gui", 3);
+            eventlog_str(&c->events.log, "level", level, strlen(level));
+            eventlog_str(&c->events.log, "text", text, prefix_len + line_len - 2);
+            EndEvent(c);
+        }
+        free(text);
+        UpdateLogView(c);
+    }
 
     if (!fileio)
     {
         return;
     }
 
-    log_fd = _tfopen(c->log_path, TEXT("at+,ccs=UTF-8"));
-    if (log_fd)
-    {
-        fwprintf(log_fd, L"%ls%ls%ls\n", datetime, prefix, line);
-        fclose(log_fd);
-    }
+    AppendStatusLog(c, datetime, prefix, line);
 }
 
 #define IO_TIMEOUT 5000 /* milliseconds */
@@ -2263,12 +2990,12 @@ OnNeedOk(connection_t *c, char *msg)
     }
     else
     {
-        ManagementCommand(c, "auth-retry none", NULL, regular);
+        ManagementReply(c, "auth-retry none");
         fmt = "needok \'%s\' cancel";
     }
 
     sprintf(resp, fmt, param->id);
-    ManagementCommand(c, resp, NULL, regular);
+    ManagementReply(c, resp);
 
 out:
     free_auth_param(param);
@@ -2326,6 +3053,32 @@ Cleanup(connection_t *c)
 {
     CloseManagement(c);
 
+    FlushEvents(c);
+    if (c->events.file)
+    {
+        CloseHandle(c->events.file);
+    }
+    c->events.file = NULL;
+    if (c->daemon_log.active)
+    {
+        if (c->hwndStatus)
+        {
+            KillTimer(c->hwndStatus, IDT_DAEMON_LOG);
+        }
+        /* keep lines not shown yet for the next time we attach */
+        if (!c->daemon_log.catch_up || c->daemon_log.first_seen)
+        {
+            ReadDaemonLog(c, NULL);
+        }
+        SaveDaemonLogPos(c);
+        c->daemon_log.active = FALSE;
+        c->daemon_log.catch_up = FALSE;
+    }
+    AcquireSRWLockExclusive(&c->log_lock);
+    logbuf_free(&c->log_lines);
+    ReleaseSRWLockExclusive(&c->log_lock);
+    logfilter_free(&c->log_filter);
+
     free_dynamic_cr(c);
     env_item_del_all(c->es);
     c->es = NULL;
@@ -2366,9 +3119,15 @@ RenderStatusWindow(HWND hwndDlg, UINT w, UINT h)
     MoveWindow(GetDlgItem(hwndDlg, ID_TXT_STATUS),
                DPI_SCALE(20),
                DPI_SCALE(5),
-               w - DPI_SCALE(30),
+               w - DPI_SCALE(210),
                DPI_SCALE(15),
                TRUE);
+    MoveWindow(GetDlgItem(hwndDlg, ID_CMB_LOGFILTER),
+               w - DPI_SCALE(180),
+               DPI_SCALE(1),
+               DPI_SCALE(160),
+               DPI_SCALE(200),
+               TRUE);
     MoveWindow(GetDlgItem(hwndDlg, ID_TXT_IP),
                DPI_SCALE(20),
                h - DPI_SCALE(75),
@@ -2447,21 +3206,28 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                 break;
             }
 
-            /* Create log window */
-            HWND hLogWnd =
-                CreateWindowEx(0,
-                               RICHEDIT_CLASS,
-                               NULL,
-                               WS_CHILD | WS_VISIBLE | WS_HSCROLL | WS_VSCROLL | ES_SUNKEN | ES_LEFT
-                                   | ES_MULTILINE | ES_READONLY | ES_AUTOHSCROLL | ES_AUTOVSCROLL,
-                               20,
-                               25,
-                               350,
-                               160,
-                               hwndDlg,
-                               (HMENU)ID_EDT_LOG,
-                               o.hInstance,
-                               NULL);
+            /* Create log window: rows are drawn from the connection's log buffer */
+            AcquireSRWLockExclusive(&c->log_lock);
+            logbuf_free(&c->log_lines);
+            c->log_lines.capacity = o.log_window_lines;
+            ReleaseSRWLockExclusive(&c->log_lock);
+            logfilter_set(&c->log_filter, &c->log_lines, 0, 0);
+            c->log_width = 0;
+            HWND hLogWnd = CreateWindowEx(WS_EX_CLIENTEDGE,
+                                          WC_LISTBOX,
+                                          NULL,
+                                          WS_CHILD | WS_VISIBLE | WS_HSCROLL | WS_VSCROLL
+                                              | LBS_NODATA | LBS_OWNERDRAWFIXED
+                                              | LBS_NOINTEGRALHEIGHT | LBS_EXTENDEDSEL
+                                              | LBS_WANTKEYBOARDINPUT,
+                                          20,
+                                          25,
+                                          350,
+                                          160,
+                                          hwndDlg,
+                                          (HMENU)ID_EDT_LOG,
+                                          o.hInstance,
+                                          NULL);
             if (!hLogWnd)
             {
                 ShowLocalizedMsgEx(MB_OK | MB_ICONERROR,
@@ -2473,16 +3239,46 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                 return FALSE;
             }
 
-            /* Set font and fontsize of the log window */
-            CHARFORMAT cfm = { .cbSize = sizeof(CHARFORMAT),
-                               .dwMask = CFM_SIZE | CFM_FACE | CFM_BOLD,
-                               .szFaceName = _T("Microsoft Sans Serif"),
-                               .dwEffects = 0,
-                               .yHeight = 160 };
-            if (SendMessage(hLogWnd, EM_SETCHARFORMAT, SCF_DEFAULT, (LPARAM)&cfm) == 0)
+            /* Use the font of the dialog in the log window */
+            HFONT font = (HFONT)SendMessage(hwndDlg, WM_GETFONT, 0, 0);
+            SendMessage(hLogWnd, WM_SETFONT, (WPARAM)font, FALSE);
+            HDC dc = GetDC(hLogWnd);
+            if (dc)
+            {
+                TEXTMETRIC tm;
+                HGDIOBJ old_font = SelectObject(dc, font);
+                if (GetTextMetrics(dc, &tm))
+                {
+                    SendMessage(hLogWnd, LB_SETITEMHEIGHT, 0, tm.tmHeight + tm.tmExternalLeading);
+                }
+                SelectObject(dc, old_font);
+                ReleaseDC(hLogWnd, dc);
+            }
+
+            /* Choice of the lines shown in the log window */
+            HWND hFilterWnd = CreateWindowEx(0,
+                                             WC_COMBOBOX,
+                                             NULL,
+                                             WS_CHILD | WS_VISIBLE | WS_TABSTOP | CBS_DROPDOWNLIST,
+                                             0,
+                                             0,
+                                             160,
+                                             200,
+                                             hwndDlg,
+                                             (HMENU)ID_CMB_LOGFILTER,
+                                             o.hInstance,
+                                             NULL);
+            if (hFilterWnd)
             {
-                ShowLocalizedMsgEx(
-                    MB_OK | MB_ICONERROR, c->hwndStatus, TEXT(PACKAGE_NAME), IDS_ERR_SET_SIZE);
+                SendMessage(hFilterWnd, WM_SETFONT, (WPARAM)font, FALSE);
+                for (size_t i = 0; i < _countof(log_filters); i++)
+                {
+                    SendMessage(hFilterWnd,
+                                CB_ADDSTRING,
+                                0,
+                                (LPARAM)LoadLocalizedString(log_filters[i].name));
+                }
+                SendMessage(hFilterWnd, CB_SETCURSEL, 0, 0);
             }
 
             /* display version string as "OpenVPN GUI gui_version/core_version" */
@@ -2521,6 +3317,33 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             SetFocus(hLogWnd);
             return FALSE;
 
+        case WM_DRAWITEM:
+            if (wParam == ID_EDT_LOG)
+            {
+                TRY_GETPROP(hwndDlg, cfgProp, c, FALSE);
+                DrawLogLine(c, (const DRAWITEMSTRUCT *)lParam);
+                return TRUE;
+            }
+            break;
+
+        case WM_VKEYTOITEM:
+            /* the return value is passed on: -1 for default handling, -2 if handled */
+            if ((HWND)lParam == GetDlgItem(hwndDlg, ID_EDT_LOG) && GetKeyState(VK_CONTROL) < 0)
+            {
+                TRY_GETPROP(hwndDlg, cfgProp, c, -1);
+                if (LOWORD(wParam) == 'C')
+                {
+                    CopyLogLines(c, (HWND)lParam);
+                    return -2;
+                }
+                else if (LOWORD(wParam) == 'A')
+                {
+                    SendMessage((HWND)lParam, LB_SETSEL, TRUE, -1);
+                    return -2;
+                }
+            }
+            return -1;
+
         case WM_DPICHANGED:
             DpiSetScale(&o, HIWORD(wParam));
             RECT dlgRect;
@@ -2562,6 +3385,14 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                     SetFocus(GetDlgItem(c->hwndStatus, ID_EDT_LOG));
                     DetachOpenVPN(c);
                     return TRUE;
+
+                case ID_CMB_LOGFILTER:
+                    if (HIWORD(wParam) == CBN_SELCHANGE)
+                    {
+                        SetLogFilter(c, SendMessage((HWND)lParam, CB_GETCURSEL, 0, 0));
+                        return TRUE;
+                    }
+                    break;
             }
             break;
 
@@ -2586,6 +3417,9 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 
         case WM_NCDESTROY:
             KillTimer(hwndDlg, IDT_STOP_TIMER);
+            KillTimer(hwndDlg, IDT_MGMT_RETRY);
+            KillTimer(hwndDlg, IDT_EVENT_FLUSH);
+            KillTimer(hwndDlg, IDT_DAEMON_LOG);
             RemoveProp(hwndDlg, cfgProp);
             break;
 
@@ -2595,7 +3429,7 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 
         case WM_OVPN_RELEASE:
             TRY_GETPROP(hwndDlg, cfgProp, c, FALSE);
-            c->state = reconnecting;
+            SetConnState(c, reconnecting);
             SetDlgItemText(
                 c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_RECONNECTING));
             SetDlgItemTextW(c->hwndStatus, ID_TXT_IP, L"");
@@ -2610,7 +3444,7 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             {
                 break;
             }
-            c->state = disconnecting;
+            SetConnState(c, disconnecting);
             if (!(c->flags & FLAG_DAEMON_PERSISTENT))
             {
                 RunDisconnectScript(c, false);
@@ -2626,7 +3460,7 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
         case WM_OVPN_DETACH:
             TRY_GETPROP(hwndDlg, cfgProp, c, FALSE);
             /* just stop the thread keeping openvpn.exe running */
-            c->state = detaching;
+            SetConnState(c, detaching);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
             OnStop(c, NULL);
@@ -2634,7 +3468,7 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
 
         case WM_OVPN_SUSPEND:
             TRY_GETPROP(hwndDlg, cfgProp, c, FALSE);
-            c->state = suspending;
+            SetConnState(c, suspending);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_DISCONNECT), FALSE);
             EnableWindow(GetDlgItem(c->hwndStatus, ID_RESTART), FALSE);
             SetMenuStatus(c, disconnecting);
@@ -2654,6 +3488,18 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
                 KillTimer(hwndDlg, IDT_STOP_TIMER);
                 OnStop(c, NULL);
             }
+            else if (wParam == IDT_MGMT_RETRY)
+            {
+                RetryManagement(c);
+            }
+            else if (wParam == IDT_EVENT_FLUSH)
+            {
+                FlushEvents(c);
+            }
+            else if (wParam == IDT_DAEMON_LOG)
+            {
+                FollowDaemonLog(c);
+            }
             break;
 
         case WM_OVPN_RESTART:
@@ -2661,7 +3507,7 @@ StatusDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
             /* external messages can trigger when we are not ready -- check the state */
             if (IsWindowEnabled(GetDlgItem(c->hwndStatus, ID_RESTART)))
             {
-                c->state = reconnecting;
+                SetConnState(c, reconnecting);
                 ManagementCommand(c, "signal SIGHUP", NULL, regular);
                 SetDlgItemText(
                     c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_RECONNECTING));
@@ -2703,7 +3549,7 @@ ThreadOpenVPNStatus(void *p)
         /* kill daemon process if we started it */
         SetEvent(c->exit_event);
         Cleanup(c);
-        c->state = disconnected;
+        SetConnState(c, disconnected);
         return 1;
     }
 
@@ -2962,7 +3808,7 @@ StartOpenVPN(connection_t *c)
             }
             else
             {
-                c->state = disconnected;
+                SetConnState(c, disconnected);
             }
             TerminateThread(hThread, 1);
             return false;
@@ -2975,7 +3821,7 @@ StartOpenVPN(connection_t *c)
         return false;
     }
 
-    c->state = (c->state == suspended || c->state == detached) ? resuming : connecting;
+    SetConnState(c, (c->state == suspended || c->state == detached) ? resuming : connecting);
 
     /* Start the status dialog thread */
     ResumeThread(hThread);
@@ -3028,6 +3874,10 @@ LaunchOpenVPN(connection_t *c)
 
     find_free_tcp_port(&c->manage.skaddr);
 
+    /* openvpn holds the log open while it runs, so it is rotated before
+     * it is reopened and again when the process exits, see OnStop() */
+    RotateLog(c->log_path);
+
     /* Construct command line -- put log first */
     _sntprintf_0(
         cmdline,
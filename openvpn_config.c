@@ -33,67 +33,153 @@
 #include "localization.h"
 #include "save_pass.h"
 #include "misc.h"
+#include "registry.h"
+#include "connmap.h"
+#include "confwatch.h"
+#include "dirscan.h"
+#include "catalog.h"
 
-typedef enum
+extern options_t o;
+
+static bool
+CheckReadAccess(const TCHAR *dir, const TCHAR *file)
 {
-    match_false,
-    match_file,
-    match_dir
-} match_t;
+    TCHAR path[MAX_PATH];
 
-extern options_t o;
+    _sntprintf_0(path, _T("%ls\\%ls"), dir, file);
+
+    return CheckFileAccess(path, GENERIC_READ);
+}
 
-static match_t
-match(const WIN32_FIND_DATA *find, const TCHAR *ext)
+static int
+ConfigAlreadyExists(TCHAR *newconfig)
 {
-    size_t ext_len = _tcslen(ext);
-    int i;
+    return GetConnByFile(newconfig) != NULL;
+}
 
-    if (find->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+/*
+ * Whether passwords are saved is cached in the config catalog, together
+ * with the last write time of the config's registry key at the time it
+ * was checked. The times of all keys are read in one pass, so that the
+ * registry values are only read for configs whose key changed. Configs
+ * without a key have no saved passwords.
+ */
+typedef struct config_key
+{
+    struct config_key *next;
+    ULONGLONG last_write;
+    WCHAR name[];
+} config_key_t;
+
+static struct
+{
+    BOOL read;             /* keys were listed since the last FreeConfigKeys() */
+    BOOL valid;            /* all keys could be listed */
+    config_key_t *list;
+    connmap_names_t index; /* config_key_t by name */
+} config_keys;
+
+static void
+AddConfigKey(void *arg, const WCHAR *config_name, ULONGLONG last_write)
+{
+    size_t len = wcslen(config_name);
+    config_key_t *key = malloc(sizeof(*key) + (len + 1) * sizeof(WCHAR));
+
+    if (!key)
     {
-        return match_dir;
+        config_keys.valid = FALSE;
+        return;
     }
-
-    if (ext_len == 0)
+    key->last_write = last_write;
+    wcscpy(key->name, config_name);
+    key->next = config_keys.list;
+    config_keys.list = key;
+    if (!connmap_names_add(&config_keys.index, key->name, key))
     {
-        return match_file;
+        config_keys.valid = FALSE;
     }
+}
 
-    i = _tcslen(find->cFileName) - ext_len - 1;
-
-    if (i > 0 && find->cFileName[i] == '.' && _tcsicmp(find->cFileName + i + 1, ext) == 0)
+static void
+FreeConfigKeys(void)
+{
+    while (config_keys.list)
     {
-        return match_file;
-    }
+        config_key_t *next = config_keys.list->next;
 
-    return match_false;
+        free(config_keys.list);
+        config_keys.list = next;
+    }
+    connmap_names_free(&config_keys.index);
+    config_keys.read = FALSE;
 }
 
-static bool
-CheckReadAccess(const TCHAR *dir, const TCHAR *file)
+/*
+ * Get the last write time of the registry key of a config, or 0 if it
+ * has none. Returns false if that is not known.
+ */
+static BOOL
+GetConfigKeyTime(const WCHAR *config_name, ULONGLONG *last_write)
 {
-    TCHAR path[MAX_PATH];
+    config_key_t *key;
 
-    _sntprintf_0(path, _T("%ls\\%ls"), dir, file);
-
-    return CheckFileAccess(path, GENERIC_READ);
+    if (!config_keys.read)
+    {
+        config_keys.read = TRUE;
+        config_keys.valid = TRUE;
+        if (!EnumConfigRegistryKeys(AddConfigKey, NULL))
+        {
+            config_keys.valid = FALSE;
+        }
+    }
+    if (!config_keys.valid)
+    {
+        return FALSE;
+    }
+    key = connmap_names_find(&config_keys.index, config_name);
+    *last_write = key ? key->last_write : 0;
+    return TRUE;
 }
 
-static int
-ConfigAlreadyExists(TCHAR *newconfig)
+/* Set the saved password flags of c, taken from its catalog entry f if that is current */
+static void
+CheckSavedPasswords(connection_t *c, dirscan_file_t *f)
 {
-    for (connection_t *c = o.chead; c; c = c->next)
+    ULONGLONG last_write = 0;
+    BOOL known = GetConfigKeyTime(c->config_name, &last_write);
+    unsigned int flags = 0;
+
+    if (known && last_write == 0)
+    {
+        flags = 0; /* no registry key -- nothing saved */
+    }
+    else if (known && f && f->meta_stamp == last_write)
+    {
+        flags = f->meta & (FLAG_SAVE_AUTH_PASS | FLAG_SAVE_KEY_PASS);
+    }
+    else
     {
-        if (_tcsicmp(c->config_file, newconfig) == 0)
+        if (IsAuthPassSaved(c->config_name))
+        {
+            flags |= FLAG_SAVE_AUTH_PASS;
+        }
+        if (IsKeyPassSaved(c->config_name))
         {
-            return true;
+            flags |= FLAG_SAVE_KEY_PASS;
         }
     }
-    return false;
+
+    if (f)
+    {
+        f->meta = flags;
+        f->meta_stamp = known ? last_write : 0;
+    }
+    c->flags |= flags;
 }
 
+/* Add a config to the list. f is its catalog entry or NULL. */
 static void
-AddConfigFileToList(int group, const TCHAR *filename, const TCHAR *config_dir)
+AddConfigFileToList(int group, const TCHAR *filename, const TCHAR *config_dir, dirscan_file_t *f)
 {
     connection_t *c = calloc(1, sizeof(connection_t));
 
@@ -154,19 +240,14 @@ AddConfigFileToList(int group, const TCHAR *filename, const TCHAR *config_dir)
     }
     else
     {
-        if (IsAuthPassSaved(c->config_name))
-        {
-            c->flags |= FLAG_SAVE_AUTH_PASS;
-        }
-        if (IsKeyPassSaved(c->config_name))
-        {
-            c->flags |= FLAG_SAVE_KEY_PASS;
-        }
+        CheckSavedPasswords(c, f);
     }
     if (o.disable_popup_messages)
     {
         DisablePopupMessages(c);
     }
+
+    IndexConn(c);
 }
 
 #define FLAG_WARN_DUPLICATES   (0x1)
@@ -210,15 +291,31 @@ NewConfigGroup(const wchar_t *name, int parent, int flags)
     return cg->id;
 }
 
+/* Disable a config that is no longer readable, and enable it again once it is */
+static void
+CheckConfigAccess(connection_t *c)
+{
+    if (CheckReadAccess(c->config_dir, c->config_file))
+    {
+        c->flags &= ~FLAG_CONFIG_DISABLED;
+    }
+    else
+    {
+        c->flags |= FLAG_CONFIG_DISABLED;
+    }
+}
+
 /*
  * All groups that link at least one config to the root are
  * enabled. Dangling entries with no terminal configs will stay
  * disabled and are not displayed in the menu tree.
  * Also groups with single configs are squashed if the group
  * and config names match --- this improves the display.
+ * Configs with an id below num_checked are disabled if they are
+ * no longer readable.
  */
 static void
-ActivateConfigGroups(void)
+ActivateConfigGroups(int num_checked)
 {
     /* the root group is always active */
     o.groups[0].active = true;
@@ -281,15 +378,53 @@ ActivateConfigGroups(void)
             cg = PARENT_GROUP(cg);
         }
         /* also deactivate any configs that are no longer readable */
-        if (CheckReadAccess(c->config_dir, c->config_file))
+        if (c->id < num_checked)
         {
-            c->flags &= ~FLAG_CONFIG_DISABLED;
+            CheckConfigAccess(c);
         }
-        else
+    }
+}
+
+#define CONFIG_SCAN_THREADS 8 /* directories listed in parallel */
+
+/* Add the configs found in the scanned directory d and its
+ * subdirectories to group, in the order in which they were listed.
+ * Returns true if d differs from the catalog it was scanned with.
+ */
+static BOOL
+AddConfigDir(dirscan_dir_t *d, int group, int flags)
+{
+    BOOL changed = d->changed;
+
+    for (size_t i = 0; i < d->nfiles; i++)
+    {
+        dirscan_file_t *f = &d->files[i];
+        unsigned int meta = f->meta;
+        uint64_t meta_stamp = f->meta_stamp;
+
+        if (ConfigAlreadyExists(f->name))
+        {
+            if (flags & FLAG_WARN_DUPLICATES)
+            {
+                ShowLocalizedMsg(IDS_ERR_CONFIG_EXIST, f->name);
+            }
+            continue;
+        }
+
+        if (f->readable)
         {
-            c->flags |= FLAG_CONFIG_DISABLED;
+            AddConfigFileToList(group, f->name, d->path, f);
+            changed |= (f->meta != meta || f->meta_stamp != meta_stamp);
         }
     }
+
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        int sub_group = NewConfigGroup(d->subdirs[i]->name, group, flags);
+
+        changed |= AddConfigDir(d->subdirs[i], sub_group, flags);
+    }
+    return changed;
 }
 
 /* Scan for configs in config_dir recursing down up to recurse_depth.
@@ -297,79 +432,399 @@ ActivateConfigGroups(void)
  *        group      -- the group into which add the configs to
  *        flags      -- enable warnings, use directory based
  *                      grouping of configs etc.
+ *        cached     -- an earlier scan of config_dir or NULL
  * Currently configs in a directory are grouped together and group is
  * the id of the current group in the global group array |o.groups|
- * This may be recursively called until depth becomes 1 and each time
- * the group is changed to that of the directory being recursed into.
+ * Each directory is listed once, several of them in parallel. The
+ * configs and groups are then added in the order of a depth-first walk,
+ * so that config ids do not depend on which directory was listed first.
+ * Returns the scan, to be used as the cache of the next one. Unless
+ * changed is NULL, *changed is set if the scan differs from cached.
+ */
+static dirscan_dir_t *
+BuildFileList0(const TCHAR *config_dir,
+               int recurse_depth,
+               int group,
+               int flags,
+               const dirscan_dir_t *cached,
+               BOOL *changed)
+{
+    dirscan_dir_t *d =
+        dirscan_run(config_dir, o.ext_string, recurse_depth, CONFIG_SCAN_THREADS, cached);
+    BOOL differs;
+
+    if (!d)
+    {
+        ErrorExit(1, L"Out of memory while scanning config directory");
+    }
+    differs = AddConfigDir(d, group, flags);
+
+    if (changed)
+    {
+        *changed = differs;
+    }
+    return d;
+}
+
+/*
+ * Once a config directory was scanned, it is watched for changes, so
+ * that later calls of BuildFileList() apply the changes found instead
+ * of walking the directory tree again. A thread per directory queues
+ * the changes, which are applied by BuildFileList() on the thread that
+ * owns the config list. Like a rescan, changes only add configs and
+ * disable or enable existing ones. If changes are lost or the directory
+ * can no longer be watched, it is walked again.
  */
+#define CONFIG_WATCH_MAX_QUEUE 4096 /* changes queued per directory before it is rescanned */
+
+typedef struct config_change
+{
+    struct config_change *next;
+    confwatch_change_t change;
+    int depth;
+    WCHAR path[];
+} config_change_t;
+
+typedef struct
+{
+    WCHAR dir[MAX_PATH];     /* the directory watched */
+    confwatch_t *watch;      /* NULL if not watched */
+    HANDLE thread;           /* thread reading the changes */
+    volatile LONG stop;      /* asks the thread to exit */
+    volatile LONG rescan;    /* changes were lost or the thread exited */
+    config_change_t *queue;  /* changes to apply, oldest first */
+    config_change_t **tail;  /* next pointer of the newest change */
+    int queued;              /* number of changes in queue */
+    dirscan_dir_t *tree;     /* the last walk, the cache of the next one */
+} config_watch_t;
+
+/* The user, system and persistent config directories */
+static config_watch_t config_watches[3];
+
+static SRWLOCK config_watch_lock = SRWLOCK_INIT; /* guards the queues */
+
+/*
+ * The last walk of each directory is saved in a catalog, so that the
+ * first walk after a restart only lists the directories that changed,
+ * and checks access and saved passwords of new or changed configs only.
+ */
+#define CONFIG_CATALOG_FILE L"config-catalog.dat" /* in the log directory */
+
+static BOOL config_catalog_dirty; /* a walk found changes not yet saved */
+
 static void
-BuildFileList0(const TCHAR *config_dir, int recurse_depth, int group, int flags)
+QueueConfigChange(void *arg, confwatch_change_t change, const wchar_t *path, int depth)
 {
-    WIN32_FIND_DATA find_obj;
-    HANDLE find_handle;
-    TCHAR find_string[MAX_PATH];
-    TCHAR subdir_name[MAX_PATH];
+    config_watch_t *w = arg;
+    size_t len = wcslen(path);
+    config_change_t *ch;
 
-    _sntprintf_0(find_string, _T("%ls\\*"), config_dir);
-    find_handle = FindFirstFile(find_string, &find_obj);
-    if (find_handle == INVALID_HANDLE_VALUE)
+    if (change == confwatch_rescan)
     {
+        InterlockedExchange(&w->rescan, 1);
         return;
     }
 
-    /* Loop over each config file in config dir */
-    do
+    ch = malloc(sizeof(*ch) + (len + 1) * sizeof(WCHAR));
+    if (!ch)
     {
-        match_t match_type = match(&find_obj, o.ext_string);
-        if (match_type == match_file)
+        InterlockedExchange(&w->rescan, 1);
+        return;
+    }
+    ch->next = NULL;
+    ch->change = change;
+    ch->depth = depth;
+    wcscpy(ch->path, path);
+
+    AcquireSRWLockExclusive(&config_watch_lock);
+    if (w->queued < CONFIG_WATCH_MAX_QUEUE)
+    {
+        *w->tail = ch;
+        w->tail = &ch->next;
+        w->queued++;
+        ch = NULL;
+    }
+    ReleaseSRWLockExclusive(&config_watch_lock);
+
+    if (ch)
+    {
+        /* too many changes: walking the directory is cheaper */
+        InterlockedExchange(&w->rescan, 1);
+        free(ch);
+    }
+}
+
+static DWORD WINAPI
+ConfigWatchThread(LPVOID arg)
+{
+    config_watch_t *w = arg;
+
+    while (!w->stop)
+    {
+        if (confwatch_read(w->watch, 500, QueueConfigChange, w) < 0)
+        {
+            InterlockedExchange(&w->rescan, 1);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Take the queued changes of a watched directory */
+static config_change_t *
+TakeConfigChanges(config_watch_t *w)
+{
+    config_change_t *queue;
+
+    AcquireSRWLockExclusive(&config_watch_lock);
+    queue = w->queue;
+    w->queue = NULL;
+    w->tail = &w->queue;
+    w->queued = 0;
+    ReleaseSRWLockExclusive(&config_watch_lock);
+
+    return queue;
+}
+
+static void
+FreeConfigChanges(config_change_t *queue)
+{
+    for (config_change_t *next; queue; queue = next)
+    {
+        next = queue->next;
+        free(queue);
+    }
+}
+
+static void
+StopConfigWatch(config_watch_t *w)
+{
+    if (w->thread)
+    {
+        InterlockedExchange(&w->stop, 1);
+        WaitForSingleObject(w->thread, INFINITE);
+        CloseHandle(w->thread);
+        w->thread = NULL;
+        InterlockedExchange(&w->stop, 0);
+    }
+    if (w->watch)
+    {
+        confwatch_close(w->watch);
+        w->watch = NULL;
+    }
+    FreeConfigChanges(TakeConfigChanges(w));
+}
+
+/* Start watching dir recurse_depth levels down. Returns false on error. */
+static BOOL
+StartConfigWatch(config_watch_t *w, const WCHAR *dir, int recurse_depth)
+{
+    w->tail = &w->queue;
+    w->watch = confwatch_open(dir, o.ext_string, recurse_depth);
+    if (!w->watch)
+    {
+        return FALSE;
+    }
+    w->thread = CreateThread(NULL, 0, ConfigWatchThread, w, 0, NULL);
+    if (!w->thread)
+    {
+        confwatch_close(w->watch);
+        w->watch = NULL;
+        return FALSE;
+    }
+    wcsncpy_s(w->dir, _countof(w->dir), dir, _TRUNCATE);
+    InterlockedExchange(&w->rescan, 0);
+
+    return TRUE;
+}
+
+/* Return true if path is the config file of c or a directory containing it */
+static BOOL
+ConfigIsBelow(const connection_t *c, const WCHAR *path)
+{
+    size_t dir_len = wcslen(c->config_dir);
+    size_t len = wcslen(path);
+
+    if (len > dir_len)
+    {
+        return wcsnicmp(path, c->config_dir, dir_len) == 0 && path[dir_len] == L'\\'
+               && wcsicmp(path + dir_len + 1, c->config_file) == 0;
+    }
+    return wcsnicmp(c->config_dir, path, len) == 0
+           && (c->config_dir[len] == L'\0' || c->config_dir[len] == L'\\');
+}
+
+/*
+ * Return the group of the directory name below parent, adding it if there
+ * is none, so that watched changes place configs as a scan would
+ */
+static int
+FindConfigGroup(UNUSED void *arg, int parent, const wchar_t *name, size_t len)
+{
+    WCHAR buf[_countof(o.groups[0].name)];
+
+    _sntprintf_0(buf, L"%.*ls", (int)len, name);
+    for (int i = 0; i < o.num_groups; i++)
+    {
+        if (o.groups[i].parent == parent && wcsicmp(o.groups[i].name, buf) == 0)
         {
-            if (ConfigAlreadyExists(find_obj.cFileName))
+            return i;
+        }
+    }
+    return NewConfigGroup(buf, parent, FLAG_ADD_CONFIG_GROUPS);
+}
+
+/* Apply a change below the watched directory of w, whose configs are in group */
+static void
+ApplyConfigChange(config_watch_t *w, const config_change_t *ch, int group)
+{
+    WCHAR dir[MAX_PATH];
+    const WCHAR *file = wcsrchr(ch->path, L'\\');
+    connection_t *c;
+
+    switch (ch->change)
+    {
+        case confwatch_config:
+            if (!file || (size_t)(file - ch->path) >= _countof(dir))
             {
-                if (flags & FLAG_WARN_DUPLICATES)
-                {
-                    ShowLocalizedMsg(IDS_ERR_CONFIG_EXIST, find_obj.cFileName);
-                }
-                continue;
+                break;
             }
+            wcsncpy_s(dir, _countof(dir), ch->path, file - ch->path);
+            file++;
 
-            if (CheckReadAccess(config_dir, find_obj.cFileName))
+            /* as on a rescan, a config name already in use elsewhere is not added */
+            c = GetConnByFile(file);
+            if (c && wcsicmp(c->config_dir, dir) == 0)
             {
-                AddConfigFileToList(group, find_obj.cFileName, config_dir);
+                CheckConfigAccess(c);
             }
-        }
-    } while (FindNextFile(find_handle, &find_obj));
+            else if (!c && CheckReadAccess(dir, file))
+            {
+                group = confwatch_group(w->dir, dir, group, FindConfigGroup, NULL);
+                AddConfigFileToList(group, file, dir, NULL);
+            }
+            break;
+
+        case confwatch_add_dir:
+            group = confwatch_group(w->dir, ch->path, group, FindConfigGroup, NULL);
+            dirscan_free(
+                BuildFileList0(ch->path, ch->depth, group, FLAG_ADD_CONFIG_GROUPS, NULL, NULL));
+            break;
+
+        case confwatch_remove:
+            for (c = o.chead; c; c = c->next)
+            {
+                if (ConfigIsBelow(c, ch->path))
+                {
+                    CheckConfigAccess(c);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    /* have the next walk, e.g. after a restart, list the directory again */
+    if (w->tree && dirscan_invalidate(w->tree, ch->path))
+    {
+        config_catalog_dirty = TRUE;
+    }
+}
 
-    FindClose(find_handle);
+/*
+ * Add the configs in config_dir to the list: on the first call, or if
+ * the directory cannot be watched, by walking it, and else by applying
+ * the changes since the last call. A walk starts from the previous one,
+ * or from the catalog. Returns true if the directory was walked.
+ */
+static BOOL
+ScanConfigDir(config_watch_t *w, const TCHAR *config_dir, int recurse_depth, int group, int flags)
+{
+    const dirscan_dir_t *cached = NULL;
+    dirscan_dir_t *tree;
+    BOOL changed;
 
-    /* optionally loop over each subdir */
-    if (recurse_depth < 1)
+    if (w->watch && !w->rescan && wcsicmp(w->dir, config_dir) == 0)
     {
-        return;
+        config_change_t *queue = TakeConfigChanges(w);
+
+        for (config_change_t *ch = queue; ch; ch = ch->next)
+        {
+            ApplyConfigChange(w, ch, group);
+        }
+        FreeConfigChanges(queue);
+        return FALSE;
     }
 
-    find_handle = FindFirstFile(find_string, &find_obj);
-    if (find_handle == INVALID_HANDLE_VALUE)
+    /* watch first, so that no change during the walk is missed */
+    StopConfigWatch(w);
+    if (!StartConfigWatch(w, config_dir, recurse_depth))
     {
-        return;
+        PrintDebug(L"Cannot watch '%ls' for changes (error = %lu)", config_dir, GetLastError());
+    }
+    if (w->tree && wcsicmp(w->tree->path, config_dir) == 0)
+    {
+        cached = w->tree;
     }
+    tree = BuildFileList0(config_dir, recurse_depth, group, flags, cached, &changed);
 
-    do
+    dirscan_free(w->tree);
+    w->tree = tree;
+    config_catalog_dirty |= changed || !cached;
+
+    return TRUE;
+}
+
+/* Move the trees in the catalog to the directories they were scanned from */
+static void
+LoadConfigCatalog(void)
+{
+    const WCHAR *roots[] = { o.config_dir, o.global_config_dir, o.config_auto_dir };
+    dirscan_dir_t *dirs[_countof(config_watches)];
+    WCHAR path[MAX_PATH];
+    size_t n;
+
+    static_assert(_countof(roots) == _countof(config_watches));
+
+    _sntprintf_0(path, L"%ls\\%ls", o.log_dir, CONFIG_CATALOG_FILE);
+    n = catalog_load(path, o.ext_string, dirs, _countof(dirs));
+
+    for (size_t i = 0; i < n; i++)
     {
-        match_t match_type = match(&find_obj, o.ext_string);
-        if (match_type == match_dir)
+        for (size_t j = 0; j < _countof(config_watches) && dirs[i]; j++)
         {
-            if (wcscmp(find_obj.cFileName, _T(".")) && wcscmp(find_obj.cFileName, _T("..")))
+            if (!config_watches[j].tree && wcsicmp(dirs[i]->path, roots[j]) == 0)
             {
-                /* recurse into subdirectory */
-                _sntprintf_0(subdir_name, _T("%ls\\%ls"), config_dir, find_obj.cFileName);
-                int sub_group = NewConfigGroup(find_obj.cFileName, group, flags);
-
-                BuildFileList0(subdir_name, recurse_depth - 1, sub_group, flags);
+                config_watches[j].tree = dirs[i];
+                dirs[i] = NULL;
             }
         }
-    } while (FindNextFile(find_handle, &find_obj));
+        dirscan_free(dirs[i]);
+    }
+}
+
+static void
+SaveConfigCatalog(void)
+{
+    dirscan_dir_t *dirs[_countof(config_watches)];
+    WCHAR path[MAX_PATH];
+    size_t n = 0;
+
+    for (size_t i = 0; i < _countof(config_watches); i++)
+    {
+        if (config_watches[i].tree)
+        {
+            dirs[n++] = config_watches[i].tree;
+        }
+    }
 
-    FindClose(find_handle);
+    _sntprintf_0(path, L"%ls\\%ls", o.log_dir, CONFIG_CATALOG_FILE);
+    if (!catalog_save(path, o.ext_string, dirs, n))
+    {
+        PrintDebug(L"Cannot save the config catalog to '%ls'", path);
+    }
+    config_catalog_dirty = FALSE;
 }
 
 void
@@ -379,6 +834,9 @@ BuildFileList()
     int recurse_depth = 20; /* maximum number of levels below config_dir to recurse into */
     int flags = 0;
     static int root_gp, system_gp, persistent_gp;
+    static bool catalog_loaded = false;
+    int num_old = o.num_configs;
+    BOOL walked;
 
     if (o.silent_connection)
     {
@@ -411,18 +869,26 @@ BuildFileList()
         flags |= FLAG_WARN_DUPLICATES | FLAG_WARN_MAX_CONFIGS;
     }
 
-    BuildFileList0(o.config_dir, recurse_depth, root_gp, flags);
+    if (!catalog_loaded)
+    {
+        LoadConfigCatalog();
+        catalog_loaded = true;
+    }
+
+    walked = ScanConfigDir(&config_watches[0], o.config_dir, recurse_depth, root_gp, flags);
 
     if (!IsSamePath(o.global_config_dir, o.config_dir))
     {
-        BuildFileList0(o.global_config_dir, recurse_depth, system_gp, flags);
+        walked |= ScanConfigDir(
+            &config_watches[1], o.global_config_dir, recurse_depth, system_gp, flags);
     }
 
     if (o.service_state == service_connected && o.enable_persistent)
     {
         if (!IsSamePath(o.config_auto_dir, o.config_dir))
         {
-            BuildFileList0(o.config_auto_dir, recurse_depth, persistent_gp, flags);
+            walked |= ScanConfigDir(
+                &config_watches[2], o.config_auto_dir, recurse_depth, persistent_gp, flags);
         }
     }
 
@@ -431,7 +897,15 @@ BuildFileList()
         ShowLocalizedMsg(IDS_NFO_NO_CONFIGS, o.config_dir, o.global_config_dir);
     }
 
-    ActivateConfigGroups();
+    /* configs in watched directories are checked as they change, and
+     * those added by this call were checked as they were scanned */
+    ActivateConfigGroups(walked ? num_old : 0);
+
+    if (config_catalog_dirty)
+    {
+        SaveConfigCatalog();
+    }
+    FreeConfigKeys();
 
     issue_warnings = false;
 }
@@ -440,6 +914,12 @@ void
 FreeConfigList(options_t *o)
 {
     connection_t *next = NULL;
+
+    for (int i = 0; i < (int)_countof(config_watches); i++)
+    {
+        StopConfigWatch(&config_watches[i]);
+    }
+    ClearConnIndex();
     for (connection_t *c = o->chead; c; c = next)
     {
         next = c->next;
@@ -44,6 +44,7 @@
 #include "misc.h"
 #include "registry.h"
 #include "save_pass.h"
+#include "connmap.h"
 
 #define streq(x, y) (_tcscmp((x), (y)) == 0)
 
@@ -167,6 +168,11 @@ add_option(options_t *options, int i, TCHAR **p)
         ++i;
         options->log_append = _ttoi(p[1]) ? 1 : 0;
     }
+    else if (streq(p[0], _T("event_log")) && p[1])
+    {
+        ++i;
+        options->event_log = _ttoi(p[1]) ? 1 : 0;
+    }
     else if ((streq(p[0], _T("iservice_admin"))) && p[1])
     {
         ++i;
@@ -316,6 +322,13 @@ add_option(options_t *options, int i, TCHAR **p)
     {
         options->disable_popup_messages = 1;
     }
+#ifdef DEBUG
+    else if (streq(p[0], _T("mgmt_record_dir")) && p[1])
+    {
+        ++i;
+        _tcsncpy(options->mgmt_record_dir, p[1], _countof(options->mgmt_record_dir) - 1);
+    }
+#endif
     else if (streq(p[0], _T("management_port_offset")) && p[1])
     {
         ++i;
@@ -473,47 +486,131 @@ ProcessCommandLine(options_t *options, TCHAR *command_line)
 }
 
 
-/* Return num of connections with state = check */
-int
-CountConnState(conn_state_t check)
+/*
+ * Indexes of the connection list: connections by config name and by
+ * config file name, connections by management socket, and the number
+ * of connections in each state. Names are only added while the list
+ * is built, sockets change as connections attach and detach, and the
+ * state counts are kept up to date by SetConnState().
+ */
+static struct
 {
-    int count = 0;
+    SRWLOCK lock;                       /* guards the maps */
+    connmap_names_t by_name;
+    connmap_names_t by_file;
+    connmap_keys_t by_socket;
+    volatile LONG states[detached + 1]; /* number of connections per state */
+} conn_index = { SRWLOCK_INIT };
+
+/* Add a new connection of the list to the indexes */
+void
+IndexConn(connection_t *c)
+{
+    AcquireSRWLockExclusive(&conn_index.lock);
+    if (!connmap_names_add(&conn_index.by_name, c->config_name, c)
+        || !connmap_names_add(&conn_index.by_file, c->config_file, c))
+    {
+        ReleaseSRWLockExclusive(&conn_index.lock);
+        ErrorExit(1, L"Out of memory in IndexConn");
+    }
+    ReleaseSRWLockExclusive(&conn_index.lock);
+    InterlockedIncrement(&conn_index.states[c->state]);
+}
 
-    for (connection_t *c = o.chead; c; c = c->next)
+/* Drop all connections from the indexes before the list is freed */
+void
+ClearConnIndex(void)
+{
+    AcquireSRWLockExclusive(&conn_index.lock);
+    connmap_names_free(&conn_index.by_name);
+    connmap_names_free(&conn_index.by_file);
+    connmap_keys_free(&conn_index.by_socket);
+    ReleaseSRWLockExclusive(&conn_index.lock);
+    for (int i = 0; i < (int)_countof(conn_index.states); i++)
     {
-        if (c->state == check)
-        {
-            ++count;
-        }
+        InterlockedExchange(&conn_index.states[i], 0);
     }
+}
 
-    return count;
+/* Change the state of a connection, keeping count of connections per state */
+void
+SetConnState(connection_t *c, conn_state_t state)
+{
+    conn_state_t old = (conn_state_t)InterlockedExchange((volatile LONG *)&c->state, state);
+
+    if (old != state)
+    {
+        InterlockedDecrement(&conn_index.states[old]);
+        InterlockedIncrement(&conn_index.states[state]);
+    }
 }
 
-connection_t *
-GetConnByManagement(SOCKET sk)
+/* Change the management socket of a connection, keeping the socket index */
+void
+SetConnManagement(connection_t *c, SOCKET sk)
 {
-    for (connection_t *c = o.chead; c; c = c->next)
+    AcquireSRWLockExclusive(&conn_index.lock);
+    if (c->manage.sk != INVALID_SOCKET)
     {
-        if (c->manage.sk == sk)
-        {
-            return c;
-        }
+        /* the socket may be closed and already reused by another connection */
+        connmap_keys_remove(&conn_index.by_socket, (uintptr_t)c->manage.sk, c);
     }
-    return NULL;
+    if (sk != INVALID_SOCKET && !connmap_keys_set(&conn_index.by_socket, (uintptr_t)sk, c))
+    {
+        ReleaseSRWLockExclusive(&conn_index.lock);
+        ErrorExit(1, L"Out of memory in SetConnManagement");
+    }
+    c->manage.sk = sk;
+    ReleaseSRWLockExclusive(&conn_index.lock);
+}
+
+/* Return num of connections with state = check */
+int
+CountConnState(conn_state_t check)
+{
+    return (int)conn_index.states[check];
+}
+
+connection_t *
+GetConnByManagement(SOCKET sk)
+{
+    connection_t *c;
+
+    AcquireSRWLockShared(&conn_index.lock);
+    c = connmap_keys_find(&conn_index.by_socket, (uintptr_t)sk);
+    ReleaseSRWLockShared(&conn_index.lock);
+
+    return c;
 }
 
 connection_t *
 GetConnByName(const WCHAR *name)
 {
-    for (connection_t *c = o.chead; c; c = c->next)
+    connection_t *by_file, *by_name;
+
+    AcquireSRWLockShared(&conn_index.lock);
+    by_file = connmap_names_find(&conn_index.by_file, name);
+    by_name = connmap_names_find(&conn_index.by_name, name);
+    ReleaseSRWLockShared(&conn_index.lock);
+
+    /* the first match in the list, as if it was searched */
+    if (by_file && by_name)
     {
-        if (wcsicmp(c->config_file, name) == 0 || wcsicmp(c->config_name, name) == 0)
-        {
-            return c;
-        }
+        return by_file->id < by_name->id ? by_file : by_name;
     }
-    return NULL;
+    return by_file ? by_file : by_name;
+}
+
+connection_t *
+GetConnByFile(const WCHAR *config_file)
+{
+    connection_t *c;
+
+    AcquireSRWLockShared(&conn_index.lock);
+    c = connmap_names_find(&conn_index.by_file, config_file);
+    ReleaseSRWLockShared(&conn_index.lock);
+
+    return c;
 }
 
 static BOOL
@@ -35,6 +35,10 @@ typedef struct connection connection_t;
 #include "manage.h"
 #include "echo.h"
 #include "pkcs11.h"
+#include "logbuf.h"
+#include "logfilter.h"
+#include "eventlog.h"
+#include "logfollow.h"
 
 #define MAX_NAME  (UNLEN + 1)
 
@@ -157,13 +161,52 @@ struct connection
         SOCKET sk;
         SOCKADDR_IN skaddr;
         time_t timeout;
-        char password[4096]; /* match with largest possible passwd in openvpn.exe */
-        char *saved_data;
-        size_t saved_size;
-        mgmt_cmd_t *cmd_queue;
+        char password[4096];          /* match with largest possible passwd in openvpn.exe */
+        mgmt_buf_t rbuf;              /* received data not yet split into lines */
+        mgmt_buf_t inbox;             /* lines waiting to be handled */
+        mgmt_buf_t lines;             /* lines being handled */
+        struct mgmt_reactor *reactor; /* reactor serving the socket, if any */
+        int slot;                     /* index of the socket within its reactor */
+        SRWLOCK rx_lock;              /* held to use inbox and the rx_ fields */
+        BOOL rx_paused;               /* receiving suspended as the inbox is full */
+        BOOL rx_notified;             /* status window notified of lines in the inbox */
+        BOOL reading;                 /* received lines are being handled */
+        BOOL read_pending;            /* more lines arrived while handling */
+        BOOL send_posted;             /* status window notified to send commands */
+        mgmt_cmdq_t cmds;             /* commands waiting for their responses */
+        int connect_attempts;         /* number of connection attempts so far */
+        ULONGLONG connect_start;      /* tick count at the first connection attempt */
+        ULONGLONG connect_time;       /* milliseconds it took to connect */
+        uint32_t retry_seed;          /* random state of the retry delays */
+        int probe_errors;             /* ready probes not answered with the pid */
+#ifdef DEBUG
+        HANDLE record;                /* file the session is recorded to, if any */
+#endif
         DWORD connected; /* 1: management interface connected, 2: connected and ready */
     } manage;
 
+    struct
+    {
+        eventlog_t log;  /* events waiting to be written */
+        HANDLE file;     /* the open event file, NULL if closed */
+        ULONGLONG size;  /* size of the event file */
+        ULONGLONG whole; /* size of the event file up to the last whole event */
+        BOOL discard;    /* drop the rest of an event that could not be written */
+    } events;            /* structured events, written if event_log is enabled */
+
+    struct
+    {
+        logfollow_pos_t pos;   /* position in the log file, saved in the registry */
+        logfollow_time_t time; /* time of the last line read */
+        ULONGLONG saved;       /* tick count when pos was last saved */
+        BOOL active;           /* the log file is followed */
+        BOOL catch_up;         /* lines are shown from the file up to the first one received */
+        BOOL first_seen;       /* the first line was received through the management interface */
+        time_t first_time;     /* its time */
+        size_t first_len;      /* its length */
+        char first[128];       /* its start */
+    } daemon_log;              /* log file written by the service for persistent connections */
+
     HANDLE hProcess; /* Handle of openvpn process if directly started */
     service_io_t iserv;
 
@@ -177,6 +220,10 @@ struct connection
     struct env_item *es;      /* Pointer to the head of config-specific env variables list */
     struct echo_msg echo_msg; /* Message echo-ed from server or client config and related data */
     struct pkcs11_list pkcs11_list;
+    logbuf_t log_lines;       /* lines shown in the log window of the status dialog */
+    SRWLOCK log_lock;         /* held to change log_lines, or to read it from other threads */
+    logfilter_t log_filter;   /* lines of log_lines shown in the log window */
+    LONG log_width;           /* width of the widest row of the log window drawn */
     char daemon_state[20];    /* state of openvpn.ex: WAIT, AUTH, GET_CONFIG etc.. */
     int id;                   /* index of config -- treat as immutable once assigned */
     connection_t *next;
@@ -227,6 +274,9 @@ typedef struct
     TCHAR ext_string[16];
     TCHAR log_dir[MAX_PATH];
     DWORD log_append;
+    DWORD log_rotate_size;  /* Size in MB above which an appended log is rotated, 0 = never */
+    DWORD log_rotate_count; /* Number of rotated logs kept */
+    DWORD event_log;        /* Write connection events to <config>.jsonl if nonzero */
     TCHAR log_viewer[MAX_PATH];
     TCHAR editor[MAX_PATH];
     DWORD silent_connection;
@@ -239,6 +289,7 @@ typedef struct
     DWORD config_menu_view;         /* 0 for auto, 1 for original flat menu, 2 for hierarchical */
     DWORD disable_popup_messages;   /* set nonzero to suppress all echo msg messages */
     DWORD popup_mute_interval;      /* Interval in hours to suppress repeated echo messages */
+    DWORD log_window_lines;         /* Number of lines kept in the status window log */
     DWORD mgmt_port_offset; /* management interface port = this offset + index of connection profile
                              */
 
@@ -248,6 +299,7 @@ typedef struct
     DWORD disable_password_reveal; /* read from group policy */
 #ifdef DEBUG
     FILE *debug_fp;
+    TCHAR mgmt_record_dir[MAX_PATH]; /* directory to record management sessions to */
 #endif
 
     HWND hWnd;
@@ -272,12 +324,23 @@ void InitOptions(options_t *);
 
 void ProcessCommandLine(options_t *, TCHAR *);
 
+void IndexConn(connection_t *c);
+
+void ClearConnIndex(void);
+
+void SetConnState(connection_t *c, conn_state_t state);
+
+void SetConnManagement(connection_t *c, SOCKET sk);
+
 int CountConnState(conn_state_t);
 
 connection_t *GetConnByManagement(SOCKET);
 
+/* Find a connection by config name or config file name, ignoring case */
 connection_t *GetConnByName(const WCHAR *config_name);
 
+connection_t *GetConnByFile(const WCHAR *config_file);
+
 INT_PTR CALLBACK ScriptSettingsDlgProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam);
 
 INT_PTR CALLBACK ConnectionSettingsDlgProc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -238,12 +238,12 @@ pkcs11_id_send(connection_t *c, const char *id)
     {
         snprintf(cmd, len, format, id ? id : "");
         cmd[len - 1] = '\0';
-        ManagementCommand(c, cmd, NULL, regular);
+        ManagementReply(c, cmd);
     }
     else
     {
         WriteStatusLog(c, L"GUI> ", L"Out of memory in pkcs11_id_send", false);
-        ManagementCommand(c, "needstr 'pkcs11-id-request' ''", NULL, regular);
+        ManagementReply(c, "needstr 'pkcs11-id-request' ''");
     }
     free(cmd);
 }
@@ -349,7 +349,17 @@ pkcs11_list_update(connection_t *c)
         for (UINT i = 0; i < l->count; i++)
         {
             _snprintf_0(cmd, "pkcs11-id-get %u", i);
-            ManagementCommand(c, cmd, pkcs11_entry_recv, regular);
+            if (!ManagementQuery(c, cmd, pkcs11_entry_recv))
+            {
+                /* list the entries queried so far */
+                WriteStatusLog(c, L"GUI> ", L"Too many pkcs11 entries, list truncated", false);
+                l->count = i;
+                if (i == 0)
+                {
+                    l->state |= STATE_FILLED;
+                }
+                break;
+            }
         }
         l->state |= STATE_GET_ENTRY;
     }
@@ -60,7 +60,7 @@ OnStop_(connection_t *c, UNUSED char *msg)
     dmsg(L"profile: %ls with state = %d", c->config_name, c->state);
 
     /* do not show any popup error messages */
-    c->state = disconnected;
+    SetConnState(c, disconnected);
     SetDlgItemText(c->hwndStatus, ID_TXT_STATUS, LoadLocalizedString(IDS_NFO_STATE_DISCONNECTED));
     SetStatusWinIcon(c->hwndStatus, ID_ICO_DISCONNECTED);
     SendMessage(c->hwndStatus, WM_CLOSE, 0, 0);
@@ -148,7 +148,7 @@ OnStateChange_(connection_t *c, char *msg)
          * let disconnect process continue. This is required to
          * retain the hold state after SIGHUP restart.
          */
-        c->state = disconnecting;
+        SetConnState(c, disconnecting);
     }
 }
 
@@ -437,6 +437,7 @@ DeleteUI(void)
     }
     DetachAllOpenVPN();
     /* at this point all status threads have terminated -- we can safely free config list */
+    StopManagementReactor();
     FreeConfigList(&o);
     CloseSemaphore(o.session_semaphore);
     WSACleanup();
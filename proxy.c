@@ -648,7 +648,7 @@ OnProxy(connection_t *c, char *line)
     char cmd[128];
     snprintf(cmd, sizeof(cmd), "proxy %s %ls %ls", type, addr, port);
     cmd[sizeof(cmd) - 1] = '\0';
-    ManagementCommand(c, cmd, NULL, regular);
+    ManagementReply(c, cmd);
 
     GlobalFree(proxy_str);
 }
@@ -59,6 +59,9 @@ struct regkey_int
     DWORD *var;
     DWORD value;
 } regkey_int[] = { { L"log_append", &o.log_append, 0 },
+                   { L"log_rotate_size", &o.log_rotate_size, 100 },
+                   { L"log_rotate_count", &o.log_rotate_count, 5 },
+                   { L"event_log", &o.event_log, 0 },
                    { L"iservice_admin", &o.iservice_admin, 1 },
                    { L"show_balloon", &o.show_balloon, 1 },
                    { L"silent_connection", &o.silent_connection, 0 },
@@ -68,6 +71,7 @@ struct regkey_int
                    { L"show_script_window", &o.show_script_window, 0 },
                    { L"config_menu_view", &o.config_menu_view, CONFIG_VIEW_AUTO },
                    { L"popup_mute_interval", &o.popup_mute_interval, 24 },
+                   { L"log_window_lines", &o.log_window_lines, 10000 },
                    { L"disable_popup_messages", &o.disable_popup_messages, 0 },
                    { L"management_port_offset", &o.mgmt_port_offset, 25340 },
                    { L"enable_peristent_connections", &o.enable_persistent, 2 },
@@ -253,6 +257,14 @@ GetRegistryKeys()
     {
         o.mgmt_port_offset = 25340;
     }
+    if (o.log_window_lines < 100 || o.log_window_lines > 1000000)
+    {
+        o.log_window_lines = 10000;
+    }
+    if (o.log_rotate_count < 1 || o.log_rotate_count > 99)
+    {
+        o.log_rotate_count = 5;
+    }
 
     /* Read group policy setting for password reveal */
     status = RegOpenKeyExW(
@@ -700,3 +712,43 @@ DeleteConfigRegistryValue(const WCHAR *config_name, const WCHAR *name)
 
     return (status == ERROR_SUCCESS);
 }
+
+/*
+ * Call fn with the name and the last write time of every config
+ * registry key. Saving or deleting a password changes the time of the
+ * config's key. Returns 0 if the keys cannot be listed.
+ */
+int
+EnumConfigRegistryKeys(config_key_fn fn, void *arg)
+{
+    HKEY regkey;
+    WCHAR name[256]; /* maximum length of a key name + 1 */
+    LONG status;
+
+    status =
+        RegOpenKeyEx(HKEY_CURRENT_USER, L"SOFTWARE\\OpenVPN-GUI\\configs", 0, KEY_READ, &regkey);
+    if (status == ERROR_FILE_NOT_FOUND)
+    {
+        return 1; /* no config has a key */
+    }
+    if (status != ERROR_SUCCESS)
+    {
+        return 0;
+    }
+
+    for (DWORD i = 0;; i++)
+    {
+        DWORD len = _countof(name);
+        FILETIME ft;
+
+        status = RegEnumKeyEx(regkey, i, name, &len, NULL, NULL, NULL, &ft);
+        if (status != ERROR_SUCCESS)
+        {
+            break;
+        }
+        fn(arg, name, ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+    }
+    RegCloseKey(regkey);
+
+    return (status == ERROR_NO_MORE_ITEMS);
+}
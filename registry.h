@@ -47,4 +47,8 @@ DWORD GetConfigRegistryValue(const WCHAR *config_name, const WCHAR *name, BYTE *
 
 int DeleteConfigRegistryValue(const WCHAR *config_name, const WCHAR *name);
 
+typedef void (*config_key_fn)(void *arg, const WCHAR *config_name, ULONGLONG last_write);
+
+int EnumConfigRegistryKeys(config_key_fn fn, void *arg);
+
 #endif /* ifndef REGISTRY_H */
@@ -0,0 +1,471 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of starting up with the config catalog.
+ *
+ *   bench_catalog [profiles in thousands] [latency in ms] [directory]
+ *
+ * A tree of 501 config directories holding the given number of profiles
+ * (default 5 thousand) is made in a scratch directory under the given
+ * one (default TMPDIR or /tmp). A third of the profiles have saved
+ * passwords, in a table standing in for the registry keys of the GUI.
+ * opendir(), readdir() and open() are wrapped at link time to wait for
+ * the given latency (default 1 ms), as on a network share: on each open
+ * and on each batch of READDIR_BATCH entries.
+ *
+ * Startup is done as BuildFileList() does it: load the catalog, scan
+ * the tree with it as the cache, look up saved passwords of the configs
+ * whose key changed, and save the catalog if anything changed. It is
+ * timed without a catalog, with the catalog just saved, after configs
+ * and a saved password changed, and with a damaged catalog. A warm
+ * start must not list a directory or open a config, and every start
+ * must give the same configs, readable flags and saved password flags
+ * as a start without a catalog.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "catalog.h"
+
+#define GROUPS        10 /* directories below the root, each with subdirectories */
+#define SUBDIRS       49
+#define READDIR_BATCH 128 /* entries fetched per round trip */
+#define SCAN_THREADS  8   /* as CONFIG_SCAN_THREADS in openvpn_config.c */
+#define SAVED_AUTH    1   /* as FLAG_SAVE_AUTH_PASS */
+#define SAVED_KEY     2   /* as FLAG_SAVE_KEY_PASS */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The latency injected, and the calls made while counting */
+static long latency_ns;
+static int counting;
+static atomic_ulong dir_opens, fetches, file_opens;
+static _Thread_local unsigned int entries_read;
+
+DIR *__real_opendir(const char *name);
+struct dirent *__real_readdir(DIR *dir);
+int __real_open(const char *path, int flags, ...);
+
+static void
+wait_latency(atomic_ulong *calls)
+{
+    struct timespec ts = { latency_ns / 1000000000, latency_ns % 1000000000 };
+
+    atomic_fetch_add(calls, 1);
+    if (latency_ns)
+    {
+        nanosleep(&ts, NULL);
+    }
+}
+
+DIR *
+__wrap_opendir(const char *name)
+{
+    if (counting)
+    {
+        wait_latency(&dir_opens);
+    }
+    entries_read = 0;
+    return __real_opendir(name);
+}
+
+struct dirent *
+__wrap_readdir(DIR *dir)
+{
+    if (counting && entries_read++ % READDIR_BATCH == 0)
+    {
+        wait_latency(&fetches);
+    }
+    return __real_readdir(dir);
+}
+
+int
+__wrap_open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    va_list ap;
+
+    if (flags & O_CREAT)
+    {
+        va_start(ap, flags);
+        mode = (mode_t)va_arg(ap, int);
+        va_end(ap);
+    }
+    if (counting)
+    {
+        wait_latency(&file_opens);
+    }
+    return __real_open(path, flags, mode);
+}
+
+/*
+ * The registry keys of the profiles: the last write time of each key, 0
+ * if the profile has none, and the passwords saved. Reading all key
+ * times is one pass, as EnumConfigRegistryKeys(); probes for the saved
+ * passwords are counted.
+ */
+static uint64_t *key_time;
+static unsigned int *key_saved;
+static unsigned long probes;
+
+static char root[4096];
+static wchar_t wroot[4096];
+static char catalog_name[4200];
+static wchar_t catalog[4200];
+static unsigned int profiles;
+
+static void
+add_profile(const char *dir, unsigned int n)
+{
+    char name[4200];
+    int fd;
+
+    snprintf(name, sizeof(name), "%.4000s/client-%05u.ovpn", dir, n);
+    fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || write(fd, "client\nremote vpn.example.com\n", 30) != 30)
+    {
+        perror(name);
+        exit(2);
+    }
+    close(fd);
+    if (n % 3 == 0)
+    {
+        key_time[n] = 1000 + n;
+        key_saved[n] = SAVED_AUTH | (n % 2 ? SAVED_KEY : 0);
+    }
+}
+
+/* Make a directory with per_dir profiles and a certificate */
+static void
+make_dir(const char *path, unsigned int per_dir)
+{
+    char name[4200];
+    int fd;
+
+    if (mkdir(path, 0700) != 0)
+    {
+        perror(path);
+        exit(2);
+    }
+    for (unsigned int i = 0; i < per_dir; i++)
+    {
+        add_profile(path, profiles++);
+    }
+    snprintf(name, sizeof(name), "%.4000s/ca.crt", path);
+    fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+/* Set the time of the directories back, as of a tree not changed lately */
+static void
+age_tree(const char *path)
+{
+    struct timespec times[2] = { { time(NULL) - 3600, 0 }, { time(NULL) - 3600, 0 } };
+    char name[4200];
+    struct dirent *de;
+    DIR *dir = opendir(path);
+
+    while (dir && (de = readdir(dir)))
+    {
+        if (strncmp(de->d_name, "site-", 5) == 0)
+        {
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            age_tree(name);
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+static void
+remove_tree(const char *path)
+{
+    char name[4200];
+    struct dirent *de;
+    DIR *dir = opendir(path);
+
+    while (dir && (de = readdir(dir)))
+    {
+        if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+        {
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            if (unlink(name) != 0)
+            {
+                remove_tree(name);
+            }
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+/* Set the saved password flags of the configs, as CheckSavedPasswords() */
+static int
+check_passwords(dirscan_dir_t *d)
+{
+    int changed = d->changed;
+
+    for (size_t i = 0; i < d->nfiles; i++)
+    {
+        dirscan_file_t *f = &d->files[i];
+        unsigned int n = (unsigned int)wcstoul(f->name + 7, NULL, 10);
+        unsigned int meta = f->meta;
+        uint64_t stamp = f->meta_stamp;
+
+        if (key_time[n] == 0)
+        {
+            f->meta = 0;
+        }
+        else if (f->meta_stamp != key_time[n])
+        {
+            probes++;
+            f->meta = key_saved[n];
+        }
+        f->meta_stamp = key_time[n];
+        changed |= f->meta != meta || f->meta_stamp != stamp;
+    }
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        changed |= check_passwords(d->subdirs[i]);
+    }
+    return changed;
+}
+
+static size_t
+count_dirs(const dirscan_dir_t *d)
+{
+    size_t n = 1;
+
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        n += count_dirs(d->subdirs[i]);
+    }
+    return n;
+}
+
+/* Return 1 if a and b hold the same configs with the same flags */
+static int
+same_tree(const dirscan_dir_t *a, const dirscan_dir_t *b)
+{
+    if (wcscmp(a->path, b->path) || a->nfiles != b->nfiles || a->nsubdirs != b->nsubdirs)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < a->nfiles; i++)
+    {
+        const dirscan_file_t *fa = &a->files[i], *fb = &b->files[i];
+
+        if (wcscmp(fa->name, fb->name) || fa->size != fb->size || fa->mtime != fb->mtime
+            || fa->readable != fb->readable || fa->meta != fb->meta)
+        {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < a->nsubdirs; i++)
+    {
+        if (!same_tree(a->subdirs[i], b->subdirs[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Start up as BuildFileList() does, with the catalog if use_catalog,
+ * and return the configs found.
+ */
+static dirscan_dir_t *
+startup(const char *what, int use_catalog, const dirscan_dir_t *expected)
+{
+    dirscan_dir_t *cached = NULL, *d;
+    size_t listed = 0, dirs;
+    int changed;
+    double start;
+
+    dir_opens = fetches = file_opens = 0;
+    probes = 0;
+    counting = 1;
+
+    start = now();
+    if (use_catalog && catalog_load(catalog, L"ovpn", &cached, 1) == 0)
+    {
+        cached = NULL;
+    }
+    d = dirscan_run(wroot, L"ovpn", 2, SCAN_THREADS, cached);
+    if (!d)
+    {
+        fprintf(stderr, "FAIL: out of memory\n");
+        exit(2);
+    }
+    changed = check_passwords(d);
+    if (use_catalog && (changed || !cached) && !catalog_save(catalog, L"ovpn", &d, 1))
+    {
+        fprintf(stderr, "FAIL: cannot save the catalog\n");
+        failures++;
+    }
+    start = now() - start;
+    counting = 0;
+
+    dirscan_free(cached);
+    dirs = count_dirs(d);
+    listed = dir_opens;
+    if (expected && !same_tree(d, expected))
+    {
+        fprintf(stderr, "FAIL: %s differs from a start without a catalog\n", what);
+        failures++;
+    }
+    printf("%-24s %8.1f ms: %4zu of %zu directories listed, %5lu configs opened, "
+           "%4lu password probes\n",
+           what,
+           1e3 * start,
+           listed,
+           dirs,
+           (unsigned long)file_opens,
+           probes);
+    return d;
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned int count = (unsigned int)((argc > 1 ? atof(argv[1]) : 5) * 1000);
+    double latency = argc > 2 ? atof(argv[2]) : 1;
+    unsigned int per_dir = count / (1 + GROUPS + GROUPS * SUBDIRS) + 1;
+    const char *tmp = getenv("TMPDIR");
+    char path[4200], added[4200], removed[4200];
+    dirscan_dir_t *cold, *d;
+    FILE *f;
+
+    snprintf(root,
+             sizeof(root),
+             "%s/test_catalog.%d",
+             argc > 3 ? argv[3] : tmp ? tmp : "/tmp",
+             (int)getpid());
+    swprintf(wroot, 4096, L"%s", root);
+    /* next to the tree, as the catalog is in the log directory */
+    snprintf(catalog_name, sizeof(catalog_name), "%s.dat", root);
+    swprintf(catalog, 4200, L"%s", catalog_name);
+
+    /* the root, groups of sites, and room for the profile added later */
+    key_time = calloc((size_t)per_dir * (1 + GROUPS + GROUPS * SUBDIRS) + 1, sizeof(*key_time));
+    key_saved = calloc((size_t)per_dir * (1 + GROUPS + GROUPS * SUBDIRS) + 1, sizeof(*key_saved));
+    make_dir(root, per_dir);
+    for (int g = 0; g < GROUPS; g++)
+    {
+        snprintf(path, sizeof(path), "%s/site-%d", root, g);
+        make_dir(path, per_dir);
+        for (int s = 0; s < SUBDIRS; s++)
+        {
+            snprintf(path, sizeof(path), "%s/site-%d/site-%d", root, g, s);
+            make_dir(path, per_dir);
+        }
+    }
+    age_tree(root);
+    printf("%u profiles in %d directories, %.1f ms latency\n",
+           profiles,
+           1 + GROUPS + GROUPS * SUBDIRS,
+           latency);
+    latency_ns = (long)(latency * 1e6);
+
+    /* without a catalog, then warm with the one saved */
+    cold = startup("cold, no catalog", 1, NULL);
+    d = startup("warm", 1, cold);
+    CHECK(dir_opens == 0 && file_opens == 0 && probes == 0);
+    dirscan_free(d);
+    dirscan_free(cold);
+
+    /* add a profile, remove the last one of site-8, and save a password */
+    snprintf(added, sizeof(added), "%s/site-3/site-7", root);
+    add_profile(added, profiles);
+    snprintf(removed,
+             sizeof(removed),
+             "%s/site-8/client-%05u.ovpn",
+             root,
+             per_dir * (2 + 8 * (1 + SUBDIRS)) - 1);
+    CHECK(unlink(removed) == 0);
+    key_time[5 * per_dir] = 5000000;
+    key_saved[5 * per_dir] = SAVED_AUTH;
+
+    cold = startup("cold, after changes", 0, NULL);
+    d = startup("warm, after changes", 1, cold);
+    CHECK(dir_opens == 2 && file_opens == 1);
+    CHECK(probes == 1 + (key_time[profiles] != 0));
+    dirscan_free(d);
+
+    /* a truncated catalog is not used */
+    f = fopen(catalog_name, "r+b");
+    CHECK(f && ftruncate(fileno(f), 5000) == 0);
+    if (f)
+    {
+        fclose(f);
+    }
+    d = startup("damaged catalog", 1, cold);
+    CHECK(d && dir_opens == count_dirs(d));
+    dirscan_free(d);
+    dirscan_free(cold);
+
+    remove_tree(root);
+    unlink(catalog_name);
+    free(key_time);
+    free(key_saved);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
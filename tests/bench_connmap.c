@@ -0,0 +1,296 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the connection indexes.
+ *
+ *   bench_connmap [number of profiles]
+ *
+ * A number of profiles (default 10000) are added with a check for
+ * duplicate names, and looked up by name and by file name in other
+ * case, once walking the list as the GUI used to and once with the
+ * name index. Then management sockets are set, looked up and removed
+ * at random in the key index and compared with a plain array, with
+ * enough removals to shift entries back into the slots freed. The key
+ * of each operation is looked up after it, and every so often all keys
+ * left in the table must still be found from their home slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <wctype.h>
+#include "connmap.h"
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct profile
+{
+    wchar_t name[64];
+    wchar_t file[64];
+    struct profile *next;
+};
+
+static int
+same_name(const wchar_t *a, const wchar_t *b)
+{
+    for (; *a && towlower(*a) == towlower(*b); a++, b++)
+    {
+    }
+    return towlower(*a) == towlower(*b);
+}
+
+/* Find a profile by name or file name walking the list, as GetConnByName() did */
+static struct profile *
+list_find(struct profile *head, const wchar_t *name)
+{
+    for (struct profile *p = head; p; p = p->next)
+    {
+        if (same_name(p->name, name) || same_name(p->file, name))
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void
+bench_names(int count)
+{
+    struct profile *profiles = calloc((size_t)count, sizeof(*profiles));
+    struct profile *head = NULL, **tail = &head;
+    connmap_names_t names = { 0 };
+    wchar_t key[64];
+    double t0, t1, t2, t3, t4;
+    int found = 0, dups = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        swprintf(profiles[i].name, 64, L"Office-%05d-%ls", i % (count - count / 100), L"VPN");
+        swprintf(profiles[i].file, 64, L"office-%05d-vpn.ovpn", i);
+    }
+
+    /* add with a check for duplicates: the last 1% repeat names */
+    t0 = now();
+    for (int i = 0; i < count; i++)
+    {
+        if (list_find(head, profiles[i].name))
+        {
+            dups++;
+            continue;
+        }
+        *tail = &profiles[i];
+        tail = &profiles[i].next;
+    }
+    t1 = now();
+    for (int i = 0; i < count; i++)
+    {
+        if (connmap_names_find(&names, profiles[i].name))
+        {
+            dups--;
+            continue;
+        }
+        CHECK(connmap_names_add(&names, profiles[i].name, &profiles[i]));
+        CHECK(connmap_names_add(&names, profiles[i].file, &profiles[i]));
+    }
+    t2 = now();
+    CHECK(dups == 0);
+
+    /* look up names in upper case, half by name and half by file name */
+    for (int i = 0; i < count; i++)
+    {
+        swprintf(key, 64, i % 2 ? L"OFFICE-%05d-VPN" : L"OFFICE-%05d-VPN.OVPN", rnd() % count);
+        found += list_find(head, key) != NULL;
+    }
+    t3 = now();
+    seed = 1;
+    for (int i = 0; i < count; i++)
+    {
+        swprintf(key, 64, i % 2 ? L"OFFICE-%05d-VPN" : L"OFFICE-%05d-VPN.OVPN", rnd() % count);
+        found -= connmap_names_find(&names, key) != NULL;
+    }
+    t4 = now();
+    CHECK(found == 0);
+
+    /* every name maps to its first profile, and each file name of those */
+    for (int i = 0; i < count; i++)
+    {
+        struct profile *first = list_find(head, profiles[i].name);
+
+        CHECK(connmap_names_find(&names, profiles[i].name) == first);
+        first = first == &profiles[i] ? first : NULL;
+        CHECK(connmap_names_find(&names, profiles[i].file) == first);
+    }
+    CHECK(connmap_names_find(&names, L"no such profile") == NULL);
+
+    printf("%d profiles: adding %.1f ms as a list scan, %.2f ms indexed; "
+           "%d lookups %.1f ms as a list scan, %.2f ms indexed\n",
+           count,
+           1e3 * (t1 - t0),
+           1e3 * (t2 - t1),
+           count,
+           1e3 * (t3 - t2),
+           1e3 * (t4 - t3));
+
+    connmap_names_free(&names);
+    free(profiles);
+}
+
+/* Check that no entry is separated from its home slot by a free slot */
+static int
+probe_chains_intact(const connmap_keys_t *m)
+{
+    for (size_t i = 0; m->slots && i <= m->mask; i++)
+    {
+        if (m->slots[i].value && connmap_keys_find(m, m->slots[i].key) != m->slots[i].value)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+bench_keys(int count)
+{
+    connmap_keys_t keys = { 0 };
+    int n = 4 * count;
+    void **ref = calloc((size_t)n, sizeof(*ref));
+    size_t live = 0;
+    unsigned long removes = 0, checks = 0;
+    double t0, t1;
+    unsigned long hits = 0, expected = 0;
+
+    /* sockets are small multiples of 4 that are reused soon after close */
+    for (int op = 0; op < 20 * count; op++)
+    {
+        int k = (int)(rnd() % (unsigned int)n);
+        uintptr_t key = 0x100 + 4 * (uintptr_t)k;
+        void *value = &ref[rnd() % (unsigned int)n];
+
+        if (rnd() % 3 == 0)
+        {
+            /* only removed while it still maps to the connection */
+            void *expected = rnd() % 4 ? ref[k] : value;
+
+            connmap_keys_remove(&keys, key, expected);
+            if (ref[k] && ref[k] == expected)
+            {
+                ref[k] = NULL;
+                live--;
+                removes++;
+            }
+            if (op % 64 == 0)
+            {
+                checks++;
+                if (!probe_chains_intact(&keys))
+                {
+                    fprintf(stderr, "FAIL: a key is lost after removal %lu\n", removes);
+                    failures++;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            CHECK(connmap_keys_set(&keys, key, value));
+            live += ref[k] == NULL;
+            ref[k] = value;
+        }
+        CHECK(connmap_keys_find(&keys, key) == ref[k]);
+    }
+    CHECK(keys.count == live);
+    for (int k = 0; k < n; k++)
+    {
+        CHECK(connmap_keys_find(&keys, 0x100 + 4 * (uintptr_t)k) == ref[k]);
+    }
+
+    t0 = now();
+    for (int i = 0; i < 1000000; i++)
+    {
+        hits += connmap_keys_find(&keys, 0x100 + 4 * (uintptr_t)(rnd() % (unsigned int)n)) != NULL;
+    }
+    t1 = now();
+    for (int k = 0; k < n; k++)
+    {
+        expected += ref[k] != NULL;
+    }
+    CHECK(hits > expected * 1000000 / (unsigned long)n / 2);
+
+    printf("%d sockets: %lu removals with %lu full checks, %zu keys left; "
+           "%.1f ns/lookup\n",
+           n,
+           removes,
+           checks,
+           keys.count,
+           1e3 * (t1 - t0));
+
+    connmap_keys_free(&keys);
+    free(ref);
+}
+
+int
+main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+
+    if (count < 100)
+    {
+        fprintf(stderr, "usage: bench_connmap [number of profiles, at least 100]\n");
+        return 2;
+    }
+    bench_names(count);
+    bench_keys(count);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
@@ -0,0 +1,390 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the config directory scan.
+ *
+ *   bench_dirscan [entries in thousands] [latency in ms] [directory]
+ *
+ * A tree of config directories with the given number of entries
+ * (default 50 thousand) is made in a scratch directory under the given
+ * one (default TMPDIR or /tmp): 1010 directories three levels deep,
+ * holding configs and other files. opendir() and readdir() are wrapped
+ * at link time to wait for the given latency (default 2 ms) on each
+ * open and on each batch of READDIR_BATCH entries, as a directory on a
+ * network share does.
+ *
+ * The tree is walked as BuildFileList0() used to do, listing each
+ * directory twice, once for files and once for subdirectories, one
+ * directory at a time. It is then scanned with dirscan_run() by one
+ * thread and by as many threads as the GUI uses. Every scan must find
+ * the same configs and directories in the same order, and a scan with
+ * the previous one as the cache must not list any directory again.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dirscan.h"
+
+#define FANOUT        10, 10, 9 /* subdirectories at each level */
+#define DEPTH         3
+#define READDIR_BATCH 128 /* entries fetched per round trip */
+#define SCAN_THREADS  8   /* as CONFIG_SCAN_THREADS in openvpn_config.c */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The latency injected, and the calls made while it is */
+static long latency_ns;
+static atomic_ulong opens, fetches;
+static _Thread_local unsigned int entries_read;
+
+DIR *__real_opendir(const char *name);
+struct dirent *__real_readdir(DIR *dir);
+
+static void
+wait_latency(void)
+{
+    struct timespec ts = { latency_ns / 1000000000, latency_ns % 1000000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+DIR *
+__wrap_opendir(const char *name)
+{
+    if (latency_ns)
+    {
+        atomic_fetch_add(&opens, 1);
+        wait_latency();
+    }
+    entries_read = 0;
+    return __real_opendir(name);
+}
+
+struct dirent *
+__wrap_readdir(DIR *dir)
+{
+    if (latency_ns && entries_read++ % READDIR_BATCH == 0)
+    {
+        atomic_fetch_add(&fetches, 1);
+        wait_latency();
+    }
+    return __real_readdir(dir);
+}
+
+static char root[4096];
+static wchar_t wroot[4096];
+static unsigned long made_dirs, made_files, made_configs;
+
+/* Make the directory path with files and depth levels of subdirectories */
+static void
+make_tree(const char *path, int depth, int files)
+{
+    static const int fanout[DEPTH] = { FANOUT };
+    static const char *const exts[] = { "ovpn", "crt", "key", "txt", "OVPN", "ovpn.bak" };
+    char name[4200];
+
+    if (mkdir(path, 0700) != 0)
+    {
+        perror(path);
+        exit(2);
+    }
+    made_dirs++;
+    for (int i = 0; i < files; i++)
+    {
+        unsigned int e = rnd() % 6;
+        int fd;
+
+        snprintf(name, sizeof(name), "%.4000s/client-%04x.%s", path, rnd() & 0xffff, exts[e]);
+        fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+        {
+            continue; /* the same name drawn twice */
+        }
+        if (write(fd, "client\n", 7) != 7)
+        {
+            exit(2);
+        }
+        close(fd);
+        made_files++;
+        made_configs += e == 0 || e == 4;
+    }
+    for (int i = 0; depth < DEPTH && i < fanout[depth]; i++)
+    {
+        snprintf(name, sizeof(name), "%.4000s/site-%d", path, i);
+        make_tree(name, depth + 1, files);
+    }
+}
+
+/* Set the time of the directories back, as of a tree not changed lately */
+static void
+age_tree(const char *path)
+{
+    struct timespec times[2] = { { time(NULL) - 3600, 0 }, { time(NULL) - 3600, 0 } };
+    char name[4200];
+    struct dirent *de;
+    DIR *dir = opendir(path);
+
+    while (dir && (de = readdir(dir)))
+    {
+        if (strncmp(de->d_name, "site-", 5) == 0)
+        {
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            age_tree(name);
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+static void
+remove_tree(const char *path)
+{
+    char name[4200];
+    struct dirent *de;
+    DIR *dir = opendir(path);
+
+    while (dir && (de = readdir(dir)))
+    {
+        if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+        {
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            if (unlink(name) != 0)
+            {
+                remove_tree(name);
+            }
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+/*
+ * Walk the tree as BuildFileList0() did: list the files of a directory,
+ * then list it again for subdirectories and walk each in turn.
+ */
+static void
+walk_twice(const char *path, int depth, unsigned long *configs, unsigned long *dirs)
+{
+    char name[4200];
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+
+    (*dirs)++;
+    if ((dir = opendir(path)))
+    {
+        while ((de = readdir(dir)))
+        {
+            size_t len = strlen(de->d_name);
+
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            if (len > 5 && strcasecmp(de->d_name + len - 5, ".ovpn") == 0
+                && stat(name, &st) == 0 && S_ISREG(st.st_mode))
+            {
+                (*configs)++;
+            }
+        }
+        closedir(dir);
+    }
+    if (depth > 0 && (dir = opendir(path)))
+    {
+        while ((de = readdir(dir)))
+        {
+            snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..") && stat(name, &st) == 0
+                && S_ISDIR(st.st_mode))
+            {
+                walk_twice(name, depth - 1, configs, dirs);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+static void
+count_tree(const dirscan_dir_t *d, unsigned long *configs, unsigned long *dirs)
+{
+    (*dirs)++;
+    *configs += d->nfiles;
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        count_tree(d->subdirs[i], configs, dirs);
+    }
+}
+
+/* Return 1 if a and b hold the same entries in the same order */
+static int
+same_tree(const dirscan_dir_t *a, const dirscan_dir_t *b)
+{
+    if (wcscmp(a->path, b->path) || a->nfiles != b->nfiles || a->nsubdirs != b->nsubdirs)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < a->nfiles; i++)
+    {
+        if (wcscmp(a->files[i].name, b->files[i].name) || a->files[i].size != b->files[i].size
+            || a->files[i].mtime != b->files[i].mtime || !a->files[i].readable
+            || !b->files[i].readable)
+        {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < a->nsubdirs; i++)
+    {
+        if (!same_tree(a->subdirs[i], b->subdirs[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Scan the tree with latency, check it against expected and report */
+static dirscan_dir_t *
+scan(const char *what, int threads, const dirscan_dir_t *cached, const dirscan_dir_t *expected)
+{
+    unsigned long configs = 0, dirs = 0;
+    dirscan_dir_t *d;
+    double start;
+
+    opens = fetches = 0;
+    start = now();
+    d = dirscan_run(wroot, L"ovpn", DEPTH, threads, cached);
+    start = now() - start;
+
+    if (!d)
+    {
+        fprintf(stderr, "FAIL: out of memory\n");
+        exit(2);
+    }
+    count_tree(d, &configs, &dirs);
+    CHECK(configs == made_configs && dirs == made_dirs);
+    if (expected && !same_tree(d, expected))
+    {
+        fprintf(stderr, "FAIL: %s differs from the first scan\n", what);
+        failures++;
+    }
+    printf("%-26s %8.1f ms, %5lu opens, %5lu fetches\n",
+           what,
+           1e3 * start,
+           (unsigned long)opens,
+           (unsigned long)fetches);
+    return d;
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long entries = (unsigned long)((argc > 1 ? atof(argv[1]) : 50) * 1000);
+    double latency = argc > 2 ? atof(argv[2]) : 2;
+    const char *tmp = getenv("TMPDIR");
+    unsigned long configs = 0, dirs = 0;
+    dirscan_dir_t *serial, *parallel, *rescan;
+    int files;
+    double start;
+
+    snprintf(root,
+             sizeof(root),
+             "%s/test_dirscan.%d",
+             argc > 3 ? argv[3] : tmp ? tmp : "/tmp",
+             (int)getpid());
+    swprintf(wroot, 4096, L"%s", root);
+
+    /* 1010 directories, the entries spread evenly among them */
+    files = entries > 2 * 1010 ? (int)((entries - 1010) / 1011) : 1;
+    make_tree(root, 0, files);
+    age_tree(root);
+    printf("%lu directories, %lu files of which %lu configs, %.1f ms latency\n",
+           made_dirs - 1,
+           made_files,
+           made_configs,
+           latency);
+
+    latency_ns = (long)(latency * 1e6);
+    opens = fetches = 0;
+    start = now();
+    walk_twice(root, DEPTH, &configs, &dirs);
+    start = now() - start;
+    CHECK(configs == made_configs && dirs == made_dirs);
+    printf("%-26s %8.1f ms, %5lu opens, %5lu fetches\n",
+           "listing twice, serially",
+           1e3 * start,
+           (unsigned long)opens,
+           (unsigned long)fetches);
+
+    serial = scan("dirscan_run, 1 thread", 1, NULL, NULL);
+    parallel = scan("dirscan_run, 8 threads", SCAN_THREADS, NULL, serial);
+    rescan = scan("dirscan_run, cached", SCAN_THREADS, parallel, serial);
+    CHECK(opens == 0 && fetches == 0);
+    latency_ns = 0;
+
+    dirscan_free(serial);
+    dirscan_free(parallel);
+    dirscan_free(rescan);
+    remove_tree(root);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
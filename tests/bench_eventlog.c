@@ -0,0 +1,252 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the JSON event formatter.
+ *
+ *   bench_eventlog [number of events in millions]
+ *
+ * Random events, some larger than the buffer, are formatted and the
+ * output is compared with a reference encoder. Every write must end at
+ * an event boundary unless it is flagged partial. Then typical log
+ * events are formatted to a sink that discards them (default 5 million)
+ * to measure throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "eventlog.h"
+
+static int failures;
+
+struct sink
+{
+    char *data;
+    size_t len;
+    size_t size;
+    int partial; /* the last write ended inside an event */
+};
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+}
+
+static void
+append(struct sink *s, const char *data, size_t len)
+{
+    if (s->len + len > s->size)
+    {
+        s->size = 2 * (s->len + len);
+        s->data = realloc(s->data, s->size);
+        if (!s->data)
+        {
+            exit(2);
+        }
+    }
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+}
+
+/* The write function: checks that writes end at event boundaries */
+static void
+collect(void *arg, const char *data, size_t len, int partial)
+{
+    struct sink *s = arg;
+
+    if (len == 0)
+    {
+        fail("empty write");
+    }
+    else if (!partial && data[len - 1] != '\n')
+    {
+        fail("write ends inside an event without being flagged partial");
+    }
+    else if (partial && memchr(data, '\n', len))
+    {
+        fail("partial write has more than one event");
+    }
+    s->partial = partial;
+    append(s, data, len);
+}
+
+static void
+discard(void *arg, const char *data, size_t len, int partial)
+{
+    (void)data;
+    (void)partial;
+    *(size_t *)arg += len;
+}
+
+/* Append value to the reference output, escaped */
+static void
+ref_str(struct sink *r, const char *key, const char *value, size_t len)
+{
+    char buf[16];
+
+    append(r, ",\"", 2);
+    append(r, key, strlen(key));
+    append(r, "\":\"", 3);
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char ch = (unsigned char)value[i];
+
+        if (ch == '"' || ch == '\\')
+        {
+            snprintf(buf, sizeof(buf), "\\%c", ch);
+        }
+        else if (ch == '\n' || ch == '\r' || ch == '\t')
+        {
+            snprintf(buf, sizeof(buf), "\\%c", ch == '\n' ? 'n' : ch == '\r' ? 'r' : 't');
+        }
+        else if (ch < 0x20)
+        {
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+        }
+        else
+        {
+            buf[0] = (char)ch;
+            buf[1] = '\0';
+        }
+        append(r, buf, strlen(buf));
+    }
+    append(r, "\"", 1);
+}
+
+static void
+test_format(void)
+{
+    static const char chars[] = "abc XYZ 019\"\\\n\r\t\x01\x1f\xc3\xa9{}:,";
+    struct sink out = { 0 }, ref = { 0 };
+    eventlog_t e;
+    char *text = malloc(3 * EVENTLOG_BUF_SIZE);
+    char buf[64];
+
+    eventlog_init(&e, collect, &out);
+    for (int i = 0; i < 20000; i++)
+    {
+        /* mostly short lines, some longer than the buffer */
+        size_t len = rnd() % 50 == 0 ? rnd() % (3 * EVENTLOG_BUF_SIZE) : rnd() % 300;
+        unsigned long long t = 1700000000ULL + (unsigned long long)i;
+
+        for (size_t j = 0; j < len; j++)
+        {
+            text[j] = chars[rnd() % (sizeof(chars) - 1)];
+        }
+
+        eventlog_begin(&e, t, "log");
+        eventlog_str(&e, "text", text, len);
+        eventlog_num(&e, "n", (unsigned long long)i);
+        eventlog_end(&e);
+
+        snprintf(buf, sizeof(buf), "{\"time\":%llu", t);
+        append(&ref, buf, strlen(buf));
+        ref_str(&ref, "type", "log", 3);
+        ref_str(&ref, "text", text, len);
+        snprintf(buf, sizeof(buf), ",\"n\":%d}\n", i);
+        append(&ref, buf, strlen(buf));
+
+        if (i % 1000 == 0)
+        {
+            eventlog_flush(&e);
+        }
+    }
+    eventlog_flush(&e);
+
+    if (out.partial)
+    {
+        fail("last write flagged partial");
+    }
+    if (out.len != ref.len || memcmp(out.data, ref.data, out.len) != 0)
+    {
+        fail("output differs from the reference encoder");
+    }
+    printf("formatted 20000 events (%.1f MB), output matches the reference\n",
+           out.len / 1048576.0);
+
+    free(out.data);
+    free(ref.data);
+    free(text);
+}
+
+static void
+bench(unsigned long events)
+{
+    const char *line = "TLS: Initial packet from [AF_INET]198.51.100.7:1194, "
+                       "sid=8a6c1b2f 3e4d5c6b, cipher \"AES-256-GCM\"";
+    size_t total = 0;
+    eventlog_t e;
+    double t;
+
+    eventlog_init(&e, discard, &total);
+    t = now();
+    for (unsigned long i = 0; i < events; i++)
+    {
+        eventlog_begin(&e, 1700000000ULL + i, "log");
+        eventlog_wstr(&e, "config", L"office-vpn");
+        eventlog_str(&e, "source", "openvpn", 7);
+        eventlog_str(&e, "level", "info", 4);
+        eventlog_str(&e, "flags", "I", 1);
+        eventlog_str(&e, "text", line, strlen(line));
+        eventlog_end(&e);
+    }
+    eventlog_flush(&e);
+    t = now() - t;
+
+    printf("%lu events of %zu bytes in %.3f s: %.0f ns/event, %.1fM events/s, %.0f MB/s\n",
+           events,
+           total / events,
+           t,
+           t * 1e9 / events,
+           events / t / 1e6,
+           total / t / 1048576.0);
+}
+
+int
+main(int argc, char **argv)
+{
+    double millions = argc > 1 ? atof(argv[1]) : 5;
+
+    test_format();
+    bench((unsigned long)(millions * 1e6));
+
+    return failures != 0;
+}
@@ -0,0 +1,175 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the log timestamp formatter.
+ *
+ *   bench_logdate [number of lines in millions]
+ *
+ * In a few time zones, including ones with DST changes and a half hour
+ * offset, timestamps advancing one second every 50 lines with random
+ * jumps back and forth are formatted with logbuf_format_date() and
+ * compared with ctime(). The same lines (default 2 million) are then
+ * timed both ways: with ctime() converted to a wide string, as the log
+ * window rows used to be formatted with _wctime(), and with the date
+ * cache of a log buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include "logbuf.h"
+
+#define LINES_PER_SECOND 50
+
+static int failures;
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The timestamp of the i'th line: mostly steady, sometimes a jump */
+static time_t
+line_time(time_t start, unsigned long i)
+{
+    time_t t = start + (time_t)(i / LINES_PER_SECOND);
+
+    /* a late line from another connection, or a clock step */
+    if (rnd() % 1000 == 0)
+    {
+        t += (time_t)(rnd() % 7200) - 3600;
+    }
+    return t;
+}
+
+/* Compare with ctime() in the time zone tz */
+static void
+test_zone(const char *tz, time_t start, unsigned long lines)
+{
+    log_date_t date = { 0 };
+    wchar_t buf[LOG_DATE_LEN + 1];
+    wchar_t expected[LOG_DATE_LEN + 1];
+    unsigned long mismatches = 0;
+
+    setenv("TZ", tz, 1);
+    tzset();
+    for (unsigned long i = 0; i < lines; i++)
+    {
+        time_t t = line_time(start, i);
+
+        logbuf_format_date(&date, t, buf);
+        mbstowcs(expected, ctime(&t), LOG_DATE_LEN);
+        expected[LOG_DATE_LEN] = L'\0';
+        if (wcscmp(buf, expected) != 0)
+        {
+            if (mismatches++ == 0)
+            {
+                fprintf(stderr, "%s: %ls, expected %ls\n", tz, buf, expected);
+            }
+        }
+    }
+    if (mismatches)
+    {
+        fprintf(stderr,
+                "FAIL: %lu of %lu dates differ from ctime() in %s\n",
+                mismatches,
+                lines,
+                tz);
+        failures++;
+    }
+}
+
+static void
+bench(unsigned long lines)
+{
+    log_date_t date = { 0 };
+    wchar_t buf[LOG_DATE_LEN + 2];
+    time_t start = 1711846800; /* 2024-03-31 01:00 UTC, DST starts in Europe */
+    unsigned long sum = 0;
+    double t0, t1, t2;
+
+    setenv("TZ", "Europe/Berlin", 1);
+    tzset();
+
+    seed = 1;
+    t0 = now();
+    for (unsigned long i = 0; i < lines; i++)
+    {
+        time_t t = line_time(start, i);
+
+        mbstowcs(buf, ctime(&t), LOG_DATE_LEN + 1);
+        sum += buf[18];
+    }
+    t1 = now();
+
+    seed = 1;
+    for (unsigned long i = 0; i < lines; i++)
+    {
+        logbuf_format_date(&date, line_time(start, i), buf);
+        sum -= buf[18];
+    }
+    t2 = now();
+
+    if (sum != 0)
+    {
+        fprintf(stderr, "FAIL: the dates timed differ\n");
+        failures++;
+    }
+    printf("%lu lines, %d a second: ctime() %.1f ns/line, date cache %.1f ns/line\n",
+           lines,
+           LINES_PER_SECOND,
+           1e9 * (t1 - t0) / lines,
+           1e9 * (t2 - t1) / lines);
+}
+
+int
+main(int argc, char **argv)
+{
+    double millions = argc > 1 ? atof(argv[1]) : 2;
+    unsigned long lines = (unsigned long)(millions * 1e6);
+
+    /* around the DST changes of 2024, and a zone without DST */
+    test_zone("Europe/Berlin", 1711846800 - 1800, lines / 4);
+    test_zone("Europe/Berlin", 1729990800 - 1800, lines / 4);
+    test_zone("America/New_York", 1710054000 - 1800, lines / 4);
+    test_zone("Asia/Kolkata", 1700000000, lines / 4);
+    bench(lines);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
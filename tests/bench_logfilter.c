@@ -0,0 +1,186 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the severity filter of the status log window.
+ *
+ *   bench_logfilter [lines in thousands] [milliseconds allowed a switch]
+ *
+ * A log buffer is filled with lines (default 500 thousand) with a mix
+ * of flags as openvpn logs them, and wraps around once. Switching
+ * between the filters of the log window must take no longer than the
+ * time allowed (default 10 ms) at best of 5 runs, and each filter must
+ * pass the same lines as a check of every line. Then lines are added
+ * and dropped, and the updated index is checked the same way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logfilter.h"
+
+#define RUNS 5
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+/* as log_filters in openvpn.c */
+static const struct
+{
+    const char *name;
+    unsigned int show;
+    unsigned int hide;
+} filters[] = {
+    { "all", 0, 0 },
+    { "no debug", 0, LOG_LINE_DEBUG },
+    { "warnings", LOG_LINE_WARNING | LOG_LINE_ERROR, 0 },
+    { "errors", LOG_LINE_ERROR, 0 },
+};
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Add n lines: mostly info, some debug, few warnings and errors */
+static void
+add_lines(logbuf_t *lb, size_t n)
+{
+    static const char text[] = "MANAGEMENT: >STATE:1700000000,CONNECTED,SUCCESS,10.8.0.6";
+
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned int r = rnd() % 1000, flags;
+
+        flags = r < 700 ? LOG_LINE_INFO : r < 960 ? LOG_LINE_DEBUG : r < 990 ? LOG_LINE_WARNING
+                                                                             : LOG_LINE_ERROR;
+        if (!logbuf_append(lb, 1700000000 + (time_t)(i / 100), flags, text, sizeof(text) - 1))
+        {
+            exit(2);
+        }
+    }
+}
+
+/* Check the index against a check of every line held */
+static void
+check_filter(const logfilter_t *f, const logbuf_t *lb)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < lb->count; i++)
+    {
+        const log_line_t *line = logbuf_get(lb, i);
+
+        if ((f->show == 0 || (line->flags & f->show)) && !(line->flags & f->hide))
+        {
+            if (logfilter_get(f, lb, n) != line)
+            {
+                fprintf(stderr, "FAIL: row %zu is not line %zu\n", n, i);
+                failures++;
+                return;
+            }
+            n++;
+        }
+    }
+    CHECK(f->count == n && logfilter_get(f, lb, n) == NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t lines = (size_t)((argc > 1 ? atof(argv[1]) : 500) * 1000);
+    double limit = argc > 2 ? atof(argv[2]) : 10;
+    logfilter_t f = { 0 };
+    logbuf_t lb;
+    double worst = 0;
+
+    logbuf_init(&lb, lines);
+    add_lines(&lb, lines + lines / 3);
+
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++)
+    {
+        double best = 1e9;
+
+        for (int r = 0; r < RUNS; r++)
+        {
+            double start;
+
+            /* switch from another filter, as from the combo box */
+            logfilter_set(&f, &lb, filters[(i + 1) % 4].show, filters[(i + 1) % 4].hide);
+            start = now();
+            CHECK(logfilter_set(&f, &lb, filters[i].show, filters[i].hide));
+            start = now() - start;
+            best = start < best ? start : best;
+        }
+        check_filter(&f, &lb);
+        printf("%-9s %7zu of %zu lines: %.2f ms\n", filters[i].name, f.count, lb.count, 1e3 * best);
+        worst = best > worst ? best : worst;
+    }
+    if (1e3 * worst > limit)
+    {
+        fprintf(stderr, "FAIL: a filter switch took %.2f ms, over %.0f ms\n", 1e3 * worst, limit);
+        failures++;
+    }
+
+    /* lines added and dropped while a filter is set */
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++)
+    {
+        size_t removed = 0;
+
+        logfilter_set(&f, &lb, filters[i].show, filters[i].hide);
+        for (int r = 0; r < 10; r++)
+        {
+            add_lines(&lb, rnd() % (lines / 10 + 1));
+            CHECK(logfilter_update(&f, &lb, &removed));
+        }
+        check_filter(&f, &lb);
+    }
+
+    logfilter_free(&f);
+    logbuf_free(&lb);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
@@ -0,0 +1,332 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the merged timeline of connection logs.
+ *
+ *   bench_logmerge [connections] [lines per connection in thousands]
+ *
+ * The log buffers of a number of connections (default 64) are filled
+ * with lines (default 20 thousand each), and merged in full to measure
+ * the throughput of the merge. Then the timeline is refreshed as
+ * TimelineMerge() does while lines keep coming in: rows of dropped lines
+ * are removed, the new lines are merged and inserted among the rows.
+ * Some connections get history older than the rows shown, and some
+ * lines are logged out of order within a buffer. After each refresh
+ * the rows must be in order and hold every line in the buffers once,
+ * and the row at the top of the view must stay in view.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logmerge.h"
+
+#define REFRESHES 200
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+append(logbuf_t *lb, time_t timestamp)
+{
+    static const char text[] = "TLS: Initial packet from [AF_INET]198.51.100.7:1194";
+
+    if (!logbuf_append(lb, timestamp, 0, text, sizeof(text) - 1))
+    {
+        exit(2);
+    }
+}
+
+/* Merge all lines of the buffers once, and time it */
+static void
+bench_merge(logbuf_t *bufs, logmerge_source_t *sources, int nconn, int lines)
+{
+    logmerge_t merge;
+    const log_line_t *line;
+    unsigned long long seq;
+    unsigned long count = 0;
+    time_t last = 0;
+    size_t i;
+    double start;
+
+    for (int c = 0; c < nconn; c++)
+    {
+        time_t t = 1700000000;
+
+        logbuf_init(&bufs[c], (size_t)lines);
+        for (int l = 0; l < lines; l++)
+        {
+            t += rnd() % 3 == 0;
+            append(&bufs[c], t);
+        }
+        sources[c].lb = &bufs[c];
+        sources[c].next = 0;
+        sources[c].end = ULLONG_MAX;
+    }
+
+    start = now();
+    if (!logmerge_init(&merge, sources, (size_t)nconn))
+    {
+        exit(2);
+    }
+    while ((line = logmerge_next(&merge, &i, &seq)) != NULL)
+    {
+        CHECK(line->timestamp >= last);
+        last = line->timestamp;
+        count++;
+    }
+    logmerge_free(&merge);
+    start = now() - start;
+
+    CHECK(count == (unsigned long)nconn * (unsigned long)lines);
+    printf("merge of %d connections: %lu lines, %.1f M lines/s\n",
+           nconn,
+           count,
+           count / start / 1e6);
+
+    for (int c = 0; c < nconn; c++)
+    {
+        logbuf_free(&bufs[c]);
+    }
+}
+
+/* Check that the rows are in order and hold each line of the buffers once */
+static void
+check_rows(const logmerge_row_t *rows, size_t count, const logbuf_t *bufs, int nconn)
+{
+    size_t held = 0;
+    unsigned char *seen;
+    size_t *offset = malloc((size_t)nconn * sizeof(*offset));
+
+    for (int c = 0; c < nconn; c++)
+    {
+        offset[c] = held;
+        held += bufs[c].count;
+    }
+    CHECK(count == held);
+    seen = calloc(held ? held : 1, 1);
+
+    for (size_t r = 0; r < count; r++)
+    {
+        const logbuf_t *lb = rows[r].owner;
+        int c = (int)(lb - bufs);
+
+        if (r > 0 && logmerge_row_before(&rows[r], &rows[r - 1]))
+        {
+            failures++;
+            fprintf(stderr, "FAIL: row %zu out of order\n", r);
+            break;
+        }
+        if (rows[r].seq < lb->dropped || rows[r].seq >= lb->dropped + lb->count
+            || rows[r].timestamp != logbuf_get(lb, rows[r].seq - lb->dropped)->timestamp
+            || seen[offset[c] + rows[r].seq - lb->dropped]++)
+        {
+            failures++;
+            fprintf(stderr, "FAIL: row %zu is not a line held once\n", r);
+            break;
+        }
+    }
+    free(seen);
+    free(offset);
+}
+
+/* Refresh the timeline while lines come in, and time the refreshes */
+static void
+bench_refresh(logbuf_t *bufs, logmerge_source_t *sources, int nconn, int lines)
+{
+    logmerge_row_t *rows = NULL;
+    size_t count = 0, alloc = 0;
+    time_t clock = 1700000000;
+    unsigned long merged = 0, late = 0;
+    double elapsed = 0;
+
+    for (int c = 0; c < nconn; c++)
+    {
+        logbuf_init(&bufs[c], (size_t)lines);
+        sources[c].lb = &bufs[c];
+        sources[c].next = 0;
+        sources[c].end = ULLONG_MAX;
+    }
+
+    for (int r = 0; r < REFRESHES; r++)
+    {
+        size_t top = count ? rnd() % count : 0;
+        logmerge_row_t top_row = count ? rows[top] : (logmerge_row_t){ 0 };
+        size_t kept = 0, dropped_above = 0, first;
+        int top_dropped = 0;
+        logmerge_t merge;
+        const log_line_t *line;
+        unsigned long long seq;
+        size_t i;
+        double start;
+
+        /* new lines: a few seconds of logging, some history, some out of order */
+        for (int c = 0; c < nconn; c++)
+        {
+            int n = (int)(rnd() % (unsigned int)(2 * lines / REFRESHES + 1));
+
+            if (rnd() % 20 == 0)
+            {
+                time_t t = clock - 600 - (time_t)(rnd() % 3600);
+
+                for (int l = 0; l < n; l++)
+                {
+                    append(&bufs[c], t + l / 10);
+                    late++;
+                }
+            }
+            for (int l = 0; l < n; l++)
+            {
+                append(&bufs[c], clock + (time_t)(rnd() % 5) - (rnd() % 50 == 0 ? 30 : 0));
+            }
+        }
+        clock += 5;
+
+        start = now();
+        for (size_t k = 0; k < count; k++)
+        {
+            const logbuf_t *lb = rows[k].owner;
+
+            if (rows[k].seq >= lb->dropped)
+            {
+                rows[kept++] = rows[k];
+            }
+            else if (k < top)
+            {
+                dropped_above++;
+            }
+            else if (k == top)
+            {
+                top_dropped = 1;
+            }
+        }
+        count = kept;
+        top -= dropped_above;
+
+        /* the sources keep their position, as in TimelineSetSources() */
+        for (int c = 0; c < nconn; c++)
+        {
+            sources[c].end = ULLONG_MAX;
+        }
+        first = count;
+        if (!logmerge_init(&merge, sources, (size_t)nconn))
+        {
+            exit(2);
+        }
+        while ((line = logmerge_next(&merge, &i, &seq)) != NULL)
+        {
+            if (count == alloc)
+            {
+                alloc = alloc ? 2 * alloc : 1024;
+                rows = realloc(rows, alloc * sizeof(*rows));
+                if (!rows)
+                {
+                    exit(2);
+                }
+            }
+            rows[count].timestamp = line->timestamp;
+            rows[count].source = i;
+            rows[count].seq = seq;
+            rows[count].owner = &bufs[i];
+            count++;
+        }
+        logmerge_free(&merge);
+        merged += count - first;
+        top += logmerge_insert(rows, first, count, top);
+        elapsed += now() - start;
+
+        check_rows(rows, count, bufs, nconn);
+        if (first > 0 && !top_dropped)
+        {
+            CHECK(top < count && !memcmp(&rows[top], &top_row, sizeof(top_row)));
+        }
+    }
+
+    printf("%d refreshes of %d connections: %lu lines merged, %lu of them late, "
+           "%zu rows, %.2f ms/refresh, %.1f M lines/s\n",
+           REFRESHES,
+           nconn,
+           merged,
+           late,
+           count,
+           1e3 * elapsed / REFRESHES,
+           merged / elapsed / 1e6);
+
+    for (int c = 0; c < nconn; c++)
+    {
+        logbuf_free(&bufs[c]);
+    }
+    free(rows);
+}
+
+int
+main(int argc, char **argv)
+{
+    int nconn = argc > 1 ? atoi(argv[1]) : 64;
+    int lines = (int)((argc > 2 ? atof(argv[2]) : 20) * 1000);
+    logbuf_t *bufs = calloc((size_t)nconn, sizeof(*bufs));
+    logmerge_source_t *sources = calloc((size_t)nconn, sizeof(*sources));
+
+    if (nconn < 1 || lines < REFRESHES || !bufs || !sources)
+    {
+        fprintf(stderr, "usage: bench_logmerge [connections] [thousand lines]\n");
+        return 2;
+    }
+    bench_merge(bufs, sources, nconn, lines);
+    bench_refresh(bufs, sources, nconn, lines);
+
+    free(bufs);
+    free(sources);
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
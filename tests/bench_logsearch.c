@@ -0,0 +1,204 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Benchmark of logsearch_find() over a synthetic openvpn log.
+ *
+ *   bench_logsearch [size in MB] [directory]
+ *
+ * Writes a log of the given size (default 1024 MB) with a known number
+ * of "TLS handshake failed" lines, then times a first search, which
+ * builds the index, repeated searches using it, a search after appending
+ * to the log and a search too short to use the index. The number of
+ * matches is checked against the lines written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "logsearch.h"
+
+#define NEEDLE_INTERVAL 100000 /* lines between needles */
+
+static const char *messages[] = {
+    "TLS: Initial packet from [AF_INET]%u.%u.%u.%u:1194, sid=%08x %08x",
+    "VERIFY OK: depth=%u, CN=server-%u.example.net, serial=%08x%08x",
+    "Control Channel: TLSv1.3, cipher TLSv1.3 TLS_AES_256_GCM_SHA384, peer %u.%u.%u.%u",
+    "PUSH: Received control message: 'PUSH_REPLY,route %u.%u.%u.%u,ping %u,peer-id %u'",
+    "Data Channel: cipher 'AES-256-GCM', peer-id: %u, compression: %u (%08x%08x)",
+    "MANAGEMENT: >STATE:%u,CONNECTED,SUCCESS,%u.%u.%u.%u,,",
+    "Outgoing Data Channel: Cipher 'AES-256-GCM' initialized with %u bit key %08x%08x",
+    "read UDPv4 [ECONNREFUSED]: Connection refused (fd=%u,code=%u) %08x%08x",
+};
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Append about size bytes of log lines to f, returning the needles written */
+static long
+write_log(FILE *f, unsigned long long size, unsigned long long *lines)
+{
+    unsigned long long written = 0;
+    long needles = 0;
+    char line[256];
+
+    while (written < size)
+    {
+        time_t t = 1700000000 + (time_t)(*lines / 10);
+        int n = (int)strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S ", gmtime(&t));
+
+        if (++*lines % NEEDLE_INTERVAL == 0)
+        {
+            n += snprintf(line + n,
+                          sizeof(line) - n,
+                          "TLS Error: TLS handshake failed with peer %u.%u.%u.%u\n",
+                          rnd() % 256,
+                          rnd() % 256,
+                          rnd() % 256,
+                          rnd() % 256);
+            needles++;
+        }
+        else
+        {
+            n += snprintf(line + n,
+                          sizeof(line) - n,
+                          messages[rnd() % (sizeof(messages) / sizeof(*messages))],
+                          rnd() % 256,
+                          rnd() % 256,
+                          rnd() % 256,
+                          rnd() % 256,
+                          rnd(),
+                          rnd());
+            line[n++] = '\n';
+        }
+        fwrite(line, 1, n, f);
+        written += n;
+    }
+    return needles;
+}
+
+static int
+count_line(void *arg, const char *line, size_t len, unsigned long long offset)
+{
+    (void)arg;
+    (void)line;
+    (void)len;
+    (void)offset;
+    return 1;
+}
+
+static int
+search(const wchar_t *log, const wchar_t *idx, const char *query, long expect, const char *what)
+{
+    logsearch_stats_t st;
+    double t = now();
+    long n = logsearch_find(log, idx, query, count_line, NULL, &st);
+
+    t = now() - t;
+    printf("%-28s %-22s %8ld matches %10.1f ms %8lu blocks %10.1f MB read\n",
+           what,
+           query,
+           n,
+           t * 1000,
+           st.blocks_read,
+           st.bytes_read / 1048576.0);
+    if (expect >= 0 && n != expect)
+    {
+        fprintf(stderr, "FAIL: expected %ld matches\n", expect);
+        return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long long size = (argc > 1 ? strtoull(argv[1], NULL, 10) : 1024) << 20;
+    const char *dir = argc > 2 ? argv[2] : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    char path[4096], index[4096 + 8];
+    wchar_t wpath[4096], windex[4096];
+    unsigned long long lines = 0;
+    long needles;
+    double t;
+    int fail = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/bench_logsearch.%d.log", dir, (int)getpid());
+    snprintf(index, sizeof(index), "%s.idx", path);
+    mbstowcs(wpath, path, 4096);
+    mbstowcs(windex, index, 4096);
+
+    f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    t = now();
+    needles = write_log(f, size, &lines);
+    fclose(f);
+    printf("wrote %llu MB, %llu lines, %ld needles in %.1f s\n",
+           size >> 20,
+           lines,
+           needles,
+           now() - t);
+
+    fail |= search(wpath, windex, "TLS handshake failed", needles, "first search (indexing)");
+    fail |= search(wpath, windex, "TLS handshake failed", needles, "indexed");
+    fail |= search(wpath, windex, "tls HANDSHAKE failed", needles, "indexed, other case");
+    fail |= search(wpath, windex, "AUTH_FAILED", 0, "indexed, absent");
+    fail |= search(wpath, windex, "CN=server-4242.", -1, "indexed, common trigrams");
+
+    f = fopen(path, "ab");
+    if (!f)
+    {
+        perror(path);
+        fail = 1;
+    }
+    else
+    {
+        needles += write_log(f, 16 << 20, &lines);
+        fclose(f);
+        fail |= search(wpath, windex, "TLS handshake failed", needles, "after appending 16 MB");
+    }
+
+    /* shorter than a trigram: every block is read */
+    fail |= search(wpath, windex, "zq", 0, "unindexed (2 characters)");
+
+    remove(path);
+    remove(index);
+    return fail;
+}
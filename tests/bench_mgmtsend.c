@@ -0,0 +1,324 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Benchmark of sending bursts of management commands.
+ *
+ *   bench_mgmtsend [number of bursts] [commands per burst]
+ *
+ * A daemon thread answers every command on a socket pair as OpenVPN
+ * does, and the main thread plays the status thread: it queues bursts
+ * (default 2000) of needok and needstr replies (default 48 a burst) and
+ * handles the responses. Each burst is sent two ways: with a write per
+ * command as it is queued and per response received, as the GUI used
+ * to, and with the commands queued meanwhile gathered into one write
+ * of up to 8 commands in flight, as SendCommand() does now. The writes
+ * and reads per command are counted, as are the command nodes and
+ * strings allocated, and the responses are checked to reach their
+ * commands in order.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "mgmtproto.h"
+
+#define MAX_INFLIGHT 8 /* as MGMT_MAX_INFLIGHT in manage.c */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+struct connection
+{
+    int sk;
+    mgmt_cmdq_t cmds;
+    mgmt_buf_t rbuf;
+    mgmt_buf_t inbox;
+    unsigned long answered;   /* responses in the order of the commands */
+    unsigned long mismatched; /* responses to another command */
+    unsigned long reads;      /* recv() calls */
+};
+
+typedef struct connection connection_t;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The daemon: answer each command line with one write, as OpenVPN does */
+static void *
+daemon_thread(void *arg)
+{
+    int sk = *(int *)arg;
+    char buf[65536], line[512], reply[600];
+    size_t len = 0;
+    ssize_t n;
+
+    while ((n = read(sk, buf + len, sizeof(buf) - len)) > 0)
+    {
+        char *start = buf, *end;
+
+        len += (size_t)n;
+        while ((end = memchr(start, '\n', buf + len - start)) != NULL)
+        {
+            size_t l = (size_t)(end - start) < sizeof(line) - 1 ? (size_t)(end - start)
+                                                                  : sizeof(line) - 1;
+            int r;
+
+            memcpy(line, start, l);
+            line[l] = '\0';
+            if (strncmp(line, "needok ", 7) == 0)
+            {
+                r = snprintf(reply, sizeof(reply), "SUCCESS: %s confirmation entered\n", line + 7);
+            }
+            else
+            {
+                r = snprintf(reply, sizeof(reply), "SUCCESS: %s string entered\n", line + 8);
+            }
+            if (write(sk, reply, (size_t)r) != r)
+            {
+                return NULL;
+            }
+            start = end + 1;
+        }
+        len -= (size_t)(start - buf);
+        memmove(buf, start, len);
+    }
+    return NULL;
+}
+
+/* Check that a response names the command it answers */
+static void
+on_reply(connection_t *c, char *msg)
+{
+    char expected[64];
+    int n = (int)(c->answered + c->mismatched);
+
+    snprintf(expected, sizeof(expected), "'request-%d'", n);
+    if (msg && strstr(msg, expected))
+    {
+        c->answered++;
+    }
+    else
+    {
+        c->mismatched++;
+    }
+}
+
+/* Write the unsent commands in the window, as SendCommand() does */
+static void
+send_commands(connection_t *c)
+{
+    char *data[MAX_INFLIGHT];
+    size_t len[MAX_INFLIGHT];
+    struct iovec iov[MAX_INFLIGHT];
+    int count;
+
+    while ((count = mgmt_cmdq_unsent(&c->cmds, MAX_INFLIGHT, data, len)) > 0)
+    {
+        ssize_t n;
+
+        for (int i = 0; i < count; i++)
+        {
+            iov[i].iov_base = data[i];
+            iov[i].iov_len = len[i];
+        }
+        if ((n = writev(c->sk, iov, count)) <= 0)
+        {
+            exit(2);
+        }
+        mgmt_cmdq_sent(&c->cmds, (size_t)n);
+    }
+}
+
+/* Write the oldest unsent command in the window only */
+static void
+send_one(connection_t *c)
+{
+    char *data[MAX_INFLIGHT];
+    size_t len[MAX_INFLIGHT];
+    ssize_t n;
+
+    if (mgmt_cmdq_unsent(&c->cmds, MAX_INFLIGHT, data, len) > 0)
+    {
+        if ((n = write(c->sk, data[0], len[0])) <= 0)
+        {
+            exit(2);
+        }
+        mgmt_cmdq_sent(&c->cmds, (size_t)n);
+    }
+}
+
+/*
+ * Run a burst of count replies. If gather is set, the commands queued
+ * in a burst or answered in a read are sent together once it has been
+ * handled, else each is written as it is queued or as a response moves
+ * the window on.
+ */
+static void
+burst(connection_t *c, int count, int gather)
+{
+    static const mgmt_msg_func no_handlers[mgmt_rtmsg_type_max];
+    char cmd[128];
+
+    c->answered = c->mismatched = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 2)
+        {
+            snprintf(cmd, sizeof(cmd), "needstr 'request-%d' 'pkcs11:id=%%01%%02'", i);
+        }
+        else
+        {
+            snprintf(cmd, sizeof(cmd), "needok 'request-%d' ok", i);
+        }
+        if (!mgmt_cmdq_add(&c->cmds, cmd, on_reply, regular))
+        {
+            exit(2);
+        }
+        if (!gather)
+        {
+            send_one(c);
+        }
+    }
+    if (gather)
+    {
+        send_commands(c);
+    }
+
+    while (c->cmds.queue)
+    {
+        ssize_t n;
+
+        if (!mgmt_buf_reserve(&c->rbuf, 4096))
+        {
+            exit(2);
+        }
+        n = recv(c->sk, c->rbuf.data + c->rbuf.len, 4096, 0);
+        if (n <= 0)
+        {
+            exit(2);
+        }
+        c->reads++;
+        c->rbuf.len += (size_t)n;
+        if (!mgmt_split_lines(&c->rbuf, &c->inbox))
+        {
+            exit(2);
+        }
+        for (char *line = c->inbox.data; line < c->inbox.data + c->inbox.len;
+             line += strlen(line) + 1)
+        {
+            if ((mgmt_dispatch(&c->cmds, no_handlers, c, line) & MGMT_DISPATCH_ANSWERED) && !gather)
+            {
+                send_one(c);
+            }
+        }
+        c->inbox.len = 0;
+        if (gather)
+        {
+            send_commands(c);
+        }
+    }
+    CHECK(c->answered == (unsigned long)count && c->mismatched == 0);
+}
+
+static void
+bench(int bursts, int count, int gather)
+{
+    connection_t c;
+    pthread_t t;
+    int sv[2];
+    double start;
+    unsigned long commands;
+
+    memset(&c, 0, sizeof(c));
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+        perror("socketpair");
+        exit(2);
+    }
+    c.sk = sv[0];
+    pthread_create(&t, NULL, daemon_thread, &sv[1]);
+
+    start = now();
+    for (int i = 0; i < bursts; i++)
+    {
+        burst(&c, count, gather);
+    }
+    start = now() - start;
+
+    shutdown(sv[0], SHUT_WR);
+    pthread_join(t, NULL);
+    close(sv[0]);
+    close(sv[1]);
+
+    commands = c.cmds.stats.commands;
+    printf("%-22s %8lu commands: %.3f writes/command, %.3f reads/command, "
+           "%.2f us/command, %lu nodes and %lu strings allocated\n",
+           gather ? "gathered writes:" : "write per command:",
+           commands,
+           (double)c.cmds.stats.sends / commands,
+           (double)c.reads / commands,
+           1e6 * start / commands,
+           c.cmds.stats.node_allocs,
+           c.cmds.stats.str_allocs);
+
+    mgmt_cmdq_clear(&c.cmds);
+    mgmt_buf_free(&c.rbuf);
+    mgmt_buf_free(&c.inbox);
+}
+
+int
+main(int argc, char **argv)
+{
+    int bursts = argc > 1 ? atoi(argv[1]) : 2000;
+    int count = argc > 2 ? atoi(argv[2]) : 48;
+
+    printf("%d bursts of %d needok/needstr replies, up to %d in flight\n",
+           bursts,
+           count,
+           MAX_INFLIGHT);
+    bench(bursts, count, 0);
+    bench(bursts, count, 1);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
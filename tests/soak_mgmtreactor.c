@@ -0,0 +1,493 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Soak test of the locking of the management reactors.
+ *
+ *   soak_mgmtreactor [number of connections] [lines per connection]
+ *
+ * Simulated daemons (default 256), one thread each, write >LOG: lines
+ * (default 4000 each) to socket pairs. Reactor threads serve up to 63
+ * sockets each with poll(), as the reactors in manage.c do with
+ * WaitForMultipleObjects(): they receive into a per-connection inbox of
+ * up to 1 MiB and split it with mgmt_split_lines(). A status thread per
+ * connection is notified of new lines and swaps the inbox for its empty
+ * buffer, as TakeLines() does. This runs twice, in a child process each
+ * time: with one lock held while a reactor drains its sockets, as the
+ * reactors used to, and with the reactor lock only held to look up a
+ * slot and a lock per connection held while its socket is drained. The
+ * lines must all arrive in order. The time the status threads wait for
+ * the lock, the CPU time and the peak RSS are reported.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "mgmtproto.h"
+
+#define REACTOR_MAX_SOCKETS 63            /* MAXIMUM_WAIT_OBJECTS - 1 */
+#define INBOX_MAX           (1024 * 1024) /* as MGMT_INBOX_MAX in manage.c */
+#define STACK_SIZE          (256 * 1024)
+
+typedef struct reactor reactor_t;
+
+typedef struct
+{
+    int id;
+    int sk;                  /* the socket of the GUI */
+    int daemon_sk;           /* the socket of the daemon */
+    reactor_t *reactor;      /* serving sk */
+    pthread_mutex_t rx_lock; /* held to use inbox and the rx_ fields */
+    mgmt_buf_t rbuf;         /* owned by the reactor */
+    mgmt_buf_t inbox;        /* lines received */
+    mgmt_buf_t lines;        /* owned by the status thread */
+    int rx_paused;           /* receiving suspended as the inbox is full */
+    int rx_notified;         /* status thread notified of lines in the inbox */
+    int eof;                 /* the daemon closed its socket */
+
+    pthread_mutex_t post_lock; /* the message queue of the status window */
+    pthread_cond_t posted_cond;
+    int posted;
+
+    unsigned long received; /* lines handled */
+    int out_of_order;       /* lines not in the order written */
+    double wait;            /* total time waited for the lock to take lines */
+    double max_wait;        /* longest wait */
+    unsigned long takes;    /* number of times lines were taken */
+} conn_t;
+
+struct reactor
+{
+    int wake[2]; /* written to when a paused socket may resume */
+    conn_t *conn[REACTOR_MAX_SOCKETS];
+    int count;
+};
+
+static int per_connection_locks;
+static pthread_mutex_t reactor_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long lines_per_conn;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+cpu_time(const struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 + ru->ru_stime.tv_sec
+           + ru->ru_stime.tv_usec / 1e6;
+}
+
+static pthread_t
+start_thread(void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, STACK_SIZE);
+    if (pthread_create(&t, &attr, fn, arg) != 0)
+    {
+        perror("pthread_create");
+        exit(2);
+    }
+    pthread_attr_destroy(&attr);
+    return t;
+}
+
+/* A daemon writing its log in bursts of lines */
+static void *
+daemon_thread(void *arg)
+{
+    conn_t *c = arg;
+    char buf[16 * 128];
+    size_t len = 0;
+
+    for (unsigned long i = 0; i < lines_per_conn; i++)
+    {
+        len += (size_t)snprintf(buf + len,
+                                sizeof(buf) - len,
+                                ">LOG:%lu,I,daemon %d: data channel line %lu\r\n",
+                                1700000000 + i,
+                                c->id,
+                                i);
+        if (i % 16 == 15 || i + 1 == lines_per_conn)
+        {
+            if (write(c->daemon_sk, buf, len) != (ssize_t)len)
+            {
+                perror("write");
+                exit(2);
+            }
+            len = 0;
+        }
+    }
+    close(c->daemon_sk);
+    return NULL;
+}
+
+static void
+post(conn_t *c)
+{
+    pthread_mutex_lock(&c->post_lock);
+    c->posted = 1;
+    pthread_cond_signal(&c->posted_cond);
+    pthread_mutex_unlock(&c->post_lock);
+}
+
+/* As ReceiveLines(): returns 1 if lines were added */
+static int
+receive_lines(conn_t *c)
+{
+    size_t len = c->inbox.len;
+    ssize_t n;
+
+    while (c->inbox.len < INBOX_MAX)
+    {
+        if (!mgmt_buf_reserve(&c->rbuf, 4096))
+        {
+            exit(2);
+        }
+        n = recv(c->sk, c->rbuf.data + c->rbuf.len, c->rbuf.size - c->rbuf.len, MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+        {
+            c->eof = 1;
+            break;
+        }
+        if (n < 0)
+        {
+            break;
+        }
+        c->rbuf.len += (size_t)n;
+        if (!mgmt_split_lines(&c->rbuf, &c->inbox))
+        {
+            exit(2);
+        }
+    }
+    c->rx_paused = c->inbox.len >= INBOX_MAX;
+    return c->inbox.len > len || c->eof;
+}
+
+static void
+handle_socket(conn_t *c)
+{
+    if (receive_lines(c) && !c->rx_notified)
+    {
+        c->rx_notified = 1;
+        post(c);
+    }
+}
+
+static void *
+reactor_thread(void *arg)
+{
+    reactor_t *r = arg;
+    struct pollfd pfd[REACTOR_MAX_SOCKETS + 1];
+    int slot[REACTOR_MAX_SOCKETS + 1];
+
+    while (1)
+    {
+        int n = 1, open = 0;
+        char drain[64];
+
+        pfd[0].fd = r->wake[0];
+        pfd[0].events = POLLIN;
+        pthread_mutex_lock(&reactor_lock);
+        for (int i = 0; i < r->count; i++)
+        {
+            conn_t *c = r->conn[i];
+
+            pthread_mutex_lock(&c->rx_lock);
+            open += !c->eof;
+            if (!c->eof && !c->rx_paused)
+            {
+                pfd[n].fd = c->sk;
+                pfd[n].events = POLLIN;
+                slot[n++] = i;
+            }
+            pthread_mutex_unlock(&c->rx_lock);
+        }
+        pthread_mutex_unlock(&reactor_lock);
+        if (open == 0)
+        {
+            break;
+        }
+
+        if (poll(pfd, (nfds_t)n, 100) <= 0)
+        {
+            continue;
+        }
+        if (pfd[0].revents & POLLIN)
+        {
+            if (read(r->wake[0], drain, sizeof(drain)) < 0)
+            {
+                exit(2);
+            }
+        }
+
+        if (!per_connection_locks)
+        {
+            /* one lock held while all signalled sockets are drained */
+            pthread_mutex_lock(&reactor_lock);
+            for (int i = 1; i < n; i++)
+            {
+                if (pfd[i].revents)
+                {
+                    pthread_mutex_lock(&r->conn[slot[i]]->rx_lock);
+                    handle_socket(r->conn[slot[i]]);
+                    pthread_mutex_unlock(&r->conn[slot[i]]->rx_lock);
+                }
+            }
+            pthread_mutex_unlock(&reactor_lock);
+            continue;
+        }
+
+        for (int i = 1; i < n; i++)
+        {
+            conn_t *c;
+
+            if (!pfd[i].revents)
+            {
+                continue;
+            }
+            pthread_mutex_lock(&reactor_lock);
+            c = r->conn[slot[i]];
+            pthread_mutex_lock(&c->rx_lock);
+            pthread_mutex_unlock(&reactor_lock);
+
+            handle_socket(c);
+            pthread_mutex_unlock(&c->rx_lock);
+        }
+    }
+    return NULL;
+}
+
+/* As TakeLines(), timing the wait for the lock */
+static int
+take_lines(conn_t *c)
+{
+    mgmt_buf_t lines = c->lines;
+    double start = now(), wait;
+    int eof;
+
+    if (!per_connection_locks)
+    {
+        pthread_mutex_lock(&reactor_lock);
+    }
+    pthread_mutex_lock(&c->rx_lock);
+    wait = now() - start;
+
+    c->lines = c->inbox;
+    c->inbox = lines;
+    c->rx_notified = 0;
+    eof = c->eof;
+    if (c->rx_paused)
+    {
+        if (write(c->reactor->wake[1], "", 1) < 0)
+        {
+            exit(2);
+        }
+    }
+    pthread_mutex_unlock(&c->rx_lock);
+    if (!per_connection_locks)
+    {
+        pthread_mutex_unlock(&reactor_lock);
+    }
+
+    c->wait += wait;
+    c->max_wait = wait > c->max_wait ? wait : c->max_wait;
+    c->takes++;
+    return eof;
+}
+
+static void *
+status_thread(void *arg)
+{
+    conn_t *c = arg;
+    int eof = 0;
+
+    while (!eof)
+    {
+        pthread_mutex_lock(&c->post_lock);
+        while (!c->posted)
+        {
+            pthread_cond_wait(&c->posted_cond, &c->post_lock);
+        }
+        c->posted = 0;
+        pthread_mutex_unlock(&c->post_lock);
+
+        eof = take_lines(c);
+        for (char *line = c->lines.data; line < c->lines.data + c->lines.len;
+             line += strlen(line) + 1)
+        {
+            const char *n = strstr(line, "line ");
+
+            if (!n || strtoul(n + 5, NULL, 10) != c->received)
+            {
+                c->out_of_order++;
+            }
+            c->received++;
+        }
+        c->lines.len = 0;
+    }
+    return NULL;
+}
+
+/* Run the soak in this process and report, returning 0 on success */
+static int
+soak(int nconn)
+{
+    int nreactors = (nconn + REACTOR_MAX_SOCKETS - 1) / REACTOR_MAX_SOCKETS;
+    conn_t *conns = calloc((size_t)nconn, sizeof(*conns));
+    reactor_t *reactors = calloc((size_t)nreactors, sizeof(*reactors));
+    pthread_t *threads = calloc((size_t)(2 * nconn + nreactors), sizeof(*threads));
+    double start, elapsed, wait = 0, max_wait = 0;
+    unsigned long takes = 0, received = 0;
+    int bad = 0, nthreads = 0;
+    struct rusage ru;
+
+    if (!conns || !reactors || !threads)
+    {
+        return 2;
+    }
+    for (int i = 0; i < nreactors; i++)
+    {
+        if (pipe(reactors[i].wake) != 0)
+        {
+            return 2;
+        }
+    }
+    for (int i = 0; i < nconn; i++)
+    {
+        conn_t *c = &conns[i];
+        int sv[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+        {
+            perror("socketpair");
+            return 2;
+        }
+        c->id = i;
+        c->sk = sv[0];
+        c->daemon_sk = sv[1];
+        c->reactor = &reactors[i / REACTOR_MAX_SOCKETS];
+        c->reactor->conn[c->reactor->count++] = c;
+        pthread_mutex_init(&c->rx_lock, NULL);
+        pthread_mutex_init(&c->post_lock, NULL);
+        pthread_cond_init(&c->posted_cond, NULL);
+    }
+
+    start = now();
+    for (int i = 0; i < nconn; i++)
+    {
+        threads[nthreads++] = start_thread(status_thread, &conns[i]);
+    }
+    for (int i = 0; i < nreactors; i++)
+    {
+        threads[nthreads++] = start_thread(reactor_thread, &reactors[i]);
+    }
+    for (int i = 0; i < nconn; i++)
+    {
+        threads[nthreads++] = start_thread(daemon_thread, &conns[i]);
+    }
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = now() - start;
+
+    for (int i = 0; i < nconn; i++)
+    {
+        conn_t *c = &conns[i];
+
+        bad += c->out_of_order || c->received != lines_per_conn;
+        received += c->received;
+        wait += c->wait;
+        takes += c->takes;
+        max_wait = c->max_wait > max_wait ? c->max_wait : max_wait;
+        close(c->sk);
+        mgmt_buf_free(&c->rbuf);
+        mgmt_buf_free(&c->inbox);
+        mgmt_buf_free(&c->lines);
+    }
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("%s: %d connections, %d reactors, %lu lines in %.2f s\n"
+           "  take lines: %lu times, wait for the lock avg %.1f us, max %.1f ms\n"
+           "  cpu %.2f s, max rss %.1f MB\n",
+           per_connection_locks ? "lock per connection" : "one lock per drain",
+           nconn,
+           nreactors,
+           received,
+           elapsed,
+           takes,
+           1e6 * wait / takes,
+           1e3 * max_wait,
+           cpu_time(&ru),
+           ru.ru_maxrss / 1024.0);
+    if (bad)
+    {
+        fprintf(stderr, "FAIL: %d connections lost lines or got them out of order\n", bad);
+    }
+    return bad != 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int nconn = argc > 1 ? atoi(argv[1]) : 256;
+    int failures = 0;
+
+    lines_per_conn = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000;
+    fflush(stdout);
+
+    for (per_connection_locks = 0; per_connection_locks < 2; per_connection_locks++)
+    {
+        pid_t pid = fork();
+        int status;
+
+        if (pid == 0)
+        {
+            exit(soak(nconn));
+        }
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        {
+            failures++;
+        }
+    }
+
+    if (failures)
+    {
+        fprintf(stderr, "%d runs failed\n", failures);
+    }
+    return failures != 0;
+}
@@ -0,0 +1,377 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test and benchmark of the config parser against the one it replaced.
+ *
+ *   test_config_parser [number of configs] [size in MB] [directory]
+ *
+ * Random configs (default 2000) of quoted and unquoted tokens, escapes,
+ * comments, options with "--", tabs, CRLF line ends, a byte order mark,
+ * UTF-8 and the odd illegal backslash are parsed by both parsers, which
+ * must return the same lines. The lines stay within the limits of the
+ * old parser. A few lines beyond them are only checked with the new one.
+ * Then a config of the given size (default 64 MB) is parsed by both,
+ * compared and timed.
+ */
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "config_parser.h"
+#include "config_parser_old.h"
+
+#define MAX_LINE_BYTES 200 /* the old parser reads up to 254 bytes a line */
+#define MAX_TOKENS     12  /* and up to 16 tokens */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static const char *words[] = {
+    "client", "dev", "tun", "proto", "udp", "remote", "vpn.example.net", "1194",
+    "resolv-retry", "infinite", "nobind", "persist-key", "auth-user-pass", "verb",
+    "3", "cipher", "AES-256-GCM", "--remote-cert-tls", "server", "C:\\\\Users\\\\me",
+    "caf\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", "\xf0\x9f\x94\x91", "a\\ b", "x=\\\"y\\\"",
+};
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Write a random line without its end to buf, returning its length. If
+ * quotes is 0, the line has no quotes or illegal backslashes.
+ */
+static size_t
+random_line(char *buf, int quotes)
+{
+    size_t len = 0;
+    int ntokens = (int)(rnd() % (MAX_TOKENS + 1));
+
+    if (rnd() % 8 == 0)
+    {
+        len += sprintf(buf + len, "%*s", (int)(rnd() % 3), "");
+    }
+    /* room for the longest token and a comment after the last one */
+    for (int i = 0; i < ntokens && len < MAX_LINE_BYTES - 80; i++)
+    {
+        const char *word = words[rnd() % (sizeof(words) / sizeof(*words))];
+
+        switch (quotes ? rnd() % 10 : 9)
+        {
+            case 0:
+                len += sprintf(buf + len, "'%s %s'", word, "single quoted \\ \"");
+                break;
+
+            case 1:
+                len += sprintf(buf + len, "\"%s \\\" \\\\ %s\"", word, "double\\ quoted");
+                break;
+
+            case 2: /* an unterminated quote runs to the end of the line */
+                len += sprintf(buf + len, "%c%s", rnd() % 2 ? '\'' : '"', word);
+                break;
+
+            case 3: /* an illegal backslash ends the parse */
+                len += sprintf(buf + len, "%s\\%c", word, rnd() % 50 ? ' ' : 'n');
+                break;
+
+            default:
+                len += sprintf(buf + len, "%s", word);
+                break;
+        }
+        len += sprintf(buf + len, "%s", rnd() % 5 ? " " : "\t ");
+    }
+    if (rnd() % 6 == 0)
+    {
+        len += sprintf(buf + len, "%c comment 'with' \"quotes\" \\", rnd() % 2 ? '#' : ';');
+    }
+    return len;
+}
+
+/* Write a random config to path */
+static void
+write_random_config(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    int nlines = (int)(rnd() % 60);
+    char line[MAX_LINE_BYTES + 64];
+
+    if (!f)
+    {
+        exit(2);
+    }
+    if (rnd() % 10 == 0)
+    {
+        fputs("\xEF\xBB\xBF", f);
+    }
+    for (int i = 0; i < nlines; i++)
+    {
+        fwrite(line, 1, random_line(line, 1), f);
+        if (i + 1 < nlines || rnd() % 2)
+        {
+            fputs(rnd() % 4 ? "\n" : "\r\n", f);
+        }
+    }
+    fclose(f);
+}
+
+/* Whether both parsers parsed a line the same */
+static int
+same_line(const config_entry_t *ce, const old_config_entry_t *oe)
+{
+    const wchar_t *comment = ce->comment.len ? ce->text + ce->comment.offset : NULL;
+
+    if (ce->ntokens != oe->ntokens)
+    {
+        return 0;
+    }
+    for (int i = 0; i < ce->ntokens; i++)
+    {
+        if (wcscmp(config_token(ce, i), oe->tokens[i]) != 0)
+        {
+            return 0;
+        }
+    }
+    return comment == oe->comment || (comment && oe->comment && wcscmp(comment, oe->comment) == 0);
+}
+
+/*
+ * Parse the config at path with both parsers and compare, returning the
+ * number of lines compared. Unbalanced quotes may split a line into more
+ * tokens than the old parser can store, which makes it stop: *cut is set
+ * if it stopped there.
+ */
+static long
+compare(const char *path, int *differs, int *cut)
+{
+    wchar_t wpath[4096];
+    config_entry_t *head, *ce;
+    old_config_entry_t *old_head, *oe;
+    long n = 0;
+
+    mbstowcs(wpath, path, 4096);
+    head = config_parse(wpath);
+    old_head = old_config_parse(wpath);
+
+    for (ce = head, oe = old_head; ce && oe; ce = ce->next, oe = oe->next, n++)
+    {
+        if (!same_line(ce, oe))
+        {
+            fprintf(stderr, "%s: line %ld parsed differently\n", path, n + 1);
+            *differs = 1;
+            break;
+        }
+    }
+    /* the old parser has room for 16 tokens including a comment */
+    if (!*differs && ce && !oe && ce->ntokens + (ce->comment.len > 0) > 16)
+    {
+        *cut = 1;
+    }
+    else if (!*differs && (ce || oe))
+    {
+        fprintf(stderr, "%s: %s parser returned more lines\n", path, ce ? "new" : "old");
+        *differs = 1;
+    }
+
+    config_list_free(head);
+    old_config_list_free(old_head);
+    return n;
+}
+
+static void
+test_random(const char *dir, int count)
+{
+    char path[4096];
+    long lines = 0;
+    int differs = 0, cut, ncut = 0;
+
+    snprintf(path, sizeof(path), "%s/test_config_parser.%d.ovpn", dir, (int)getpid());
+    for (int i = 0; i < count && !differs; i++)
+    {
+        write_random_config(path);
+        cut = 0;
+        lines += compare(path, &differs, &cut);
+        ncut += cut;
+    }
+    CHECK(!differs);
+    if (differs)
+    {
+        fprintf(stderr, "config kept as %s\n", path);
+        return;
+    }
+    remove(path);
+    printf("%d random configs, %ld lines parsed the same by both parsers, "
+           "%d configs compared up to a line of more than 16 tokens\n",
+           count,
+           lines,
+           ncut);
+}
+
+/* Lines the old parser cannot parse */
+static void
+test_beyond_limits(const char *dir)
+{
+    char path[4096];
+    wchar_t wpath[4096];
+    config_entry_t *head;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/test_config_parser_long.%d.ovpn", dir, (int)getpid());
+    mbstowcs(wpath, path, 4096);
+
+    /* 100000 tokens on a line longer than a block, then invalid UTF-8 */
+    f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (!f)
+    {
+        return;
+    }
+    fputs("--route", f);
+    for (int i = 1; i < 100000; i++)
+    {
+        fprintf(f, " t%d", i);
+    }
+    fputs("\nremote \xff\xc3 caf\xc3\xa9 \xed\xa0\x80\n", f);
+    fclose(f);
+
+    head = config_parse(wpath);
+    CHECK(head && head->ntokens == 100000);
+    CHECK(head && wcscmp(config_token(head, 0), L"route") == 0);
+    CHECK(head && wcscmp(config_token(head, 99999), L"t99999") == 0);
+    CHECK(head && head->next && head->next->ntokens == 4);
+    CHECK(head && head->next && wcscmp(config_token(head->next, 1), L"\xfffd\xfffd") == 0);
+    CHECK(head && head->next && wcscmp(config_token(head->next, 2), L"caf\xe9") == 0);
+    CHECK(head && head->next && wcscmp(config_token(head->next, 3), L"\xfffd\xfffd\xfffd") == 0);
+    config_list_free(head);
+    remove(path);
+}
+
+static void
+bench(const char *dir, unsigned long long size)
+{
+    char path[4096], line[MAX_LINE_BYTES + 64];
+    wchar_t wpath[4096];
+    unsigned long long written = 0;
+    long lines = 0;
+    config_entry_t *head;
+    old_config_entry_t *old_head;
+    int differs = 0, cut = 0;
+    double t, t_old;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/bench_config_parser.%d.ovpn", dir, (int)getpid());
+    mbstowcs(wpath, path, 4096);
+
+    /* options and inline certificates, all parsed in full by the old parser */
+    f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (!f)
+    {
+        return;
+    }
+    while (written < size)
+    {
+        size_t len;
+
+        if (rnd() % 4 == 0)
+        {
+            len = (size_t)sprintf(line, "MIIDSzCCAjOgAwIBAgIUQ%08xTbD7y+o5ZJY1nN3fUQwDQ", rnd());
+        }
+        else
+        {
+            len = random_line(line, 0);
+        }
+        line[len++] = '\n';
+        fwrite(line, 1, len, f);
+        written += len;
+        lines++;
+    }
+    fclose(f);
+
+    CHECK(compare(path, &differs, &cut) == lines && !differs && !cut);
+
+    t = now();
+    head = config_parse(wpath);
+    t = now() - t;
+    config_list_free(head);
+
+    t_old = now();
+    old_head = old_config_parse(wpath);
+    t_old = now() - t_old;
+    old_config_list_free(old_head);
+
+    printf("config of %.1f MB: parsed in %.1f ms (%.0f MB/s), old parser %.1f ms (%.0f MB/s)\n",
+           written / 1048576.0,
+           t * 1000,
+           written / t / 1048576.0,
+           t_old * 1000,
+           written / t_old / 1048576.0);
+    remove(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned long long size = (argc > 2 ? strtoull(argv[2], NULL, 10) : 64) << 20;
+    const char *dir = argc > 3 ? argv[3] : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+
+    /* the old parser converts lines with mbstowcs() */
+    if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "en_US.UTF-8"))
+    {
+        fprintf(stderr, "FAIL: no UTF-8 locale\n");
+        return 1;
+    }
+
+    test_random(dir, count);
+    test_beyond_limits(dir);
+    bench(dir, size);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
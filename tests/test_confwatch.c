@@ -0,0 +1,636 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test of watching a config tree for changes.
+ *
+ *   test_confwatch [number of rounds] [directory]
+ *
+ * A tree of 220 directories and 10000 files is watched while it is
+ * mutated in rounds (default 20) of 500 random changes: configs added,
+ * rewritten, deleted and renamed, also away from the config extension,
+ * nested directories created, deleted and moved, and finally a whole
+ * group directory renamed. A catalog of configs is kept from the changes
+ * reported, the way BuildFileList() applies them, and after every round
+ * it must match a fresh scan of the tree by dirscan_run(). Configs are
+ * placed in groups by confwatch_group() as they are added, and the group
+ * of each config must be that of its directory, as on a scan.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "confwatch.h"
+#include "dirscan.h"
+
+#define MAX_DEPTH 20
+#define GROUPS    20
+#define DIRS      200 /* directories of configs, spread over the groups */
+#define FILES     50  /* files per directory, one in five not a config */
+#define CHANGES   500 /* changes per round */
+
+/* A config in the catalog */
+typedef struct
+{
+    char *path;
+    int enabled;
+    int group;
+} config_t;
+
+/* A group of configs, as in the menu */
+typedef struct
+{
+    char *name;
+    int parent;
+} group_t;
+
+static config_t *catalog;
+static size_t nconfigs;
+static size_t size;
+
+static group_t *groups;
+static int ngroups;
+static int groups_size;
+
+static char root[4096];
+static wchar_t wroot[4096];
+
+static unsigned long changes[confwatch_rescan + 1];
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+is_config(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 5 && strcmp(name + len - 5, ".ovpn") == 0;
+}
+
+static int
+readable(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, R_OK) == 0;
+}
+
+/* Add a group named name below parent, as a scan does for each directory */
+static int
+new_group(const char *name, int parent)
+{
+    if (ngroups == groups_size)
+    {
+        groups_size = groups_size ? 2 * groups_size : 256;
+        groups = realloc(groups, groups_size * sizeof(*groups));
+        if (!groups)
+        {
+            exit(2);
+        }
+    }
+    groups[ngroups].name = strdup(name);
+    groups[ngroups].parent = parent;
+    return ngroups++;
+}
+
+/* The confwatch_group() callback: find the group of a directory or add it */
+static int
+find_group(void *arg, int parent, const wchar_t *wname, size_t len)
+{
+    wchar_t buf[256];
+    char name[1024];
+
+    (void)arg;
+    len = len < 255 ? len : 255;
+    wmemcpy(buf, wname, len);
+    buf[len] = L'\0';
+    wcstombs(name, buf, sizeof(name));
+
+    for (int i = 0; i < ngroups; i++)
+    {
+        if (groups[i].parent == parent && strcmp(groups[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return new_group(name, parent);
+}
+
+/* The group of the directory dir, as ApplyConfigChange() finds it */
+static int
+dir_group(const char *dir)
+{
+    wchar_t wdir[4096];
+
+    mbstowcs(wdir, dir, 4096);
+    return confwatch_group(wroot, wdir, 0, find_group, NULL);
+}
+
+/*
+ * Add a config to the catalog, or enable or disable it if it is there.
+ * A config added is placed in group, or in the group of its directory if
+ * group is -1.
+ */
+static void
+check_config(const char *path, int group)
+{
+    for (size_t i = 0; i < nconfigs; i++)
+    {
+        if (strcmp(catalog[i].path, path) == 0)
+        {
+            catalog[i].enabled = readable(path);
+            return;
+        }
+    }
+    if (!readable(path))
+    {
+        return;
+    }
+    if (nconfigs == size)
+    {
+        size = size ? 2 * size : 1024;
+        catalog = realloc(catalog, size * sizeof(*catalog));
+        if (!catalog)
+        {
+            exit(2);
+        }
+    }
+    if (group < 0)
+    {
+        char dir[4096];
+
+        snprintf(dir, sizeof(dir), "%.*s", (int)(strrchr(path, '/') - path), path);
+        group = dir_group(dir);
+    }
+    catalog[nconfigs].path = strdup(path);
+    catalog[nconfigs].group = group;
+    catalog[nconfigs++].enabled = 1;
+}
+
+/* Check the configs below path again, as for a removed directory */
+static void
+check_below(const char *path)
+{
+    size_t len = strlen(path);
+
+    for (size_t i = 0; i < nconfigs; i++)
+    {
+        if (strncmp(catalog[i].path, path, len) == 0
+            && (catalog[i].path[len] == '\0' || catalog[i].path[len] == '/'))
+        {
+            catalog[i].enabled = readable(catalog[i].path);
+        }
+    }
+}
+
+/*
+ * Add the configs in the directory dir and depth levels below it to
+ * group, with a new group for each subdirectory as AddConfigDir() does
+ */
+static void
+scan(const char *dir, int depth, int group)
+{
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    struct stat st;
+    char path[4096];
+
+    if (!d)
+    {
+        return;
+    }
+    while ((de = readdir(d)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (lstat(path, &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            if (depth > 0)
+            {
+                scan(path, depth - 1, new_group(de->d_name, group));
+            }
+        }
+        else if (is_config(de->d_name))
+        {
+            check_config(path, group);
+        }
+    }
+    closedir(d);
+}
+
+/* Apply a change to the catalog */
+static void
+apply(void *arg, confwatch_change_t change, const wchar_t *wpath, int depth)
+{
+    char path[4096];
+
+    (void)arg;
+    wcstombs(path, wpath, sizeof(path));
+    changes[change]++;
+
+    switch (change)
+    {
+        case confwatch_config:
+            check_config(path, -1);
+            break;
+
+        case confwatch_add_dir:
+            scan(path, depth, dir_group(path));
+            break;
+
+        case confwatch_remove:
+            check_below(path);
+            break;
+
+        case confwatch_rescan:
+            check_below(path);
+            scan(path, depth, dir_group(path));
+            break;
+    }
+}
+
+static int
+compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* A list of paths */
+typedef struct
+{
+    char **paths;
+    size_t n;
+    size_t size;
+} list_t;
+
+static void
+push(list_t *l, char *path)
+{
+    if (l->n == l->size)
+    {
+        l->size = l->size ? 2 * l->size : 1024;
+        l->paths = realloc(l->paths, l->size * sizeof(*l->paths));
+        if (!l->paths)
+        {
+            exit(2);
+        }
+    }
+    l->paths[l->n++] = path;
+}
+
+/* Collect the paths of the readable configs found by dirscan_run() */
+static void
+collect(const dirscan_dir_t *d, list_t *l)
+{
+    char path[4096];
+
+    for (size_t i = 0; i < d->nfiles; i++)
+    {
+        if (d->files[i].readable)
+        {
+            snprintf(path, sizeof(path), "%ls/%ls", d->path, d->files[i].name);
+            push(l, strdup(path));
+        }
+    }
+    for (size_t i = 0; i < d->nsubdirs; i++)
+    {
+        collect(d->subdirs[i], l);
+    }
+}
+
+/* Write the names of the groups from the root down to group, separated by '/' */
+static size_t
+group_path(int group, char *buf, size_t size)
+{
+    size_t len;
+
+    if (group <= 0)
+    {
+        buf[0] = '\0';
+        return 0;
+    }
+    len = group_path(groups[group].parent, buf, size);
+    return len + snprintf(buf + len, size - len, "/%s", groups[group].name);
+}
+
+/* Whether config is in the group of its directory */
+static int
+placed(const config_t *config)
+{
+    char expected[4096], dir[4096];
+
+    group_path(config->group, dir, sizeof(dir));
+    snprintf(expected, sizeof(expected), "%s%s%s", root, dir, strrchr(config->path, '/'));
+    return strcmp(expected, config->path) == 0;
+}
+
+/*
+ * Whether the enabled configs in the catalog are those in the tree, each
+ * in the group of its directory
+ */
+static int
+consistent(void)
+{
+    dirscan_dir_t *d = dirscan_run(wroot, L"ovpn", MAX_DEPTH, 4, NULL);
+    list_t fresh = { 0 }, enabled = { 0 };
+    size_t i = 0, j = 0;
+    int shown = 0, ok;
+
+    if (!d)
+    {
+        exit(2);
+    }
+    collect(d, &fresh);
+    dirscan_free(d);
+    for (size_t k = 0; k < nconfigs; k++)
+    {
+        if (catalog[k].enabled)
+        {
+            push(&enabled, catalog[k].path);
+        }
+        if (catalog[k].enabled && !placed(&catalog[k]) && shown < 10)
+        {
+            fprintf(stderr, "  not in the group of its directory: %s\n", catalog[k].path);
+            shown++;
+        }
+    }
+    qsort(fresh.paths, fresh.n, sizeof(*fresh.paths), compare_paths);
+    qsort(enabled.paths, enabled.n, sizeof(*enabled.paths), compare_paths);
+
+    ok = fresh.n == enabled.n && shown == 0;
+    while ((i < enabled.n || j < fresh.n) && shown < 10)
+    {
+        int cmp = i == enabled.n  ? 1
+                  : j == fresh.n ? -1
+                                 : strcmp(enabled.paths[i], fresh.paths[j]);
+
+        if (cmp < 0)
+        {
+            fprintf(stderr, "  in the catalog only: %s\n", enabled.paths[i++]);
+        }
+        else if (cmp > 0)
+        {
+            fprintf(stderr, "  in the tree only: %s\n", fresh.paths[j++]);
+        }
+        else
+        {
+            i++;
+            j++;
+            continue;
+        }
+        ok = 0;
+        shown++;
+    }
+
+    for (size_t k = 0; k < fresh.n; k++)
+    {
+        free(fresh.paths[k]);
+    }
+    free(fresh.paths);
+    free(enabled.paths);
+    return ok;
+}
+
+static void
+write_config(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f)
+    {
+        fputs("client\n", f);
+        fclose(f);
+    }
+}
+
+static void
+remove_tree(const char *path)
+{
+    DIR *d = opendir(path);
+    struct dirent *de;
+    char sub[4096];
+
+    if (!d)
+    {
+        unlink(path);
+        return;
+    }
+    while ((de = readdir(d)) != NULL)
+    {
+        if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
+        {
+            snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
+            remove_tree(sub);
+        }
+    }
+    closedir(d);
+    rmdir(path);
+}
+
+/* Make a random change to the tree */
+static void
+mutate(const char *root)
+{
+    unsigned int n = rnd() % DIRS, f = rnd() % (2 * FILES);
+    char dir[4200], path[4300], to[4400];
+
+    snprintf(dir, sizeof(dir), "%s/g%u/d%u", root, n % GROUPS, n);
+    snprintf(path, sizeof(path), "%s/p%u_%u.ovpn", dir, n, f);
+
+    switch (rnd() % 8)
+    {
+        case 0: /* config added or rewritten */
+        case 1:
+            write_config(path);
+            break;
+
+        case 2:
+            unlink(path);
+            break;
+
+        case 3:
+            snprintf(to, sizeof(to), "%s/p%u_%u.ovpn", dir, n, f + 1000);
+            rename(path, to);
+            break;
+
+        case 4: /* no longer a config */
+            snprintf(to, sizeof(to), "%s/p%u_%u.txt", dir, n, f);
+            rename(path, to);
+            break;
+
+        case 5: /* a directory with configs a level down */
+            snprintf(path, sizeof(path), "%s/new%u", dir, f);
+            mkdir(path, 0755);
+            snprintf(path, sizeof(path), "%s/new%u/sub", dir, f);
+            mkdir(path, 0755);
+            for (int i = 0; i < 5; i++)
+            {
+                snprintf(to, sizeof(to), "%s/n%d.ovpn", path, i);
+                write_config(to);
+            }
+            break;
+
+        case 6:
+            snprintf(path, sizeof(path), "%s/new%u", dir, f);
+            remove_tree(path);
+            break;
+
+        case 7: /* a directory moved to another group */
+            snprintf(path, sizeof(path), "%s/new%u", dir, f);
+            snprintf(to, sizeof(to), "%s/g%u/moved%u_%u", root, rnd() % GROUPS, n, f);
+            rename(path, to);
+            break;
+    }
+}
+
+/* Apply the changes until there are none for a while */
+static void
+drain(confwatch_t *w)
+{
+    while (confwatch_read(w, 50, apply, NULL) > 0)
+    {
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    const char *dir = argc > 2 ? argv[2] : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    char path[4200], from[4200];
+    int failures = 0;
+    double t, applied = 0;
+    confwatch_t *w;
+
+    snprintf(root, sizeof(root), "%s/test_confwatch.%d", dir, (int)getpid());
+    mbstowcs(wroot, root, 4096);
+    mkdir(root, 0755);
+    for (unsigned int n = 0; n < DIRS; n++)
+    {
+        snprintf(path, sizeof(path), "%s/g%u", root, n % GROUPS);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/g%u/d%u", root, n % GROUPS, n);
+        mkdir(path, 0755);
+        for (unsigned int f = 0; f < FILES; f++)
+        {
+            snprintf(path,
+                     sizeof(path),
+                     "%s/g%u/d%u/p%u_%u.%s",
+                     root,
+                     n % GROUPS,
+                     n,
+                     n,
+                     f,
+                     f % 5 ? "ovpn" : "txt");
+            write_config(path);
+        }
+    }
+
+    w = confwatch_open(wroot, L"ovpn", MAX_DEPTH);
+    if (!w)
+    {
+        fprintf(stderr, "FAIL: cannot watch %s\n", root);
+        remove_tree(root);
+        return 1;
+    }
+    scan(root, MAX_DEPTH, new_group("", -1));
+    if (!consistent())
+    {
+        fprintf(stderr, "FAIL: initial catalog\n");
+        failures++;
+    }
+    printf("watching %zu configs in %d directories, %d groups\n", nconfigs, DIRS + GROUPS, ngroups);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < CHANGES; i++)
+        {
+            mutate(root);
+        }
+        t = now();
+        drain(w);
+        applied += now() - t;
+        if (!consistent())
+        {
+            fprintf(stderr, "FAIL: catalog differs from the tree after round %d\n", round);
+            failures++;
+        }
+    }
+
+    snprintf(from, sizeof(from), "%s/g3", root);
+    snprintf(path, sizeof(path), "%s/g3renamed", root);
+    rename(from, path);
+    drain(w);
+    if (!consistent())
+    {
+        fprintf(stderr, "FAIL: catalog differs from the tree after renaming a group\n");
+        failures++;
+    }
+
+    printf("%d changes in %d rounds reported as %lu config, %lu add_dir, %lu remove, %lu rescan; "
+           "applied in %.1f ms\n",
+           rounds * CHANGES,
+           rounds,
+           changes[confwatch_config],
+           changes[confwatch_add_dir],
+           changes[confwatch_remove],
+           changes[confwatch_rescan],
+           applied * 1000);
+
+    confwatch_close(w);
+    remove_tree(root);
+    for (size_t i = 0; i < nconfigs; i++)
+    {
+        free(catalog[i].path);
+    }
+    free(catalog);
+    for (int i = 0; i < ngroups; i++)
+    {
+        free(groups[i].name);
+    }
+    free(groups);
+    return failures != 0;
+}
@@ -0,0 +1,302 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test of following a log file appended to by another process.
+ *
+ *   test_logfollow [lines in thousands] [directory]
+ *
+ * A child process plays openvpn: it appends lines (default 200
+ * thousand) to a log in a scratch directory under the given one
+ * (default TMPDIR or /tmp), in writes that split lines at random
+ * places, and now and then rotates the log by renaming it. The parent
+ * polls the log with logfollow_read() as the GUI does. Every line must
+ * be read once, complete and in order, across the rotations. The times
+ * of the lines are checked with logfollow_line_time(), and a read of a
+ * rotated log with a limited backlog must start at a line boundary.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "logfollow.h"
+
+#define ROTATE_EVERY 20000 /* lines */
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char dir[4096];
+static char log_name[4200];
+static char rotated_name[4200];
+
+/* Format line n as openvpn writes it, with a length depending on n */
+static int
+format_line(char *buf, size_t size, unsigned long n)
+{
+    time_t t = 1709294400 + (time_t)(n / 50); /* 2024-03-01 12:00 UTC */
+    struct tm tm;
+    int len;
+
+    localtime_r(&t, &tm);
+    len = (int)strftime(buf, size, "%Y-%m-%d %H:%M:%S ", &tm);
+    len += snprintf(buf + len, size - (size_t)len, "line %lu ", n);
+    for (unsigned long i = 0; i < n % 97; i++)
+    {
+        buf[len++] = (char)('a' + (n + i) % 26);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+/*
+ * The writer: append the lines in random pieces and rotate the log now
+ * and then, with the last lines before the rotation not read yet. Before
+ * writing those, wait for the reader to finish a poll that started after
+ * the previous rotation, as the GUI polls far more often than openvpn
+ * rotates.
+ */
+static void
+writer(unsigned long lines, int sync)
+{
+    char buf[65536];
+    size_t have = 0;
+    int fd = open(log_name, O_WRONLY | O_CREAT | O_APPEND, 0600);
+
+    seed = 7;
+    for (unsigned long n = 0; n < lines; n++)
+    {
+        int rotate = n % ROTATE_EVERY == ROTATE_EVERY - 1 && n + 1 < lines;
+
+        have += (size_t)format_line(buf + have, sizeof(buf) - have, n);
+        if (rotate)
+        {
+            char c;
+
+            while (read(sync, &c, 1) == 1)
+            {
+            }
+            fcntl(sync, F_SETFL, 0);
+            if (read(sync, &c, 1) != 1 || read(sync, &c, 1) != 1)
+            {
+                _exit(2);
+            }
+            fcntl(sync, F_SETFL, O_NONBLOCK);
+        }
+        if (have > sizeof(buf) / 2 || rnd() % 8 == 0 || rotate || n + 1 == lines)
+        {
+            size_t done = 0;
+
+            while (done < have)
+            {
+                size_t piece = 1 + rnd() % (have - done);
+
+                if (write(fd, buf + done, piece) != (ssize_t)piece)
+                {
+                    _exit(2);
+                }
+                done += piece;
+            }
+            have = 0;
+        }
+        if (rotate)
+        {
+            close(fd);
+            rename(log_name, rotated_name);
+            fd = open(log_name, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        }
+    }
+    close(fd);
+    _exit(0);
+}
+
+struct reader
+{
+    int any;               /* take the first line read as expected */
+    unsigned long next;    /* number of the next line expected */
+    unsigned long bad;     /* lines not as expected */
+    unsigned long times;   /* lines with the time checked */
+    logfollow_time_t time; /* cache of logfollow_line_time() */
+};
+
+static void
+on_line(void *arg, const char *line, size_t len)
+{
+    struct reader *r = arg;
+    char expected[256];
+    size_t prefix_len;
+    time_t t = logfollow_line_time(&r->time, line, len, &prefix_len);
+    int n;
+
+    if (r->any && len > 25)
+    {
+        r->next = strtoul(line + 25, NULL, 10);
+        r->any = 0;
+    }
+    n = format_line(expected, sizeof(expected), r->next);
+
+    if (len != (size_t)n - 1 || memcmp(line, expected, len) != 0)
+    {
+        if (r->bad++ == 0)
+        {
+            fprintf(stderr, "line %lu: '%.*s'\n", r->next, (int)len, line);
+        }
+    }
+    else if (t == 1709294400 + (time_t)(r->next / 50) && prefix_len == 20)
+    {
+        r->times++;
+    }
+    r->next = (len > 25 ? strtoul(line + 25, NULL, 10) : r->next) + 1;
+}
+
+/*
+ * Read the last 8000 bytes of the rotated log, which ends before line
+ * end: the first line read must be whole.
+ */
+static void
+test_backlog(unsigned long end)
+{
+    logfollow_pos_t pos = { 0 };
+    struct reader r = { .any = 1 };
+    wchar_t path[4200];
+    long n;
+
+    swprintf(path, 4200, L"%s", rotated_name);
+    n = logfollow_read(&pos, path, NULL, 8000, on_line, &r);
+    CHECK(n > 50 && n < 8000 / 30);
+    CHECK(r.bad == 0 && r.next == end);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long lines = (unsigned long)((argc > 1 ? atof(argv[1]) : 200) * 1000);
+    const char *tmp = getenv("TMPDIR");
+    struct reader r = { 0 };
+    logfollow_pos_t pos = { 0 };
+    wchar_t path[4200], rotated[4200];
+    unsigned long polls = 0, rotations;
+    int sync[2], status;
+    double start;
+    pid_t child;
+
+    snprintf(dir,
+             sizeof(dir),
+             "%s/test_logfollow.%d",
+             argc > 2 ? argv[2] : tmp ? tmp : "/tmp",
+             (int)getpid());
+    if (mkdir(dir, 0700) != 0 || pipe(sync) != 0)
+    {
+        perror(dir);
+        return 2;
+    }
+    snprintf(log_name, sizeof(log_name), "%s/client.log", dir);
+    snprintf(rotated_name, sizeof(rotated_name), "%s/client.1.log", dir);
+    swprintf(path, 4200, L"%s", log_name);
+    swprintf(rotated, 4200, L"%s", rotated_name);
+    fcntl(sync[0], F_SETFL, O_NONBLOCK);
+    fcntl(sync[1], F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    start = now();
+    child = fork();
+    if (child == 0)
+    {
+        close(sync[1]);
+        writer(lines, sync[0]);
+    }
+    close(sync[0]);
+
+    for (;;)
+    {
+        int done = waitpid(child, &status, WNOHANG) == child;
+
+        logfollow_read(&pos, path, rotated, UINT64_MAX, on_line, &r);
+        polls++;
+        if (write(sync[1], "", 1) != 1)
+        {
+            /* the pipe is full or the writer has exited */
+        }
+        if (done)
+        {
+            break;
+        }
+        usleep(200);
+    }
+    start = now() - start;
+
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(r.bad == 0);
+    CHECK(r.next == lines);
+    CHECK(r.times == lines);
+    rotations = (lines - 1) / ROTATE_EVERY;
+    if (rotations > 0)
+    {
+        test_backlog(rotations * ROTATE_EVERY);
+    }
+
+    printf("%lu lines in %lu polls with %lu rotations: %.0f lines/s\n",
+           r.next,
+           polls,
+           rotations,
+           r.next / start);
+
+    unlink(log_name);
+    unlink(rotated_name);
+    rmdir(dir);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
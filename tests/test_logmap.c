@@ -0,0 +1,276 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test of the log mapping and line index.
+ *
+ *   test_logmap [size of the sparse log in GB] [directory]
+ *
+ * A log of known lines several views long is indexed from its tail and
+ * in full, checked line by line, appended to and truncated. Then a
+ * sparse log of the given size (default 6 GB) is opened at its tail
+ * with the address space limited to 1 GB, which only works if the log
+ * is not mapped as a whole. A size of 0 skips the sparse log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "logmap.h"
+
+#define LONG_LINE  1000                         /* number of the overlong line */
+#define LONG_LEN   (LOGMAP_VIEW_SIZE + 8000000) /* its length, more than a view */
+#define TAIL_LINES 5000
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Text of line i without its terminator; returns its length */
+static size_t
+line_text(unsigned long long i, char *buf, size_t size)
+{
+    int n = snprintf(buf, size, "%llu line %llu ", i * 7919, i);
+    size_t pad = (size_t)(i * 7919 % 200);
+
+    memset(buf + n, 'x', pad);
+    return n + pad;
+}
+
+/* Write lines first..last-1 to f, each with its offset in offsets */
+static int
+write_lines(FILE *f, unsigned long long first, unsigned long long last, uint64_t *offsets)
+{
+    char buf[512];
+
+    for (unsigned long long i = first; i < last; i++)
+    {
+        offsets[i] = (uint64_t)ftello(f);
+        if (i == LONG_LINE)
+        {
+            for (size_t n = 0; n < LONG_LEN; n += sizeof(buf))
+            {
+                memset(buf, 'y', sizeof(buf));
+                fwrite(buf, 1, LONG_LEN - n < sizeof(buf) ? LONG_LEN - n : sizeof(buf), f);
+            }
+        }
+        else
+        {
+            fwrite(buf, 1, line_text(i, buf, sizeof(buf)), f);
+        }
+        fputs(i % 3 ? "\n" : "\r\n", f);
+    }
+    return ferror(f) == 0;
+}
+
+static int
+line_ok(logmap_t *m, const logmap_lines_t *l, uint64_t n, unsigned long long i)
+{
+    char buf[512];
+    size_t len;
+    const char *line = logmap_line(m, l, n, &len);
+
+    if (!line)
+    {
+        return 0;
+    }
+    if (i == LONG_LINE)
+    {
+        return len == LOGMAP_MAX_LINE && line[0] == 'y' && line[len - 1] == 'y';
+    }
+    return len == line_text(i, buf, sizeof(buf)) && memcmp(line, buf, len) == 0;
+}
+
+static void
+test_lines(const char *dir)
+{
+    const unsigned long long total = 600000, more = 1000;
+    uint64_t *offsets = malloc((total + more) * sizeof(*offsets));
+    char path[4096];
+    wchar_t wpath[4096];
+    logmap_lines_t tail, all;
+    logmap_t m;
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path), "%s/test_logmap.%d.log", dir, (int)getpid());
+    mbstowcs(wpath, path, 4096);
+    f = fopen(path, "wb");
+    CHECK(f && offsets && write_lines(f, 0, total, offsets));
+    /* an incomplete last line is not indexed */
+    fputs("partial", f);
+    fclose(f);
+
+    CHECK(logmap_open(&m, wpath));
+    printf("log of %llu lines, %.1f MB\n", total, m.size / 1048576.0);
+
+    /* the tail */
+    CHECK(logmap_tail(&m, TAIL_LINES) == offsets[total - TAIL_LINES]);
+    CHECK(logmap_tail(&m, total + 10) == 0);
+    CHECK(logmap_lines_init(&tail, logmap_tail(&m, TAIL_LINES)));
+    CHECK(logmap_lines_scan(&tail, &m, UINT64_MAX) == 1);
+    CHECK(tail.count == TAIL_LINES);
+    for (uint64_t n = 0; n < tail.count; n += 97)
+    {
+        CHECK(line_ok(&m, &tail, n, total - TAIL_LINES + n));
+    }
+
+    /* all lines, scanned in pieces as by the index thread */
+    CHECK(logmap_lines_init(&all, 0));
+    while ((ret = logmap_lines_scan(&all, &m, 7 * 1024 * 1024)) == 0)
+    {
+    }
+    CHECK(ret == 1);
+    CHECK(all.count == total);
+    for (unsigned long long i = 0; i < total; i += 1 + i % 1013)
+    {
+        CHECK(line_ok(&m, &all, i, i));
+        CHECK(logmap_line_number(&m, &all, offsets[i]) == i);
+    }
+    CHECK(line_ok(&m, &all, LONG_LINE, LONG_LINE));
+    CHECK(line_ok(&m, &all, LONG_LINE + 1, LONG_LINE + 1));
+    CHECK(line_ok(&m, &all, total - 1, total - 1));
+    CHECK(logmap_line_number(&m, &all, tail.base) == total - TAIL_LINES);
+
+    /* appended lines are indexed after a remap */
+    f = fopen(path, "ab");
+    CHECK(f != NULL);
+    fputs("\n", f); /* ends the partial line */
+    offsets[total] = offsets[total - 1]; /* not checked */
+    CHECK(write_lines(f, total + 1, total + more, offsets));
+    fclose(f);
+    CHECK(logmap_remap(&m) == 1);
+    CHECK(logmap_remap(&m) == 0);
+    CHECK(logmap_lines_scan(&all, &m, UINT64_MAX) == 1);
+    CHECK(all.count == total + more);
+    CHECK(line_ok(&m, &all, total + more - 1, total + more - 1));
+    CHECK(line_ok(&m, &all, 17, 17));
+
+    /* truncation is reported */
+    CHECK(truncate(path, 100) == 0);
+    CHECK(logmap_remap(&m) == -1);
+
+    logmap_lines_free(&tail);
+    logmap_lines_free(&all);
+    logmap_close(&m);
+    remove(path);
+    free(offsets);
+}
+
+static void
+test_sparse(const char *dir, unsigned long long gb)
+{
+    const uint64_t size = gb << 30;
+    struct rlimit limit = { 1ULL << 30, 1ULL << 30 };
+    char path[4096];
+    wchar_t wpath[4096];
+    char buf[512];
+    logmap_lines_t l;
+    logmap_t m;
+    FILE *f;
+    double t;
+    uint64_t pos;
+    size_t len;
+    const char *line;
+
+    snprintf(path, sizeof(path), "%s/test_logmap_sparse.%d.log", dir, (int)getpid());
+    mbstowcs(wpath, path, 4096);
+
+    /* a hole followed by lines, so that only the end takes disk space */
+    f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (!f)
+    {
+        return;
+    }
+    CHECK(fseeko(f, (off_t)(size - 16 * 1024 * 1024), SEEK_SET) == 0);
+    fputs("\n", f);
+    pos = (uint64_t)ftello(f);
+    for (unsigned long long i = 0; pos < size; i++)
+    {
+        size_t n = line_text(i, buf, sizeof(buf));
+        buf[n++] = '\n';
+        fwrite(buf, 1, n, f);
+        pos += n;
+    }
+    fclose(f);
+
+    if (setrlimit(RLIMIT_AS, &limit) != 0)
+    {
+        printf("cannot limit the address space, sparse log not limited\n");
+    }
+
+    t = now();
+    CHECK(logmap_open(&m, wpath));
+    CHECK(logmap_lines_init(&l, logmap_tail(&m, TAIL_LINES)));
+    CHECK(logmap_lines_scan(&l, &m, UINT64_MAX) == 1);
+    CHECK(l.count == TAIL_LINES);
+    line = logmap_line(&m, &l, l.count - 1, &len);
+    t = now() - t;
+
+    CHECK(line && len > 0 && m.len <= LOGMAP_VIEW_SIZE);
+    printf("sparse log of %.1f GB: %llu tail lines indexed in %.1f ms, view of %zu kB\n",
+           m.size / 1073741824.0,
+           (unsigned long long)l.count,
+           t * 1000,
+           m.len >> 10);
+
+    logmap_lines_free(&l);
+    logmap_close(&m);
+    remove(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long long gb = argc > 1 ? strtoull(argv[1], NULL, 10) : 6;
+    const char *dir = argc > 2 ? argv[2] : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+
+    test_lines(dir);
+    if (gb > 0)
+    {
+        test_sparse(dir, gb);
+    }
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
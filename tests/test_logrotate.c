@@ -0,0 +1,233 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test of the rotation of logs.
+ *
+ *   test_logrotate [rotations] [directory]
+ *
+ * A log in a scratch directory under the given one (default TMPDIR or
+ * /tmp) is written and rotated a number of times (default 12) with a
+ * count of 5 generations. After each rotation the generations must hold
+ * the most recent sessions in order, each with its search index, and
+ * there must be no more than count of them. A log below the size limit
+ * must be left alone, and lowering the count must drop the generations
+ * above it. Also checks the names of the generations.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wchar.h>
+#include "logrotate.h"
+
+#define COUNT    5
+#define MAX_SIZE 64
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static char dir[4096];
+static wchar_t log_path[4096];
+
+/* Write a session of the log and its index, tagged with its number */
+static void
+write_session(int session, size_t size)
+{
+    char name[4200];
+    FILE *f;
+    int len;
+
+    snprintf(name, sizeof(name), "%s/client.log", dir);
+    if (!(f = fopen(name, "w")))
+    {
+        perror(name);
+        exit(2);
+    }
+    len = fprintf(f, "session %d\n", session);
+    for (size_t i = (size_t)len; i < size; i++)
+    {
+        fputc('x', f);
+    }
+    fclose(f);
+
+    strcat(name, ".idx");
+    if (!(f = fopen(name, "w")))
+    {
+        exit(2);
+    }
+    fprintf(f, "index %d\n", session);
+    fclose(f);
+}
+
+/* The session in generation n of the log, or its index; -1 if missing */
+static int
+read_session(unsigned long n, int index)
+{
+    wchar_t path[4096];
+    char name[4200];
+    int session = -1;
+    FILE *f;
+
+    if (!logrotate_path(path, 4096, log_path, n))
+    {
+        return -1;
+    }
+    wcstombs(name, path, 4096);
+    if (index)
+    {
+        strcat(name, ".idx");
+    }
+    if ((f = fopen(name, "r")))
+    {
+        if (fscanf(f, index ? "index %d" : "session %d", &session) != 1)
+        {
+            session = -1;
+        }
+        fclose(f);
+    }
+    return session;
+}
+
+/* Number of files in the directory */
+static int
+count_files(void)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    int n = 0;
+
+    while ((e = readdir(d)))
+    {
+        n += e->d_name[0] != '.';
+    }
+    closedir(d);
+    return n;
+}
+
+static void
+remove_dir(void)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    char name[4400];
+
+    while ((e = readdir(d)))
+    {
+        if (e->d_name[0] != '.')
+        {
+            snprintf(name, sizeof(name), "%s/%s", dir, e->d_name);
+            unlink(name);
+        }
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static void
+test_names(void)
+{
+    wchar_t buf[64];
+
+    CHECK(logrotate_path(buf, 64, L"/logs/client.log", 0) && !wcscmp(buf, L"/logs/client.log"));
+    CHECK(logrotate_path(buf, 64, L"/logs/client.log", 3) && !wcscmp(buf, L"/logs/client.3.log"));
+    CHECK(logrotate_path(buf, 64, L"/logs/a.b.LOG", 1) && !wcscmp(buf, L"/logs/a.b.1.LOG"));
+    CHECK(logrotate_path(buf, 64, L"/logs/c.jsonl", 12) && !wcscmp(buf, L"/logs/c.12.jsonl"));
+    CHECK(logrotate_path(buf, 64, L"/logs/client.txt", 2) && !wcscmp(buf, L"/logs/client.txt.2"));
+    CHECK(!logrotate_path(buf, 8, L"/logs/client.log", 1));
+}
+
+int
+main(int argc, char **argv)
+{
+    int rotations = argc > 1 ? atoi(argv[1]) : 12;
+    const char *tmp = getenv("TMPDIR");
+
+    snprintf(dir,
+             sizeof(dir),
+             "%s/test_logrotate.%d",
+             argc > 2 ? argv[2] : tmp ? tmp : "/tmp",
+             (int)getpid());
+    if (mkdir(dir, 0700) != 0)
+    {
+        perror(dir);
+        return 2;
+    }
+    swprintf(log_path, 4096, L"%s/client.log", dir);
+
+    test_names();
+
+    /* nothing to do for a missing log or one below the limit */
+    CHECK(logrotate(log_path, MAX_SIZE, COUNT) == LOGROTATE_NOT_DUE);
+    write_session(0, MAX_SIZE - 1);
+    CHECK(logrotate(log_path, MAX_SIZE, COUNT) == LOGROTATE_NOT_DUE);
+    CHECK(logrotate(log_path, 0, COUNT) == LOGROTATE_NOT_DUE);
+    CHECK(read_session(0, 0) == 0 && read_session(1, 0) == -1);
+
+    for (int s = 1; s <= rotations; s++)
+    {
+        write_session(s, MAX_SIZE);
+        CHECK(logrotate(log_path, MAX_SIZE, COUNT) == LOGROTATE_DONE);
+
+        /* the log is gone until it is reopened, generation n holds session s + 1 - n */
+        CHECK(read_session(0, 0) == -1 && read_session(0, 1) == -1);
+        for (int n = 1; n <= COUNT; n++)
+        {
+            int expected = s + 1 - n >= 1 ? s + 1 - n : -1;
+
+            CHECK(read_session(n, 0) == expected);
+            CHECK(read_session(n, 1) == expected);
+        }
+        CHECK(read_session(COUNT + 1, 0) == -1);
+        CHECK(count_files() == 2 * (s < COUNT ? s : COUNT));
+    }
+
+    /* a lower count drops the older generations with their indexes */
+    write_session(rotations + 1, MAX_SIZE);
+    CHECK(logrotate(log_path, MAX_SIZE, 2) == LOGROTATE_DONE);
+    CHECK(read_session(1, 0) == rotations + 1 && read_session(1, 1) == rotations + 1);
+    CHECK(read_session(2, 0) == rotations && read_session(2, 1) == rotations);
+    CHECK(read_session(3, 0) == -1 && read_session(3, 1) == -1);
+    CHECK(count_files() == 4);
+
+    printf("%d rotations of a log keeping %d generations, then 2: %s\n",
+           rotations + 1,
+           COUNT,
+           failures ? "failed" : "ok");
+
+    remove_dir();
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
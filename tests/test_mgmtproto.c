@@ -0,0 +1,593 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Replay of recorded management sessions through the protocol code.
+ *
+ *   test_mgmtproto [number of replays] [corpus directory]
+ *
+ * Each recording in the corpus (default tests/mgmt) is split into lines
+ * and dispatched to stub handlers, with its original read boundaries,
+ * one byte at a time and in random pieces. The stubs answer prompts and
+ * send the commands the GUI sends, and check that each response reaches
+ * the command it answers. The handler calls must be the same whatever
+ * the read boundaries, and all commands must be answered. Then every
+ * recording is replayed (default 20 times) to measure throughput, the
+ * buffer allocations per line and the time spent per line, by type of
+ * line. Recordings made with the mgmt_record_dir option of a debug build
+ * can be added to the corpus.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mgmtproto.h"
+
+#define NTYPES (mgmt_rtmsg_type_max + 1) /* the last one counts responses */
+
+static const char *const type_names[NTYPES] = {
+    "ready",    "stop",    "bytecount", "echo",   "hold",    "log",
+    "password", "proxy",   "state",     "needok", "needstr", "pkcs11-id-count",
+    "infomsg",  "timeout", "validate",  "response"
+};
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+/* A connection as far as the stub handlers need it */
+struct connection
+{
+    mgmt_cmdq_t cmds;
+    int type;                 /* type of the line being handled */
+    uint64_t digest;          /* of the lines passed to the handlers */
+    unsigned long answered;   /* responses that reached the command they answer */
+    unsigned long mismatched; /* responses that did not */
+    unsigned long errors;     /* commands that failed */
+    int pkcs11_ids;           /* PKCS#11 ids still to be read */
+};
+
+typedef struct connection connection_t;
+
+/* A recording: the data received and the length of each read */
+typedef struct
+{
+    char name[256];
+    char *data;
+    size_t size;
+    uint32_t *reads;
+    size_t nreads;
+} recording_t;
+
+/* Lines handled and time spent on them by type */
+typedef struct
+{
+    unsigned long lines[NTYPES];
+    double time[NTYPES];
+    double max[NTYPES];   /* of a single line */
+    unsigned long allocs; /* of the receive buffer and the inbox */
+} timing_t;
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+mix(connection_t *c, int type, const char *text, size_t len)
+{
+    c->digest = (c->digest ^ (unsigned char)type) * 1099511628211ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        c->digest = (c->digest ^ (unsigned char)text[i]) * 1099511628211ULL;
+    }
+}
+
+static void
+command(connection_t *c, const char *cmd, mgmt_msg_func handler, mgmt_cmd_type type)
+{
+    if (!mgmt_cmdq_add(&c->cmds, cmd, handler, type))
+    {
+        exit(2);
+    }
+}
+
+/* Check that a response to a command is the one expected */
+static void
+expect(connection_t *c, const char *msg, const char *expected)
+{
+    if (!msg)
+    {
+        c->errors++;
+    }
+    else if (strstr(msg, expected))
+    {
+        c->answered++;
+        mix(c, NTYPES, msg, strlen(msg));
+    }
+    else if (++c->mismatched <= 5)
+    {
+        fprintf(stderr,
+                "  response \"%s\" to a command expecting \"%s\"\n",
+                msg,
+                expected);
+    }
+}
+
+#define EXPECT(name, expected)                  \
+    static void name(connection_t *c, char *msg) \
+    {                                            \
+        expect(c, msg, expected);                \
+    }
+
+EXPECT(on_password_ok, "password is correct")
+EXPECT(on_hold_off, "hold flag set to OFF")
+EXPECT(on_hold_release, "hold release succeeded")
+EXPECT(on_state_on, "state notification set to ON")
+EXPECT(on_bytecount, "bytecount interval changed")
+EXPECT(on_username, "username entered")
+EXPECT(on_password, "password entered")
+EXPECT(on_needok, "needok-confirmation entered")
+EXPECT(on_needstr, "needstr-string entered")
+EXPECT(on_state, ",")
+EXPECT(on_pkcs11_entry_line, ">PKCS11ID-ENTRY:")
+
+/* "log on all" and "echo on all": the response to "on", then the history */
+static void
+on_log_all(connection_t *c, char *msg)
+{
+    expect(c, msg, msg && strchr(msg, ',') ? "," : "log notification set to ON");
+}
+
+static void
+on_echo_all(connection_t *c, char *msg)
+{
+    expect(c, msg, msg && strchr(msg, ',') ? "," : "echo notification set to ON");
+}
+
+/* The commands OnReady() sends */
+static void
+on_pid(connection_t *c, char *msg)
+{
+    expect(c, msg, "pid=");
+    command(c, "state on", on_state_on, regular);
+    command(c, "log on all", on_log_all, combined);
+    command(c, "echo on all", on_echo_all, combined);
+    command(c, "bytecount 5", on_bytecount, regular);
+    command(c, "state", on_state, regular);
+}
+
+static void
+on_pkcs11_entry(connection_t *c, char *msg)
+{
+    on_pkcs11_entry_line(c, msg);
+    if (--c->pkcs11_ids == 0)
+    {
+        command(c, "needstr 'pkcs11-id-request' 'pkcs11:serial=1'", on_needstr, regular);
+    }
+}
+
+static void
+on_pkcs11_count(connection_t *c, char *msg)
+{
+    char cmd[64];
+
+    expect(c, msg, ">PKCS11ID-COUNT:");
+    c->pkcs11_ids = msg ? atoi(msg + 16) : 0;
+    for (int i = 0; i < c->pkcs11_ids; i++)
+    {
+        snprintf(cmd, sizeof(cmd), "pkcs11-id-get %d", i);
+        command(c, cmd, on_pkcs11_entry, regular);
+    }
+}
+
+/* Real-time notifications are mixed into the digest without their time */
+static void
+rt_mix(connection_t *c, char *msg)
+{
+    const char *text = strchr(msg, ',');
+
+    text = text ? text + 1 : msg;
+    mix(c, c->type, text, strlen(text));
+}
+
+/* Joined log lines are mixed in one by one, as joining depends on the reads */
+static void
+rt_log(connection_t *c, char *msg)
+{
+    for (char *line = msg, *end; line; line = end ? end + 1 : NULL)
+    {
+        const char *text = strchr(line, ',');
+
+        end = strchr(line, '\n');
+        text = text && (!end || text < end) ? text + 1 : line;
+        mix(c, log_, text, end ? (size_t)(end - text) : strlen(text));
+    }
+}
+
+static void
+rt_hold(connection_t *c, char *msg)
+{
+    rt_mix(c, msg);
+    command(c, "hold off", on_hold_off, regular);
+    command(c, "hold release", on_hold_release, regular);
+}
+
+static void
+rt_password(connection_t *c, char *msg)
+{
+    rt_mix(c, msg);
+    if (strncmp(msg, "Need 'Auth'", 11) == 0)
+    {
+        command(c, "username \"Auth\" \"user\"", on_username, regular);
+        command(c, "password \"Auth\" \"secret\"", on_password, regular);
+    }
+}
+
+static void
+rt_needok(connection_t *c, char *msg)
+{
+    rt_mix(c, msg);
+    command(c, "needok 'token-insertion-request' ok", on_needok, regular);
+}
+
+static void
+rt_needstr(connection_t *c, char *msg)
+{
+    rt_mix(c, msg);
+    command(c, "pkcs11-id-count", on_pkcs11_count, regular);
+}
+
+static const mgmt_msg_func handlers[mgmt_rtmsg_type_max] = {
+    [bytecount_] = rt_mix, [echo_] = rt_mix,         [hold_] = rt_hold,
+    [log_] = rt_log,       [password_] = rt_password, [proxy_] = rt_mix,
+    [state_] = rt_mix,     [needok_] = rt_needok,     [needstr_] = rt_needstr,
+    [infomsg_] = rt_mix,
+};
+
+/* Handle the lines in inbox the way ReadManagement() does */
+static void
+handle_lines(connection_t *c, mgmt_buf_t *inbox, timing_t *t)
+{
+    char *end = inbox->data + inbox->len;
+
+    for (char *line = inbox->data, *next; line < end; line = next)
+    {
+        unsigned long count = 1;
+        size_t len;
+        double start = t ? now() : 0;
+
+        next = line + strlen(line) + 1;
+        if (strncmp(line, ">LOG:", 5) == 0)
+        {
+            next = mgmt_join_log_lines(line, end, &count);
+        }
+        c->type = line[0] == '>' ? (int)mgmt_rtmsg_type_of(line + 1, &len) : mgmt_rtmsg_type_max;
+
+        if (strcmp(line, "ENTER PASSWORD:") == 0)
+        {
+            command(c, "management-password", on_password_ok, regular);
+        }
+        else if (mgmt_dispatch(&c->cmds, handlers, c, line) & MGMT_DISPATCH_BANNER)
+        {
+            /* the probe DispatchLine() sends */
+            mix(c, ready_, line, strlen(line));
+            command(c, "pid", on_pid, regular);
+        }
+
+        if (t)
+        {
+            double d = now() - start;
+
+            t->lines[c->type] += count;
+            t->time[c->type] += d;
+            if (d / count > t->max[c->type])
+            {
+                t->max[c->type] = d / count;
+            }
+        }
+    }
+    inbox->len = 0;
+}
+
+/*
+ * Replay a recording in reads of its original lengths if chunk is 0, and
+ * else of random lengths up to chunk. Returns the digest of the lines
+ * passed to the handlers.
+ */
+static uint64_t
+replay(const recording_t *r, size_t chunk, timing_t *t, connection_t *c)
+{
+    mgmt_buf_t rbuf = { 0 }, inbox = { 0 };
+    size_t offset = 0, i = 0;
+
+    memset(c, 0, sizeof(*c));
+    c->digest = 14695981039346656037ULL;
+
+    while (offset < r->size)
+    {
+        size_t n = chunk ? 1 + rnd() % chunk : r->reads[i++];
+        size_t rbuf_size = rbuf.size, inbox_size = inbox.size;
+
+        n = n < r->size - offset ? n : r->size - offset;
+        if (!mgmt_buf_reserve(&rbuf, n))
+        {
+            exit(2);
+        }
+        memcpy(rbuf.data + rbuf.len, r->data + offset, n);
+        rbuf.len += n;
+        offset += n;
+
+        if (!mgmt_split_lines(&rbuf, &inbox))
+        {
+            exit(2);
+        }
+        if (t)
+        {
+            t->allocs += (rbuf.size != rbuf_size) + (inbox.size != inbox_size);
+        }
+        handle_lines(c, &inbox, t);
+    }
+
+    CHECK(rbuf.len == 0);
+    mgmt_buf_free(&rbuf);
+    mgmt_buf_free(&inbox);
+    return c->digest;
+}
+
+static uint32_t
+get32(const unsigned char *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Load a recording, whose headers are little-endian as written on Windows */
+static int
+load(const char *path, recording_t *r)
+{
+    unsigned char hdr[sizeof(mgmt_record_t)];
+    char magic[sizeof(MGMT_RECORD_MAGIC) - 1];
+    size_t alloc = 0, reads_alloc = 0;
+    FILE *f = fopen(path, "rb");
+
+    memset(r, 0, sizeof(*r));
+    if (!f)
+    {
+        return 0;
+    }
+    if (fread(magic, sizeof(magic), 1, f) != 1
+        || memcmp(magic, MGMT_RECORD_MAGIC, sizeof(magic)) != 0)
+    {
+        fclose(f);
+        return 0;
+    }
+    while (fread(hdr, sizeof(hdr), 1, f) == 1)
+    {
+        uint32_t len = get32(hdr + 8);
+
+        if (r->size + len > alloc)
+        {
+            alloc = 2 * (r->size + len);
+            r->data = realloc(r->data, alloc);
+        }
+        if (r->nreads == reads_alloc)
+        {
+            reads_alloc = reads_alloc ? 2 * reads_alloc : 1024;
+            r->reads = realloc(r->reads, reads_alloc * sizeof(*r->reads));
+        }
+        if (!r->data || !r->reads)
+        {
+            exit(2);
+        }
+        if (fread(r->data + r->size, 1, len, f) != len)
+        {
+            break;
+        }
+        r->size += len;
+        r->reads[r->nreads++] = len;
+    }
+    fclose(f);
+    return r->size > 0;
+}
+
+/* Replay r with different read boundaries and check the handler calls */
+static void
+test_recording(const recording_t *r)
+{
+    connection_t c;
+    uint64_t digest = replay(r, 0, NULL, &c);
+    unsigned long answered = c.answered;
+
+    CHECK(c.cmds.queue == NULL);
+    CHECK(c.mismatched == 0 && c.errors == 0);
+    mgmt_cmdq_clear(&c.cmds);
+
+    for (size_t chunk = 1; chunk <= 4096; chunk *= 8)
+    {
+        CHECK(replay(r, chunk, NULL, &c) == digest);
+        CHECK(c.cmds.queue == NULL && c.answered == answered);
+        mgmt_cmdq_clear(&c.cmds);
+    }
+
+    printf("%s: %zu bytes in %zu reads, %lu responses matched, same handler calls "
+           "for reads of 1 to 4096 bytes\n",
+           r->name,
+           r->size,
+           r->nreads,
+           answered);
+}
+
+/* An error answers one part of a combined command, not both */
+static void
+test_error(void)
+{
+    char lines[][64] = {
+        "ERROR: unknown command",
+        ">LOG:1700000000,N,log notification",
+        "1700000001,I,log history",
+        "END",
+        "SUCCESS: bytecount interval changed",
+    };
+    connection_t c;
+
+    memset(&c, 0, sizeof(c));
+    command(&c, "log on all", on_log_all, combined);
+    command(&c, "bytecount 5", on_bytecount, regular);
+    for (size_t i = 0; i < sizeof(lines) / sizeof(*lines); i++)
+    {
+        mgmt_dispatch(&c.cmds, handlers, &c, lines[i]);
+    }
+    CHECK(c.errors == 1);
+    CHECK(c.answered == 2 && c.mismatched == 0);
+    CHECK(c.cmds.queue == NULL && c.cmds.bytes == 0);
+    mgmt_cmdq_clear(&c.cmds);
+}
+
+static void
+bench(const recording_t *recs, size_t n, int replays)
+{
+    timing_t t = { 0 };
+    connection_t c;
+    unsigned long long bytes = 0;
+    unsigned long lines = 0;
+    double start = now(), total;
+
+    for (int i = 0; i < replays; i++)
+    {
+        for (size_t j = 0; j < n; j++)
+        {
+            replay(&recs[j], 0, &t, &c);
+            mgmt_cmdq_clear(&c.cmds);
+            bytes += recs[j].size;
+        }
+    }
+    total = now() - start;
+
+    for (int i = 0; i < NTYPES; i++)
+    {
+        lines += t.lines[i];
+    }
+    printf("replayed %.1f MB, %lu lines in %.3f s: %.0f MB/s, %.1fM lines/s, "
+           "%.5f allocations/line\n",
+           bytes / 1048576.0,
+           lines,
+           total,
+           bytes / total / 1048576.0,
+           lines / total / 1e6,
+           (double)t.allocs / lines);
+    printf("  %-16s %10s %12s %12s\n", "type", "lines", "avg ns/line", "max us/line");
+    for (int i = 0; i < NTYPES; i++)
+    {
+        if (t.lines[i])
+        {
+            printf("  %-16s %10lu %12.0f %12.2f\n",
+                   type_names[i],
+                   t.lines[i],
+                   1e9 * t.time[i] / t.lines[i],
+                   1e6 * t.max[i]);
+        }
+    }
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+    return strcmp(((const recording_t *)a)->name, ((const recording_t *)b)->name);
+}
+
+int
+main(int argc, char **argv)
+{
+    int replays = argc > 1 ? atoi(argv[1]) : 20;
+    const char *dir = argc > 2 ? argv[2] : "tests/mgmt";
+    recording_t recs[64];
+    size_t n = 0;
+    struct dirent *de;
+    char path[4096];
+    DIR *d = opendir(dir);
+
+    if (!d)
+    {
+        perror(dir);
+        return 1;
+    }
+    while ((de = readdir(d)) != NULL && n < sizeof(recs) / sizeof(*recs))
+    {
+        size_t len = strlen(de->d_name);
+
+        if (len < 6 || strcmp(de->d_name + len - 5, ".mgmt") != 0)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (!load(path, &recs[n]))
+        {
+            fprintf(stderr, "FAIL: %s is not a management recording\n", path);
+            failures++;
+            continue;
+        }
+        snprintf(recs[n].name, sizeof(recs[n].name), "%s", de->d_name);
+        n++;
+    }
+    closedir(d);
+    CHECK(n > 0);
+    qsort(recs, n, sizeof(*recs), compare_names);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        test_recording(&recs[i]);
+    }
+    test_error();
+    bench(recs, n, replays);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        free(recs[i].data);
+        free(recs[i].reads);
+    }
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
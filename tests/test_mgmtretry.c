@@ -0,0 +1,265 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Test of the retries to connect to a management interface.
+ *
+ *   test_mgmtretry [connections] [milliseconds until the daemon listens]
+ *
+ * A number of connections (default 16) connect to a local port that
+ * refuses connections until a simulated daemon starts listening on it
+ * (default after 400 ms). Each retries with the delays of
+ * mgmt_retry_delay() and its own random state, as ScheduleConnect()
+ * does, and must connect within one maximum delay of the daemon coming
+ * up. The delays must stay within +/-25% of the backoff, and the
+ * connections must not retry in lock-step. The attempts and the time
+ * to connect are reported.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "mgmtproto.h"
+
+#define RETRY_MIN 50   /* as MGMT_RETRY_MIN in manage.c */
+#define RETRY_MAX 2000 /* as MGMT_RETRY_MAX */
+#define MAX_CONNS 256
+
+static int failures;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+typedef struct
+{
+    uint32_t seed;        /* random state of the retry delays */
+    int attempts;         /* number of connection attempts */
+    double connect_time;  /* seconds it took to connect, 0 if it did not */
+    int delays_in_range;  /* all delays within +/-25% of the backoff */
+    unsigned int delay_2; /* delay after the second attempt */
+} conn_t;
+
+static struct sockaddr_in addr;
+static double start;
+static int daemon_delay_ms;
+static int nconn;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+sleep_ms(unsigned int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+/* The daemon: listen on the port once it has come up and take connections in */
+static void *
+daemon_thread(void *arg)
+{
+    int sk = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+    (void)arg;
+    sleep_ms((unsigned int)daemon_delay_ms);
+    setsockopt(sk, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sk, MAX_CONNS) != 0)
+    {
+        perror("daemon");
+        exit(2);
+    }
+    for (int i = 0; i < nconn; i++)
+    {
+        int c = accept(sk, NULL, NULL);
+
+        if (c >= 0)
+        {
+            close(c);
+        }
+    }
+    close(sk);
+    return NULL;
+}
+
+/* Connect as OpenManagement() and RetryManagement() do, with a non-blocking connect */
+static void *
+conn_thread(void *arg)
+{
+    conn_t *c = arg;
+
+    c->delays_in_range = 1;
+    while (now() - start < 15)
+    {
+        int sk = socket(AF_INET, SOCK_STREAM, 0), err = 0;
+        socklen_t len = sizeof(err);
+        struct pollfd pfd = { sk, POLLOUT, 0 };
+        unsigned int backoff, delay;
+
+        c->attempts++;
+        if (sk < 0 || fcntl(sk, F_SETFL, O_NONBLOCK) != 0)
+        {
+            exit(2);
+        }
+        if (connect(sk, (struct sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS)
+        {
+            err = errno;
+        }
+        else if (poll(&pfd, 1, 1000) == 1)
+        {
+            getsockopt(sk, SOL_SOCKET, SO_ERROR, &err, &len);
+        }
+        else
+        {
+            err = ETIMEDOUT;
+        }
+        close(sk);
+        if (err == 0)
+        {
+            c->connect_time = now() - start;
+            return NULL;
+        }
+
+        backoff = RETRY_MIN << (c->attempts - 1 < 16 ? c->attempts - 1 : 16);
+        backoff = backoff < RETRY_MAX ? backoff : RETRY_MAX;
+        delay = mgmt_retry_delay(&c->seed, c->attempts, RETRY_MIN, RETRY_MAX);
+        if (delay < backoff - backoff / 4 || delay > backoff - backoff / 4 + backoff / 2)
+        {
+            c->delays_in_range = 0;
+        }
+        if (c->attempts == 2)
+        {
+            c->delay_2 = delay;
+        }
+        sleep_ms(delay);
+    }
+    return NULL;
+}
+
+/* Find a free local port, which refuses connections until the daemon listens */
+static void
+pick_port(void)
+{
+    socklen_t len = sizeof(addr);
+    int sk = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || getsockname(sk, (struct sockaddr *)&addr, &len) != 0)
+    {
+        perror("bind");
+        exit(2);
+    }
+    close(sk);
+}
+
+int
+main(int argc, char **argv)
+{
+    static conn_t conns[MAX_CONNS];
+    pthread_t daemon, threads[MAX_CONNS];
+    unsigned int distinct[MAX_CONNS];
+    int ndistinct = 0, max_attempts = 0, connected = 0;
+    double max_time = 0, sum_time = 0;
+
+    nconn = argc > 1 ? atoi(argv[1]) : 16;
+    nconn = nconn < 1 ? 1 : nconn > MAX_CONNS ? MAX_CONNS : nconn;
+    daemon_delay_ms = argc > 2 ? atoi(argv[2]) : 400;
+
+    pick_port();
+    start = now();
+    pthread_create(&daemon, NULL, daemon_thread, NULL);
+    for (int i = 0; i < nconn; i++)
+    {
+        /* seeded as in OpenManagement(): from the connection, the time and the thread */
+        conns[i].seed = (uint32_t)((uintptr_t)&conns[i] * 2654435761u)
+                        ^ (uint32_t)(now() * 1000) ^ (uint32_t)i;
+        pthread_create(&threads[i], NULL, conn_thread, &conns[i]);
+    }
+    for (int i = 0; i < nconn; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_join(daemon, NULL);
+
+    for (int i = 0; i < nconn; i++)
+    {
+        conn_t *c = &conns[i];
+        int j;
+
+        connected += c->connect_time > 0;
+        CHECK(c->delays_in_range);
+        CHECK(c->attempts > 1);
+        CHECK(c->connect_time >= daemon_delay_ms / 1000.0);
+        CHECK(c->connect_time < (daemon_delay_ms + RETRY_MAX * 1.25) / 1000 + 0.5);
+        max_attempts = c->attempts > max_attempts ? c->attempts : max_attempts;
+        max_time = c->connect_time > max_time ? c->connect_time : max_time;
+        sum_time += c->connect_time;
+
+        for (j = 0; j < ndistinct && distinct[j] != c->delay_2; j++)
+        {
+        }
+        if (j == ndistinct)
+        {
+            distinct[ndistinct++] = c->delay_2;
+        }
+    }
+    CHECK(connected == nconn);
+    /* the delays after the second attempt spread over 75-125 ms */
+    CHECK(nconn < 4 || ndistinct >= nconn / 2);
+
+    printf("%d connections to a daemon listening after %d ms: up to %d attempts, "
+           "connected after %.0f ms on average, %.0f ms at most, "
+           "%d distinct delays after the second attempt\n",
+           nconn,
+           daemon_delay_ms,
+           max_attempts,
+           1000 * sum_time / nconn,
+           1000 * max_time,
+           ndistinct);
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures != 0;
+}
@@ -0,0 +1,401 @@
+/*
+ *  OpenVPN-GUI -- A Windows GUI for OpenVPN.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <windows.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "options.h"
+#include "openvpn.h"
+#include "openvpn-gui-res.h"
+#include "localization.h"
+#include "misc.h"
+#include "logmerge.h"
+#include "timeline.h"
+
+extern options_t o;
+
+/* Interval in msec for merging new log lines into the timeline */
+#define TIMELINE_REFRESH_INTERVAL 1000
+
+/*
+ * State of the timeline window. Rows refer to the lines held in the log
+ * buffers of the connections, which are not copied. Connections are
+ * never freed, so rows can keep pointers to them.
+ */
+static struct
+{
+    HWND hwnd;
+    logmerge_row_t *rows; /* owner is the connection of the line, source its index in conns */
+    size_t count;
+    size_t alloc;
+    connection_t **conns;       /* the connections in list order */
+    logmerge_source_t *sources; /* the log buffer of each connection */
+    size_t nsources;
+    log_date_t date;
+    LONG width; /* width of the widest row drawn */
+} tl;
+
+static BOOL
+TimelineAddRow(size_t source, unsigned long long seq, time_t timestamp)
+{
+    if (tl.count == tl.alloc)
+    {
+        size_t alloc = tl.alloc ? 2 * tl.alloc : 1024;
+        logmerge_row_t *rows = realloc(tl.rows, alloc * sizeof(*rows));
+        if (!rows)
+        {
+            return FALSE;
+        }
+        tl.rows = rows;
+        tl.alloc = alloc;
+    }
+    tl.rows[tl.count].owner = tl.conns[source];
+    tl.rows[tl.count].seq = seq;
+    tl.rows[tl.count].timestamp = timestamp;
+    tl.rows[tl.count].source = source;
+    tl.count++;
+
+    return TRUE;
+}
+
+/*
+ * Set up a merge source for each connection, keeping the position up
+ * to which lines of existing connections were merged. Rows are
+ * renumbered if connections were added or removed.
+ */
+static BOOL
+TimelineSetSources(void)
+{
+    size_t n = 0;
+    connection_t **conns;
+    logmerge_source_t *sources;
+
+    for (connection_t *c = o.chead; c; c = c->next)
+    {
+        n++;
+    }
+    conns = calloc(n ? n : 1, sizeof(*conns));
+    sources = calloc(n ? n : 1, sizeof(*sources));
+    if (!conns || !sources)
+    {
+        free(conns);
+        free(sources);
+        return FALSE;
+    }
+
+    n = 0;
+    for (connection_t *c = o.chead; c; c = c->next, n++)
+    {
+        conns[n] = c;
+        sources[n].lb = &c->log_lines;
+        for (size_t i = 0; i < tl.nsources; i++)
+        {
+            if (tl.conns[i] == c)
+            {
+                sources[n].next = tl.sources[i].next;
+                break;
+            }
+        }
+        sources[n].end = ULLONG_MAX;
+    }
+
+    if (n != tl.nsources || memcmp(conns, tl.conns, n * sizeof(*conns)) != 0)
+    {
+        for (size_t i = 0; i < tl.count; i++)
+        {
+            size_t j = 0;
+            while (j < n && conns[j] != tl.rows[i].owner)
+            {
+                j++;
+            }
+            tl.rows[i].source = j < n ? j : SIZE_MAX;
+        }
+    }
+
+    free(tl.conns);
+    free(tl.sources);
+    tl.conns = conns;
+    tl.sources = sources;
+    tl.nsources = n;
+
+    return TRUE;
+}
+
+/*
+ * Merge the lines logged since the last call into the timeline and drop
+ * the rows of lines no longer held. Lines may be logged with an earlier
+ * timestamp than lines merged before, e.g., the history sent on
+ * attaching to a connection, so they are inserted in order. Returns the
+ * number of rows added before row top less the number dropped.
+ */
+static int
+TimelineMerge(size_t top)
+{
+    size_t kept = 0;
+    size_t dropped_above = 0;
+    size_t inserted_above = 0;
+    size_t first;
+    logmerge_t merge;
+    connection_t *c;
+
+    if (!TimelineSetSources())
+    {
+        return 0;
+    }
+
+    /* the log buffers must not change while they are merged */
+    for (c = o.chead; c; c = c->next)
+    {
+        AcquireSRWLockShared(&c->log_lock);
+    }
+
+    for (size_t i = 0; i < tl.count; i++)
+    {
+        c = tl.rows[i].owner;
+        if (tl.rows[i].seq >= c->log_lines.dropped)
+        {
+            tl.rows[kept++] = tl.rows[i];
+        }
+        else if (i < top)
+        {
+            dropped_above++;
+        }
+    }
+    tl.count = kept;
+    top -= dropped_above;
+
+    first = tl.count;
+    if (logmerge_init(&merge, tl.sources, tl.nsources))
+    {
+        const log_line_t *line;
+        unsigned long long seq;
+        size_t i;
+
+        while ((line = logmerge_next(&merge, &i, &seq)) != NULL)
+        {
+            if (!TimelineAddRow(i, seq, line->timestamp))
+            {
+                break;
+            }
+        }
+        logmerge_free(&merge);
+    }
+
+    for (c = o.chead; c; c = c->next)
+    {
+        ReleaseSRWLockShared(&c->log_lock);
+    }
+
+    /* the merge expects the lines of a buffer in timestamp order, but
+     * lines sent by openvpn may be older than lines logged by the GUI */
+    inserted_above = logmerge_insert(tl.rows, first, tl.count, top);
+
+    return (int)inserted_above - (int)dropped_above;
+}
+
+/* Merge new lines and update the list, following the end if in view */
+static void
+TimelineRefresh(void)
+{
+    HWND lb = GetDlgItem(tl.hwnd, ID_LST_TIMELINE);
+    int top = SendMessage(lb, LB_GETTOPINDEX, 0, 0);
+    int count = SendMessage(lb, LB_GETCOUNT, 0, 0);
+    BOOL follow = TRUE;
+    RECT rect, item;
+
+    if (count > 0)
+    {
+        GetClientRect(lb, &rect);
+        follow = SendMessage(lb, LB_GETITEMRECT, count - 1, (LPARAM)&item) != LB_ERR
+                 && item.bottom <= rect.bottom;
+    }
+
+    top += TimelineMerge(top);
+    count = (int)min(tl.count, INT_MAX);
+
+    SendMessage(lb, WM_SETREDRAW, FALSE, 0);
+    SendMessage(lb, LB_SETCOUNT, count, 0);
+    SendMessage(lb, LB_SETTOPINDEX, follow ? count - 1 : max(top, 0), 0);
+    SendMessage(lb, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(lb, NULL, TRUE);
+
+    /* widen the horizontal scroll range to the rows drawn */
+    if (tl.width > SendMessage(lb, LB_GETHORIZONTALEXTENT, 0, 0))
+    {
+        SendMessage(lb, LB_SETHORIZONTALEXTENT, tl.width, 0);
+    }
+}
+
+/* Draw a row as "<date> <connection>: <text>" */
+static void
+TimelineDrawRow(const DRAWITEMSTRUCT *dis)
+{
+    COLORREF text_clr = GetSysColor(COLOR_WINDOWTEXT);
+    WCHAR date[LOG_DATE_LEN + 1];
+    WCHAR *text = NULL;
+    WCHAR *row = NULL;
+    size_t len;
+    SIZE size;
+
+    if (dis->itemID < tl.count)
+    {
+        connection_t *c = tl.rows[dis->itemID].owner;
+        unsigned long long seq = tl.rows[dis->itemID].seq;
+        const log_line_t *line = NULL;
+
+        AcquireSRWLockShared(&c->log_lock);
+        if (seq >= c->log_lines.dropped)
+        {
+            line = logbuf_get(&c->log_lines, (size_t)(seq - c->log_lines.dropped));
+        }
+        if (line)
+        {
+            logbuf_format_date(&tl.date, line->timestamp, date);
+            text = Widen(line->text);
+            if ((line->flags & LOG_LINE_ERROR) && o.clr_error)
+            {
+                text_clr = o.clr_error;
+            }
+            else if ((line->flags & LOG_LINE_WARNING) && o.clr_warning)
+            {
+                text_clr = o.clr_warning;
+            }
+        }
+        ReleaseSRWLockShared(&c->log_lock);
+
+        if (text)
+        {
+            len = LOG_DATE_LEN + wcslen(c->config_name) + wcslen(text) + 4;
+            row = malloc(len * sizeof(*row));
+            if (row)
+            {
+                _snwprintf_s(row, len, _TRUNCATE, L"%ls %ls: %ls", date, c->config_name, text);
+            }
+        }
+    }
+
+    SetBkColor(dis->hDC, GetSysColor(COLOR_WINDOW));
+    SetTextColor(dis->hDC, text_clr);
+    ExtTextOutW(dis->hDC,
+                dis->rcItem.left + DPI_SCALE(2),
+                dis->rcItem.top,
+                ETO_OPAQUE | ETO_CLIPPED,
+                &dis->rcItem,
+                row ? row : L"",
+                row ? (UINT)wcslen(row) : 0,
+                NULL);
+
+    if (row && GetTextExtentPoint32W(dis->hDC, row, (int)wcslen(row), &size))
+    {
+        tl.width = max(tl.width, size.cx + DPI_SCALE(4));
+    }
+    free(row);
+    free(text);
+}
+
+static INT_PTR CALLBACK
+TimelineDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    HWND lb;
+
+    switch (msg)
+    {
+        case WM_INITDIALOG:
+            tl.hwnd = hwndDlg;
+            SetStatusWinIcon(hwndDlg, ID_ICO_APP);
+
+            lb = GetDlgItem(hwndDlg, ID_LST_TIMELINE);
+            HDC dc = GetDC(lb);
+            if (dc)
+            {
+                TEXTMETRIC tm;
+                HGDIOBJ old_font = SelectObject(dc, (HFONT)SendMessage(lb, WM_GETFONT, 0, 0));
+                if (GetTextMetrics(dc, &tm))
+                {
+                    SendMessage(lb, LB_SETITEMHEIGHT, 0, tm.tmHeight + tm.tmExternalLeading);
+                }
+                SelectObject(dc, old_font);
+                ReleaseDC(lb, dc);
+            }
+
+            TimelineRefresh();
+            SetTimer(hwndDlg, IDT_TIMELINE_REFRESH, TIMELINE_REFRESH_INTERVAL, NULL);
+            return TRUE;
+
+        case WM_SIZE:
+            MoveWindow(
+                GetDlgItem(hwndDlg, ID_LST_TIMELINE), 0, 0, LOWORD(lParam), HIWORD(lParam), TRUE);
+            return TRUE;
+
+        case WM_DRAWITEM:
+            if (wParam == ID_LST_TIMELINE)
+            {
+                TimelineDrawRow((const DRAWITEMSTRUCT *)lParam);
+                return TRUE;
+            }
+            break;
+
+        case WM_TIMER:
+            if (wParam == IDT_TIMELINE_REFRESH)
+            {
+                TimelineRefresh();
+            }
+            break;
+
+        case WM_COMMAND:
+            if (LOWORD(wParam) == IDCANCEL)
+            {
+                DestroyWindow(hwndDlg);
+                return TRUE;
+            }
+            break;
+
+        case WM_CLOSE:
+            DestroyWindow(hwndDlg);
+            return TRUE;
+
+        case WM_NCDESTROY:
+            KillTimer(hwndDlg, IDT_TIMELINE_REFRESH);
+            free(tl.rows);
+            free(tl.conns);
+            free(tl.sources);
+            CLEAR(tl);
+            break;
+    }
+    return FALSE;
+}
+
+void
+ShowLogTimeline(void)
+{
+    if (tl.hwnd)
+    {
+        ShowWindow(tl.hwnd, SW_RESTORE);
+        SetForegroundWindow(tl.hwnd);
+        return;
+    }
+    CreateLocalizedDialog(ID_DLG_TIMELINE, TimelineDialogFunc);
+}
@@ -248,6 +248,8 @@ CreatePopupMenus()
         AppendMenu(
             hMenuImport, MF_STRING, IDM_IMPORT_URL, LoadLocalizedString(IDS_MENU_IMPORT_URL));
 
+        AppendMenu(hMenu, MF_STRING, IDM_SEARCHLOGS, LoadLocalizedString(IDS_MENU_SEARCHLOGS));
+        AppendMenu(hMenu, MF_STRING, IDM_TIMELINE, LoadLocalizedString(IDS_MENU_TIMELINE));
         AppendMenu(hMenu, MF_STRING, IDM_SETTINGS, LoadLocalizedString(IDS_MENU_SETTINGS));
         AppendMenu(hMenu, MF_STRING, IDM_CLOSE, LoadLocalizedString(IDS_MENU_CLOSE));
 
@@ -325,6 +327,8 @@ CreatePopupMenus()
         AppendMenu(
             hMenuImport, MF_STRING, IDM_IMPORT_URL, LoadLocalizedString(IDS_MENU_IMPORT_URL));
 
+        AppendMenu(hMenu, MF_STRING, IDM_SEARCHLOGS, LoadLocalizedString(IDS_MENU_SEARCHLOGS));
+        AppendMenu(hMenu, MF_STRING, IDM_TIMELINE, LoadLocalizedString(IDS_MENU_TIMELINE));
         AppendMenu(hMenu, MF_STRING, IDM_SETTINGS, LoadLocalizedString(IDS_MENU_SETTINGS));
         AppendMenu(hMenu, MF_STRING, IDM_CLOSE, LoadLocalizedString(IDS_MENU_CLOSE));
 
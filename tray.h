@@ -32,6 +32,8 @@
 #define IDM_IMPORT_FILE    225
 #define IDM_IMPORT_AS      226
 #define IDM_IMPORT_URL     227
+#define IDM_SEARCHLOGS     228
+#define IDM_TIMELINE       229
 
 #define IDM_CONNECTMENU    300
 #define IDM_DISCONNECTMENU (1 + IDM_CONNECTMENU)
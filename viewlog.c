@@ -25,8 +25,10 @@
 
 #include <windows.h>
 #include <stdio.h>
+#include <limits.h>
 #include <shellapi.h>
 #include <objbase.h>
+#include <commctrl.h>
 
 #include "tray.h"
 #include "openvpn.h"
@@ -34,9 +36,378 @@
 #include "options.h"
 #include "openvpn-gui-res.h"
 #include "localization.h"
+#include "misc.h"
+#include "logmap.h"
+#include "logrotate.h"
+#include "logsearch.h"
 
 extern options_t o;
 
+/* Maximum number of matching lines listed by the log search dialog */
+#define MAX_SEARCH_RESULTS 1000
+
+/* Number of lines at the end of a log shown before all lines are indexed */
+#define LOGVIEW_TAIL_LINES 5000
+
+/* Number of bytes indexed between checks for cancellation */
+#define LOGVIEW_SCAN_CHUNK (16 * 1024 * 1024)
+
+/* Interval in msec for checking the log for new lines */
+#define LOGVIEW_FOLLOW_INTERVAL 500
+
+static const WCHAR *logviewProp = L"logview";
+
+/* State of a log viewer window */
+struct log_view
+{
+    WCHAR path[MAX_PATH];
+    HWND hwnd;
+    logmap_t map;
+    logmap_lines_t lines; /* the lines shown */
+    logmap_lines_t *all;  /* all lines of the log, set by the index thread */
+    HANDLE thread;        /* thread indexing all lines */
+    volatile LONG stop;   /* tells the index thread to give up */
+    LONG width;           /* width of the widest line drawn */
+};
+
+/*
+ * Index all lines of the log in the background. The thread uses a
+ * mapping of its own as the window remaps the log when it grows.
+ */
+static DWORD WINAPI
+LogViewIndexThread(LPVOID arg)
+{
+    struct log_view *v = arg;
+    logmap_lines_t *l = malloc(sizeof(*l));
+    logmap_t m;
+    int ret = -1;
+
+    if (l && logmap_lines_init(l, 0))
+    {
+        if (logmap_open(&m, v->path))
+        {
+            do
+            {
+                ret = logmap_lines_scan(l, &m, LOGVIEW_SCAN_CHUNK);
+            } while (ret == 0 && !v->stop);
+            logmap_close(&m);
+        }
+        if (ret != 1)
+        {
+            logmap_lines_free(l);
+        }
+    }
+
+    if (ret == 1)
+    {
+        v->all = l;
+    }
+    else
+    {
+        free(l);
+    }
+    PostMessage(v->hwnd, WM_OVPN_LOGINDEX, 0, 0);
+
+    return 0;
+}
+
+static void
+LogViewStopIndex(struct log_view *v)
+{
+    if (v->thread)
+    {
+        InterlockedExchange(&v->stop, 1);
+        WaitForSingleObject(v->thread, INFINITE);
+        CloseHandle(v->thread);
+        v->thread = NULL;
+        InterlockedExchange(&v->stop, 0);
+    }
+    if (v->all)
+    {
+        logmap_lines_free(v->all);
+        free(v->all);
+        v->all = NULL;
+    }
+}
+
+/*
+ * Map the log and index its last lines, which is fast whatever the
+ * size of the log. The lines before are indexed by LogViewStartIndex().
+ */
+static BOOL
+LogViewLoad(struct log_view *v)
+{
+    LogViewStopIndex(v);
+    logmap_lines_free(&v->lines);
+    logmap_close(&v->map);
+
+    return logmap_open(&v->map, v->path)
+           && logmap_lines_init(&v->lines, logmap_tail(&v->map, LOGVIEW_TAIL_LINES))
+           && logmap_lines_scan(&v->lines, &v->map, UINT64_MAX) >= 0;
+}
+
+static void
+LogViewStartIndex(struct log_view *v)
+{
+    if (v->lines.base > 0)
+    {
+        v->thread = CreateThread(NULL, 0, LogViewIndexThread, v, 0, NULL);
+        if (v->thread)
+        {
+            SetThreadPriority(v->thread, THREAD_PRIORITY_BELOW_NORMAL);
+        }
+    }
+}
+
+/* Return true if the last line of the list is visible */
+static BOOL
+LogViewAtEnd(HWND lb)
+{
+    int count = SendMessage(lb, LB_GETCOUNT, 0, 0);
+    RECT rect, item;
+
+    if (count <= 0)
+    {
+        return TRUE;
+    }
+    GetClientRect(lb, &rect);
+    return SendMessage(lb, LB_GETITEMRECT, count - 1, (LPARAM)&item) != LB_ERR
+           && item.bottom <= rect.bottom;
+}
+
+/*
+ * Update the list to the lines indexed, showing line top first or the
+ * end of the log if follow is true.
+ */
+static void
+LogViewShow(struct log_view *v, uint64_t top, BOOL follow)
+{
+    HWND lb = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    int count = (int)min(v->lines.count, INT_MAX);
+
+    SendMessage(lb, WM_SETREDRAW, FALSE, 0);
+    SendMessage(lb, LB_SETCOUNT, count, 0);
+    SendMessage(lb, LB_SETTOPINDEX, follow ? count - 1 : (int)min(top, INT_MAX), 0);
+    SendMessage(lb, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(lb, NULL, TRUE);
+}
+
+/* Switch to the index of all lines once the index thread is done */
+static void
+LogViewIndexed(struct log_view *v)
+{
+    HWND lb = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    BOOL follow = LogViewAtEnd(lb);
+    uint64_t top = SendMessage(lb, LB_GETTOPINDEX, 0, 0);
+
+    /* ignore notifications of threads stopped by a reload */
+    if (!v->thread || WaitForSingleObject(v->thread, 0) != WAIT_OBJECT_0)
+    {
+        return;
+    }
+    CloseHandle(v->thread);
+    v->thread = NULL;
+
+    /* add the lines written since the thread mapped the log */
+    if (v->all && logmap_lines_scan(v->all, &v->map, UINT64_MAX) >= 0)
+    {
+        top += logmap_line_number(&v->map, v->all, v->lines.base);
+        logmap_lines_free(&v->lines);
+        v->lines = *v->all;
+        free(v->all);
+        v->all = NULL;
+        LogViewShow(v, top, follow);
+    }
+    LogViewStopIndex(v);
+}
+
+/* Show lines appended to the log since the last check */
+static void
+LogViewFollow(struct log_view *v)
+{
+    HWND lb = GetDlgItem(v->hwnd, ID_LST_LOGVIEW);
+    BOOL follow = LogViewAtEnd(lb);
+    uint64_t top = SendMessage(lb, LB_GETTOPINDEX, 0, 0);
+    uint64_t count = v->lines.count;
+    int ret = logmap_remap(&v->map);
+
+    if (ret < 0)
+    {
+        /* truncated or replaced: start over at its end */
+        if (LogViewLoad(v))
+        {
+            LogViewStartIndex(v);
+        }
+        LogViewShow(v, 0, TRUE);
+    }
+    else if (ret > 0 && logmap_lines_scan(&v->lines, &v->map, UINT64_MAX) >= 0
+             && v->lines.count != count)
+    {
+        LogViewShow(v, top, follow);
+    }
+
+    /* widen the horizontal scroll range to the lines drawn */
+    if (v->width > SendMessage(lb, LB_GETHORIZONTALEXTENT, 0, 0))
+    {
+        SendMessage(lb, LB_SETHORIZONTALEXTENT, v->width, 0);
+    }
+}
+
+static void
+LogViewDrawLine(struct log_view *v, const DRAWITEMSTRUCT *dis)
+{
+    const char *line = NULL;
+    WCHAR text[1024];
+    size_t len = 0;
+    int n = 0;
+    SIZE size;
+
+    if (dis->itemID != (UINT)-1)
+    {
+        line = logmap_line(&v->map, &v->lines, dis->itemID, &len);
+    }
+    if (line && len > 0)
+    {
+        n = MultiByteToWideChar(
+            CP_UTF8, 0, line, (int)min(len, _countof(text)), text, _countof(text));
+    }
+
+    SetBkColor(dis->hDC, GetSysColor(COLOR_WINDOW));
+    SetTextColor(dis->hDC, GetSysColor(COLOR_WINDOWTEXT));
+    ExtTextOutW(dis->hDC,
+                dis->rcItem.left + DPI_SCALE(2),
+                dis->rcItem.top,
+                ETO_OPAQUE | ETO_CLIPPED,
+                &dis->rcItem,
+                text,
+                n,
+                NULL);
+
+    if (n > 0 && GetTextExtentPoint32W(dis->hDC, text, n, &size))
+    {
+        v->width = max(v->width, size.cx + DPI_SCALE(4));
+    }
+}
+
+static INT_PTR CALLBACK
+LogViewDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    struct log_view *v;
+    HWND lb;
+
+    switch (msg)
+    {
+        case WM_INITDIALOG:
+            v = (struct log_view *)lParam;
+            if (!SetPropW(hwndDlg, logviewProp, (HANDLE)v))
+            {
+                DestroyWindow(hwndDlg);
+                return FALSE;
+            }
+            v->hwnd = hwndDlg;
+            SetStatusWinIcon(hwndDlg, ID_ICO_APP);
+            SetWindowTextW(hwndDlg, v->path);
+
+            lb = GetDlgItem(hwndDlg, ID_LST_LOGVIEW);
+            HDC dc = GetDC(lb);
+            if (dc)
+            {
+                TEXTMETRIC tm;
+                HGDIOBJ old_font = SelectObject(dc, (HFONT)SendMessage(lb, WM_GETFONT, 0, 0));
+                if (GetTextMetrics(dc, &tm))
+                {
+                    SendMessage(lb, LB_SETITEMHEIGHT, 0, tm.tmHeight + tm.tmExternalLeading);
+                }
+                SelectObject(dc, old_font);
+                ReleaseDC(lb, dc);
+            }
+
+            LogViewStartIndex(v);
+            LogViewShow(v, 0, TRUE);
+            SetTimer(hwndDlg, IDT_LOG_FOLLOW, LOGVIEW_FOLLOW_INTERVAL, NULL);
+            return TRUE;
+
+        case WM_SIZE:
+            MoveWindow(
+                GetDlgItem(hwndDlg, ID_LST_LOGVIEW), 0, 0, LOWORD(lParam), HIWORD(lParam), TRUE);
+            return TRUE;
+
+        case WM_DRAWITEM:
+            TRY_GETPROP(hwndDlg, logviewProp, v, FALSE);
+            if (wParam == ID_LST_LOGVIEW)
+            {
+                LogViewDrawLine(v, (const DRAWITEMSTRUCT *)lParam);
+                return TRUE;
+            }
+            break;
+
+        case WM_TIMER:
+            TRY_GETPROP(hwndDlg, logviewProp, v, FALSE);
+            if (wParam == IDT_LOG_FOLLOW)
+            {
+                LogViewFollow(v);
+            }
+            break;
+
+        case WM_OVPN_LOGINDEX:
+            TRY_GETPROP(hwndDlg, logviewProp, v, FALSE);
+            LogViewIndexed(v);
+            return TRUE;
+
+        case WM_COMMAND:
+            if (LOWORD(wParam) == IDCANCEL)
+            {
+                DestroyWindow(hwndDlg);
+                return TRUE;
+            }
+            break;
+
+        case WM_CLOSE:
+            DestroyWindow(hwndDlg);
+            return TRUE;
+
+        case WM_NCDESTROY:
+            KillTimer(hwndDlg, IDT_LOG_FOLLOW);
+            v = (struct log_view *)RemovePropW(hwndDlg, logviewProp);
+            if (v)
+            {
+                LogViewStopIndex(v);
+                logmap_lines_free(&v->lines);
+                logmap_close(&v->map);
+                free(v);
+            }
+            break;
+    }
+    return FALSE;
+}
+
+/*
+ * Show the log of a connection in a viewer window that maps the file
+ * instead of reading it, so that large logs open at once at their end.
+ * Returns false if the log could not be mapped.
+ */
+static BOOL
+OpenLogViewer(connection_t *c)
+{
+    struct log_view *v = calloc(1, sizeof(*v));
+
+    if (!v)
+    {
+        return FALSE;
+    }
+    _sntprintf_0(v->path, L"%ls", c->log_path);
+
+    if (!LogViewLoad(v)
+        || !CreateLocalizedDialogParam(ID_DLG_LOGVIEW, LogViewDialogFunc, (LPARAM)v))
+    {
+        logmap_lines_free(&v->lines);
+        logmap_close(&v->map);
+        free(v);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 void
 ViewLog(connection_t *c)
 {
@@ -48,6 +419,16 @@ ViewLog(connection_t *c)
     SECURITY_DESCRIPTOR sd;
     HINSTANCE status;
 
+    /* Appended logs grow without bound: show them in the log viewer
+     * which does not read them in full. The viewer keeps the log mapped,
+     * which blocks truncating it, so it is not used for logs truncated
+     * at every connect.
+     */
+    if (o.log_append && OpenLogViewer(c))
+    {
+        return;
+    }
+
     CLEAR(start_info);
     CLEAR(proc_info);
     CLEAR(sa);
@@ -164,3 +545,339 @@ EditConfig(connection_t *c)
     CloseHandle(proc_info.hThread);
     CloseHandle(proc_info.hProcess);
 }
+
+
+/* A connection log to search, copied as connections may change meanwhile */
+struct log_search_source
+{
+    connection_t *c;
+    WCHAR log_path[MAX_PATH];
+};
+
+/* A matching line found by the search thread */
+struct log_search_result
+{
+    connection_t *c;
+    WCHAR *text;
+};
+
+/*
+ * A search of the connection logs, run by a thread of its own so that
+ * the dialog and the tray stay responsive while large logs are read.
+ * The thread posts WM_OVPN_LOGSEARCH to the dialog when it is done.
+ */
+struct log_search
+{
+    HWND hwnd;
+    UINT id;            /* tells the results of successive searches apart */
+    HANDLE thread;
+    volatile LONG stop; /* tells the thread to give up */
+    char *query;
+    struct log_search_source *sources;
+    int nsources;
+    struct log_search_source *source; /* the log being searched */
+    struct log_search_result results[MAX_SEARCH_RESULTS];
+    int count;          /* number of results */
+    ULONGLONG elapsed;  /* msec taken by the search */
+};
+
+static const WCHAR *logsearchProp = L"logsearch";
+
+/* Return true if c is still in the list of connections */
+static BOOL
+IsConnection(const connection_t *c)
+{
+    for (const connection_t *p = o.chead; p; p = p->next)
+    {
+        if (p == c)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Record a matching line */
+static int
+AddSearchResult(void *arg, const char *line, size_t len, UNUSED unsigned long long offset)
+{
+    struct log_search *s = arg;
+    WCHAR text[512];
+    int n;
+
+    if (line == NULL)
+    {
+        /* a block was read */
+        return !s->stop;
+    }
+
+    /* long lines are cut: the list view displays 259 characters at most */
+    if (len > _countof(text) - 1)
+    {
+        len = _countof(text) - 1;
+    }
+    n = MultiByteToWideChar(CP_UTF8, 0, line, (int)len, text, _countof(text) - 1);
+    text[n] = L'\0';
+
+    s->results[s->count].c = s->source->c;
+    s->results[s->count].text = _wcsdup(text);
+    if (s->results[s->count].text)
+    {
+        s->count++;
+    }
+
+    return !s->stop && s->count < MAX_SEARCH_RESULTS;
+}
+
+/* Search the logs of all connections, newest generation first */
+static DWORD WINAPI
+LogSearchThread(LPVOID arg)
+{
+    struct log_search *s = arg;
+    WCHAR log_path[MAX_PATH];
+    WCHAR index_path[MAX_PATH + 4];
+    ULONGLONG start = GetTickCount64();
+
+    for (int i = 0; i < s->nsources && s->count < MAX_SEARCH_RESULTS && !s->stop; i++)
+    {
+        s->source = &s->sources[i];
+        for (DWORD n = 0; n <= o.log_rotate_count && s->count < MAX_SEARCH_RESULTS && !s->stop;
+             n++)
+        {
+            logsearch_stats_t stats;
+
+            if (!logrotate_path(log_path, _countof(log_path), s->source->log_path, n))
+            {
+                break;
+            }
+            /* the index is kept next to the log and updated by the search */
+            _sntprintf_0(index_path, L"%ls.idx", log_path);
+            if (logsearch_find(log_path, index_path, s->query, AddSearchResult, s, &stats) >= 0)
+            {
+                PrintDebug(L"Log search of '%ls': read %lu blocks (%llu bytes), %lu indexed",
+                           log_path,
+                           stats.blocks_read,
+                           stats.bytes_read,
+                           stats.blocks);
+            }
+        }
+    }
+
+    s->elapsed = GetTickCount64() - start;
+    PostMessage(s->hwnd, WM_OVPN_LOGSEARCH, s->id, 0);
+
+    return 0;
+}
+
+static void
+FreeLogSearch(struct log_search *s)
+{
+    for (int i = 0; i < s->count; i++)
+    {
+        free(s->results[i].text);
+    }
+    free(s->sources);
+    free(s->query);
+    free(s);
+}
+
+/* Stop the running search, if any, and discard its results */
+static void
+StopLogSearch(HWND hwndDlg)
+{
+    struct log_search *s = (struct log_search *)GetPropW(hwndDlg, logsearchProp);
+
+    if (s)
+    {
+        InterlockedExchange(&s->stop, 1);
+        WaitForSingleObject(s->thread, INFINITE);
+        CloseHandle(s->thread);
+        RemovePropW(hwndDlg, logsearchProp);
+        FreeLogSearch(s);
+    }
+}
+
+/* Start searching the logs of all connections for the text in the query box */
+static void
+StartLogSearch(HWND hwndDlg)
+{
+    static UINT last_id;
+    struct log_search *s;
+    int len;
+
+    StopLogSearch(hwndDlg);
+    ListView_DeleteAllItems(GetDlgItem(hwndDlg, ID_LVW_LOGSEARCH));
+    SetDlgItemTextW(hwndDlg, ID_TXT_LOGSEARCH, L"");
+
+    s = calloc(1, sizeof(*s));
+    if (!s)
+    {
+        return;
+    }
+    s->hwnd = hwndDlg;
+    s->id = ++last_id;
+    if (!GetDlgItemTextUtf8(hwndDlg, ID_EDT_LOGSEARCH, &s->query, &len))
+    {
+        free(s);
+        return;
+    }
+
+    for (connection_t *c = o.chead; c; c = c->next)
+    {
+        s->nsources++;
+    }
+    s->sources = calloc(max(s->nsources, 1), sizeof(*s->sources));
+    if (!s->sources)
+    {
+        FreeLogSearch(s);
+        return;
+    }
+    s->nsources = 0;
+    for (connection_t *c = o.chead; c; c = c->next)
+    {
+        s->sources[s->nsources].c = c;
+        wcsncpy_s(s->sources[s->nsources].log_path,
+                  _countof(s->sources[s->nsources].log_path),
+                  c->log_path,
+                  _TRUNCATE);
+        s->nsources++;
+    }
+
+    s->thread = CreateThread(NULL, 0, LogSearchThread, s, 0, NULL);
+    if (!s->thread)
+    {
+        FreeLogSearch(s);
+        return;
+    }
+    if (!SetPropW(hwndDlg, logsearchProp, (HANDLE)s))
+    {
+        InterlockedExchange(&s->stop, 1);
+        WaitForSingleObject(s->thread, INFINITE);
+        CloseHandle(s->thread);
+        FreeLogSearch(s);
+        return;
+    }
+    SetDlgItemTextW(hwndDlg, ID_TXT_LOGSEARCH, LoadLocalizedString(IDS_NFO_LOGSEARCH_RUNNING));
+}
+
+/* List the results of a search once its thread is done */
+static void
+ShowLogSearchResults(HWND hwndDlg, UINT id)
+{
+    HWND lv = GetDlgItem(hwndDlg, ID_LVW_LOGSEARCH);
+    struct log_search *s = (struct log_search *)GetPropW(hwndDlg, logsearchProp);
+
+    /* ignore notifications of searches stopped since */
+    if (!s || s->id != id)
+    {
+        return;
+    }
+    WaitForSingleObject(s->thread, INFINITE);
+    CloseHandle(s->thread);
+    RemovePropW(hwndDlg, logsearchProp);
+
+    SendMessage(lv, WM_SETREDRAW, FALSE, 0);
+    for (int i = 0; i < s->count; i++)
+    {
+        connection_t *c = s->results[i].c;
+
+        /* the connection may be gone since the search started */
+        if (!IsConnection(c))
+        {
+            continue;
+        }
+        LVITEMW lvi = { .mask = LVIF_TEXT | LVIF_PARAM,
+                        .iItem = i,
+                        .pszText = c->config_name,
+                        .lParam = (LPARAM)c };
+        int pos = ListView_InsertItem(lv, &lvi);
+        if (pos >= 0)
+        {
+            ListView_SetItemText(lv, pos, 1, s->results[i].text);
+        }
+    }
+    SendMessage(lv, WM_SETREDRAW, TRUE, 0);
+    ListView_SetColumnWidth(lv, 0, LVSCW_AUTOSIZE_USEHEADER);
+    ListView_SetColumnWidth(lv, 1, LVSCW_AUTOSIZE_USEHEADER);
+
+    SetDlgItemTextW(hwndDlg,
+                    ID_TXT_LOGSEARCH,
+                    LoadLocalizedString(s->count < MAX_SEARCH_RESULTS ? IDS_NFO_LOGSEARCH_RESULT
+                                                                      : IDS_NFO_LOGSEARCH_LIMIT,
+                                        s->count,
+                                        (unsigned long)s->elapsed));
+    FreeLogSearch(s);
+}
+
+static INT_PTR CALLBACK
+LogSearchDialogFunc(HWND hwndDlg, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    HWND lv;
+
+    switch (msg)
+    {
+        case WM_INITDIALOG:
+            SetStatusWinIcon(hwndDlg, ID_ICO_APP);
+
+            lv = GetDlgItem(hwndDlg, ID_LVW_LOGSEARCH);
+            SendMessage(lv, LVM_SETEXTENDEDLISTVIEWSTYLE, 0, LVS_EX_FULLROWSELECT);
+
+            int hdrs[] = { IDS_LOGSEARCH_CONNECTION, IDS_LOGSEARCH_LINE };
+            LVCOLUMNW lvc;
+            lvc.mask = LVCF_TEXT | LVCF_SUBITEM;
+            for (int i = 0; i < 2; i++)
+            {
+                lvc.iSubItem = i;
+                lvc.pszText = LoadLocalizedString(hdrs[i]);
+                ListView_InsertColumn(lv, i, &lvc);
+                ListView_SetColumnWidth(lv, i, LVSCW_AUTOSIZE_USEHEADER);
+            }
+            return TRUE;
+
+        case WM_COMMAND:
+            if (LOWORD(wParam) == IDOK)
+            {
+                StartLogSearch(hwndDlg);
+                return TRUE;
+            }
+            else if (LOWORD(wParam) == IDCANCEL)
+            {
+                StopLogSearch(hwndDlg);
+                EndDialog(hwndDlg, wParam);
+                return TRUE;
+            }
+            break;
+
+        case WM_OVPN_LOGSEARCH:
+            ShowLogSearchResults(hwndDlg, (UINT)wParam);
+            return TRUE;
+
+        case WM_NOTIFY:
+            if (((NMHDR *)lParam)->idFrom == ID_LVW_LOGSEARCH
+                && ((NMHDR *)lParam)->code == NM_DBLCLK)
+            {
+                NMITEMACTIVATE *ln = (NMITEMACTIVATE *)lParam;
+                LVITEM lvi = { .iItem = ln->iItem, .mask = LVIF_PARAM };
+
+                /* open the log unless its connection is gone since the search */
+                if (ln->iItem >= 0 && ListView_GetItem(ln->hdr.hwndFrom, &lvi)
+                    && IsConnection((connection_t *)lvi.lParam))
+                {
+                    ViewLog((connection_t *)lvi.lParam);
+                }
+            }
+            break;
+
+        case WM_CLOSE:
+            StopLogSearch(hwndDlg);
+            EndDialog(hwndDlg, wParam);
+            return TRUE;
+    }
+    return FALSE;
+}
+
+void
+SearchLogs(void)
+{
+    LocalizedDialogBoxParam(ID_DLG_LOGSEARCH, LogSearchDialogFunc, 0);
+}
@@ -23,3 +23,5 @@ struct connection;
 
 void ViewLog(struct connection *c);
 void EditConfig(struct connection *c);
+
+void SearchLogs(void);